@@ -1,6 +1,7 @@
 #include "LDModelParser.h"
 #include "LDrawModelViewer.h"
 #include "LDObiInfo.h"
+#include "LDUserDefaultsKeys.h"
 
 #include <string.h>
 
@@ -17,6 +18,7 @@
 #include <TCFoundation/TCVector.h>
 #include <TCFoundation/TCProgressAlert.h>
 #include <TCFoundation/TCLocalStrings.h>
+#include <TCFoundation/TCUserDefaults.h>
 #include <ctype.h>
 
 #ifdef WIN32
@@ -172,6 +174,10 @@ bool LDModelParser::parseMainModel(LDLModel *mainLDLModel)
 		m_mainTREModel->setSendProgressFlag(false);
 	}
 	m_mainTREModel->setMultiThreadedFlag(getMultiThreadedFlag());
+	m_mainTREModel->setWeldVerticesFlag(
+		TCUserDefaults::boolForKey(WELD_VERTICES_KEY, false, false));
+	m_mainTREModel->setLowDetailSize(
+		TCUserDefaults::longForKey(CURVE_LOD_SIZE_KEY, 0, false));
 	m_mainTREModel->setUseStripsFlag(getUseStripsFlag());
 	m_mainTREModel->setPartFlag(mainLDLModel->isPart());
 	m_mainTREModel->setEdgeLinesFlag(getEdgeLinesFlag());
@@ -526,6 +532,18 @@ std::string LDModelParser::modelNameKey(LDLModel *model, int activeColorNumber)
 {
 	const char *name = model->getName();
 
+	if (m_flags.lowDetail)
+	{
+		// Low detail models and everything in them are kept apart from the
+		// normal ones, since they are parsed with a different curve quality.
+		std::string nameKey = "LOD:";
+
+		m_flags.lowDetail = false;
+		nameKey += modelNameKey(model, activeColorNumber);
+		m_flags.lowDetail = true;
+		return nameKey;
+	}
+
 	if (model->colorNumberIsTransparent(activeColorNumber))
 	{
 		std::string nameKey;
@@ -608,6 +626,12 @@ bool LDModelParser::parseModel(
 			{
 				m_mainTREModel->registerModel(model, bfc);
 				model->release();
+				if (nameKey == ldlModel->getName() &&
+					shouldParseLowDetailModel(ldlModel, treModel, model))
+				{
+					parseLowDetailModel(ldlModel, model, bfc,
+						activeColorNumber, parentIsPart);
+				}
 				return addSubModel(modelLine, treModel, model, bfc && invert,
 					activeColorNumber);
 			}
@@ -624,6 +648,50 @@ bool LDModelParser::parseModel(
 	}
 }
 
+// Returns true if a low detail variant of the just-parsed part model is worth
+// having.  Only parts whose curved primitives were substituted, and that will
+// be drawn directly by a non-part model, get one.  Parts with texture maps or
+// with their own colors are skipped, since those pieces get moved out of the
+// part before drawing.
+bool LDModelParser::shouldParseLowDetailModel(
+	LDLModel *ldlModel,
+	TREModel *treModel,
+	TREModel *model)
+{
+	return m_mainTREModel->getLowDetailSize() > 0 &&
+		!m_flags.lowDetail && !m_flags.boundingBoxesOnly &&
+		getCurveQuality() > 1 &&
+		ldlModel->isPart() && !treModel->isPart() && model->hasCurves() &&
+		!model->hasTexmaps() && !model->hasColoredShapes();
+}
+
+void LDModelParser::parseLowDetailModel(
+	LDLModel *ldlModel,
+	TREModel *model,
+	bool bfc,
+	int activeColorNumber,
+	bool parentIsPart)
+{
+	TREModel *lowDetailModel = new TREModel;
+	int curveQuality = getCurveQuality();
+
+	m_flags.lowDetail = true;
+	setCurveQuality(1);
+	lowDetailModel->setMainModel(model->getMainModel());
+	lowDetailModel->setName(modelNameKey(ldlModel, activeColorNumber).c_str());
+	lowDetailModel->setPartFlag(true);
+	lowDetailModel->setNoShrinkFlag(ldlModel->getNoShrinkFlag());
+	if (parseModel(ldlModel, lowDetailModel, bfc, activeColorNumber,
+		parentIsPart))
+	{
+		m_mainTREModel->registerModel(lowDetailModel, bfc);
+		model->setLowDetailModel(lowDetailModel);
+	}
+	lowDetailModel->release();
+	setCurveQuality(curveQuality);
+	m_flags.lowDetail = false;
+}
+
 bool LDModelParser::substituteStud(int numSegments)
 {
 	TCULong edgeColor = 0;
@@ -949,7 +1017,12 @@ bool LDModelParser::performPrimitiveSubstitution2(
 {
 	m_currentTREModel = treModel;
 	m_currentColorNumber = activeColorNumber;
-	return LDLPrimitiveCheck::performPrimitiveSubstitution(ldlModel, bfc);
+	if (LDLPrimitiveCheck::performPrimitiveSubstitution(ldlModel, bfc))
+	{
+		treModel->setCurvedFlag(true);
+		return true;
+	}
+	return false;
 }
 
 bool LDModelParser::actionLineIsActive(LDLActionLine *actionLine)
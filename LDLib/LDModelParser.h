@@ -57,6 +57,10 @@ protected:
 		int activeColorNumber, bool parentIsPart);
 	virtual bool parseModel(LDLModelLine *modelLine, TREModel *treModel,
 		bool bfc, int activeColorNumber, bool parentIsPart);
+	bool shouldParseLowDetailModel(LDLModel *ldlModel, TREModel *treModel,
+		TREModel *model);
+	void parseLowDetailModel(LDLModel *ldlModel, TREModel *model, bool bfc,
+		int activeColorNumber, bool parentIsPart);
 	virtual void parseLine(LDLShapeLine *shapeLine, TREModel *treModel,
 		int activeColorNumber);
 	virtual void parseTriangle(LDLShapeLine *shapeLine, TREModel *treModel,
@@ -171,6 +175,7 @@ protected:
 		bool texmapNext:1;
 		bool texmapStarted:1;
 		bool isHighlightModel:1;
+		bool lowDetail:1;
 	} m_flags;
 };
 
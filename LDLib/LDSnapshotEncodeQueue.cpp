@@ -0,0 +1,289 @@
+#include "LDSnapshotEncodeQueue.h"
+
+#ifdef WIN32
+#if defined(_MSC_VER) && _MSC_VER >= 1400 && defined(_DEBUG)
+#define new DEBUG_CLIENTBLOCK
+#endif // _DEBUG
+#endif // WIN32
+
+#ifdef USE_CPP11
+typedef std::unique_lock<std::mutex> ScopedLock;
+#else
+#ifndef _NO_LD_THREADS
+#include <boost/bind.hpp>
+typedef boost::mutex::scoped_lock ScopedLock;
+#endif // !_NO_LD_THREADS
+#endif // !USE_CPP11
+
+// Rendering keeps one processor busy, and more encoder threads than this
+// mostly just use up memory.
+#define MAX_DEFAULT_ENCODER_THREADS 4
+
+LDSnapshotEncodeJob::LDSnapshotEncodeJob(void)
+{
+#ifdef _LEAK_DEBUG
+	strcpy(className, "LDSnapshotEncodeJob");
+#endif // _LEAK_DEBUG
+}
+
+LDSnapshotEncodeJob::~LDSnapshotEncodeJob(void)
+{
+}
+
+LDSnapshotEncodeQueue::LDSnapshotEncodeQueue(
+	int threadCount,
+	size_t maxDataSize)
+	: m_threadCount(threadCount)
+	, m_processorCount(1)
+	, m_runningCount(0)
+	, m_maxDataSize(maxDataSize)
+	, m_dataSize(0)
+#if defined(USE_CPP11) || !defined(_NO_LD_THREADS)
+#ifdef USE_CPP11
+	, m_threads(NULL)
+	, m_mutex(new std::mutex)
+	, m_workCondition(new std::condition_variable)
+	, m_doneCondition(new std::condition_variable)
+#else
+	, m_threadGroup(NULL)
+	, m_mutex(new boost::mutex)
+	, m_workCondition(new boost::condition)
+	, m_doneCondition(new boost::condition)
+#endif
+	, m_exiting(false)
+#endif // USE_CPP11 || !_NO_LD_THREADS
+{
+#ifdef _LEAK_DEBUG
+	strcpy(className, "LDSnapshotEncodeQueue");
+#endif // _LEAK_DEBUG
+#if !defined(USE_CPP11) && defined(_NO_LD_THREADS)
+	m_threadCount = 0;
+#endif // !USE_CPP11 && _NO_LD_THREADS
+	if (m_threadCount < 0)
+	{
+		m_threadCount = 0;
+	}
+#if defined(USE_CPP11) || !defined(_NO_LD_THREADS)
+#ifdef USE_CPP11
+	m_processorCount = (int)std::thread::hardware_concurrency();
+#else // USE_CPP11
+	m_processorCount = (int)boost::thread::hardware_concurrency();
+#endif // !USE_CPP11
+	if (m_processorCount < 1)
+	{
+		m_processorCount = 1;
+	}
+	if (m_threadCount > 0)
+	{
+#ifdef USE_CPP11
+		m_threads = new std::vector<std::thread>;
+#else
+		m_threadGroup = new boost::thread_group;
+#endif
+		for (int i = 0; i < m_threadCount; i++)
+		{
+#ifdef USE_CPP11
+			m_threads->emplace_back(&LDSnapshotEncodeQueue::encoderThreadProc,
+				this);
+#else
+			m_threadGroup->create_thread(
+				boost::bind(&LDSnapshotEncodeQueue::encoderThreadProc, this));
+#endif
+		}
+	}
+#endif // USE_CPP11 || !_NO_LD_THREADS
+}
+
+LDSnapshotEncodeQueue::~LDSnapshotEncodeQueue(void)
+{
+}
+
+void LDSnapshotEncodeQueue::dealloc(void)
+{
+	waitForAll();
+#if defined(USE_CPP11) || !defined(_NO_LD_THREADS)
+	{
+		ScopedLock lock(*m_mutex);
+
+		m_exiting = true;
+		m_workCondition->notify_all();
+	}
+#ifdef USE_CPP11
+	if (m_threads != NULL)
+	{
+		for (auto&& thread: *m_threads)
+		{
+			thread.join();
+		}
+		delete m_threads;
+	}
+#else
+	if (m_threadGroup != NULL)
+	{
+		m_threadGroup->join_all();
+		delete m_threadGroup;
+	}
+#endif
+	delete m_mutex;
+	delete m_workCondition;
+	delete m_doneCondition;
+#endif // USE_CPP11 || !_NO_LD_THREADS
+	TCObject::dealloc();
+}
+
+// NOTE: static function.
+int LDSnapshotEncodeQueue::defaultThreadCount(void)
+{
+#if defined(USE_CPP11) || !defined(_NO_LD_THREADS)
+#ifdef USE_CPP11
+	int numProcessors = (int)std::thread::hardware_concurrency();
+#else // USE_CPP11
+	int numProcessors = (int)boost::thread::hardware_concurrency();
+#endif // !USE_CPP11
+
+	if (numProcessors > MAX_DEFAULT_ENCODER_THREADS + 1)
+	{
+		return MAX_DEFAULT_ENCODER_THREADS;
+	}
+	else if (numProcessors > 1)
+	{
+		return numProcessors - 1;
+	}
+#endif // USE_CPP11 || !_NO_LD_THREADS
+	return 0;
+}
+
+// Adds the job to the queue, retaining it until it has been finished.
+void LDSnapshotEncodeQueue::addJob(LDSnapshotEncodeJob *job)
+{
+	Entry entry;
+
+	entry.job = job;
+	entry.dataSize = job->getDataSize();
+	entry.started = false;
+	entry.done = false;
+	entry.succeeded = false;
+	job->retain();
+	if (m_threadCount == 0)
+	{
+		entry.succeeded = job->encode(0);
+		finishJob(entry);
+		return;
+	}
+#if defined(USE_CPP11) || !defined(_NO_LD_THREADS)
+	ScopedLock lock(*m_mutex);
+
+	finishJobs(lock);
+	// One job always gets in, no matter how big it is.
+	while (!m_entries.empty() &&
+		m_dataSize + entry.dataSize > m_maxDataSize)
+	{
+		m_doneCondition->wait(lock);
+		finishJobs(lock);
+	}
+	m_entries.push_back(entry);
+	m_dataSize += entry.dataSize;
+	m_workCondition->notify_one();
+#endif // USE_CPP11 || !_NO_LD_THREADS
+}
+
+void LDSnapshotEncodeQueue::checkJobs(void)
+{
+#if defined(USE_CPP11) || !defined(_NO_LD_THREADS)
+	if (m_threadCount > 0)
+	{
+		ScopedLock lock(*m_mutex);
+
+		finishJobs(lock);
+	}
+#endif // USE_CPP11 || !_NO_LD_THREADS
+}
+
+void LDSnapshotEncodeQueue::waitForAll(void)
+{
+#if defined(USE_CPP11) || !defined(_NO_LD_THREADS)
+	if (m_threadCount > 0)
+	{
+		ScopedLock lock(*m_mutex);
+
+		finishJobs(lock);
+		while (!m_entries.empty())
+		{
+			m_doneCondition->wait(lock);
+			finishJobs(lock);
+		}
+	}
+#endif // USE_CPP11 || !_NO_LD_THREADS
+}
+
+// Finishes the jobs at the front of the queue that are done.  The lock is
+// released while each job is being finished.
+template <class _ScopedLock>
+void LDSnapshotEncodeQueue::finishJobs(_ScopedLock &lock)
+{
+	while (!m_entries.empty() && m_entries.front().done)
+	{
+		Entry entry = m_entries.front();
+
+		m_entries.pop_front();
+		m_dataSize -= entry.dataSize;
+		lock.unlock();
+		finishJob(entry);
+		lock.lock();
+	}
+}
+
+void LDSnapshotEncodeQueue::finishJob(const Entry &entry)
+{
+	entry.job->finish(entry.succeeded);
+	entry.job->release();
+}
+
+#if defined(USE_CPP11) || !defined(_NO_LD_THREADS)
+void LDSnapshotEncodeQueue::encoderThreadProc(void)
+{
+	ScopedLock lock(*m_mutex);
+
+	while (true)
+	{
+		EntryList::iterator it;
+
+		for (it = m_entries.begin(); it != m_entries.end() && it->started;
+			++it)
+		{
+			// Don't do anything.
+		}
+		if (it == m_entries.end())
+		{
+			if (m_exiting)
+			{
+				break;
+			}
+			m_workCondition->wait(lock);
+			continue;
+		}
+		LDSnapshotEncodeJob *job = it->job;
+		int threadShare;
+
+		it->started = true;
+		m_runningCount++;
+		// A job that starts while the others are being encoded gets an even
+		// share of the processors, so a lone big image still gets encoded on
+		// all of them.
+		threadShare = m_processorCount / m_runningCount;
+		if (threadShare < 1)
+		{
+			threadShare = 1;
+		}
+		lock.unlock();
+		bool succeeded = job->encode(threadShare);
+		lock.lock();
+		// Entries only get removed from the list once they are done, so it
+		// is still valid.
+		it->succeeded = succeeded;
+		it->done = true;
+		m_runningCount--;
+		m_doneCondition->notify_all();
+	}
+}
+#endif // USE_CPP11 || !_NO_LD_THREADS
@@ -0,0 +1,114 @@
+#ifndef __LDSNAPSHOTENCODEQUEUE_H__
+#define __LDSNAPSHOTENCODEQUEUE_H__
+
+#include <TCFoundation/TCObject.h>
+#include <TCFoundation/TCStlIncludes.h>
+
+#ifdef USE_CPP11
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#else
+#if defined(_MSC_VER) && _MSC_VER <= 1200	// VS 6
+#define _NO_LD_THREADS
+#else  // VS 6
+#ifdef _NO_BOOST
+#define _NO_LD_THREADS
+#endif // _NO_BOOST
+#endif // VS 6
+#ifndef _NO_LD_THREADS
+#ifdef WIN32
+#pragma warning(push)
+#pragma warning(disable:4244 4512)
+#endif // WIN32
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#ifdef WIN32
+#pragma warning(pop)
+#endif // WIN32
+#endif // !_NO_LD_THREADS
+#endif
+
+// A grabbed image waiting to be written out by LDSnapshotEncodeQueue.
+class LDSnapshotEncodeJob : public TCObject
+{
+public:
+	LDSnapshotEncodeJob(void);
+	// Number of bytes of image data the job is holding on to.
+	virtual size_t getDataSize(void) const = 0;
+	// Writes the image.  Called on one of the encoder threads, or on the
+	// thread that added the job when there aren't any.  threadCount is this
+	// job's share of the processors, given the other jobs being encoded at
+	// the same time, or 0 if it has them all to itself.
+	virtual bool encode(int threadCount) = 0;
+	// Called on the thread that added the job after encode is done, in the
+	// same order that the jobs were added.
+	virtual void finish(bool /*succeeded*/) {}
+protected:
+	virtual ~LDSnapshotEncodeJob(void);
+};
+
+// Writes snapshot images on a pool of encoder threads, so that the next image
+// can be rendered while the previous ones are being compressed.  addJob blocks
+// while the jobs that haven't been finished yet hold more than the maximum
+// amount of image data.  With no encoder threads, addJob encodes the image
+// right away.
+class LDSnapshotEncodeQueue : public TCObject
+{
+public:
+	LDSnapshotEncodeQueue(int threadCount, size_t maxDataSize);
+	int getThreadCount(void) const { return m_threadCount; }
+	void addJob(LDSnapshotEncodeJob *job);
+	// Finishes any jobs that are done.
+	void checkJobs(void);
+	// Waits for all the jobs to be done, and finishes them.
+	void waitForAll(void);
+
+	static int defaultThreadCount(void);
+protected:
+	struct Entry
+	{
+		LDSnapshotEncodeJob *job;
+		size_t dataSize;
+		bool started;
+		bool done;
+		bool succeeded;
+	};
+	typedef std::list<Entry> EntryList;
+
+	virtual ~LDSnapshotEncodeQueue(void);
+	virtual void dealloc(void);
+	template <class _ScopedLock> void finishJobs(_ScopedLock &lock);
+	void finishJob(const Entry &entry);
+#if defined(USE_CPP11) || !defined(_NO_LD_THREADS)
+	void encoderThreadProc(void);
+#endif // USE_CPP11 || !_NO_LD_THREADS
+
+	int m_threadCount;
+	int m_processorCount;
+	// Jobs that are being encoded right now.
+	int m_runningCount;
+	size_t m_maxDataSize;
+	// Data held by the jobs in m_entries.
+	size_t m_dataSize;
+	// Jobs in the order they were added.  Each one stays in the list until it
+	// has been finished on the thread that added it.
+	EntryList m_entries;
+#if defined(USE_CPP11) || !defined(_NO_LD_THREADS)
+#ifdef USE_CPP11
+	std::vector<std::thread> *m_threads;
+	std::mutex *m_mutex;
+	std::condition_variable *m_workCondition;
+	std::condition_variable *m_doneCondition;
+#else
+	boost::thread_group *m_threadGroup;
+	boost::mutex *m_mutex;
+	boost::condition *m_workCondition;
+	boost::condition *m_doneCondition;
+#endif
+	bool m_exiting;
+#endif // USE_CPP11 || !_NO_LD_THREADS
+};
+
+#endif // __LDSNAPSHOTENCODEQUEUE_H__
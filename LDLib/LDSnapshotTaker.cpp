@@ -1,7 +1,10 @@
 #include "LDSnapshotTaker.h"
+#include "LDSnapshotEncodeQueue.h"
 #include "LDUserDefaultsKeys.h"
 #include <TCFoundation/mystring.h>
 #include <TCFoundation/TCImage.h>
+#include <TCFoundation/TCImageOptions.h>
+#include <TCFoundation/TCPngOptions.h>
 #include <TCFoundation/TCAlertManager.h>
 #include <TCFoundation/TCLocalStrings.h>
 #include <TCFoundation/TCProgressAlert.h>
@@ -16,6 +19,7 @@
 #include <gl2ps/gl2ps.h>
 #include <sys/stat.h>
 #include <cstdlib>
+#include <math.h>
 
 #ifdef WIN32
 #if defined(_MSC_VER) && _MSC_VER >= 1400 && defined(_DEBUG)
@@ -25,6 +29,14 @@
 
 using namespace TREGLExtensionsNS;
 
+#ifdef USE_STD_CHRONO
+//#define TIME_IMAGE_SAVE
+#endif // USE_STD_CHRONO
+
+#ifdef TIME_IMAGE_SAVE
+#include <iostream>
+#endif // TIME_IMAGE_SAVE
+
 #define FBO_SIZE 1024
 
 #ifndef GL_EXT_packed_depth_stencil
@@ -188,7 +200,172 @@ public:
 
 bool FBOHelper::sm_active = false;
 
+// Writes an image grabbed by LDSnapshotTaker, along with its z map if it has
+// one.  When the snapshot taker has an encode queue, encode runs on one of
+// the queue's threads, so everything it needs gets set up ahead of time.
+class LDSnapshotImageJob : public LDSnapshotEncodeJob
+{
+public:
+	LDSnapshotImageJob(
+		LDSnapshotTaker *snapshotTaker,
+		TCImage *image,
+		const char *filename,
+		TCByte *buffer,
+		TCFloat *zBuffer)
+		: m_snapshotTaker(snapshotTaker)
+		, m_image(image)
+		, m_filename(filename)
+		, m_buffer(buffer)
+		, m_zBuffer(zBuffer)
+		, m_modelIndex(snapshotTaker->m_imageModelIndex)
+		, m_autoCrop(false)
+		, m_progressCallback(NULL)
+		, m_progressUserData(NULL)
+	{
+		m_image->retain();
+		// These get created on first use, and creating them reads the user
+		// defaults, which can only be done on the main thread.
+		m_image->getCompressionOptions();
+		if (m_zBuffer != NULL)
+		{
+			m_zMapFilename = filename;
+			removeExtenstion(m_zMapFilename);
+			m_zMapFilename += ".ldvz";
+		}
+	}
+	void setAutoCrop(TCByte r, TCByte g, TCByte b)
+	{
+		m_autoCrop = true;
+		m_backgroundR = r;
+		m_backgroundG = g;
+		m_backgroundB = b;
+	}
+	void setProgressCallback(TCImageProgressCallback value, void *userData)
+	{
+		m_progressCallback = value;
+		m_progressUserData = userData;
+	}
+	// Keeps a PNG from being split into bands on more threads than threadCount,
+	// so that the jobs being encoded at the same time share the processors
+	// instead of each one trying to use them all.
+	void limitThreads(int threadCount)
+	{
+		if (threadCount > 0 && strcasecmp(m_image->getFormatName(), "PNG") == 0)
+		{
+			TCPngOptions *options =
+				(TCPngOptions *)m_image->getCompressionOptions();
+
+			if (options->getThreadCount() <= 0 ||
+				options->getThreadCount() > threadCount)
+			{
+				options->setThreadCount(threadCount);
+			}
+		}
+	}
+	int getModelIndex(void) const { return m_modelIndex; }
+	virtual size_t getDataSize(void) const
+	{
+		size_t dataSize = (size_t)m_image->getRowSize() * m_image->getHeight();
+
+		if (m_zBuffer != NULL)
+		{
+			dataSize += (size_t)m_image->getWidth() * m_image->getHeight() *
+				sizeof(TCFloat);
+		}
+		return dataSize;
+	}
+	virtual bool encode(int threadCount)
+	{
+		int width = m_image->getWidth();
+		int height = m_image->getHeight();
+		int croppedX = 0;
+		int croppedY = 0;
+		bool retValue;
+
+		if (m_autoCrop)
+		{
+			m_image->autoCrop(m_backgroundR, m_backgroundG, m_backgroundB);
+			croppedX = m_image->getCroppedX();
+			croppedY = m_image->getCroppedY();
+		}
+		limitThreads(threadCount);
+#ifdef TIME_IMAGE_SAVE
+		auto start = std::chrono::high_resolution_clock::now();
+#endif // TIME_IMAGE_SAVE
+		retValue = m_image->saveFileOnThread(m_filename.c_str(),
+			m_progressCallback, m_progressUserData);
+#ifdef TIME_IMAGE_SAVE
+		auto end = std::chrono::high_resolution_clock::now();
+		std::chrono::duration<double> elapsed_seconds = end-start;
+
+		std::cout << "Image save of " << m_filename << " took " <<
+			elapsed_seconds.count() << "s\n";
+		if (retValue && strcasecmp(m_image->getFormatName(), "PNG") == 0)
+		{
+			// Save the image again as a single libpng stream, to compare the
+			// banded encoder against it.
+			TCPngOptions *options =
+				(TCPngOptions *)m_image->getCompressionOptions();
+			int threadCount = options->getThreadCount();
+			std::string libpngFilename = m_filename + ".libpng.png";
+
+			options->setThreadCount(1);
+			start = std::chrono::high_resolution_clock::now();
+			m_image->saveFileOnThread(libpngFilename.c_str());
+			end = std::chrono::high_resolution_clock::now();
+			elapsed_seconds = end-start;
+			options->setThreadCount(threadCount);
+			remove(libpngFilename.c_str());
+			std::cout << "Single stream libpng save took " <<
+				elapsed_seconds.count() << "s\n";
+		}
+#endif // TIME_IMAGE_SAVE
+		if (m_zBuffer != NULL)
+		{
+			LDSnapshotTaker::writeZMap(m_zMapFilename.c_str(), width, height,
+				m_zBuffer, croppedX, croppedY, m_image->getWidth(),
+				m_image->getHeight());
+		}
+		return retValue;
+	}
+	virtual void finish(bool succeeded)
+	{
+		if (succeeded)
+		{
+			m_image->getCompressionOptions()->save();
+		}
+		debugPrintf("Saved image: %s\n", m_filename.c_str());
+		m_snapshotTaker->imageFinished(this, succeeded);
+	}
+protected:
+	virtual ~LDSnapshotImageJob(void)
+	{
+	}
+	virtual void dealloc(void)
+	{
+		TCObject::release(m_image);
+		delete[] m_buffer;
+		delete[] m_zBuffer;
+		LDSnapshotEncodeJob::dealloc();
+	}
+
+	LDSnapshotTaker *m_snapshotTaker;
+	TCImage *m_image;
+	std::string m_filename;
+	std::string m_zMapFilename;
+	TCByte *m_buffer;
+	TCFloat *m_zBuffer;
+	int m_modelIndex;
+	bool m_autoCrop;
+	TCByte m_backgroundR;
+	TCByte m_backgroundG;
+	TCByte m_backgroundB;
+	TCImageProgressCallback m_progressCallback;
+	void *m_progressUserData;
+};
+
 bool LDSnapshotTaker::sm_consoleAlerts = true;
+LDSnapshotModelCallback LDSnapshotTaker::sm_modelCallback = NULL;
 
 LDSnapshotTaker::LDSnapshotTaker(void):
 m_modelViewer(NULL),
@@ -207,6 +384,12 @@ m_16BPC(false),
 m_canceled(false),
 m_width(-1),
 m_height(-1),
+m_encodeQueue(NULL),
+m_imageModelIndex(0),
+m_modelImageFailed(false),
+m_imagesSaved(0),
+m_imagesFailed(0),
+m_modelIndex(0),
 m_scaleFactor(1.0)
 {
 }
@@ -228,6 +411,12 @@ m_16BPC(false),
 m_canceled(false),
 m_width(-1),
 m_height(-1),
+m_encodeQueue(NULL),
+m_imageModelIndex(0),
+m_modelImageFailed(false),
+m_imagesSaved(0),
+m_imagesFailed(0),
+m_modelIndex(0),
 m_scaleFactor(1.0f)
 {
 }
@@ -255,6 +444,8 @@ int LDSnapshotTaker::getFBOSize(void) const
 
 void LDSnapshotTaker::dealloc(void)
 {
+	// This finishes any images that are still in the queue.
+	TCObject::release(m_encodeQueue);
 	if (m_fromCommandLine)
 	{
 		TCObject::release(m_modelViewer);
@@ -262,6 +453,69 @@ void LDSnapshotTaker::dealloc(void)
 	TCObject::dealloc();
 }
 
+// Starts the encoder threads used to write command line snapshots, unless
+// they have been turned off.
+void LDSnapshotTaker::startEncodeQueue(void)
+{
+	if (m_encodeQueue == NULL)
+	{
+		int threadCount = (int)TCUserDefaults::longForKey(
+			SNAPSHOT_ENCODE_THREADS_KEY,
+			LDSnapshotEncodeQueue::defaultThreadCount(), false);
+
+		if (threadCount > 0)
+		{
+			size_t maxDataSize = (size_t)TCUserDefaults::longForKey(
+				SNAPSHOT_ENCODE_MEMORY_KEY, 256, false) * 1024 * 1024;
+
+			m_encodeQueue = new LDSnapshotEncodeQueue(threadCount,
+				maxDataSize);
+		}
+	}
+}
+
+void LDSnapshotTaker::imageFinished(LDSnapshotImageJob *job, bool succeeded)
+{
+	if (succeeded)
+	{
+		m_imagesSaved++;
+	}
+	else
+	{
+		m_imagesFailed++;
+		if (job->getModelIndex() == m_imageModelIndex)
+		{
+			m_modelImageFailed = true;
+		}
+	}
+}
+
+// Returns false if the model callback says that the next command line model
+// should be skipped.
+bool LDSnapshotTaker::startModel(void)
+{
+	if (sm_modelCallback == NULL)
+	{
+		return true;
+	}
+	return sm_modelCallback(m_modelIndex++, false);
+}
+
+// Tells the model callback that the model most recently accepted by
+// startModel is done.  All of its images have been written by the time the
+// callback gets called.
+void LDSnapshotTaker::finishModel(void)
+{
+	if (sm_modelCallback != NULL)
+	{
+		if (m_encodeQueue != NULL)
+		{
+			m_encodeQueue->waitForAll();
+		}
+		sm_modelCallback(m_modelIndex - 1, true);
+	}
+}
+
 void LDSnapshotTaker::setUseFBO(bool value)
 {
 	m_useFBO = value && TREGLExtensions::haveFramebufferObjectExtension();
@@ -334,6 +588,7 @@ bool LDSnapshotTaker::exportFiles(bool *tried /*= nullptr*/)
 		const char *exportExt = NULL;
 		bool commandLineType = false;
 		bool zoomToFit = getZoomToFit();
+		bool modelStarted;
 		std::string exportSuffix =
 			TCUserDefaults::commandLineStringForKey(EXPORT_SUFFIX_KEY);
 
@@ -411,7 +666,11 @@ bool LDSnapshotTaker::exportFiles(bool *tried /*= nullptr*/)
 				zoomToFit = true;
 			}
 		}
-		for (i = 0; i < count && (exportFiles || !retValue); ++i)
+		// When there is only one export file, the models are tried one at a
+		// time until one works, so they all count as a single model.
+		modelStarted = exportFiles || startModel();
+		for (i = 0; i < count && modelStarted && (exportFiles || !retValue);
+			++i)
 		{
 			std::string arg = unhandledArgs->stringAtIndex(i);
 			
@@ -419,6 +678,10 @@ bool LDSnapshotTaker::exportFiles(bool *tried /*= nullptr*/)
 			{
 				std::string exportFilename;
 				
+				if (exportFiles && !startModel())
+				{
+					continue;
+				}
 				if (isFileUri(arg))
 				{
 					m_fileUri = arg;
@@ -511,8 +774,16 @@ bool LDSnapshotTaker::exportFiles(bool *tried /*= nullptr*/)
 						*tried = true;
 					}
 				}
+				if (exportFiles)
+				{
+					finishModel();
+				}
 			}
 		}
+		if (!exportFiles && modelStarted)
+		{
+			finishModel();
+		}
 		delete[] exportsDir;
 		unhandledArgs->release();
 	}
@@ -645,6 +916,9 @@ bool LDSnapshotTaker::saveImage(bool *tried /*= nullptr*/)
 		int height = (int)TCUserDefaults::longForKey(SAVE_HEIGHT_KEY, 480, false);
 		bool zoomToFit = getZoomToFit();
 		bool commandLineType = false;
+		bool modelStarted;
+		int imagesSaved;
+		int imagesFailed;
 		std::string snapshotSuffix =
 			TCUserDefaults::commandLineStringForKey(SNAPSHOT_SUFFIX_KEY);
 		std::string commandLineScaleFactor =
@@ -752,7 +1026,17 @@ bool LDSnapshotTaker::saveImage(bool *tried /*= nullptr*/)
 				zoomToFit = true;
 			}
 		}
-		for (i = 0; i < count && (saveSnapshots || !retValue); i++)
+		if (m_fromCommandLine)
+		{
+			startEncodeQueue();
+		}
+		imagesSaved = m_imagesSaved;
+		imagesFailed = m_imagesFailed;
+		// When there is only one snapshot file, the models are tried one at a
+		// time until one works, so they all count as a single model.
+		modelStarted = saveSnapshots || startModel();
+		for (i = 0; i < count && modelStarted && (saveSnapshots || !retValue);
+			i++)
 		{
 			std::string arg = unhandledArgs->stringAtIndex(i);
 			
@@ -760,6 +1044,10 @@ bool LDSnapshotTaker::saveImage(bool *tried /*= nullptr*/)
 			{
 				std::string imageFilename;
 
+				if (saveSnapshots && !startModel())
+				{
+					continue;
+				}
 				if (isFileUri(arg))
 				{
 					m_fileUri = arg;
@@ -844,16 +1132,41 @@ bool LDSnapshotTaker::saveImage(bool *tried /*= nullptr*/)
 				}
 				if (imageFilename.size() > 0)
 				{
+					bool saved;
+
 					updateModelFilename(arg.c_str());
-					retValue = saveImage(imageFilename.c_str(), width, height,
-						zoomToFit) || retValue;
+					saved = saveImage(imageFilename.c_str(), width, height,
+						zoomToFit);
+					if (saved && !saveSnapshots && m_encodeQueue != NULL)
+					{
+						// The next file only gets tried if this one fails.
+						m_encodeQueue->waitForAll();
+						saved = !m_modelImageFailed;
+					}
+					retValue = saved || retValue;
 					if (tried != NULL)
 					{
 						*tried = true;
 					}
 				}
+				if (saveSnapshots)
+				{
+					finishModel();
+				}
+			}
+		}
+		if (m_encodeQueue != NULL)
+		{
+			m_encodeQueue->waitForAll();
+			if (m_imagesFailed > imagesFailed && m_imagesSaved == imagesSaved)
+			{
+				retValue = false;
 			}
 		}
+		if (!saveSnapshots && modelStarted)
+		{
+			finishModel();
+		}
 		delete[] saveDir;
 		unhandledArgs->release();
 	}
@@ -890,6 +1203,8 @@ bool LDSnapshotTaker::saveImage(
 	bool zoomToFit)
 {
 	bool steps = false;
+	m_imageModelIndex++;
+	m_modelImageFailed = false;
 	imageWidth = scale(imageWidth);
 	imageHeight = scale(imageHeight);
 	TCAlertManager::sendAlert(alertClass(), this, _UC("PreFbo"));
@@ -903,6 +1218,159 @@ bool LDSnapshotTaker::saveImage(
 	{
 		steps = TCUserDefaults::boolForKey(SAVE_STEPS_KEY, false, false);
 	}
+	if (hasCommandLineViews())
+	{
+		return saveViewImages(filename, imageWidth, imageHeight, zoomToFit,
+			steps);
+	}
+	return saveViewImage(filename, imageWidth, imageHeight, zoomToFit, steps);
+}
+
+bool LDSnapshotTaker::hasCommandLineViews(void)
+{
+	if (!m_fromCommandLine)
+	{
+		return false;
+	}
+	return !TCUserDefaults::commandLineStringForKey(SNAPSHOT_VIEWS_KEY).empty()
+		|| !TCUserDefaults::commandLineStringForKey(TURNTABLE_STEP_KEY).empty();
+}
+
+// Fills views from the SnapshotViews command line setting, which is a list of
+// latitude,longitude[,distance] views separated by semicolons.  If that isn't
+// set, TurntableStep gives the number of degrees of longitude between views
+// that go all the way around the model, starting from the default view.
+void LDSnapshotTaker::getCommandLineViews(ViewVector &views)
+{
+	std::string viewsString =
+		TCUserDefaults::commandLineStringForKey(SNAPSHOT_VIEWS_KEY);
+
+	if (!viewsString.empty())
+	{
+		size_t start = 0;
+
+		while (start < viewsString.size())
+		{
+			size_t end = viewsString.find(';', start);
+			float latitude;
+			float longitude;
+			float distance = -1.0f;
+
+			if (end >= viewsString.size())
+			{
+				end = viewsString.size();
+			}
+			if (sscanf(viewsString.substr(start, end - start).c_str(),
+				"%f,%f,%f", &latitude, &longitude, &distance) >= 2)
+			{
+				View view;
+
+				view.latitude = latitude;
+				view.longitude = longitude;
+				view.distance = distance > 0.0f ? distance : -1.0f;
+				views.push_back(view);
+			}
+			start = end + 1;
+		}
+	}
+	else if (m_modelViewer != NULL)
+	{
+		float step = TCUserDefaults::floatForKey(TURNTABLE_STEP_KEY, 0.0f,
+			false);
+
+		if (step > 0.0f)
+		{
+			// Don't add an extra view that's a tiny fraction of a degree short
+			// of the first one.
+			int count = (int)ceil(360.0f / step - 0.001f);
+			View view;
+
+			view.latitude = m_modelViewer->getDefaultLatitude();
+			view.distance = -1.0f;
+			for (int i = 0; i < count; i++)
+			{
+				view.longitude = m_modelViewer->getDefaultLongitude() +
+					step * i;
+				views.push_back(view);
+			}
+		}
+	}
+}
+
+// Saves images of the model from each of the command line views, adding the
+// view number to the filename.  The model only gets loaded once, and it only
+// gets zoomed to fit for the views that don't have a distance.
+bool LDSnapshotTaker::saveViewImages(
+	const char *filename,
+	int imageWidth,
+	int imageHeight,
+	bool zoomToFit,
+	bool steps)
+{
+	char *viewSuffix = TCUserDefaults::stringForKey(SNAPSHOT_VIEW_SUFFIX_KEY,
+		"-View", false);
+	bool retValue = true;
+	ViewVector views;
+	TCVector cameraPosition;
+
+	grabSetup();
+	if (m_modelViewer == NULL)
+	{
+		delete[] viewSuffix;
+		return false;
+	}
+	// This makes sure that the model has been loaded and that its view has
+	// been reset, so that neither of those happens after the view has been
+	// changed.
+	renderOffscreenImage();
+	getCommandLineViews(views);
+	if (views.empty())
+	{
+		delete[] viewSuffix;
+		return saveViewImage(filename, imageWidth, imageHeight, zoomToFit,
+			steps);
+	}
+	cameraPosition = m_modelViewer->getCamera().getPosition();
+	for (size_t i = 0; i < views.size() && retValue; i++)
+	{
+		const View &view = views[i];
+		std::string viewFilename = addStepSuffix(filename, viewSuffix,
+			(int)i + 1, (int)views.size());
+
+		if (view.distance > 0.0f)
+		{
+			m_modelViewer->setLatLon(view.latitude, view.longitude,
+				view.distance);
+			retValue = saveViewImage(viewFilename.c_str(), imageWidth,
+				imageHeight, false, steps);
+		}
+		else
+		{
+			// The previous view may have moved the camera.
+			m_modelViewer->getCamera().setPosition(cameraPosition);
+			m_modelViewer->setLatLon(view.latitude, view.longitude);
+			if (zoomToFit && (steps || m_commandLineStep))
+			{
+				// The steps get zoomed to fit before any of them are
+				// rendered, and that needs the new rotation matrix, which
+				// only gets set up during rendering.
+				renderOffscreenImage();
+			}
+			retValue = saveViewImage(viewFilename.c_str(), imageWidth,
+				imageHeight, zoomToFit, steps);
+		}
+	}
+	delete[] viewSuffix;
+	return retValue;
+}
+
+bool LDSnapshotTaker::saveViewImage(
+	const char *filename,
+	int imageWidth,
+	int imageHeight,
+	bool zoomToFit,
+	bool steps)
+{
 	if (steps || m_commandLineStep)
 	{
 		char *stepSuffix = TCUserDefaults::stringForKey(SAVE_STEPS_SUFFIX_KEY,
@@ -1126,26 +1594,25 @@ bool LDSnapshotTaker::saveStepImage(
 			{
 			case ITPng:
 				retValue = writePng(filename, imageWidth, imageHeight, buffer,
-					saveAlpha);
+					saveAlpha, zBuffer);
 				break;
 			case ITBmp:
-				retValue = writeBmp(filename, imageWidth, imageHeight, buffer);
+				retValue = writeBmp(filename, imageWidth, imageHeight, buffer,
+					zBuffer);
 				break;
 			case ITJpg:
-				retValue = writeJpg(filename, imageWidth, imageHeight, buffer);
+				retValue = writeJpg(filename, imageWidth, imageHeight, buffer,
+					zBuffer);
 				break;
 			default:
 				// Get rid of warning
+				delete[] buffer;
+				delete[] zBuffer;
 				break;
 			}
-			delete[] buffer;
 		}
-		if (zBuffer != NULL)
+		else
 		{
-			std::string zMapFilename = filename;
-			removeExtenstion(zMapFilename);
-			zMapFilename += ".ldvz";
-			writeZMap(zMapFilename.c_str(), imageWidth, imageHeight, zBuffer);
 			delete[] zBuffer;
 		}
 	}
@@ -1285,11 +1752,16 @@ static void testZMap(const char *filename)
 
 #endif // TEST_ZMAP
 
+// NOTE: static function.
 bool LDSnapshotTaker::writeZMap(
 	FILE *zMapFile,
 	int width,
-	int height,
-	TCFloat *zBuffer)
+	int /*height*/,
+	TCFloat *zBuffer,
+	int croppedX,
+	int croppedY,
+	int croppedWidth,
+	int croppedHeight)
 {
 	const char *magic = "ldvz";
 	if (fwrite(magic, 4, 1, zMapFile) != 1)
@@ -1305,36 +1777,24 @@ bool LDSnapshotTaker::writeZMap(
 	{
 		return false;
 	}
-	// Crop zBuffer in place.
-	if (m_croppedX != 0 || m_croppedY != 0 || m_croppedWidth != width ||
-		m_croppedHeight != height)
-	{
-		int newBytesPerLine = m_croppedWidth * sizeof(TCFloat);
-		for (int y = 0; y < m_croppedHeight; ++y)
-		{
-			// Use memmove, since the source and destination might overlap.
-			memmove(&zBuffer[y * m_croppedWidth],
-					&zBuffer[(y + m_croppedY) * width + m_croppedX],
-					newBytesPerLine);
-		}
-		width = m_croppedWidth;
-		height = m_croppedHeight;
-	}
-	int32_t fileWidth = (int32_t)width;
+	int32_t fileWidth = (int32_t)croppedWidth;
 	if (fwrite(&fileWidth, sizeof(fileWidth), 1, zMapFile) != 1)
 	{
 		return false;
 	}
-	int32_t fileHeight = (int32_t)height;
+	int32_t fileHeight = (int32_t)croppedHeight;
 	if (fwrite(&fileHeight, sizeof(fileHeight), 1, zMapFile) != 1)
 	{
 		return false;
 	}
-	for (size_t y = 0; y < (size_t)height; ++y)
+	// Write the rows of the cropped area straight out of zBuffer, bottom row
+	// first.
+	for (size_t y = 0; y < (size_t)croppedHeight; ++y)
 	{
-		size_t yOffset = (height - y - 1) * width;
-		if (fwrite(&zBuffer[yOffset], sizeof(GLfloat), width, zMapFile) !=
-			(size_t)width)
+		size_t yOffset = (croppedY + croppedHeight - y - 1) * (size_t)width +
+			croppedX;
+		if (fwrite(&zBuffer[yOffset], sizeof(GLfloat), croppedWidth,
+			zMapFile) != (size_t)croppedWidth)
 		{
 			return false;
 		}
@@ -1342,16 +1802,22 @@ bool LDSnapshotTaker::writeZMap(
 	return true;
 }
 
+// NOTE: static function.
 bool LDSnapshotTaker::writeZMap(
 	const char *filename,
 	int width,
 	int height,
-	TCFloat *zBuffer)
+	TCFloat *zBuffer,
+	int croppedX,
+	int croppedY,
+	int croppedWidth,
+	int croppedHeight)
 {
 	FILE *zMapFile = ucfopen(filename, "wb");
 	if (zMapFile != NULL)
 	{
-		bool retValue = writeZMap(zMapFile, width, height, zBuffer);
+		bool retValue = writeZMap(zMapFile, width, height, zBuffer, croppedX,
+			croppedY, croppedWidth, croppedHeight);
 		fclose(zMapFile);
 #ifdef TEST_ZMAP
 		if (retValue)
@@ -1370,9 +1836,11 @@ bool LDSnapshotTaker::writeImage(
 	int height,
 	TCByte *buffer,
 	const char *formatName,
-	bool saveAlpha)
+	bool saveAlpha,
+	TCFloat *zBuffer /*= NULL*/)
 {
 	TCImage *image = new TCImage;
+	LDSnapshotImageJob *job;
 	bool retValue;
 	std::string comment;
 
@@ -1427,23 +1895,26 @@ bool LDSnapshotTaker::writeImage(
 		comment += m_productVersion;
 	}
 	image->setComment(comment.c_str());
+	job = new LDSnapshotImageJob(this, image, filename, buffer, zBuffer);
+	image->release();
 	if (m_autoCrop)
 	{
-		image->autoCrop((TCByte)m_modelViewer->getBackgroundR(),
+		job->setAutoCrop((TCByte)m_modelViewer->getBackgroundR(),
 			(TCByte)m_modelViewer->getBackgroundG(),
 			(TCByte)m_modelViewer->getBackgroundB());
-		m_croppedX = image->getCroppedX();
-		m_croppedY = image->getCroppedY();
+	}
+	if (m_encodeQueue != NULL)
+	{
+		m_encodeQueue->addJob(job);
+		retValue = !m_modelImageFailed;
 	}
 	else
 	{
-		m_croppedX = m_croppedY = 0;
+		job->setProgressCallback(staticImageProgressCallback, this);
+		retValue = job->encode(0);
+		job->finish(retValue);
 	}
-	m_croppedWidth = image->getWidth();
-	m_croppedHeight = image->getHeight();
-	retValue = image->saveFile(filename, staticImageProgressCallback, this);
-	debugPrintf("Saved image: %s\n", filename);
-	image->release();
+	job->release();
 	return retValue;
 }
 
@@ -1451,18 +1922,20 @@ bool LDSnapshotTaker::writeJpg(
 	const char *filename,
 	int width,
 	int height,
-	TCByte *buffer)
+	TCByte *buffer,
+	TCFloat *zBuffer /*= NULL*/)
 {
-	return writeImage(filename, width, height, buffer, "JPG", false);
+	return writeImage(filename, width, height, buffer, "JPG", false, zBuffer);
 }
 
 bool LDSnapshotTaker::writeBmp(
 	const char *filename,
 	int width,
 	int height,
-	TCByte *buffer)
+	TCByte *buffer,
+	TCFloat *zBuffer /*= NULL*/)
 {
-	return writeImage(filename, width, height, buffer, "BMP", false);
+	return writeImage(filename, width, height, buffer, "BMP", false, zBuffer);
 }
 
 bool LDSnapshotTaker::writePng(
@@ -1470,9 +1943,11 @@ bool LDSnapshotTaker::writePng(
 	int width,
 	int height,
 	TCByte *buffer,
-	bool saveAlpha)
+	bool saveAlpha,
+	TCFloat *zBuffer /*= NULL*/)
 {
-	return writeImage(filename, width, height, buffer, "PNG", saveAlpha);
+	return writeImage(filename, width, height, buffer, "PNG", saveAlpha,
+		zBuffer);
 }
 
 void LDSnapshotTaker::setRenderSize(int width, int height)
@@ -1855,14 +2330,20 @@ bool LDSnapshotTaker::doCommandLine(
 {
 	LDSnapshotTaker *snapshotTaker = new LDSnapshotTaker;
 	LDConsoleAlertHandler *consoleAlertHandler = getConsoleAlertHandler();
+	bool origPartCache = LDLModel::getPartCacheEnabled();
 	if (tried != NULL)
 	{
 		*tried = false;
 	}
+	// Keep parsed library parts around between the models on the command line,
+	// so that each model after the first only loads the parts it adds.
+	LDLModel::setPartCacheEnabled(TCUserDefaults::boolForKey(PART_CACHE_KEY,
+		true, false));
 	bool retValue = snapshotTaker->doCommandLine(doSnapshots, doExports, tried,
 		consoleAlertHandler);
 	snapshotTaker->release();
 	TCObject::release(consoleAlertHandler);
+	LDLModel::setPartCacheEnabled(origPartCache);
 	return retValue;
 }
 
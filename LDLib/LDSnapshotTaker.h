@@ -8,6 +8,13 @@
 
 class LDrawModelViewer;
 class LDConsoleAlertHandler;
+class LDSnapshotEncodeQueue;
+class LDSnapshotImageJob;
+
+// Called before and after each model on the command line is processed, with
+// the model's index among all the models on the command line.  If the call
+// with finished set to false returns false, the model is skipped.
+typedef bool (*LDSnapshotModelCallback)(int modelIndex, bool finished);
 
 class LDSnapshotTaker : public TCAlertSender
 {
@@ -66,6 +73,10 @@ public:
 
 	static bool doCommandLine(bool doSnapshots = true, bool doExports = true,
 		bool *tried = nullptr);
+	static void setModelCallback(LDSnapshotModelCallback value)
+	{
+		sm_modelCallback = value;
+	}
 	static std::string removeStepSuffix(const std::string &filename,
 		const std::string &stepSuffix);
 	static std::string addStepSuffix(const std::string &filename,
@@ -79,18 +90,38 @@ public:
 
 	static const char *alertClass(void) { return "LDSnapshotTaker"; }
 protected:
+	// A camera position for SnapshotViews or TurntableStep.  A negative
+	// distance means the distance isn't specified.
+	struct View
+	{
+		TCFloat latitude;
+		TCFloat longitude;
+		TCFloat distance;
+	};
+	typedef std::vector<View> ViewVector;
+
 	virtual ~LDSnapshotTaker(void);
 	virtual void dealloc(void);
-	bool writeJpg(const char *filename, int width, int height, TCByte *buffer);
-	bool writeBmp(const char *filename, int width, int height, TCByte *buffer);
+	// The write functions take ownership of buffer and zBuffer, which must
+	// have been allocated with new[].  When encoding is pipelined, the image
+	// is only queued, and the return value just says whether or not any
+	// earlier image of the same model failed.
+	bool writeJpg(const char *filename, int width, int height, TCByte *buffer,
+		TCFloat *zBuffer = NULL);
+	bool writeBmp(const char *filename, int width, int height, TCByte *buffer,
+		TCFloat *zBuffer = NULL);
 	bool writePng(const char *filename, int width, int height, TCByte *buffer,
-		bool saveAlpha);
-	bool writeZMap(const char *filename, int width, int height,
-		TCFloat *zBuffer);
-	bool writeZMap(FILE *zMapFile, int width, int height,
-		TCFloat *zBuffer);
+		bool saveAlpha, TCFloat *zBuffer = NULL);
 	bool writeImage(const char *filename, int width, int height, TCByte *buffer,
-		const char *formatName, bool saveAlpha);
+		const char *formatName, bool saveAlpha, TCFloat *zBuffer = NULL);
+	void imageFinished(LDSnapshotImageJob *job, bool succeeded);
+	void startEncodeQueue(void);
+	static bool writeZMap(const char *filename, int width, int height,
+		TCFloat *zBuffer, int croppedX, int croppedY, int croppedWidth,
+		int croppedHeight);
+	static bool writeZMap(FILE *zMapFile, int width, int height,
+		TCFloat *zBuffer, int croppedX, int croppedY, int croppedWidth,
+		int croppedHeight);
 	bool canSaveAlpha(void);
 	void renderOffscreenImage(void);
 	bool imageProgressCallback(CUCSTR message, float progress);
@@ -99,6 +130,10 @@ protected:
 	void grabSetup(void);
 	bool exportFile(const std::string& exportFilename, const char *modelPath,
 		bool zoomToFit);
+	bool saveViewImages(const char *filename, int imageWidth,
+		int imageHeight, bool zoomToFit, bool steps);
+	bool saveViewImage(const char *filename, int imageWidth, int imageHeight,
+		bool zoomToFit, bool steps);
 	bool saveStepImage(const char *filename, int imageWidth, int imageHeight,
 		bool zoomToFit);
 	bool saveGl2psStepImage(const char *filename, int imageWidth,
@@ -112,6 +147,10 @@ protected:
 		bool *tried, LDConsoleAlertHandler *consoleAlertHandler);
 	void commandLineChanged(void);
 	bool getZoomToFit(void);
+	bool hasCommandLineViews(void);
+	void getCommandLineViews(ViewVector &views);
+	bool startModel(void);
+	void finishModel(void);
 
 	static void getViewportSize(int &width, int &height);
 	static bool staticImageProgressCallback(CUCSTR message, float progress,
@@ -135,16 +174,25 @@ protected:
 	bool m_canceled;
 	int m_width;
 	int m_height;
-	int m_croppedX;
-	int m_croppedY;
-	int m_croppedWidth;
-	int m_croppedHeight;
+	// Only set for command line snapshots with encoder threads.
+	LDSnapshotEncodeQueue *m_encodeQueue;
+	// Incremented for every model that gets saved, so that queued images
+	// know whether or not the model they belong to is still being saved.
+	int m_imageModelIndex;
+	bool m_modelImageFailed;
+	int m_imagesSaved;
+	int m_imagesFailed;
+	// Index of the next command line model passed to sm_modelCallback.
+	int m_modelIndex;
 	TCFloat m_scaleFactor;
 	std::string m_modelFilename;
 	std::string m_fileUri;
 	std::string m_currentImageFilename;
 	std::set<std::string> m_commandLinesLists;
 	static bool sm_consoleAlerts;
+	static LDSnapshotModelCallback sm_modelCallback;
+
+	friend class LDSnapshotImageJob;
 };
 
 #endif // __LDSNAPSHOTTAKER_H__
@@ -16,6 +16,7 @@
 #define CHECK_PART_WAIT_KEY "CheckPartWait"
 #define COMMAND_LINES_LIST_KEY "CommandLinesList"				// NO UI
 #define CONDITIONAL_HIGHLIGHTS_KEY "ConditionalHighlights"
+#define CURVE_LOD_SIZE_KEY "CurveLODSize"								// NO UI
 #define CURVE_QUALITY_KEY "CurveQuality"
 #define CUSTOM_COLORS_KEY "CustomColors"
 #define CUTAWAY_ALPHA_KEY "CutawayAlpha"
@@ -41,6 +42,7 @@
 #define EXPORTS_DIR_KEY "ExportsDir"
 #define EXPORTS_DIR_MODE_KEY "ExportsDirMode"
 #define EXTRA_SEARCH_DIRS_KEY "ExtraSearchDirs"
+#define FILE_INDEX_KEY "FileIndex"								// NO UI
 #define FOV_KEY "FOV"
 #define FULLSCREEN_DEPTH_KEY "FullscreenDepth"
 #define FULLSCREEN_HEIGHT_KEY "FullscreenHeight"
@@ -65,10 +67,13 @@
 #define INV_PART_IMAGES_KEY "InventoryPartImages"
 #define INV_SHOW_FILE_KEY "InventoryShowFile"
 #define INV_SHOW_MODEL_KEY "InventoryShowModel"
+#define JOBS_KEY "Jobs"									// NO UI
 #define LAST_OPEN_PATH_KEY "LastOpenPath"
 #define LDRAWDIR_KEY "LDrawDir"
 #define LDCONFIG_KEY "LDConfig"
 #define LEFT_MARGIN_KEY "LeftMargin"
+#define LIBRARY_ARCHIVE_KEY "LibraryArchive"					// NO UI
+#define LIBRARY_CACHE_KEY "LibraryCache"						// NO UI
 #define LIGHTING_KEY "Lighting"
 #define LIGHT_VECTOR_KEY "LightVector"
 #define LINE_SMOOTHING_KEY "LineSmoothing"
@@ -80,6 +85,7 @@
 #define OPTIONAL_STANDARD_LIGHT_KEY "OptionalStandardLight"
 #define ORIENTATION_KEY "Orientation"
 #define PAPER_SIZE_KEY "PaperSize"
+#define PART_CACHE_KEY "PartCache"								// NO UI
 #define PARTS_LISTS_DIR_KEY "PartsListsDir"
 #define PARTS_LISTS_DIR_MODE_KEY "PartsListsDirMode"
 #define PERFORM_SMOOTHING_KEY "PerformSmoothing"
@@ -122,10 +128,14 @@
 #define SHOW_HIGHLIGHT_LINES_KEY "ShowHighlightLines"
 #define SHOW_TYPE5_CONTROL_POINTS_KEY "ShowType5ControlPoints"
 #define SHOW_WARNINGS_KEY "ShowWarnings"
+#define SNAPSHOT_ENCODE_MEMORY_KEY "SnapshotEncodeMemory"		// NO UI
+#define SNAPSHOT_ENCODE_THREADS_KEY "SnapshotEncodeThreads"	// NO UI
 #define SNAPSHOTS_DIR_KEY "SnapshotsDir"
 #define SNAPSHOTS_DIR_MODE_KEY "SnapshotsDirMode"
 #define SNAPSHOT_SUFFIX_KEY "SnapshotSuffix"
 #define SNAPSHOT_TN_METAS_KEY "SnapshotTNMetas"
+#define SNAPSHOT_VIEWS_KEY "SnapshotViews"						// NO UI
+#define SNAPSHOT_VIEW_SUFFIX_KEY "SnapshotViewSuffix"			// NO UI
 #define SORT_KEY "SortTransparent"
 #define STATUS_BAR_KEY "StatusBar"
 #define STEP_KEY "Step"
@@ -138,6 +148,7 @@
 #define TOP_MARGIN_KEY "TopMargin"
 #define TOPMOST_KEY "Topmost"
 #define TRANS_DEFAULT_COLOR_KEY "TransDefaultColor"
+#define TURNTABLE_STEP_KEY "TurntableStep"						// NO UI
 #define FLAT_SHADING_KEY "UseFlatShading"
 #define QUALITY_LIGHTING_KEY "UseQualityLighting"
 #define QUALITY_STUDS_KEY "UseQualityStuds"
@@ -147,6 +158,7 @@
 #define VERIFY_LDRAW_DIR_KEY "VerifyLDrawDir"
 #define VIEW_MODE_KEY "ViewMode"
 #define VISUAL_STYLE_ENABLED_KEY "VisualStyleEnabled"
+#define WELD_VERTICES_KEY "WeldVertices"						// NO UI
 #define WINDOW_HEIGHT_KEY "WindowHeight"
 #define WINDOW_MAXIMIZED_KEY "WindowMaximized"
 #define WINDOW_WIDTH_KEY "WindowWidth"
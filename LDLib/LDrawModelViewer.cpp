@@ -49,6 +49,10 @@
 #ifdef TIME_MODEL_LOAD
 #include <iostream>
 #include <ctime>
+#include <TCFoundation/TCHashDictionary.h>
+#include <LDLoader/LDLActionLine.h>
+#include <LDLoader/LDLFileIndex.h>
+#include <LDLoader/LDLPrimitiveCheck.h>
 #endif // TIME_MODEL_LOAD
 
 #ifdef WIN32
@@ -64,6 +68,97 @@ float fmodf(float x, float y)
 }
 #endif
 
+#ifdef TIME_MODEL_LOAD
+typedef std::vector<LDLFileLineArray *> FileLineArrayVector;
+
+// Times just the scanning of the line types and numbers of all the lines in
+// fileLineArrays, the way LDLFileLine and LDLActionLine do it while loading,
+// without any of the rest of the work of loading.
+static void timeLineScanning(const FileLineArrayVector &fileLineArrays)
+{
+	const int passCount = 10;
+	std::vector<const char *> lines;
+	float values[12];
+	int colorNumber;
+	int failedCount = 0;
+
+	for (size_t i = 0; i < fileLineArrays.size(); i++)
+	{
+		LDLFileLineArray *fileLines = fileLineArrays[i];
+
+		for (int j = 0; j < fileLines->getCount(); j++)
+		{
+			const char *line = (*fileLines)[j]->getLine();
+
+			if (line != NULL)
+			{
+				lines.push_back(line);
+			}
+		}
+	}
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int pass = 0; pass < passCount; pass++)
+	{
+		for (size_t i = 0; i < lines.size(); i++)
+		{
+			LDLLineType lineType = LDLFileLine::lineTypeForLine(lines[i]);
+			int valueCount = LDLActionLine::valueCountForLineType(lineType);
+
+			if (valueCount > 0 && !LDLActionLine::scanValues(lines[i],
+				colorNumber, values, valueCount))
+			{
+				failedCount++;
+			}
+		}
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	std::chrono::duration<double> elapsed_seconds = end-start;
+	int lineCount = (int)lines.size() * passCount;
+
+	std::cout << "Scanning " << lines.size() << " lines " << passCount <<
+		" times took " << elapsed_seconds.count() << "s (" <<
+		(int)(lineCount / elapsed_seconds.count()) << " lines/s, " <<
+		failedCount / passCount << " bad lines)\n\n";
+}
+
+// Times the primitive classifier over the names of all the files in the p and
+// p/48 directories: once to classify them, and once more to look them up in
+// the classifier's memo.
+static void timePrimitiveClassifier(void)
+{
+	StringVector names;
+	StringVector names48;
+	std::string pDir = LDLModel::lDrawDir();
+	LDLPrimitiveCheck *primitiveCheck = new LDLPrimitiveCheck;
+
+	pDir += "/p";
+	if (!LDLFileIndex::listDirectory(pDir, names))
+	{
+		pDir = LDLModel::lDrawDir();
+		pDir += "/P";
+		LDLFileIndex::listDirectory(pDir, names);
+	}
+	LDLFileIndex::listDirectory(pDir + "/48", names48);
+	for (size_t i = 0; i < names48.size(); i++)
+	{
+		names.push_back("48/" + names48[i]);
+	}
+	auto start = std::chrono::high_resolution_clock::now();
+	int primitiveCount = primitiveCheck->countPrimitives(names);
+	auto middle = std::chrono::high_resolution_clock::now();
+	primitiveCheck->countPrimitives(names);
+	auto end = std::chrono::high_resolution_clock::now();
+	std::chrono::duration<double> classifySeconds = middle-start;
+	std::chrono::duration<double> memoSeconds = end-middle;
+
+	primitiveCheck->release();
+	std::cout << "Primitive classifier: " << primitiveCount << " of " <<
+		names.size() << " names in " << pDir << " are primitives\n" <<
+		"Classifying took " << classifySeconds.count() << "s, looking up " <<
+		"the memoized results took " << memoSeconds.count() << "s\n\n";
+}
+#endif // TIME_MODEL_LOAD
+
 #define FONT_CHAR_WIDTH 8
 #define FONT_IMAGE_WIDTH 128
 #define FONT_IMAGE_HEIGHT 256
@@ -1126,6 +1221,15 @@ bool LDrawModelViewer::loadLDLModel(void)
 	mainModel->setSeamWidth(seamWidth);
 	mainModel->setCheckPartTracker(flags.checkPartTracker);
 	mainModel->setTexmaps(flags.texmaps);
+	mainModel->setMultiThreaded(flags.multiThreaded);
+	LDLModel::setLibraryCacheEnabled(
+		TCUserDefaults::boolForKey(LIBRARY_CACHE_KEY, false, false));
+	char *libraryArchive = TCUserDefaults::stringForKey(LIBRARY_ARCHIVE_KEY,
+		NULL, false);
+	LDLModel::setLibraryArchive(libraryArchive);
+	delete[] libraryArchive;
+	LDLModel::setFileIndexEnabled(
+		TCUserDefaults::boolForKey(FILE_INDEX_KEY, true, false));
 	if (flags.needsResetMpd)
 	{
 		mpdChildIndex = 0;
@@ -1139,8 +1243,26 @@ bool LDrawModelViewer::loadLDLModel(void)
 #ifdef TIME_MODEL_LOAD
 		auto end = std::chrono::high_resolution_clock::now();
 		std::chrono::duration<double> elapsed_seconds = end-start;
+		TCObjectArray *subModels = mainModel->getLoadedModels()->allObjects();
+		FileLineArrayVector fileLineArrays(1, mainModel->getFileLines());
+		int lineCount = mainModel->getFileLines()->getCount();
+
+		for (int i = 0; i < subModels->getCount(); i++)
+		{
+			LDLFileLineArray *fileLines =
+				((LDLModel *)(*subModels)[i])->getFileLines();
+
+			if (fileLines != NULL)
+			{
+				fileLineArrays.push_back(fileLines);
+				lineCount += fileLines->getCount();
+			}
+		}
 		std::cout << "\n\nModel load of " << filename << " took " <<
-			elapsed_seconds.count() << "s\n\n\n";
+			elapsed_seconds.count() << "s (" << lineCount << " lines, " <<
+			(int)(lineCount / elapsed_seconds.count()) << " lines/s)\n\n\n";
+		timeLineScanning(fileLineArrays);
+		timePrimitiveClassifier();
 #endif // TIME_MODEL_LOAD
 		return calcSize();
 	}
@@ -1181,9 +1303,35 @@ bool LDrawModelViewer::parseModel(void)
 	modelParser->setAlertSender(this);
 	modelParser->setTexmapsFlag(getTexmaps());
 	model = getCurModel();
+#ifdef TIME_MODEL_LOAD
+	auto start = std::chrono::high_resolution_clock::now();
+#endif // TIME_MODEL_LOAD
 	if (modelParser->parseMainModel(model))
 	{
 		mainTREModel = modelParser->getMainTREModel();
+#ifdef TIME_MODEL_LOAD
+		auto end = std::chrono::high_resolution_clock::now();
+		std::chrono::duration<double> elapsed_seconds = end-start;
+		int unweldedCount = mainTREModel->getUnweldedVertexCount();
+
+		std::cout << "\n\nModel parse took " << elapsed_seconds.count() <<
+			"s\n";
+		if (unweldedCount > 0)
+		{
+			int weldedCount = mainTREModel->getWeldedVertexCount();
+
+			std::cout << "Vertex weld: " << unweldedCount << " -> " <<
+				weldedCount << " vertices (" <<
+				100.0 * weldedCount / unweldedCount << "%)\n";
+		}
+		if (mainTREModel->getUnoptimizedACMR() > 0.0f)
+		{
+			std::cout << "Vertex cache: ACMR " <<
+				mainTREModel->getUnoptimizedACMR() << " before, " <<
+				mainTREModel->getOptimizedACMR() << " after\n";
+		}
+		std::cout << "\n\n";
+#endif // TIME_MODEL_LOAD
 		mainTREModel->setTexturesAfterTransparentFlag(getTexturesAfterTransparent());
 		mainTREModel->setTextureOffsetFactor(getTextureOffsetFactor());
 		mainTREModel->retain();
@@ -2919,6 +3067,21 @@ void LDrawModelViewer::setViewMode(ViewMode value)
 void LDrawModelViewer::innerDrawModel(void)
 {
 	mainTREModel->draw();
+#ifdef TIME_MODEL_LOAD
+	static int lastCulledCount = -1;
+	static int lastDrawnCount = -1;
+	int culledCount = mainTREModel->getCulledSubModelCount();
+	int drawnCount = mainTREModel->getDrawnSubModelCount();
+
+	// Only report changes, since this happens every frame.
+	if (culledCount != lastCulledCount || drawnCount != lastDrawnCount)
+	{
+		std::cout << "Instance culling: " << culledCount << " culled, " <<
+			drawnCount << " drawn\n";
+		lastCulledCount = culledCount;
+		lastDrawnCount = drawnCount;
+	}
+#endif // TIME_MODEL_LOAD
 	if (highlightModel != NULL)
 	{
 		if (flags.drawWireframe)
@@ -542,6 +542,8 @@ class LDrawModelViewer: public TCAlertSender
 		virtual void setPovCameraAspect(bool value, bool saveSetting);
 		virtual void setDefaultRotationMatrix(const TCFloat *value);
 		virtual void setDefaultLatLong(TCFloat latitude, TCFloat longitude);
+		TCFloat getDefaultLatitude(void) const { return defaultLatitude; }
+		TCFloat getDefaultLongitude(void) const { return defaultLongitude; }
 		const TCFloat *getDefaultRotationMatrix(void)
 		{
 			return defaultRotationMatrix;
@@ -1,6 +1,10 @@
 #include "LDLActionLine.h"
 #include "LDLPalette.h"
 #include "LDLMainModel.h"
+#include <TCFoundation/mystring.h>
+#include <stdio.h>
+#include <string.h>
+#include <sstream>
 
 #ifdef WIN32
 #if defined(_MSC_VER) && _MSC_VER >= 1400 && defined(_DEBUG)
@@ -9,8 +13,11 @@
 #endif // WIN32
 
 LDLActionLine::LDLActionLine(LDLModel *parentModel, const char *line,
-							 int lineNumber, const char *originalLine)
-	:LDLFileLine(parentModel, line, lineNumber, originalLine),
+							 int lineNumber, const char *originalLine,
+							 LDLLineArena *arena)
+	:LDLFileLine(parentModel, line, lineNumber, originalLine, arena),
+	m_compiledValues(NULL),
+	m_compiledValueCount(0),
 	m_haveRandomColorNumber(false)
 {
 	memset(&m_actionFlags, 0, sizeof(m_actionFlags));
@@ -22,6 +29,8 @@ LDLActionLine::LDLActionLine(const LDLActionLine &other)
 	:LDLFileLine(other),
 	m_actionFlags(other.m_actionFlags),
 	m_colorNumber(other.m_colorNumber),
+	m_compiledValues(NULL),
+	m_compiledValueCount(0),
 	m_haveRandomColorNumber(false)
 {
 }
@@ -35,6 +44,123 @@ void LDLActionLine::setBFCSettings(BFCState bfcCertify, bool bfcClip,
 	m_actionFlags.bfcInvert = bfcInvert;
 }
 
+// Sets the color number and numeric values of the line from the compiled copy
+// of its file in the library cache, so that parse() doesn't have to scan the
+// text of the line.
+void LDLActionLine::setCompiledValues(
+	int colorNumber,
+	const float *values,
+	int valueCount)
+{
+	m_colorNumber = colorNumber;
+	m_compiledValues = values;
+	m_compiledValueCount = valueCount;
+}
+
+// Fills in values with the count numbers that follow the color number in
+// the line (m_line, unless line is given), and sets the color number.  If the
+// numbers were already scanned (by the library cache or a loader thread),
+// those are used instead of scanning the text again.
+bool LDLActionLine::readValues(float *values, int count, const char *line)
+{
+	if (m_compiledValues != NULL && m_compiledValueCount == count)
+	{
+		memcpy(values, m_compiledValues, count * sizeof(float));
+		m_compiledValues = NULL;
+		return true;
+	}
+	return scanValues(line != NULL ? line : m_line, m_colorNumber, values,
+		count);
+}
+
+// Scans the color number and the first count numbers after it in one pass,
+// getting the same results the sscanf calls the parse() functions of the
+// subclasses used to make did.  colorNumber is set as soon as it has been
+// scanned, even if scanning the numbers after it fails.
+// NOTE: static function.
+bool LDLActionLine::scanValues(
+	const char *line,
+	int &colorNumber,
+	float *values,
+	int count)
+{
+	int lineType;
+	int i;
+
+	if (!scanInteger(line, lineType, false) ||
+		!scanInteger(line, colorNumber, true))
+	{
+		return false;
+	}
+	for (i = 0; i < count; i++)
+	{
+		if (!scanFloat(line, values[i]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Returns the number of values that follow the color number in lines of the
+// given type.
+// NOTE: static function.
+int LDLActionLine::valueCountForLineType(LDLLineType lineType)
+{
+	switch (lineType)
+	{
+	case LDLLineTypeLine:
+		return 6;
+	case LDLLineTypeTriangle:
+		return 9;
+	case LDLLineTypeModel:
+	case LDLLineTypeQuad:
+	case LDLLineTypeConditionalLine:
+		return 12;
+	default:
+		return 0;
+	}
+}
+
+// The formatted line is only used in error messages, so instead of building
+// it for every line in parse(), it gets built here the first time it's asked
+// for.  The values are scanned again from m_line, which gives the same
+// result parse() got.
+const char *LDLActionLine::getFormattedLine(void) const
+{
+	int count = (int)m_actionFlags.formatValueCount;
+
+	if (m_formattedLine == NULL && count > 0 && m_line != NULL)
+	{
+		float values[12];
+		int colorNumber;
+
+		if (scanValues(m_line, colorNumber, values, count))
+		{
+			std::string prefix = getTypeAndColorPrefix();
+			std::stringstream ss;
+			int i;
+
+			if (!prefix.empty())
+			{
+				ss << prefix << "  ";
+			}
+			else
+			{
+				ss << (int)getLineType() << " " << colorNumber << "  ";
+			}
+			for (i = 0; i < count; i += 3)
+			{
+				ss << values[i] << " " << values[i + 1] << " " << values[i + 2]
+					<< "  ";
+			}
+			ss << getFormattedName();
+			m_formattedLine = copyString(ss.str().c_str());
+		}
+	}
+	return LDLFileLine::getFormattedLine();
+}
+
 void LDLActionLine::setTexmapFallback(void)
 {
 	m_actionFlags.texmapFallback = true;
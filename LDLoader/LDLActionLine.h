@@ -23,8 +23,12 @@ public:
 	}
 	bool getBFCInvert(void) const { return m_actionFlags.bfcInvert != false; }
 	BFCState getBFCState(void) const { return m_actionFlags.bfcCertify; }
+	virtual const char *getFormattedLine(void) const;
 	virtual int getColorNumber(void) const;
 	virtual void setColorNumber(int value) { m_colorNumber = value; }
+	void setCompiledValues(int colorNumber, const float *values,
+		int valueCount);
+	void clearCompiledValues(void) { m_compiledValues = NULL; }
 	bool getBFCOn(void) const
 	{
 		return (m_actionFlags.bfcCertify == BFCOnState ||
@@ -39,11 +43,18 @@ public:
 		LDLScanPointCallback scanPointCallback, const TCFloat *matrix,
 		bool watchBBoxIgnore)
 		const = 0;
+
+	static bool scanValues(const char *line, int &colorNumber, float *values,
+		int count);
+	static int valueCountForLineType(LDLLineType lineType);
 protected:
 	LDLActionLine(LDLModel *parentModel, const char *line, int lineNumber,
-		const char *originalLine = NULL);
+		const char *originalLine = NULL,
+		LDLLineArena *arena = NULL);
 	LDLActionLine(const LDLActionLine &other);
 	int getRandomColorNumber(void) const;
+	bool readValues(float *values, int count, const char *line = NULL);
+	virtual std::string getFormattedName(void) const { return std::string(); }
 
 	static bool colorsAreSimilar(int r1, int g1, int b1, int r2, int g2,
 		int b2);
@@ -57,8 +68,14 @@ protected:
 		bool bfcInvert:1;
 		bool bboxIgnore:1;
 		bool texmapFallback:1;
+		// Number of values parse() successfully scanned from the line.
+		unsigned int formatValueCount:4;
 	} m_actionFlags;
 	int m_colorNumber;
+	// Points into the library cache (or the values scanned ahead on a loader
+	// thread), and is only valid until parse() returns.
+	const float *m_compiledValues;
+	int m_compiledValueCount;
 	mutable int m_randomColorNumber;
 	mutable bool m_haveRandomColorNumber;
 };
@@ -135,7 +135,7 @@ void LDLAutoCamera::zoomToFit(void)
 #endif // _DEBUG
 		mainModel->setScanConditionalControlPoints(
 			m_scanConditionalControlPoints);
-		m_model->scanPoints(this,
+		m_model->scanHullPoints(this,
 			(LDLScanPointCallback)&LDLAutoCamera::scanCameraPoint,
 			transformationMatrix, m_step, true);
 		mainModel->setScanConditionalControlPoints(origScanControlPoints);
@@ -13,8 +13,9 @@
 #endif // WIN32
 
 LDLCommentLine::LDLCommentLine(LDLModel *parentModel, const char *line,
-							   int lineNumber, const char *originalLine)
-	:LDLFileLine(parentModel, line, lineNumber, originalLine),
+							   int lineNumber, const char *originalLine,
+							   LDLLineArena *arena)
+	:LDLFileLine(parentModel, line, lineNumber, originalLine, arena),
 	m_processedLine(NULL),
 	m_words(NULL)
 {
@@ -63,7 +63,8 @@ public:
 	}
 protected:
 	LDLCommentLine(LDLModel *parentModel, const char *line, int lineNumber,
-		const char *originalLine = NULL);
+		const char *originalLine = NULL,
+		LDLLineArena *arena = NULL);
 	LDLCommentLine(const LDLCommentLine &other);
 	~LDLCommentLine(void);
 	virtual void dealloc(void);
@@ -1,7 +1,6 @@
 #include "LDLConditionalLineLine.h"
 #include "LDLMainModel.h"
 #include <TCFoundation/TCLocalStrings.h>
-#include <sstream>
 
 #ifdef WIN32
 #if defined(_MSC_VER) && _MSC_VER >= 1400 && defined(_DEBUG)
@@ -11,8 +10,9 @@
 
 LDLConditionalLineLine::LDLConditionalLineLine(LDLModel *parentModel,
 											   const char *line, int lineNumber,
-											   const char *originalLine)
-	:LDLLineLine(parentModel, line, lineNumber, originalLine),
+											   const char *originalLine,
+											   LDLLineArena *arena)
+	:LDLLineLine(parentModel, line, lineNumber, originalLine, arena),
 	m_controlPoints(NULL)
 {
 }
@@ -37,37 +37,17 @@ LDLConditionalLineLine::LDLConditionalLineLine(const LDLConditionalLineLine
 
 bool LDLConditionalLineLine::parse(void)
 {
-	float x1, y1, z1;
-	float x2, y2, z2;
-	float x3, y3, z3;
-	float x4, y4, z4;
-	int lineType;
+	float values[12];
 
-	if (sscanf(m_line, "%d %i %f %f %f %f %f %f %f %f %f %f %f %f", &lineType,
-		&m_colorNumber, &x1, &y1, &z1, &x2, &y2, &z2, &x3, &y3, &z3,
-		&x4, &y4, &z4) == 14)
+	if (readValues(values, 12))
 	{
-		std::string prefix = getTypeAndColorPrefix();
-		std::stringstream ss;
-		if (!prefix.empty())
-		{
-			ss << prefix << "  ";
-		}
-		else
-		{
-			ss << "4 " << m_colorNumber << "  ";
-		}
-		ss << x1 << " " << y1 << " " << z1 << "  ";
-		ss << x2 << " " << y2 << " " << z2 << "  ";
-		ss << x3 << " " << y3 << " " << z3 << "  ";
-		ss << x4 << " " << y4 << " " << z4 << "  ";
-		m_formattedLine = copyString(ss.str().c_str());
+		m_actionFlags.formatValueCount = 12;
 		m_points = new TCVector[2];
-		m_points[0] = TCVector(x1, y1, z1);
-		m_points[1] = TCVector(x2, y2, z2);
+		m_points[0] = TCVector(values[0], values[1], values[2]);
+		m_points[1] = TCVector(values[3], values[4], values[5]);
 		m_controlPoints = new TCVector[2];
-		m_controlPoints[0] = TCVector(x3, y3, z3);
-		m_controlPoints[1] = TCVector(x4, y4, z4);
+		m_controlPoints[0] = TCVector(values[6], values[7], values[8]);
+		m_controlPoints[1] = TCVector(values[9], values[10], values[11]);
 		if (getMatchingPoints())
 		{
 			setError(LDLEMatchingPoints,
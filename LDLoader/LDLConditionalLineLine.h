@@ -19,7 +19,8 @@ public:
 		bool watchBBoxIgnore) const;
 protected:
 	LDLConditionalLineLine(LDLModel *parentModel, const char *line,
-		int lineNumber, const char *originalLine = NULL);
+		int lineNumber, const char *originalLine = NULL,
+		LDLLineArena *arena = NULL);
 	LDLConditionalLineLine(const LDLConditionalLineLine &other);
 	virtual void dealloc(void);
 
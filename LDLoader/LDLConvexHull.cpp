@@ -0,0 +1,308 @@
+#include "LDLConvexHull.h"
+#include <math.h>
+#include <algorithm>
+
+#ifdef WIN32
+#if defined(_MSC_VER) && _MSC_VER >= 1400 && defined(_DEBUG)
+#define new DEBUG_CLIENTBLOCK
+#endif // _DEBUG
+#endif // WIN32
+
+// Points have to be at least this far inside (relative to the size of the
+// model) before they get removed.
+#define HULL_TOLERANCE 1e-9
+
+// Orders points by x, then y, then z.
+static bool pointLess(const TCVector &left, const TCVector &right)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		if (left.get(i) != right.get(i))
+		{
+			return left.get(i) < right.get(i);
+		}
+	}
+	return false;
+}
+
+static bool pointEqual(const TCVector &left, const TCVector &right)
+{
+	return left.get(0) == right.get(0) && left.get(1) == right.get(1) &&
+		left.get(2) == right.get(2);
+}
+
+static void crossProduct(
+	const double *a,
+	const double *b,
+	const double *c,
+	double *normal)
+{
+	double ab[3];
+	double ac[3];
+
+	for (int i = 0; i < 3; i++)
+	{
+		ab[i] = b[i] - a[i];
+		ac[i] = c[i] - a[i];
+	}
+	normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+	normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+	normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+}
+
+static double dotProduct(const double *a, const double *b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// NOTE: static function.
+void LDLConvexHull::reducePoints(TCVectorVector &points)
+{
+	TCVectorVector extremePoints;
+	TetrahedronVector tetrahedra;
+	TCVector min;
+	TCVector max;
+	double size = 0.0;
+	double tolerance;
+	size_t i, j;
+
+	std::sort(points.begin(), points.end(), pointLess);
+	points.erase(std::unique(points.begin(), points.end(), pointEqual),
+		points.end());
+	if (points.size() < HULL_MIN_REDUCE_COUNT)
+	{
+		return;
+	}
+	findExtremePoints(points, extremePoints);
+	if (extremePoints.size() < 4)
+	{
+		return;
+	}
+	min = max = extremePoints[0];
+	for (i = 1; i < extremePoints.size(); i++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			min[axis] = std::min(min[axis], extremePoints[i].get(axis));
+			max[axis] = std::max(max[axis], extremePoints[i].get(axis));
+		}
+	}
+	for (int axis = 0; axis < 3; axis++)
+	{
+		size = std::max(size, (double)(max[axis] - min[axis]));
+	}
+	tolerance = size * HULL_TOLERANCE;
+	findTetrahedra(extremePoints, tolerance, tetrahedra);
+	if (tetrahedra.empty())
+	{
+		// All the points are in one plane (or on one line).
+		return;
+	}
+	j = 0;
+	for (i = 0; i < points.size(); i++)
+	{
+		if (!isInside(points[i], tetrahedra, tolerance))
+		{
+			points[j++] = points[i];
+		}
+	}
+	points.resize(j);
+}
+
+// Finds the points that are farthest along each of the 26 directions from the
+// center of a cube to its corners, edges, and faces.
+// NOTE: static function.
+void LDLConvexHull::findExtremePoints(
+	const TCVectorVector &points,
+	TCVectorVector &extremePoints)
+{
+	std::vector<size_t> indices;
+
+	for (int x = -1; x <= 1; x++)
+	{
+		for (int y = -1; y <= 1; y++)
+		{
+			for (int z = -1; z <= 1; z++)
+			{
+				size_t best = 0;
+				double bestDistance;
+
+				if (x == 0 && y == 0 && z == 0)
+				{
+					continue;
+				}
+				bestDistance = x * points[0].get(0) + y * points[0].get(1) +
+					z * points[0].get(2);
+				for (size_t i = 1; i < points.size(); i++)
+				{
+					const TCVector &point = points[i];
+					double distance = x * point.get(0) + y * point.get(1) +
+						z * point.get(2);
+
+					if (distance > bestDistance)
+					{
+						best = i;
+						bestDistance = distance;
+					}
+				}
+				indices.push_back(best);
+			}
+		}
+	}
+	std::sort(indices.begin(), indices.end());
+	indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+	extremePoints.reserve(indices.size());
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		extremePoints.push_back(points[indices[i]]);
+	}
+}
+
+// Fills tetrahedra with ones that join the center of the extreme points to
+// each triangle of them that has all the others on one side.  Those triangles
+// make up the surface of the hull of the extreme points, so together the
+// tetrahedra fill it.  Every tetrahedron is inside the hull of the points no
+// matter what, since all its corners are, so a point that is inside any of
+// them can't be on the hull.
+// NOTE: static function.
+void LDLConvexHull::findTetrahedra(
+	const TCVectorVector &extremePoints,
+	double tolerance,
+	TetrahedronVector &tetrahedra)
+{
+	size_t count = extremePoints.size();
+	std::vector<double> values(count * 3);
+	double center[3] = { 0.0, 0.0, 0.0 };
+	size_t i, j, k, l;
+
+	for (i = 0; i < count; i++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			values[i * 3 + axis] = extremePoints[i].get(axis);
+			center[axis] += values[i * 3 + axis] / count;
+		}
+	}
+	for (i = 0; i < count; i++)
+	{
+		const double *a = &values[i * 3];
+
+		for (j = i + 1; j < count; j++)
+		{
+			const double *b = &values[j * 3];
+
+			for (k = j + 1; k < count; k++)
+			{
+				const double *c = &values[k * 3];
+				Tetrahedron tetrahedron;
+				Plane &face = tetrahedron.planes[0];
+				bool above = false;
+				bool below = false;
+
+				if (!makePlane(a, b, c, center, tolerance, face))
+				{
+					continue;
+				}
+				for (l = 0; l < count && !(above && below); l++)
+				{
+					double distance = dotProduct(face.normal, &values[l * 3]) -
+						face.distance;
+
+					if (distance > tolerance)
+					{
+						above = true;
+					}
+					else if (distance < -tolerance)
+					{
+						below = true;
+					}
+				}
+				if (above && below)
+				{
+					// Not on the surface.
+					continue;
+				}
+				if (makePlane(center, a, b, c, tolerance,
+					tetrahedron.planes[1]) &&
+					makePlane(center, b, c, a, tolerance,
+					tetrahedron.planes[2]) &&
+					makePlane(center, c, a, b, tolerance,
+					tetrahedron.planes[3]))
+				{
+					tetrahedra.push_back(tetrahedron);
+				}
+			}
+		}
+	}
+}
+
+// Sets plane to the plane through a, b, and c, facing toward inside.  Returns
+// false if the three points are in a line, or inside is in the plane.
+// NOTE: static function.
+bool LDLConvexHull::makePlane(
+	const double *a,
+	const double *b,
+	const double *c,
+	const double *inside,
+	double tolerance,
+	Plane &plane)
+{
+	double length;
+	double distance;
+
+	crossProduct(a, b, c, plane.normal);
+	length = sqrt(dotProduct(plane.normal, plane.normal));
+	if (length == 0.0)
+	{
+		return false;
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		plane.normal[i] /= length;
+	}
+	plane.distance = dotProduct(plane.normal, a);
+	distance = dotProduct(plane.normal, inside) - plane.distance;
+	if (fabs(distance) <= tolerance)
+	{
+		return false;
+	}
+	if (distance < 0.0)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			plane.normal[i] = -plane.normal[i];
+		}
+		plane.distance = -plane.distance;
+	}
+	return true;
+}
+
+// NOTE: static function.
+bool LDLConvexHull::isInside(
+	const TCVector &point,
+	const TetrahedronVector &tetrahedra,
+	double tolerance)
+{
+	double values[3] = { point.get(0), point.get(1), point.get(2) };
+
+	for (size_t i = 0; i < tetrahedra.size(); i++)
+	{
+		const Tetrahedron &tetrahedron = tetrahedra[i];
+		int j;
+
+		for (j = 0; j < 4; j++)
+		{
+			const Plane &plane = tetrahedron.planes[j];
+
+			if (dotProduct(plane.normal, values) - plane.distance <= tolerance)
+			{
+				break;
+			}
+		}
+		if (j == 4)
+		{
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,49 @@
+#ifndef __LDLCONVEXHULL_H__
+#define __LDLCONVEXHULL_H__
+
+#include <TCFoundation/TCVector.h>
+#include <TCFoundation/TCStlIncludes.h>
+
+typedef std::vector<TCVector> TCVectorVector;
+
+// Number of points below which LDLConvexHull::reducePoints doesn't bother
+// looking for interior points.
+#define HULL_MIN_REDUCE_COUNT 32
+
+// Cuts lists of points down to the ones that might be on their convex hull.
+// The maximum of any linear function (or any other convex function, like the
+// distance from a point) over the points is always reached at a vertex of the
+// hull, so anything that only looks for extremes gets the same answer from the
+// reduced list.
+class LDLConvexHull
+{
+public:
+	// Removes duplicate points, along with points that are strictly inside
+	// the convex hull of the points that are farthest out in a fixed set of
+	// directions (Akl and Toussaint).  Points on or near the surface of the
+	// hull are always kept.
+	static void reducePoints(TCVectorVector &points);
+protected:
+	struct Plane
+	{
+		double normal[3];
+		double distance;
+	};
+	// The inside of a tetrahedron is on the positive side of all four planes.
+	struct Tetrahedron
+	{
+		Plane planes[4];
+	};
+	typedef std::vector<Tetrahedron> TetrahedronVector;
+
+	static void findExtremePoints(const TCVectorVector &points,
+		TCVectorVector &extremePoints);
+	static void findTetrahedra(const TCVectorVector &extremePoints,
+		double tolerance, TetrahedronVector &tetrahedra);
+	static bool makePlane(const double *a, const double *b, const double *c,
+		const double *inside, double tolerance, Plane &plane);
+	static bool isInside(const TCVector &point,
+		const TetrahedronVector &tetrahedra, double tolerance);
+};
+
+#endif // __LDLCONVEXHULL_H__
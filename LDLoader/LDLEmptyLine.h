@@ -11,7 +11,8 @@ public:
 	virtual LDLLineType getLineType(void) const { return LDLLineTypeEmpty; }
 protected:
 	LDLEmptyLine(LDLModel *parentModel, const char *line, int lineNumber,
-		const char *originalLine = NULL);
+		const char *originalLine = NULL,
+		LDLLineArena *arena = NULL);
 	LDLEmptyLine(const LDLEmptyLine &other);
 	virtual ~LDLEmptyLine(void);
 
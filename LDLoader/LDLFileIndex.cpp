@@ -0,0 +1,214 @@
+#include "LDLFileIndex.h"
+#include <TCFoundation/mystring.h>
+#include <sys/stat.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else // WIN32
+#include <dirent.h>
+#endif // WIN32
+
+#ifdef WIN32
+#if defined(_MSC_VER) && _MSC_VER >= 1400 && defined(_DEBUG)
+#define new DEBUG_CLIENTBLOCK
+#endif // _DEBUG
+#endif // WIN32
+
+LDLFileIndex::LDLFileIndex(void)
+	: m_generation(1)
+	, m_lookupCount(0)
+	, m_foundCount(0)
+	, m_notFoundCount(0)
+	, m_directoryReadCount(0)
+{
+}
+
+LDLFileIndex::~LDLFileIndex(void)
+{
+}
+
+void LDLFileIndex::dealloc(void)
+{
+	TCObject::dealloc();
+}
+
+// Looks up name (which may contain subdirectories) inside dir.  If it's
+// there, path is set to its full path, using the real case of every
+// component after dir.
+LDLFileIndex::FindResult LDLFileIndex::findFile(
+	const char *dir,
+	const char *name,
+	std::string &path)
+{
+	std::string dirPath = dir;
+	const char *start = name;
+
+	m_lookupCount++;
+	while (true)
+	{
+		while (*start == '/' || *start == '\\')
+		{
+			start++;
+		}
+		const char *end = start + strcspn(start, "/\\");
+		Directory &entryDir = directory(dirPath);
+
+		if (!entryDir.readable)
+		{
+			return FRNotIndexed;
+		}
+		EntryMap::const_iterator it = entryDir.entries.find(
+			lowerCaseString(std::string(start, end - start)));
+
+		if (it == entryDir.entries.end())
+		{
+			m_notFoundCount++;
+			return FRNotFound;
+		}
+		dirPath += '/';
+		dirPath += it->second;
+		if (*end == 0)
+		{
+			path = dirPath;
+			m_foundCount++;
+			return FRFound;
+		}
+		start = end + 1;
+	}
+}
+
+// Makes every directory get checked for changes the next time it is used.
+// Directories whose modification time has changed get read again.
+void LDLFileIndex::revalidate(void)
+{
+	m_generation++;
+}
+
+void LDLFileIndex::clear(void)
+{
+	if (m_lookupCount > 0)
+	{
+		debugPrintf("File index: %d lookups, %d found, %d ruled out without "
+			"opening, %d directories read.\n", m_lookupCount, m_foundCount,
+			m_notFoundCount, m_directoryReadCount);
+	}
+	m_directories.clear();
+	m_lookupCount = 0;
+	m_foundCount = 0;
+	m_notFoundCount = 0;
+	m_directoryReadCount = 0;
+}
+
+LDLFileIndex::Directory &LDLFileIndex::directory(const std::string &path)
+{
+	DirectoryMap::iterator it = m_directories.find(path);
+
+	if (it != m_directories.end() && it->second.generation == m_generation)
+	{
+		return it->second;
+	}
+	time_t mtime = 0;
+	bool readable = statDirectory(path, mtime);
+	bool isNew = it == m_directories.end();
+	Directory &dir = m_directories[path];
+
+	if (isNew || dir.readable != readable || dir.mtime != mtime)
+	{
+		dir.entries.clear();
+		dir.readable = readable && readDirectory(path, dir.entries);
+		dir.mtime = mtime;
+		if (dir.readable)
+		{
+			m_directoryReadCount++;
+		}
+	}
+	dir.generation = m_generation;
+	return dir;
+}
+
+// NOTE: static function.
+bool LDLFileIndex::statDirectory(const std::string &path, time_t &mtime)
+{
+	struct stat statData;
+
+	if (stat(path.c_str(), &statData) == 0 &&
+		(statData.st_mode & S_IFDIR) != 0)
+	{
+		mtime = statData.st_mtime;
+		return true;
+	}
+	return false;
+}
+
+// NOTE: static function.
+bool LDLFileIndex::readDirectory(const std::string &path, EntryMap &entries)
+{
+	StringVector names;
+
+	if (!listDirectory(path, names))
+	{
+		return false;
+	}
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		addEntry(entries, names[i].c_str());
+	}
+	return true;
+}
+
+// NOTE: static function.
+bool LDLFileIndex::listDirectory(const std::string &path, StringVector &names)
+{
+#ifdef WIN32
+	std::wstring findString;
+	std::string name;
+	WIN32_FIND_DATAW findData;
+	HANDLE hFind;
+
+	utf8towstring(findString, path + "\\*");
+	hFind = FindFirstFileW(findString.c_str(), &findData);
+	if (hFind == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	do
+	{
+		wstringtoutf8(name, findData.cFileName);
+		names.push_back(name);
+	} while (FindNextFileW(hFind, &findData));
+	FindClose(hFind);
+	return true;
+#else // WIN32
+	DIR *pDir = opendir(path.c_str());
+	dirent *de;
+
+	if (pDir == NULL)
+	{
+		return false;
+	}
+	while ((de = readdir(pDir)) != NULL)
+	{
+		names.push_back(de->d_name);
+	}
+	closedir(pDir);
+	return true;
+#endif // !WIN32
+}
+
+// If two names in a directory only differ in case, the all lower-case one
+// wins, since that is the one LDLModel::openFile tries first.
+// NOTE: static function.
+void LDLFileIndex::addEntry(EntryMap &entries, const char *name)
+{
+	std::string lowerName = lowerCaseString(name);
+	EntryMap::iterator it = entries.find(lowerName);
+
+	if (it == entries.end())
+	{
+		entries[lowerName] = name;
+	}
+	else if (lowerName == name)
+	{
+		it->second = name;
+	}
+}
@@ -0,0 +1,74 @@
+#ifndef __LDLFILEINDEX_H__
+#define __LDLFILEINDEX_H__
+
+#include <TCFoundation/TCObject.h>
+#include <TCFoundation/TCStlIncludes.h>
+#include <time.h>
+
+#ifdef USE_CPP11
+#include <unordered_map>
+#endif // USE_CPP11
+
+// Case-insensitive index of the files in the directories on the LDraw search
+// path.  Each directory is read once, the first time a file inside it is
+// looked up, so that files that aren't there can be ruled out without trying
+// to open them, and files that are there can be opened with their real case
+// on the first try.
+class LDLFileIndex : public TCObject
+{
+public:
+	enum FindResult
+	{
+		FRNotIndexed,	// The directory couldn't be read; try opening the file.
+		FRNotFound,
+		FRFound
+	};
+
+	LDLFileIndex(void);
+	FindResult findFile(const char *dir, const char *name, std::string &path);
+	void revalidate(void);
+	void clear(void);
+	int getLookupCount(void) const { return m_lookupCount; }
+	int getFoundCount(void) const { return m_foundCount; }
+	// Lookups that were answered without any attempt to open the file.
+	int getNotFoundCount(void) const { return m_notFoundCount; }
+	int getDirectoryReadCount(void) const { return m_directoryReadCount; }
+	// Adds the names of all the entries in the directory at path to names.
+	static bool listDirectory(const std::string &path, StringVector &names);
+protected:
+#ifdef USE_CPP11
+	typedef std::unordered_map<std::string, std::string> EntryMap;
+#else // USE_CPP11
+	typedef std::map<std::string, std::string> EntryMap;
+#endif // !USE_CPP11
+	struct Directory
+	{
+		bool readable;
+		time_t mtime;
+		int generation;
+		// Lower-case name -> real name, for both files and subdirectories.
+		EntryMap entries;
+	};
+#ifdef USE_CPP11
+	typedef std::unordered_map<std::string, Directory> DirectoryMap;
+#else // USE_CPP11
+	typedef std::map<std::string, Directory> DirectoryMap;
+#endif // !USE_CPP11
+
+	virtual ~LDLFileIndex(void);
+	virtual void dealloc(void);
+	Directory &directory(const std::string &path);
+
+	static bool statDirectory(const std::string &path, time_t &mtime);
+	static bool readDirectory(const std::string &path, EntryMap &entries);
+	static void addEntry(EntryMap &entries, const char *name);
+
+	DirectoryMap m_directories;
+	int m_generation;
+	int m_lookupCount;
+	int m_foundCount;
+	int m_notFoundCount;
+	int m_directoryReadCount;
+};
+
+#endif // __LDLFILEINDEX_H__
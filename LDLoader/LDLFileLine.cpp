@@ -23,10 +23,13 @@
 #endif // WIN32
 
 LDLFileLine::LDLFileLine(LDLModel *parentModel, const char *line,
-						 int lineNumber, const char *originalLine)
+						 int lineNumber, const char *originalLine,
+						 LDLLineArena *arena)
 	:m_parentModel(parentModel),
-	m_line(copyString(line)),
-	m_originalLine(copyString(originalLine)),
+	m_arena(arena),
+	m_line(arena ? arena->copyString(line) : copyString(line)),
+	m_originalLine(arena ? arena->copyString(originalLine) :
+		copyString(originalLine)),
 	m_formattedLine(NULL),
 	m_lineNumber(lineNumber),
 	m_error(NULL),
@@ -39,6 +42,7 @@ LDLFileLine::LDLFileLine(LDLModel *parentModel, const char *line,
 
 LDLFileLine::LDLFileLine(const LDLFileLine &other)
 	:m_parentModel(other.m_parentModel),
+	m_arena(NULL),
 	m_line(copyString(other.m_line)),
 	m_originalLine(copyString(other.m_originalLine)),
 	m_formattedLine(NULL),
@@ -57,13 +61,37 @@ LDLFileLine::~LDLFileLine(void)
 
 void LDLFileLine::dealloc(void)
 {
-	delete[] m_line;
-	delete[] m_originalLine;
+	if (m_arena == NULL)
+	{
+		delete[] m_line;
+		delete[] m_originalLine;
+	}
 	delete[] m_formattedLine;
 	TCObject::release(m_error);
 	TCObject::release(m_texmapImage);
 	m_error = NULL;
-	TCObject::dealloc();
+	if (m_arena != NULL)
+	{
+		LDLLineArena *arena = m_arena;
+
+		// The memory belongs to the arena, so all that is left to do is run
+		// the destructor.
+		this->~LDLFileLine();
+		arena->lineFreed();
+	}
+	else
+	{
+		TCObject::dealloc();
+	}
+}
+
+void LDLFileLine::forgetLine(void)
+{
+	if (m_arena == NULL)
+	{
+		delete[] m_line;
+	}
+	m_line = NULL;
 }
 
 LDLFileLine::operator const char *(void) const
@@ -110,13 +138,184 @@ int LDLFileLine::scanLineType(const char *line)
 {
 	int num;
 
-	if (sscanf(line, "%d", &num) == 1)
+	if (scanInteger(line, num, false))
 	{
 		return num;
 	}
 	return -1;
 }
 
+// Returns true if character is white space in the "C" locale, which is what
+// LDLMainModel sets LC_NUMERIC to.
+// NOTE: static function.
+bool LDLFileLine::isScanSpace(char character)
+{
+	return character == ' ' || (character >= '\t' && character <= '\r');
+}
+
+// Scans an integer from text the same way sscanf's %d (or %i, if detectBase
+// is true) does, and advances text past it.  Plain decimal numbers (which is
+// all LDraw files normally contain) are handled here; anything else, like
+// octal or hex numbers, numbers that could overflow, or numbers with other
+// characters directly after them, is passed on to sscanf itself, so that the
+// result is always the same.
+// NOTE: static function.
+bool LDLFileLine::scanInteger(const char *&text, int &value, bool detectBase)
+{
+	const char *spot = text;
+	bool negative = false;
+	int digitCount = 0;
+	int result = 0;
+
+	while (isScanSpace(*spot))
+	{
+		spot++;
+	}
+	if (*spot == '-' || *spot == '+')
+	{
+		negative = *spot == '-';
+		spot++;
+	}
+	if (!detectBase || spot[0] != '0' || spot[1] == 0 || isScanSpace(spot[1]))
+	{
+		while (*spot >= '0' && *spot <= '9' && digitCount < 10)
+		{
+			result = result * 10 + (*spot - '0');
+			digitCount++;
+			spot++;
+		}
+		if (digitCount > 0 && digitCount < 10 &&
+			(*spot == 0 || isScanSpace(*spot)))
+		{
+			value = negative ? -result : result;
+			text = spot;
+			return true;
+		}
+	}
+	int offset;
+
+	if (sscanf(text, detectBase ? "%i%n" : "%d%n", &value, &offset) == 1)
+	{
+		text += offset;
+		return true;
+	}
+	return false;
+}
+
+// Scans a floating point number from text the same way sscanf's %f does, and
+// advances text past it.  Numbers with up to 9 significant digits and a
+// small decimal exponent are converted here with a single float multiply or
+// divide by an exact power of ten, which (like sscanf) gives the correctly
+// rounded result.  Anything else is passed on to sscanf.
+// NOTE: static function.
+bool LDLFileLine::scanFloat(const char *&text, float &value)
+{
+	static const float powersOf10[] =
+	{
+		1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+	};
+	const char *spot = text;
+	bool negative = false;
+	bool haveDigits = false;
+	int digitCount = 0;
+	int exponent = 0;
+	TCULong mantissa = 0;
+
+	while (isScanSpace(*spot))
+	{
+		spot++;
+	}
+	if (*spot == '-' || *spot == '+')
+	{
+		negative = *spot == '-';
+		spot++;
+	}
+	for (bool fraction = false; ; spot++)
+	{
+		if (*spot >= '0' && *spot <= '9')
+		{
+			haveDigits = true;
+			if (mantissa != 0 || *spot != '0')
+			{
+				mantissa = mantissa * 10 + (*spot - '0');
+				digitCount++;
+			}
+			if (fraction)
+			{
+				exponent--;
+			}
+			if (digitCount > 9)
+			{
+				break;
+			}
+		}
+		else if (*spot == '.' && !fraction)
+		{
+			fraction = true;
+		}
+		else
+		{
+			break;
+		}
+	}
+	if (haveDigits && digitCount <= 9 && (*spot == 'e' || *spot == 'E'))
+	{
+		const char *exponentSpot = spot + 1;
+		bool negativeExponent = false;
+		int exponentValue = 0;
+		int exponentDigits = 0;
+
+		if (*exponentSpot == '-' || *exponentSpot == '+')
+		{
+			negativeExponent = *exponentSpot == '-';
+			exponentSpot++;
+		}
+		while (*exponentSpot >= '0' && *exponentSpot <= '9' &&
+			exponentDigits < 4)
+		{
+			exponentValue = exponentValue * 10 + (*exponentSpot - '0');
+			exponentDigits++;
+			exponentSpot++;
+		}
+		if (exponentDigits > 0)
+		{
+			exponent += negativeExponent ? -exponentValue : exponentValue;
+			spot = exponentSpot;
+		}
+		else
+		{
+			// Let sscanf deal with it.
+			haveDigits = false;
+		}
+	}
+	if (haveDigits && digitCount <= 9 && (*spot == 0 || isScanSpace(*spot)) &&
+		mantissa <= (1 << 24) &&
+		(mantissa == 0 || (exponent >= -10 && exponent <= 10)))
+	{
+		float result = (float)mantissa;
+
+		if (mantissa != 0 && exponent < 0)
+		{
+			result /= powersOf10[-exponent];
+		}
+		else if (mantissa != 0 && exponent > 0)
+		{
+			result *= powersOf10[exponent];
+		}
+		value = negative ? -result : result;
+		text = spot;
+		return true;
+	}
+	int offset;
+
+	if (sscanf(text, "%f%n", &value, &offset) == 1)
+	{
+		text += offset;
+		return true;
+	}
+	return false;
+}
+
 bool LDLFileLine::lineIsEmpty(const char *line)
 {
 	while (line[0])
@@ -132,47 +331,107 @@ bool LDLFileLine::lineIsEmpty(const char *line)
 	return true;
 }
 
-LDLFileLine *LDLFileLine::initFileLine(
-	LDLModel *parentModel,
-	const char *line,
-	int lineNumber,
-	const char *originalLine /*= NULL*/)
+// NOTE: static function.
+LDLLineType LDLFileLine::lineTypeForLine(const char *line)
 {
 	if (strlen(line))
 	{
 		switch (scanLineType(line))
 		{
 		case 0:
-			return new LDLCommentLine(parentModel, line, lineNumber,
-				originalLine);
-			break;
+			return LDLLineTypeComment;
 		case 1:
-			return new LDLModelLine(parentModel, line, lineNumber,
-				originalLine);
-			break;
+			return LDLLineTypeModel;
 		case 2:
-			return new LDLLineLine(parentModel, line, lineNumber, originalLine);
-			break;
+			return LDLLineTypeLine;
 		case 3:
-			return new LDLTriangleLine(parentModel, line, lineNumber,
-				originalLine);
-			break;
+			return LDLLineTypeTriangle;
 		case 4:
-			return new LDLQuadLine(parentModel, line, lineNumber,
-				originalLine);
-			break;
+			return LDLLineTypeQuad;
 		case 5:
-			return new LDLConditionalLineLine(parentModel, line, lineNumber,
-				originalLine);
-			break;
+			return LDLLineTypeConditionalLine;
 		}
 	}
 	if (lineIsEmpty(line))
 	{
-		return new LDLEmptyLine(parentModel, line, lineNumber, originalLine);
+		return LDLLineTypeEmpty;
 	}
 	else
 	{
+		return LDLLineTypeUnknown;
+	}
+}
+
+LDLFileLine *LDLFileLine::initFileLine(
+	LDLModel *parentModel,
+	const char *line,
+	int lineNumber,
+	const char *originalLine /*= NULL*/,
+	LDLLineArena *arena /*= NULL*/)
+{
+	return initFileLine(parentModel, line, lineNumber, lineTypeForLine(line),
+		originalLine, arena);
+}
+
+// Creates a file line of a type that is already known (for example, from the
+// compiled copy of a file in the library cache).
+LDLFileLine *LDLFileLine::initFileLine(
+	LDLModel *parentModel,
+	const char *line,
+	int lineNumber,
+	LDLLineType lineType,
+	const char *originalLine /*= NULL*/,
+	LDLLineArena *arena /*= NULL*/)
+{
+	if (arena != NULL)
+	{
+		switch (lineType)
+		{
+		case LDLLineTypeComment:
+			return newArenaLine<LDLCommentLine>(parentModel, line, lineNumber,
+				originalLine, arena);
+		case LDLLineTypeModel:
+			return newArenaLine<LDLModelLine>(parentModel, line, lineNumber,
+				originalLine, arena);
+		case LDLLineTypeLine:
+			return newArenaLine<LDLLineLine>(parentModel, line, lineNumber,
+				originalLine, arena);
+		case LDLLineTypeTriangle:
+			return newArenaLine<LDLTriangleLine>(parentModel, line,
+				lineNumber, originalLine, arena);
+		case LDLLineTypeQuad:
+			return newArenaLine<LDLQuadLine>(parentModel, line, lineNumber,
+				originalLine, arena);
+		case LDLLineTypeConditionalLine:
+			return newArenaLine<LDLConditionalLineLine>(parentModel, line,
+				lineNumber, originalLine, arena);
+		case LDLLineTypeEmpty:
+			return newArenaLine<LDLEmptyLine>(parentModel, line, lineNumber,
+				originalLine, arena);
+		default:
+			return newArenaLine<LDLUnknownLine>(parentModel, line, lineNumber,
+				NULL, arena);
+		}
+	}
+	switch (lineType)
+	{
+	case LDLLineTypeComment:
+		return new LDLCommentLine(parentModel, line, lineNumber, originalLine);
+	case LDLLineTypeModel:
+		return new LDLModelLine(parentModel, line, lineNumber, originalLine);
+	case LDLLineTypeLine:
+		return new LDLLineLine(parentModel, line, lineNumber, originalLine);
+	case LDLLineTypeTriangle:
+		return new LDLTriangleLine(parentModel, line, lineNumber,
+			originalLine);
+	case LDLLineTypeQuad:
+		return new LDLQuadLine(parentModel, line, lineNumber, originalLine);
+	case LDLLineTypeConditionalLine:
+		return new LDLConditionalLineLine(parentModel, line, lineNumber,
+			originalLine);
+	case LDLLineTypeEmpty:
+		return new LDLEmptyLine(parentModel, line, lineNumber, originalLine);
+	default:
 		return new LDLUnknownLine(parentModel, line, lineNumber);
 	}
 }
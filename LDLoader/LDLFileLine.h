@@ -3,10 +3,12 @@
 
 #include <TCFoundation/TCObject.h>
 #include <LDLoader/LDLError.h>
+#include <LDLoader/LDLLineArena.h>
 #include <TCFoundation/TCTypedObjectArray.h>
 #include <TCFoundation/TCStlIncludes.h>
 #include <TCFoundation/TCVector.h>
 #include <stdarg.h>
+#include <new>
 
 // The following is needed in order to declare the array below (which is used
 // in the definition of LDLFileLine itself).
@@ -62,7 +64,7 @@ public:
 	virtual bool isValid(void) const { return m_valid; }
 	virtual bool isReplaced(void) const { return m_replaced; }
 	virtual void setReplaced(bool value) { m_replaced = value; }
-	virtual void forgetLine(void) { delete[] m_line; m_line = NULL; }
+	virtual void forgetLine(void);
 	virtual LDLFileLineArray *getReplacementLines(void);
 	virtual bool isXZPlanar(void) const;
 	virtual bool isXZPlanar(const TCFloat *matrix) const;
@@ -82,10 +84,15 @@ public:
 	void setParentModel(LDLModel *value);
 
 	static LDLFileLine *initFileLine(LDLModel *parentModel, const char *line,
-		int lineNumber, const char *originalLine = NULL);
+		int lineNumber, const char *originalLine = NULL,
+		LDLLineArena *arena = NULL);
+	static LDLFileLine *initFileLine(LDLModel *parentModel, const char *line,
+		int lineNumber, LDLLineType lineType, const char *originalLine = NULL,
+		LDLLineArena *arena = NULL);
+	static LDLLineType lineTypeForLine(const char *line);
 protected:
 	LDLFileLine(LDLModel *parentModel, const char *line, int lineNumber,
-		const char *originalLine = NULL);
+		const char *originalLine = NULL, LDLLineArena *arena = NULL);
 	LDLFileLine(const LDLFileLine &other);
 	virtual ~LDLFileLine(void);
 	virtual void dealloc(void);
@@ -97,11 +104,30 @@ protected:
 
 	static bool lineIsEmpty(const char *line);
 	static int scanLineType(const char *line);
+	static bool scanInteger(const char *&text, int &value, bool detectBase);
+	static bool scanFloat(const char *&text, float &value);
+	static bool isScanSpace(char character);
+
+	// This is defined here instead of in the .cpp file so that the debug
+	// version of new that the .cpp files use on Windows doesn't get in the
+	// way of placement new.
+	template <class _Line> static _Line *newArenaLine(LDLModel *parentModel,
+		const char *line, int lineNumber, const char *originalLine,
+		LDLLineArena *arena)
+	{
+		_Line *fileLine = new (arena->allocate(sizeof(_Line)))
+			_Line(parentModel, line, lineNumber, originalLine, arena);
+
+		arena->lineAllocated();
+		return fileLine;
+	}
 
 	LDLModel *m_parentModel;
+	// If this is set, this line and its text live in the arena.
+	LDLLineArena *m_arena;
 	char *m_line;
 	char *m_originalLine;
-	char *m_formattedLine;
+	mutable char *m_formattedLine;
 	int m_lineNumber;
 	LDLError *m_error;
 	bool m_valid;
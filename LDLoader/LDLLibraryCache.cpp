@@ -0,0 +1,469 @@
+#include "LDLLibraryCache.h"
+#include "LDLActionLine.h"
+#include <TCFoundation/mystring.h>
+#include <TCFoundation/TCTypedObjectArray.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else // WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif // WIN32
+
+#ifdef WIN32
+#if defined(_MSC_VER) && _MSC_VER >= 1400 && defined(_DEBUG)
+#define new DEBUG_CLIENTBLOCK
+#endif // _DEBUG
+#endif // WIN32
+
+#define LDL_LIBRARY_CACHE_MAGIC "LDVLIBC"
+#define LDL_LIBRARY_CACHE_VERSION 1
+#define LDL_LIBRARY_CACHE_BYTE_ORDER 0x01020304
+
+// The cache file starts with this header.  The compiled files follow it, each
+// starting on an 8-byte boundary, and the index of them comes last.
+struct LDLLibraryCacheHeader
+{
+	char magic[8];
+	TCULong version;
+	TCULong byteOrder;
+	TCULong fileCount;
+	TCULong reserved;
+	long long indexOffset;
+};
+
+// Each index entry is followed by the NUL-terminated path of the file it is
+// for, padded to an 8-byte boundary.
+struct LDLLibraryCacheIndexEntry
+{
+	long long offset;
+	long long length;
+	long long mtime;
+	long long size;
+	TCULong lineCount;
+	TCULong pathLength;
+};
+
+LDLLibraryCache::LDLLibraryCache(const char *filename)
+	:m_filename(filename),
+	m_mappedData(NULL),
+	m_mappedSize(0),
+	m_dirty(false)
+{
+#ifdef _LEAK_DEBUG
+	strcpy(className, "LDLLibraryCache");
+#endif
+	if (map() && !readIndex())
+	{
+		debugPrintf("Ignoring invalid library cache %s.\n", filename);
+		m_files.clear();
+		unmap();
+	}
+}
+
+LDLLibraryCache::~LDLLibraryCache(void)
+{
+}
+
+void LDLLibraryCache::dealloc(void)
+{
+	unmap();
+	TCObject::dealloc();
+}
+
+bool LDLLibraryCache::map(void)
+{
+	size_t size;
+	void *data;
+
+#ifdef WIN32
+	HANDLE fileHandle = CreateFileA(m_filename.c_str(), GENERIC_READ,
+		FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	LARGE_INTEGER fileSize;
+	HANDLE mappingHandle;
+
+	if (fileHandle == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	if (!GetFileSizeEx(fileHandle, &fileSize) ||
+		fileSize.QuadPart < (LONGLONG)sizeof(LDLLibraryCacheHeader))
+	{
+		CloseHandle(fileHandle);
+		return false;
+	}
+	size = (size_t)fileSize.QuadPart;
+	mappingHandle = CreateFileMapping(fileHandle, NULL, PAGE_READONLY, 0, 0,
+		NULL);
+	CloseHandle(fileHandle);
+	if (mappingHandle == NULL)
+	{
+		return false;
+	}
+	// The view keeps the mapping alive after its handle is closed.
+	data = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mappingHandle);
+	if (data == NULL)
+	{
+		return false;
+	}
+#else // WIN32
+	int fd = open(m_filename.c_str(), O_RDONLY);
+	struct stat statData;
+
+	if (fd == -1)
+	{
+		return false;
+	}
+	if (fstat(fd, &statData) != 0 ||
+		statData.st_size < (off_t)sizeof(LDLLibraryCacheHeader))
+	{
+		close(fd);
+		return false;
+	}
+	size = (size_t)statData.st_size;
+	data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		return false;
+	}
+#endif // WIN32
+	m_mappedData = (const char *)data;
+	m_mappedSize = size;
+	return true;
+}
+
+void LDLLibraryCache::unmap(void)
+{
+	if (m_mappedData != NULL)
+	{
+#ifdef WIN32
+		UnmapViewOfFile(m_mappedData);
+#else // WIN32
+		munmap((void *)m_mappedData, m_mappedSize);
+#endif // WIN32
+		m_mappedData = NULL;
+		m_mappedSize = 0;
+	}
+}
+
+bool LDLLibraryCache::readIndex(void)
+{
+	const LDLLibraryCacheHeader *header =
+		(const LDLLibraryCacheHeader *)m_mappedData;
+	size_t offset;
+	TCULong i;
+
+	if (memcmp(header->magic, LDL_LIBRARY_CACHE_MAGIC,
+		sizeof(header->magic)) != 0 ||
+		header->version != LDL_LIBRARY_CACHE_VERSION ||
+		header->byteOrder != LDL_LIBRARY_CACHE_BYTE_ORDER ||
+		header->indexOffset < (long long)sizeof(LDLLibraryCacheHeader) ||
+		header->indexOffset > (long long)m_mappedSize)
+	{
+		return false;
+	}
+	offset = (size_t)header->indexOffset;
+	for (i = 0; i < header->fileCount; i++)
+	{
+		const LDLLibraryCacheIndexEntry *indexEntry;
+		const char *path;
+		FileEntry fileEntry;
+
+		if (offset + sizeof(LDLLibraryCacheIndexEntry) > m_mappedSize)
+		{
+			return false;
+		}
+		indexEntry = (const LDLLibraryCacheIndexEntry *)&m_mappedData[offset];
+		offset += sizeof(LDLLibraryCacheIndexEntry);
+		path = &m_mappedData[offset];
+		if (offset + indexEntry->pathLength + 1 > m_mappedSize ||
+			path[indexEntry->pathLength] != 0 ||
+			indexEntry->offset < (long long)sizeof(LDLLibraryCacheHeader) ||
+			indexEntry->offset % 4 != 0 ||
+			indexEntry->length < 0 ||
+			indexEntry->lineCount > (TCULong)INT_MAX ||
+			indexEntry->offset + indexEntry->length > header->indexOffset)
+		{
+			return false;
+		}
+		offset += (indexEntry->pathLength + 1 + 7) & ~7;
+		fileEntry.data = &m_mappedData[indexEntry->offset];
+		fileEntry.length = indexEntry->length;
+		fileEntry.mtime = (time_t)indexEntry->mtime;
+		fileEntry.size = indexEntry->size;
+		fileEntry.lineCount = (int)indexEntry->lineCount;
+		fileEntry.checked = false;
+		m_files[path] = fileEntry;
+	}
+	return true;
+}
+
+// Returns the first compiled line of the file at path, or NULL if the cache
+// doesn't have an up to date copy of that file.
+const LDLCompiledLine *LDLLibraryCache::findFile(
+	const char *path,
+	time_t mtime,
+	long long size,
+	int &lineCount)
+{
+	FileEntryMap::iterator it = m_files.find(path);
+
+	if (it == m_files.end())
+	{
+		return NULL;
+	}
+	if (it->second.mtime != mtime || it->second.size != size)
+	{
+		// The file has changed since it was compiled.  Drop it; the caller
+		// will read the text and add the new version.
+		m_compiledData.erase(it->first);
+		m_files.erase(it);
+		m_dirty = true;
+		return NULL;
+	}
+	if (!it->second.checked)
+	{
+		if (!checkLines(it->second.data, it->second.length,
+			it->second.lineCount))
+		{
+			// The cache file is corrupt (or truncated).  Treat this the same
+			// as a changed file.
+			debugPrintf("Ignoring invalid library cache entry for %s.\n",
+				path);
+			m_compiledData.erase(it->first);
+			m_files.erase(it);
+			m_dirty = true;
+			return NULL;
+		}
+		it->second.checked = true;
+	}
+	lineCount = it->second.lineCount;
+	return (const LDLCompiledLine *)it->second.data;
+}
+
+// Returns true if the lineCount compiled lines in data are all valid and fit
+// inside length bytes, so that nextLine, getValues, and getText can walk them
+// without any further checks.
+// NOTE: static function.
+bool LDLLibraryCache::checkLines(
+	const char *data,
+	long long length,
+	int lineCount)
+{
+	long long offset = 0;
+
+	if (lineCount < 0 ||
+		(long long)lineCount * (long long)sizeof(LDLCompiledLine) > length)
+	{
+		return false;
+	}
+	for (int i = 0; i < lineCount; i++)
+	{
+		const LDLCompiledLine *compiledLine;
+		long long textOffset;
+
+		if (offset + (long long)sizeof(LDLCompiledLine) > length)
+		{
+			return false;
+		}
+		compiledLine = (const LDLCompiledLine *)&data[offset];
+		if (compiledLine->lineType < LDLLineTypeComment ||
+			compiledLine->lineType > LDLLineTypeUnknown)
+		{
+			return false;
+		}
+		if (compiledLine->valueCount != 0 &&
+			(int)compiledLine->valueCount !=
+			LDLActionLine::valueCountForLineType(
+			(LDLLineType)compiledLine->lineType))
+		{
+			return false;
+		}
+		textOffset = offset + (long long)sizeof(LDLCompiledLine) +
+			(long long)compiledLine->valueCount * (long long)sizeof(float);
+		if (textOffset + (long long)compiledLine->textLength + 1 > length ||
+			data[textOffset + compiledLine->textLength] != 0 ||
+			memchr(&data[textOffset], 0, compiledLine->textLength) != NULL)
+		{
+			return false;
+		}
+		offset = (textOffset + compiledLine->textLength + 1 + 3) & ~3;
+	}
+	return offset <= length;
+}
+
+// NOTE: static function.
+const LDLCompiledLine *LDLLibraryCache::nextLine(
+	const LDLCompiledLine *compiledLine)
+{
+	size_t length = getText(compiledLine) - (const char *)compiledLine +
+		compiledLine->textLength + 1;
+
+	length = (length + 3) & ~3;
+	return (const LDLCompiledLine *)((const char *)compiledLine + length);
+}
+
+// Compiles the lines that were just read from the file at path, and adds them
+// to the cache.  They get written to disk the next time save() is called.
+void LDLLibraryCache::addFile(
+	const char *path,
+	time_t mtime,
+	long long size,
+	LDLFileLineArray *fileLines)
+{
+	std::string &data = m_compiledData[path];
+	int count = fileLines->getCount();
+	FileEntry fileEntry;
+	int i;
+
+	data.clear();
+	for (i = 0; i < count; i++)
+	{
+		compileLine(data, (*fileLines)[i]);
+	}
+	fileEntry.data = data.data();
+	fileEntry.length = (long long)data.size();
+	fileEntry.mtime = mtime;
+	fileEntry.size = size;
+	fileEntry.lineCount = count;
+	fileEntry.checked = true;
+	m_files[path] = fileEntry;
+	m_dirty = true;
+}
+
+// NOTE: static function.
+void LDLLibraryCache::padData(std::string &data, size_t alignment)
+{
+	size_t remainder = data.size() % alignment;
+
+	if (remainder != 0)
+	{
+		data.append(alignment - remainder, 0);
+	}
+}
+
+// NOTE: static function.
+void LDLLibraryCache::compileLine(std::string &data, LDLFileLine *fileLine)
+{
+	LDLCompiledLine compiledLine;
+	const char *text = fileLine->getLine();
+	float values[12];
+	int colorNumber;
+	int valueCount =
+		LDLActionLine::valueCountForLineType(fileLine->getLineType());
+
+	if (text == NULL)
+	{
+		text = "";
+	}
+	compiledLine.lineType = fileLine->getLineType();
+	compiledLine.colorNumber = 0;
+	compiledLine.valueCount = 0;
+	compiledLine.textLength = (TCULong)strlen(text);
+	if (valueCount > 0 &&
+		LDLActionLine::scanValues(text, colorNumber, values, valueCount))
+	{
+		compiledLine.colorNumber = colorNumber;
+		compiledLine.valueCount = valueCount;
+	}
+	data.append((const char *)&compiledLine, sizeof(compiledLine));
+	data.append((const char *)values,
+		compiledLine.valueCount * sizeof(float));
+	data.append(text, compiledLine.textLength + 1);
+	padData(data, 4);
+}
+
+// Writes the cache file if anything was added to or dropped from the cache
+// since it was loaded.  The new file is written next to the old one and then
+// renamed over it.  The temporary file's name includes the process ID, since
+// several processes can be sharing the same cache.
+bool LDLLibraryCache::save(void)
+{
+	LDLLibraryCacheHeader header;
+	std::string image(sizeof(header), 0);
+	std::string index;
+	std::string tempFilename;
+	char pidString[32];
+	FILE *file;
+	bool ok;
+
+	if (!m_dirty)
+	{
+		return true;
+	}
+#ifdef WIN32
+	sprintf(pidString, ".%lu.tmp", (unsigned long)GetCurrentProcessId());
+#else // WIN32
+	sprintf(pidString, ".%lu.tmp", (unsigned long)getpid());
+#endif // WIN32
+	tempFilename = m_filename + pidString;
+	for (FileEntryMap::const_iterator it = m_files.begin();
+		it != m_files.end(); ++it)
+	{
+		const FileEntry &fileEntry = it->second;
+		LDLLibraryCacheIndexEntry indexEntry;
+
+		padData(image, 8);
+		indexEntry.offset = (long long)image.size();
+		indexEntry.length = fileEntry.length;
+		indexEntry.mtime = (long long)fileEntry.mtime;
+		indexEntry.size = fileEntry.size;
+		indexEntry.lineCount = (TCULong)fileEntry.lineCount;
+		indexEntry.pathLength = (TCULong)it->first.size();
+		image.append(fileEntry.data, (size_t)fileEntry.length);
+		index.append((const char *)&indexEntry, sizeof(indexEntry));
+		index.append(it->first.c_str(), it->first.size() + 1);
+		padData(index, 8);
+	}
+	padData(image, 8);
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, LDL_LIBRARY_CACHE_MAGIC, sizeof(header.magic));
+	header.version = LDL_LIBRARY_CACHE_VERSION;
+	header.byteOrder = LDL_LIBRARY_CACHE_BYTE_ORDER;
+	header.fileCount = (TCULong)m_files.size();
+	header.indexOffset = (long long)image.size();
+	memcpy(&image[0], &header, sizeof(header));
+	image += index;
+	file = ucfopen(tempFilename.c_str(), "wb");
+	if (file == NULL)
+	{
+		debugPrintf("Error creating library cache %s.\n",
+			tempFilename.c_str());
+		return false;
+	}
+	ok = fwrite(image.data(), image.size(), 1, file) == 1;
+	ok = fclose(file) == 0 && ok;
+	if (!ok)
+	{
+		remove(tempFilename.c_str());
+		return false;
+	}
+	// Everything in m_files has been copied into image, so the old mapping
+	// can go away.  (On Windows, the file can't be replaced while it's
+	// mapped.)
+	m_files.clear();
+	m_compiledData.clear();
+	unmap();
+#ifdef WIN32
+	remove(m_filename.c_str());
+#endif // WIN32
+	ok = rename(tempFilename.c_str(), m_filename.c_str()) == 0;
+	if (!ok)
+	{
+		remove(tempFilename.c_str());
+	}
+	if (map() && !readIndex())
+	{
+		m_files.clear();
+		unmap();
+	}
+	m_dirty = false;
+	return ok;
+}
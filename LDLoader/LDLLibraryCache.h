@@ -0,0 +1,81 @@
+#ifndef __LDLLIBRARYCACHE_H__
+#define __LDLLIBRARYCACHE_H__
+
+#include <TCFoundation/TCObject.h>
+#include <TCFoundation/TCStlIncludes.h>
+#include <LDLoader/LDLFileLine.h>
+#include <time.h>
+
+// One line of a compiled library file.  Each record is followed by valueCount
+// floats, and then by the NUL-terminated text of the line, padded so that the
+// next record starts on a 4-byte boundary.
+struct LDLCompiledLine
+{
+	TCLong lineType;
+	TCLong colorNumber;
+	TCULong valueCount;
+	TCULong textLength;
+};
+
+// On-disk cache of LDraw library files that have already been split into
+// lines and had the numbers in their geometry lines scanned.  The cache file
+// is memory-mapped, and LDLModel::read creates its file lines straight from
+// the mapped records.  Each file's entry is only used while the file's mtime
+// and size still match the ones recorded when it was compiled.
+class LDLLibraryCache : public TCObject
+{
+public:
+	LDLLibraryCache(const char *filename);
+	const char *getFilename(void) const { return m_filename.c_str(); }
+	const LDLCompiledLine *findFile(const char *path, time_t mtime,
+		long long size, int &lineCount);
+	void addFile(const char *path, time_t mtime, long long size,
+		LDLFileLineArray *fileLines);
+	bool save(void);
+
+	static const float *getValues(const LDLCompiledLine *compiledLine)
+	{
+		return (const float *)(compiledLine + 1);
+	}
+	static const char *getText(const LDLCompiledLine *compiledLine)
+	{
+		return (const char *)(getValues(compiledLine) +
+			compiledLine->valueCount);
+	}
+	static const LDLCompiledLine *nextLine(
+		const LDLCompiledLine *compiledLine);
+protected:
+	struct FileEntry
+	{
+		const char *data;
+		long long length;
+		time_t mtime;
+		long long size;
+		int lineCount;
+		// Set once the compiled lines have been checked against the
+		// entry's length.
+		bool checked;
+	};
+	typedef std::map<std::string, FileEntry> FileEntryMap;
+	typedef std::map<std::string, std::string> CompiledDataMap;
+
+	virtual ~LDLLibraryCache(void);
+	virtual void dealloc(void);
+	bool map(void);
+	void unmap(void);
+	bool readIndex(void);
+
+	static bool checkLines(const char *data, long long length, int lineCount);
+
+	static void compileLine(std::string &data, LDLFileLine *fileLine);
+	static void padData(std::string &data, size_t alignment);
+
+	std::string m_filename;
+	FileEntryMap m_files;
+	CompiledDataMap m_compiledData;
+	const char *m_mappedData;
+	size_t m_mappedSize;
+	bool m_dirty;
+};
+
+#endif // __LDLLIBRARYCACHE_H__
@@ -0,0 +1,120 @@
+#include "LDLLineArena.h"
+#include <string.h>
+
+#ifdef WIN32
+#if defined(_MSC_VER) && _MSC_VER >= 1400 && defined(_DEBUG)
+#define new DEBUG_CLIENTBLOCK
+#endif // _DEBUG
+#endif // WIN32
+
+// Most files in the LDraw library are only a few dozen lines long, so the
+// first chunk is small, and each chunk after that is twice as big as the one
+// before it, up to a limit.
+#define FIRST_CHUNK_SIZE 4096
+#define MAX_CHUNK_SIZE (64 * 1024)
+// Everything handed out is aligned to this, which is enough for any of the
+// file line classes.
+#define ARENA_ALIGNMENT 16
+
+LDLLineArena::LDLLineArena(void)
+	: m_spot(NULL)
+	, m_spaceLeft(0)
+	, m_nextChunkSize(FIRST_CHUNK_SIZE)
+	, m_size(0)
+	, m_lineCount(0)
+	, m_closed(false)
+{
+}
+
+LDLLineArena::~LDLLineArena(void)
+{
+	for (size_t i = 0; i < m_chunks.size(); i++)
+	{
+		delete[] m_chunks[i];
+	}
+}
+
+void LDLLineArena::addChunk(size_t minSize)
+{
+	size_t chunkSize = m_nextChunkSize;
+
+	if (chunkSize < minSize + ARENA_ALIGNMENT)
+	{
+		chunkSize = minSize + ARENA_ALIGNMENT;
+	}
+	char *chunk = new char[chunkSize];
+	size_t offset = (ARENA_ALIGNMENT - (size_t)chunk % ARENA_ALIGNMENT) %
+		ARENA_ALIGNMENT;
+
+	m_chunks.push_back(chunk);
+	m_spot = chunk + offset;
+	m_spaceLeft = chunkSize - offset;
+	m_size += chunkSize;
+	if (m_nextChunkSize < MAX_CHUNK_SIZE)
+	{
+		m_nextChunkSize *= 2;
+	}
+}
+
+void *LDLLineArena::allocate(size_t size)
+{
+	size_t padding = (ARENA_ALIGNMENT - (size_t)m_spot % ARENA_ALIGNMENT) %
+		ARENA_ALIGNMENT;
+
+	if (size + padding > m_spaceLeft)
+	{
+		addChunk(size);
+	}
+	else
+	{
+		m_spot += padding;
+		m_spaceLeft -= padding;
+	}
+	void *retValue = m_spot;
+
+	m_spot += size;
+	m_spaceLeft -= size;
+	return retValue;
+}
+
+char *LDLLineArena::copyString(const char *string)
+{
+	if (string == NULL)
+	{
+		return NULL;
+	}
+	size_t length = strlen(string) + 1;
+
+	// Text doesn't need to be aligned, so it is packed in at the end of the
+	// current chunk if it fits there.
+	if (length > m_spaceLeft)
+	{
+		addChunk(length);
+	}
+	char *retValue = m_spot;
+
+	memcpy(retValue, string, length);
+	m_spot += length;
+	m_spaceLeft -= length;
+	return retValue;
+}
+
+void LDLLineArena::lineFreed(void)
+{
+	m_lineCount--;
+	if (m_closed && m_lineCount == 0)
+	{
+		delete this;
+	}
+}
+
+// Called by the model that owns the arena when it is done with it.  The
+// memory goes away right away unless some of the lines are still alive.
+void LDLLineArena::close(void)
+{
+	m_closed = true;
+	if (m_lineCount == 0)
+	{
+		delete this;
+	}
+}
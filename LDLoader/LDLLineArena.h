@@ -0,0 +1,38 @@
+#ifndef __LDLLINEARENA_H__
+#define __LDLLINEARENA_H__
+
+#include <TCFoundation/TCDefines.h>
+#include <TCFoundation/TCStlIncludes.h>
+
+// Block allocator for the file lines of one model and the text of those
+// lines.  Everything is carved out of a few large chunks, which are all freed
+// together once the model has closed the arena and every line allocated from
+// it has been released.  (Lines can outlive their model; the sub-models of an
+// MPD file share their lines with the model that read the file.)
+//
+// An arena is only ever used by one thread at a time: the one reading the
+// model's file.
+class LDLLineArena
+{
+public:
+	LDLLineArena(void);
+	void *allocate(size_t size);
+	char *copyString(const char *string);
+	void lineAllocated(void) { m_lineCount++; }
+	void lineFreed(void);
+	void close(void);
+	size_t getSize(void) const { return m_size; }
+protected:
+	~LDLLineArena(void);
+	void addChunk(size_t minSize);
+
+	std::vector<char *> m_chunks;
+	char *m_spot;
+	size_t m_spaceLeft;
+	size_t m_nextChunkSize;
+	size_t m_size;
+	int m_lineCount;
+	bool m_closed;
+};
+
+#endif // __LDLLINEARENA_H__
@@ -1,7 +1,6 @@
 #include "LDLLineLine.h"
 #include "LDLMainModel.h"
 #include <TCFoundation/TCLocalStrings.h>
-#include <sstream>
 
 #ifdef WIN32
 #if defined(_MSC_VER) && _MSC_VER >= 1400 && defined(_DEBUG)
@@ -10,8 +9,9 @@
 #endif // WIN32
 
 LDLLineLine::LDLLineLine(LDLModel *parentModel, const char *line,
-						 int lineNumber, const char *originalLine)
-	:LDLShapeLine(parentModel, line, lineNumber, originalLine)
+						 int lineNumber, const char *originalLine,
+						 LDLLineArena *arena)
+	:LDLShapeLine(parentModel, line, lineNumber, originalLine, arena)
 {
 }
 
@@ -22,29 +22,14 @@ LDLLineLine::LDLLineLine(const LDLLineLine &other)
 
 bool LDLLineLine::parse(void)
 {
-	float x1, y1, z1;
-	float x2, y2, z2;
-	int lineType;
+	float values[6];
 
-	if (sscanf(m_line, "%d %i %f %f %f %f %f %f", &lineType, &m_colorNumber,
-		&x1, &y1, &z1, &x2, &y2, &z2) == 8)
+	if (readValues(values, 6))
 	{
-		std::string prefix = getTypeAndColorPrefix();
-		std::stringstream ss;
-		if (!prefix.empty())
-		{
-			ss << prefix << "  ";
-		}
-		else
-		{
-			ss << "2 " << m_colorNumber << "  ";
-		}
-		ss << x1 << " " << y1 << " " << z1 << "  ";
-		ss << x2 << " " << y2 << " " << z2 << "  ";
-		m_formattedLine = copyString(ss.str().c_str());
+		m_actionFlags.formatValueCount = 6;
 		m_points = new TCVector[2];
-		m_points[0] = TCVector(x1, y1, z1);
-		m_points[1] = TCVector(x2, y2, z2);
+		m_points[0] = TCVector(values[0], values[1], values[2]);
+		m_points[1] = TCVector(values[3], values[4], values[5]);
 		if (!getMainModel()->getSkipValidation())
 		{
 			getMatchingPoints();
@@ -9,7 +9,8 @@ class LDLLineLine : public LDLShapeLine
 {
 public:
 	LDLLineLine(LDLModel *parentModel, const char *line, int lineNumber,
-		const char *originalLine = NULL);
+		const char *originalLine = NULL,
+		LDLLineArena *arena = NULL);
 	virtual TCObject *copy(void) const;
 	virtual bool parse(void);
 	virtual int getNumPoints(void) const { return 2; }
@@ -1,6 +1,7 @@
 #include "LDLMainModel.h"
 #include "LDLPalette.h"
-#include <TCFoundation/TCDictionary.h>
+#include "LDLFileIndex.h"
+#include <TCFoundation/TCHashDictionary.h>
 #include <TCFoundation/TCStringArray.h>
 #include <stdio.h>
 #include <string.h>
@@ -16,6 +17,15 @@
 #endif // _DEBUG
 #endif // WIN32
 
+#ifdef USE_CPP11
+typedef std::unique_lock<std::mutex> ScopedLock;
+#else
+#ifndef _NO_LDL_THREADS
+#include <boost/bind.hpp>
+typedef boost::mutex::scoped_lock ScopedLock;
+#endif // !_NO_LDL_THREADS
+#endif // !USE_CPP11
+
 LDLMainModel::LDLMainModel(void)
 	:m_alertSender(NULL),
 	m_loadedModels(NULL),
@@ -23,6 +33,17 @@ LDLMainModel::LDLMainModel(void)
 	m_extraSearchDirs(NULL),
 	m_seamWidth(0.0f),
 	m_highlightColorNumber(0x2FFFFFF)
+#if defined(USE_CPP11) || !defined(_NO_LDL_THREADS)
+#ifdef USE_CPP11
+	, m_loaderThreads(NULL)
+#else
+	, m_loaderThreadGroup(NULL)
+#endif
+	, m_loaderMutex(NULL)
+	, m_loaderCondition(NULL)
+	, m_prefetchCondition(NULL)
+	, m_loaderExiting(false)
+#endif // USE_CPP11 || !_NO_LDL_THREADS
 {
 	// We need to use '.' as our decimal separator, no matter what the system
 	// default decimal separator is.
@@ -39,17 +60,18 @@ TCObject *LDLMainModel::copy(void) const
 	return NULL;
 }
 
-TCDictionary *LDLMainModel::getLoadedModels(void)
+TCHashDictionary *LDLMainModel::getLoadedModels(void)
 {
 	if (!m_loadedModels)
 	{
-		m_loadedModels = new TCDictionary(0);
+		m_loadedModels = new TCHashDictionary(false, false);
 	}
 	return m_loadedModels;
 }
 
 void LDLMainModel::dealloc(void)
 {
+	stopLoaderThreads();
 	TCObject::release(m_loadedModels);
 	TCObject::release(m_mainPalette);
 	TCObject::release(m_extraSearchDirs);
@@ -65,13 +87,54 @@ void LDLMainModel::ldrawDirNotFound(void)
 	error->release();
 }
 
+// Records the directories that openSubModelNamed will search, so that cached
+// library files are only reused when their sub-file names still resolve to the
+// same files.  (<MODELDIR> comes first, so this changes with the directory of
+// the main model.)
+void LDLMainModel::updateSearchPath(void)
+{
+	char flagsBuf[32];
+
+	m_searchPath.clear();
+	if (sm_lDrawIni && sm_lDrawIni->nSearchDirs > 0)
+	{
+		for (int i = 0; i < sm_lDrawIni->nSearchDirs; i++)
+		{
+			LDrawSearchDirS *searchDir = &sm_lDrawIni->SearchDirs[i];
+
+			sprintf(flagsBuf, "%d ", searchDir->Flags);
+			m_searchPath += flagsBuf;
+			m_searchPath += searchDir->Dir;
+			m_searchPath += '\n';
+		}
+	}
+	else
+	{
+		m_searchPath += lDrawDir();
+		m_searchPath += '\n';
+	}
+	if (m_extraSearchDirs)
+	{
+		int count = m_extraSearchDirs->getCount();
+
+		for (int i = 0; i < count; i++)
+		{
+			m_searchPath += (*m_extraSearchDirs)[i];
+			m_searchPath += '\n';
+		}
+	}
+}
+
 bool LDLMainModel::load(const char *filename)
 {
 	std::ifstream stream;
 	LDLError *error;
 
 	setFilename(filename);
-	if (TCUserDefaults::boolForKey("VerifyLDrawDir", true, false))
+	// With a library archive mounted, the LDraw directory doesn't have to
+	// exist on disk.
+	if (!haveLibraryArchive() &&
+		TCUserDefaults::boolForKey("VerifyLDrawDir", true, false))
 	{
 		if (!verifyLDrawDir(lDrawDir()))
 		{
@@ -83,15 +146,22 @@ bool LDLMainModel::load(const char *filename)
 	{
 		lDrawDir(); // Initializes sm_lDrawIni
 	}
+	if (sm_fileIndex != NULL)
+	{
+		// Pick up any files that were added or removed since the last load.
+		sm_fileIndex->revalidate();
+	}
 	if (sm_lDrawIni)
 	{
-		LDrawIniComputeRealDirs(sm_lDrawIni, 1, 0, filename);
+		LDrawIniComputeRealDirs(sm_lDrawIni, !haveLibraryArchive(), 0,
+			filename);
 	}
 	if (!strlen(lDrawDir()))
 	{
 		ldrawDirNotFound();
 		return false;
 	}
+	updateSearchPath();
 	m_mainModel = this;
 	if (openStream(filename, stream))
 	{
@@ -101,7 +171,18 @@ bool LDLMainModel::load(const char *filename)
 		{
 			processLDConfig();
 		}
+		openLibraryCache();
+		if (getMultiThreaded())
+		{
+			launchLoaderThreads();
+		}
+		m_mainFlags.loading = true;
 		retValue = LDLModel::load(stream);
+		stopLoaderThreads();
+		m_mainFlags.loading = false;
+		// Write out any library files that got compiled during the load, so
+		// that the next run can use them.
+		saveLibraryCache();
 		if (sm_lDrawIni)
 		{
 			// If bool isn't 1 byte, then the filename case callback won't
@@ -150,7 +231,7 @@ bool LDLMainModel::load(const char *filename)
 		m_ancestorMap.clear();
 		if (getHaveMpdTexmaps())
 		{
-			TCDictionary* subModelDict = getLoadedModels();
+			TCHashDictionary* subModelDict = getLoadedModels();
 			if (subModelDict != NULL)
 			{
 				TCObjectArray *subModels = subModelDict->allObjects();
@@ -179,23 +260,28 @@ void LDLMainModel::processLDConfig(void)
 {
 	std::ifstream configStream;
 	std::string filename;
+	std::string archiveData;
+	bool found = false;
 	if (!m_ldConfig.empty())
 	{
 		// First, check the standard model path
-		if (!openSubModelNamed(m_ldConfig.c_str(), filename, configStream,
-			false))
+		found = openSubModelNamed(m_ldConfig.c_str(), filename, configStream,
+			false, NULL, true, &archiveData);
+		if (!found)
 		{
 			// Next, check the root LDraw dir
 			combinePathParts(filename, lDrawDir(), "/", m_ldConfig);
-			openFile(filename.c_str(), configStream);
+			found = openArchiveFile(filename.c_str(), archiveData) ||
+				openFile(filename.c_str(), configStream);
 		}
 	}
-	if (!configStream.is_open())
+	if (!found)
 	{
 		combinePathParts(filename, lDrawDir(), "/ldconfig.ldr");
-		openFile(filename.c_str(), configStream);
+		found = openArchiveFile(filename.c_str(), archiveData) ||
+			openFile(filename.c_str(), configStream);
 	}
-	if (configStream.is_open())
+	if (found)
 	{
 		configStream.close();
 		subModelNamed(filename.c_str());
@@ -221,10 +307,7 @@ bool LDLMainModel::colorNumberIsTransparent(int colorNumber)
 	}
 	if (m_mainPalette != NULL)
 	{
-		int r, g, b, a;
-
-		m_mainPalette->getRGBA(colorNumber, r, g, b, a);
-		return a < 255;
+		return m_mainPalette->isTransparent(colorNumber);
 	}
 	else
 	{
@@ -245,6 +328,17 @@ void LDLMainModel::getRGBA(int colorNumber, int& r, int& g, int& b, int& a)
 	}
 }
 
+TCULong LDLMainModel::getPackedRGBA(int colorNumber)
+{
+	TCULong rgba = m_mainPalette->getPackedRGBA(colorNumber);
+
+	if (transparencyIsDisabled())
+	{
+		rgba |= 0xFF;
+	}
+	return rgba;
+}
+
 bool LDLMainModel::hasSpecular(int colorNumber)
 {
 	return m_mainPalette->hasSpecular(colorNumber);
@@ -321,3 +415,240 @@ void LDLMainModel::release()
 {
 	LDLModel::release();
 }
+
+int LDLMainModel::getNumLoaderThreads(void)
+{
+#if defined(USE_CPP11) || !defined(_NO_LDL_THREADS)
+#ifdef USE_CPP11
+	int numProcessors = (int)std::thread::hardware_concurrency();
+#else // USE_CPP11
+	int numProcessors = (int)boost::thread::hardware_concurrency();
+#endif // !USE_CPP11
+
+	if (numProcessors > 1)
+	{
+		// The main thread keeps parsing while the loader threads read.
+		return numProcessors - 1;
+	}
+#endif // USE_CPP11 || !_NO_LDL_THREADS
+	return 0;
+}
+
+void LDLMainModel::launchLoaderThreads(void)
+{
+#if defined(USE_CPP11) || !defined(_NO_LDL_THREADS)
+	int loaderThreadCount = getNumLoaderThreads();
+
+	if (m_loaderMutex != NULL || loaderThreadCount == 0)
+	{
+		return;
+	}
+	m_loaderExiting = false;
+#ifdef USE_CPP11
+	m_loaderThreads = new std::vector<std::thread>;
+	m_loaderMutex = new std::mutex;
+	m_loaderCondition = new std::condition_variable;
+	m_prefetchCondition = new std::condition_variable;
+#else
+	m_loaderThreadGroup = new boost::thread_group;
+	m_loaderMutex = new boost::mutex;
+	m_loaderCondition = new boost::condition;
+	m_prefetchCondition = new boost::condition;
+#endif
+	for (int i = 0; i < loaderThreadCount; i++)
+	{
+#ifdef USE_CPP11
+		m_loaderThreads->emplace_back(&LDLMainModel::loaderThreadProc, this);
+#else
+		m_loaderThreadGroup->create_thread(
+			boost::bind(&LDLMainModel::loaderThreadProc, this));
+#endif
+	}
+#endif // USE_CPP11 || !_NO_LDL_THREADS
+}
+
+// Stops the loader threads, and releases any prefetched models that didn't
+// end up getting used.
+void LDLMainModel::stopLoaderThreads(void)
+{
+#if defined(USE_CPP11) || !defined(_NO_LDL_THREADS)
+	if (m_loaderMutex != NULL)
+	{
+		ScopedLock lock(*m_loaderMutex);
+
+		m_loaderExiting = true;
+		m_loaderCondition->notify_all();
+		lock.unlock();
+#ifdef USE_CPP11
+		for (size_t i = 0; i < m_loaderThreads->size(); i++)
+		{
+			(*m_loaderThreads)[i].join();
+		}
+		delete m_loaderThreads;
+		m_loaderThreads = NULL;
+#else
+		m_loaderThreadGroup->join_all();
+		delete m_loaderThreadGroup;
+		m_loaderThreadGroup = NULL;
+#endif
+		delete m_loaderMutex;
+		m_loaderMutex = NULL;
+		delete m_loaderCondition;
+		m_loaderCondition = NULL;
+		delete m_prefetchCondition;
+		m_prefetchCondition = NULL;
+		m_prefetchQueue.clear();
+		m_readModelNames.clear();
+	}
+#endif // USE_CPP11 || !_NO_LDL_THREADS
+	for (LDLPrefetchMap::iterator it = m_prefetchedModels.begin();
+		it != m_prefetchedModels.end(); ++it)
+	{
+		delete it->second;
+	}
+	m_prefetchedModels.clear();
+}
+
+#if defined(USE_CPP11) || !defined(_NO_LDL_THREADS)
+void LDLMainModel::loaderThreadProc(void)
+{
+	ScopedLock lock(*m_loaderMutex);
+
+	while (!m_loaderExiting)
+	{
+		if (m_prefetchQueue.empty())
+		{
+			m_loaderCondition->wait(lock);
+		}
+		else
+		{
+			LDLPrefetchedModel *prefetchedModel = m_prefetchQueue.front();
+
+			m_prefetchQueue.pop_front();
+			prefetchedModel->started = true;
+			lock.unlock();
+			readPrefetchedModel(prefetchedModel);
+			lock.lock();
+			prefetchedModel->done = true;
+			if (!prefetchedModel->mpd)
+			{
+				m_readModelNames.push_back(prefetchedModel->dictName);
+			}
+			m_prefetchCondition->notify_all();
+		}
+	}
+}
+#endif // USE_CPP11 || !_NO_LDL_THREADS
+
+bool LDLMainModel::canPrefetch(void) const
+{
+#if defined(USE_CPP11) || !defined(_NO_LDL_THREADS)
+	return m_loaderMutex != NULL;
+#else // USE_CPP11 || !_NO_LDL_THREADS
+	return false;
+#endif // !USE_CPP11 && _NO_LDL_THREADS
+}
+
+bool LDLMainModel::isPrefetched(const std::string &dictName) const
+{
+	return m_prefetchedModels.find(dictName) != m_prefetchedModels.end();
+}
+
+// Queues prefetchedModel to be read on one of the loader threads.  This takes
+// ownership of prefetchedModel.
+void LDLMainModel::prefetch(
+	const std::string &dictName,
+	LDLPrefetchedModel *prefetchedModel)
+{
+	prefetchedModel->dictName = dictName;
+	m_prefetchedModels[dictName] = prefetchedModel;
+#if defined(USE_CPP11) || !defined(_NO_LDL_THREADS)
+	if (m_loaderMutex != NULL)
+	{
+		ScopedLock lock(*m_loaderMutex);
+
+		m_prefetchQueue.push_back(prefetchedModel);
+		m_loaderCondition->notify_one();
+		return;
+	}
+#endif // USE_CPP11 || !_NO_LDL_THREADS
+	// No loader threads; read it now.
+	readPrefetchedModel(prefetchedModel);
+	prefetchedModel->done = true;
+}
+
+// Returns the prefetched model for dictName, once its file has been read, or
+// NULL if it wasn't prefetched.  The caller takes ownership of the returned
+// value.  If no loader thread has gotten to the model yet, it gets read on
+// the calling thread, instead of waiting behind the rest of the queue.
+LDLPrefetchedModel *LDLMainModel::takePrefetchedModel(const char *dictName)
+{
+	LDLPrefetchMap::iterator it;
+
+	prefetchReadSubModels();
+	it = m_prefetchedModels.find(dictName);
+	if (it == m_prefetchedModels.end())
+	{
+		return NULL;
+	}
+	LDLPrefetchedModel *prefetchedModel = it->second;
+
+	m_prefetchedModels.erase(it);
+#if defined(USE_CPP11) || !defined(_NO_LDL_THREADS)
+	if (m_loaderMutex != NULL)
+	{
+		ScopedLock lock(*m_loaderMutex);
+
+		if (!prefetchedModel->started)
+		{
+			m_prefetchQueue.remove(prefetchedModel);
+			prefetchedModel->started = true;
+			lock.unlock();
+			readPrefetchedModel(prefetchedModel);
+			prefetchedModel->done = true;
+		}
+		else
+		{
+			while (!prefetchedModel->done)
+			{
+				m_prefetchCondition->wait(lock);
+			}
+		}
+	}
+#endif // USE_CPP11 || !_NO_LDL_THREADS
+	return prefetchedModel;
+}
+
+// Queues the sub-files of the prefetched models that the loader threads have
+// finished reading since the last call, so that whole subtrees get read in
+// parallel, instead of one level at a time as each model gets parsed.  This
+// runs on the main thread, since finding files isn't thread-safe.
+void LDLMainModel::prefetchReadSubModels(void)
+{
+#if defined(USE_CPP11) || !defined(_NO_LDL_THREADS)
+	LDLPrefetchNameList readModelNames;
+
+	if (m_loaderMutex == NULL)
+	{
+		return;
+	}
+	{
+		ScopedLock lock(*m_loaderMutex);
+
+		readModelNames.swap(m_readModelNames);
+	}
+	for (LDLPrefetchNameList::iterator itName = readModelNames.begin();
+		itName != readModelNames.end() && !getLoadCanceled(); ++itName)
+	{
+		LDLPrefetchMap::iterator it = m_prefetchedModels.find(*itName);
+
+		// Models that have already been taken are parsed, or about to be,
+		// and parsing them prefetches their sub-files.
+		if (it != m_prefetchedModels.end() &&
+			it->second->model->getFileLines() != NULL)
+		{
+			it->second->model->prefetchSubModels();
+		}
+	}
+#endif // USE_CPP11 || !_NO_LDL_THREADS
+}
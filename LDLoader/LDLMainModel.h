@@ -4,19 +4,89 @@
 #include <LDLoader/LDLModel.h>
 #include <TCFoundation/TCStlIncludes.h>
 
+#ifdef USE_CPP11
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#else
+#if defined(_MSC_VER) && _MSC_VER <= 1200	// VS 6
+#define _NO_LDL_THREADS
+#else  // VS 6
+#ifdef _NO_BOOST
+#define _NO_LDL_THREADS
+#endif // _NO_BOOST
+#endif // VS 6
+#ifndef _NO_LDL_THREADS
+#ifdef WIN32
+#pragma warning(push)
+#pragma warning(disable:4244 4512)
+#endif // WIN32
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#ifdef WIN32
+#pragma warning(pop)
+#endif // WIN32
+#endif // !_NO_LDL_THREADS
+#endif
+
 class LDLPalette;
 
 typedef std::vector<LDLModel *> LDLModelVector;
 
+// A sub-model whose file gets split into lines on a loader thread, ahead of
+// the main thread getting to the line that references it.  The file itself
+// is read on the main thread, so that the loader threads never touch the
+// search path, the file index, or the library archive.
+struct LDLPrefetchedModel
+{
+	LDLPrefetchedModel(void)
+		:model(NULL),
+		loadingPart(false),
+		loadingSubPart(false),
+		loadingPrimitive(false),
+		loadingUnoffic(false),
+		mpd(false),
+		started(false),
+		done(false)
+	{
+	}
+	~LDLPrefetchedModel(void) { TCObject::release(model); }
+
+	LDLModel *model;
+	std::string dictName;
+	std::string path;
+	// Set when the file is in the library archive, in which case data holds
+	// its raw data from the archive until the loader thread inflates it.
+	std::string archivePath;
+	std::string data;
+	// Numbers scanned from the model's action lines on the loader thread.
+	std::vector<float> values;
+	// The loading flags that finding the file set.
+	bool loadingPart;
+	bool loadingSubPart;
+	bool loadingPrimitive;
+	bool loadingUnoffic;
+	// Set on the loader thread if the file has MPD sub-files, whose names
+	// aren't known until it gets parsed.
+	bool mpd;
+	bool started;
+	bool done;
+};
+
+typedef std::map<std::string, LDLPrefetchedModel *> LDLPrefetchMap;
+typedef std::list<LDLPrefetchedModel *> LDLPrefetchList;
+typedef std::list<std::string> LDLPrefetchNameList;
+
 class LDLMainModel : public LDLModel
 {
 public:
 	LDLMainModel(void);
 	bool load(const char *filename);
-	virtual TCDictionary* getLoadedModels(void);
+	virtual TCHashDictionary* getLoadedModels(void);
 	void print(void);
 	virtual int getEdgeColorNumber(int colorNumber);
 	virtual void getRGBA(int colorNumber, int& r, int& g, int& b, int& a);
+	virtual TCULong getPackedRGBA(int colorNumber);
 	virtual bool hasSpecular(int colorNumber);
 	virtual bool hasShininess(int colorNumber);
 	virtual void getSpecular(int colorNumber, float *specular);
@@ -32,6 +102,9 @@ public:
 
 	void setLDConfig(const std::string& value) { m_ldConfig = value; }
 	const std::string& getLDConfig(void) const { return m_ldConfig; };
+	// Returns the directories that sub-file names are looked up in, in search
+	// order, as of the last call to load.
+	const std::string &getSearchPath(void) const { return m_searchPath; }
 	// Flags
 	void setLowResStuds(bool value) { m_mainFlags.lowResStuds = value; }
 	bool getLowResStuds(void) const { return m_mainFlags.lowResStuds; }
@@ -118,6 +191,11 @@ public:
 	{
 		return m_mainFlags.blueNeutralFaces != false;
 	}
+	void setMultiThreaded(bool value) { m_mainFlags.multiThreaded = value; }
+	bool getMultiThreaded(void) const
+	{
+		return m_mainFlags.multiThreaded != false;
+	}
 	void setTexmaps(bool value) { m_mainFlags.texmaps = value; }
 	bool getTexmaps(void) const { return m_mainFlags.texmaps != false; }
 	void setScanConditionalControlPoints(bool value)
@@ -130,6 +208,9 @@ public:
 	}
 	void setHaveMpdTexmaps(void) { m_mainFlags.haveMpdTexmaps = true; }
 	bool getHaveMpdTexmaps(void) const { return m_mainFlags.haveMpdTexmaps != false; }
+	// Returns true while the model's file and its sub-files are still being
+	// read and parsed.
+	bool isLoading(void) const { return m_mainFlags.loading != false; }
 	bool &ancestorCheck(const std::string &name) { return m_ancestorMap[name]; }
 	void ancestorClear(const std::string &name) { m_ancestorMap[name] = false; }
 	virtual TCObject *getAlertSender(void) { return m_alertSender; }
@@ -138,6 +219,12 @@ public:
 	virtual LDLModelVector &getMpdModels(void) { return m_mpdModels; }
 	virtual void release(void);
 	virtual bool transparencyIsDisabled(void) const;
+	bool canPrefetch(void) const;
+	bool isPrefetched(const std::string &dictName) const;
+	void prefetch(const std::string &dictName,
+		LDLPrefetchedModel *prefetchedModel);
+	LDLPrefetchedModel *takePrefetchedModel(const char *dictName);
+	void prefetchReadSubModels(void);
 private:
 	//LDLMainModel(const LDLMainModel &other);
 	virtual TCObject *copy(void) const;
@@ -145,9 +232,16 @@ protected:
 	virtual void dealloc(void);
 	virtual void processLDConfig(void);
 	void ldrawDirNotFound(void);
+	void updateSearchPath(void);
+	int getNumLoaderThreads(void);
+	void launchLoaderThreads(void);
+	void stopLoaderThreads(void);
+#if defined(USE_CPP11) || !defined(_NO_LDL_THREADS)
+	void loaderThreadProc(void);
+#endif // USE_CPP11 || !_NO_LDL_THREADS
 
 	TCObject *m_alertSender;
-	TCDictionary *m_loadedModels;
+	TCHashDictionary *m_loadedModels;
 	LDLPalette *m_mainPalette;
 	TCStringArray *m_extraSearchDirs;
 	// This needs to not retain its children; hence, the std::vector, instead of
@@ -156,6 +250,26 @@ protected:
 	float m_seamWidth;
 	int m_highlightColorNumber;
 	std::string m_ldConfig;
+	std::string m_searchPath;
+	LDLPrefetchMap m_prefetchedModels;
+#if defined(USE_CPP11) || !defined(_NO_LDL_THREADS)
+	LDLPrefetchList m_prefetchQueue;
+	// The prefetched models whose lines the loader threads have read, and
+	// whose own sub-files haven't been queued yet.
+	LDLPrefetchNameList m_readModelNames;
+#ifdef USE_CPP11
+	std::vector<std::thread> *m_loaderThreads;
+	std::mutex *m_loaderMutex;
+	std::condition_variable *m_loaderCondition;
+	std::condition_variable *m_prefetchCondition;
+#else
+	boost::thread_group *m_loaderThreadGroup;
+	boost::mutex *m_loaderMutex;
+	boost::condition *m_loaderCondition;
+	boost::condition *m_prefetchCondition;
+#endif
+	bool m_loaderExiting;
+#endif // USE_CPP11 || !_NO_LDL_THREADS
 	struct
 	{
 		// Public flags
@@ -174,6 +288,8 @@ protected:
 		bool texmaps:1;
 		bool scanConditionalControlPoints:1;
 		bool haveMpdTexmaps:1;
+		bool multiThreaded:1;
+		bool loading:1;			// Temporal
 		// Semi-public flags
 		bool loadCanceled:1;
 	} m_mainFlags;
@@ -2,9 +2,11 @@
 #include "LDLMainModel.h"
 #include "LDLCommentLine.h"
 #include "LDLModelLine.h"
+#include "LDLLibraryCache.h"
+#include "LDLFileIndex.h"
 #include "LDLFindFileAlert.h"
 #include "LDrawIni.h"
-#include <TCFoundation/TCDictionary.h>
+#include <TCFoundation/TCHashDictionary.h>
 #include <TCFoundation/mystring.h>
 #include <TCFoundation/TCStringArray.h>
 #include <TCFoundation/TCAlertManager.h>
@@ -12,7 +14,10 @@
 #include <TCFoundation/TCLocalStrings.h>
 #include <TCFoundation/TCUserDefaults.h>
 #include <TCFoundation/TCImage.h>
+#include <TCFoundation/TCUnzip.h>
 #include <math.h>
+#include <sstream>
+#include <sys/stat.h>
 
 #ifdef WIN32
 #include <direct.h>
@@ -28,17 +33,33 @@
 #define LDL_LOWRES_PREFIX "LDL-LOWRES:"
 #define LOAD_MESSAGE TCLocalStrings::get(_UC("LDLModelLoading"))
 #define MAIN_READ_FRACTION 0.1f
+#define LIBRARY_CACHE_FILENAME "LDViewLibrary.cache"
 
 char *LDLModel::sm_systemLDrawDir = NULL;
 char *LDLModel::sm_defaultLDrawDir = NULL;
 LDrawIniS *LDLModel::sm_lDrawIni = NULL;
 int LDLModel::sm_modelCount = 0;
 LDLFileCaseCallback LDLModel::fileCaseCallback = NULL;
+bool LDLModel::sm_partCacheEnabled = false;
+LDLPartCacheMap LDLModel::sm_partCache;
+LDLPartCacheKeyMap LDLModel::sm_partCacheKeys;
+int LDLModel::sm_partCacheHits = 0;
+int LDLModel::sm_partCacheMisses = 0;
+bool LDLModel::sm_libraryCacheEnabled = false;
+LDLLibraryCache *LDLModel::sm_libraryCache = NULL;
+TCUnzip *LDLModel::sm_libraryArchive = NULL;
+LDLFileIndex *LDLModel::sm_fileIndex = NULL;
 LDLModel::LDLModelCleanup LDLModel::sm_cleanup;
 StringList LDLModel::sm_checkDirs;
 
 LDLModel::LDLModelCleanup::~LDLModelCleanup(void)
 {
+	LDLModel::clearPartCache();
+	TCObject::release(LDLModel::sm_libraryCache);
+	LDLModel::sm_libraryCache = NULL;
+	TCObject::release(LDLModel::sm_libraryArchive);
+	LDLModel::sm_libraryArchive = NULL;
+	LDLModel::setFileIndexEnabled(false);
 	delete[] LDLModel::sm_systemLDrawDir;
 	delete[] LDLModel::sm_defaultLDrawDir;
 	LDLModel::sm_systemLDrawDir = NULL;
@@ -55,15 +76,19 @@ LDLModel::LDLModel(void)
 	m_author(NULL),
 	m_description(NULL),
 	m_fileLines(NULL),
+	m_lineArena(NULL),
 	m_mpdTexmapModels(NULL),
 	m_mpdTexmapLines(NULL),
 	m_mpdTexmapImages(NULL),
 	m_mainModel(NULL),
 	m_activeLineCount(0),
 	m_activeMPDModel(NULL),
+	m_hullScanPoints(NULL),
 	m_texmapImage(NULL),
-	m_dataLine(NULL)
+	m_dataLine(NULL),
+	m_partCacheErrors(NULL)
 {
+	memset(m_hullPoints, 0, sizeof(m_hullPoints));
 	// Initialize Private flags
 	m_flags.loadingPart = false;
 	m_flags.loadingSubPart = false;
@@ -82,6 +107,7 @@ LDLModel::LDLModel(void)
 	m_flags.texmapStarted = false;
 	m_flags.texmapFallback = false;
 	m_flags.texmapNext = false;
+	m_flags.subModelsPrefetched = false;
 	// Initialize Public flags
 	m_flags.part = false;
 	m_flags.subPart = false;
@@ -103,6 +129,7 @@ LDLModel::LDLModel(const LDLModel &other)
 	m_author(copyString(other.m_author)),
 	m_description(copyString(other.m_description)),
 	m_fileLines(NULL),
+	m_lineArena(NULL),
 	m_mpdTexmapModels(NULL),
 	m_mpdTexmapLines(NULL),
 	m_mpdTexmapImages(NULL),
@@ -114,10 +141,13 @@ LDLModel::LDLModel(const LDLModel &other)
 	m_boundingMax(other.m_boundingMax),
 	m_center(other.m_center),
 	m_maxRadius(other.m_maxRadius),
+	m_hullScanPoints(NULL),
 	m_texmapImage(TCObject::retain(other.m_texmapImage)),
 	m_dataLine(TCObject::retain(other.m_dataLine)),
+	m_partCacheErrors(NULL),
 	m_flags(other.m_flags)
 {
+	memset(m_hullPoints, 0, sizeof(m_hullPoints));
 	if (other.m_fileLines)
 	{
 		m_fileLines = (LDLFileLineArray *)other.m_fileLines->copy();
@@ -143,11 +173,20 @@ void LDLModel::dealloc(void)
 	delete[] m_author;
 	delete[] m_description;
 	TCObject::release(m_fileLines);
+	if (m_lineArena != NULL)
+	{
+		m_lineArena->close();
+	}
 	TCObject::release(m_mpdTexmapModels);
 	TCObject::release(m_mpdTexmapLines);
 	TCObject::release(m_mpdTexmapImages);
 	TCObject::release(m_texmapImage);
 	TCObject::release(m_dataLine);
+	TCObject::release(m_partCacheErrors);
+	for (int i = 0; i < 4; i++)
+	{
+		delete m_hullPoints[i];
+	}
 	sm_modelCount--;
 	TCObject::dealloc();
 }
@@ -171,10 +210,7 @@ void LDLModel::setName(const char *name)
 
 TCULong LDLModel::getPackedRGBA(int colorNumber)
 {
-	int r, g, b, a;
-
-	getRGBA(colorNumber, r, g, b, a);
-	return r << 24 | g << 16 | b << 8 | a;
+	return m_mainModel->getPackedRGBA(colorNumber);
 }
 
 bool LDLModel::hasSpecular(int colorNumber)
@@ -216,7 +252,7 @@ LDLModel *LDLModel::subModelNamed(const char *subModelName, bool lowRes,
 								  bool secondAttempt,
 								  const LDLModelLine *fileLine, bool knownPart)
 {
-	TCDictionary* subModelDict = getLoadedModels();
+	TCHashDictionary* subModelDict = getLoadedModels();
 	LDLModel* subModel;
 	char *dictName = NULL;
 	char *adjustedName;
@@ -265,27 +301,89 @@ LDLModel *LDLModel::subModelNamed(const char *subModelName, bool lowRes,
 	{
 		std::ifstream subModelStream;
 		std::string subModelPath;
+		std::string archiveData;
+		LDLPrefetchedModel *prefetchedModel = NULL;
+		bool found;
 
-		if (openSubModelNamed(adjustedName, subModelPath, subModelStream,
-			knownPart, &loop))
+		if (!lowRes && !secondAttempt)
+		{
+			prefetchedModel = m_mainModel->takePrefetchedModel(dictName);
+		}
+		if (prefetchedModel != NULL && prefetchedModel->model->m_fileLines ==
+			NULL)
+		{
+			// The loader thread couldn't read the file, so find it again here.
+			delete prefetchedModel;
+			prefetchedModel = NULL;
+		}
+		if (prefetchedModel != NULL)
+		{
+			// Finding the file only ever turns these flags on.
+			subModelPath = prefetchedModel->path;
+			m_flags.loadingPart |= prefetchedModel->loadingPart;
+			m_flags.loadingSubPart |= prefetchedModel->loadingSubPart;
+			m_flags.loadingPrimitive |= prefetchedModel->loadingPrimitive;
+			m_flags.loadingUnoffic |= prefetchedModel->loadingUnoffic;
+			found = true;
+		}
+		else
+		{
+			found = openSubModelNamed(adjustedName, subModelPath,
+				subModelStream, knownPart, &loop, true, &archiveData);
+		}
+		if (found)
 		{
 			bool clearSubModel = false;
-			replaceStringCharacter(&subModelPath[0], '\\', '/');
-			subModel = new LDLModel;
-			subModel->setFilename(subModelPath.c_str());
+			bool libraryModel = m_flags.loadingPart ||
+				m_flags.loadingSubPart || m_flags.loadingPrimitive;
 
-			if (!initializeNewSubModel(subModel, dictName, subModelStream))
+			replaceStringCharacter(&subModelPath[0], '\\', '/');
+			if (sm_partCacheEnabled && libraryModel)
+			{
+				subModel = cachedSubModel(dictName, subModelPath);
+			}
+			if (subModel != NULL)
 			{
-				clearSubModel = true;
+				subModelStream.close();
 			}
-			if (clearSubModel)
+			else
 			{
-				subModel = NULL;
+				if (prefetchedModel != NULL)
+				{
+					// Its lines have already been read, and
+					// initializeNewSubModel takes over the reference to it.
+					subModel = prefetchedModel->model;
+					prefetchedModel->model = NULL;
+				}
+				else
+				{
+					subModel = new LDLModel;
+					subModel->setFilename(subModelPath.c_str());
+				}
+				if (sm_partCacheEnabled && libraryModel)
+				{
+					subModel->m_partCacheErrors = new LDLErrorArray;
+				}
+
+				if (!initializeNewSubModel(subModel, dictName, subModelStream,
+					&archiveData))
+				{
+					clearSubModel = true;
+				}
+				if (clearSubModel)
+				{
+					subModel = NULL;
+				}
+				else if (sm_partCacheEnabled && libraryModel)
+				{
+					cacheSubModel(subModel, dictName, subModelPath);
+				}
 			}
 			m_flags.loadingPart = false;
 			m_flags.loadingSubPart = false;
 			m_flags.loadingUnoffic = false;
 		}
+		delete prefetchedModel;
 	}
 	if (subModel != NULL && subModel->isUnOfficial())
 	{
@@ -319,6 +417,460 @@ LDLModel *LDLModel::subModelNamed(const char *subModelName, bool lowRes,
 	return subModel;
 }
 
+// NOTE: static function.
+void LDLModel::setPartCacheEnabled(bool value)
+{
+	sm_partCacheEnabled = value;
+	if (!value)
+	{
+		clearPartCache();
+	}
+}
+
+// NOTE: static function.
+void LDLModel::setLibraryCacheEnabled(bool value)
+{
+	sm_libraryCacheEnabled = value;
+	if (!value)
+	{
+		TCObject::release(sm_libraryCache);
+		sm_libraryCache = NULL;
+	}
+}
+
+// Makes sure that sm_libraryCache is the cache file in the current LDraw
+// directory, if the library cache is enabled.
+// NOTE: static function.
+void LDLModel::openLibraryCache(void)
+{
+	std::string filename;
+
+	if (!sm_libraryCacheEnabled)
+	{
+		return;
+	}
+	combinePathParts(filename, lDrawDir(), "/", LIBRARY_CACHE_FILENAME);
+	if (sm_libraryCache == NULL ||
+		filename != sm_libraryCache->getFilename())
+	{
+		saveLibraryCache();
+		TCObject::release(sm_libraryCache);
+		sm_libraryCache = new LDLLibraryCache(filename.c_str());
+	}
+}
+
+// NOTE: static function.
+void LDLModel::saveLibraryCache(void)
+{
+	if (sm_libraryCache != NULL)
+	{
+		sm_libraryCache->save();
+	}
+}
+
+// Mounts the zip file at filename (normally the official complete.zip) as
+// the contents of the LDraw directory.  Library files are then read out of
+// the archive instead of being opened one at a time from disk.  A NULL or
+// empty filename unmounts the current archive.
+// NOTE: static function.
+bool LDLModel::setLibraryArchive(const char *filename)
+{
+	if (filename == NULL || filename[0] == 0)
+	{
+		TCObject::release(sm_libraryArchive);
+		sm_libraryArchive = NULL;
+		return true;
+	}
+	if (sm_libraryArchive != NULL &&
+		strcmp(sm_libraryArchive->getArchiveFilename(), filename) == 0)
+	{
+		return true;
+	}
+	TCObject::release(sm_libraryArchive);
+	sm_libraryArchive = new TCUnzip;
+	if (!sm_libraryArchive->openArchive(filename))
+	{
+		debugPrintf("Error opening library archive %s.\n", filename);
+		sm_libraryArchive->release();
+		sm_libraryArchive = NULL;
+		return false;
+	}
+	return true;
+}
+
+// NOTE: static function.
+void LDLModel::setFileIndexEnabled(bool value)
+{
+	if (value)
+	{
+		if (sm_fileIndex == NULL)
+		{
+			sm_fileIndex = new LDLFileIndex;
+		}
+	}
+	else if (sm_fileIndex != NULL)
+	{
+		sm_fileIndex->clear();
+		sm_fileIndex->release();
+		sm_fileIndex = NULL;
+	}
+}
+
+// Forgets everything in the file index, so that all directories get read
+// again the next time they are searched.
+// NOTE: static function.
+void LDLModel::refreshFileIndex(void)
+{
+	if (sm_fileIndex != NULL)
+	{
+		sm_fileIndex->clear();
+	}
+}
+
+// Converts filename, which must be inside the LDraw directory, into the path
+// of the same file in the library archive.  Like in complete.zip, the paths in
+// the archive all start with the ldraw directory.
+// NOTE: static function.
+bool LDLModel::libraryArchivePath(
+	const char *filename,
+	std::string &archivePath)
+{
+	const char *ldrawDir = lDrawDir();
+	size_t len = strlen(ldrawDir);
+
+	if (len == 0 || strncasecmp(filename, ldrawDir, len) != 0 ||
+		(filename[len] != '/' && filename[len] != '\\'))
+	{
+		return false;
+	}
+	archivePath = "ldraw";
+	archivePath += &filename[len];
+	return true;
+}
+
+// Reads filename out of the library archive.  If inflate is false, archiveData
+// gets the file's raw data from the archive, for the caller to inflate later
+// with TCUnzip::inflateArchiveEntry.
+// NOTE: static function.
+bool LDLModel::openArchiveFile(
+	const char *filename,
+	std::string &archiveData,
+	bool inflate /*= true*/)
+{
+	std::string archivePath;
+
+	if (sm_libraryArchive == NULL ||
+		!libraryArchivePath(filename, archivePath))
+	{
+		return false;
+	}
+	if (!inflate)
+	{
+		return sm_libraryArchive->readRawArchiveEntry(archivePath.c_str(),
+			archiveData);
+	}
+	if (!sm_libraryArchive->readArchiveEntry(archivePath.c_str(), archiveData))
+	{
+		return false;
+	}
+	if (archiveData.compare(0, 3, "\xEF\xBB\xBF") == 0)
+	{
+		// Skip the UTF-8 BOM, like skipUtf8BomIfPresent does for files.
+		archiveData.erase(0, 3);
+	}
+	return true;
+}
+
+// NOTE: static function.
+void LDLModel::clearPartCache(void)
+{
+	if (sm_partCacheHits > 0 || sm_partCacheMisses > 0)
+	{
+		debugPrintf("Part cache: %d hits, %d misses, %d models.\n",
+			sm_partCacheHits, sm_partCacheMisses, (int)sm_partCache.size());
+	}
+	for (LDLPartCacheMap::iterator it = sm_partCache.begin();
+		it != sm_partCache.end(); ++it)
+	{
+		TCObject::release(it->second.model);
+	}
+	sm_partCache.clear();
+	sm_partCacheKeys.clear();
+	sm_partCacheHits = 0;
+	sm_partCacheMisses = 0;
+}
+
+// NOTE: static function.
+void LDLModel::removePartCacheEntry(LDLPartCacheMap::iterator it)
+{
+	sm_partCacheKeys.erase(it->second.model);
+	TCObject::release(it->second.model);
+	sm_partCache.erase(it);
+}
+
+// NOTE: static function.
+std::string LDLModel::partCacheKey(
+	const char *dictName,
+	const std::string &subModelPath)
+{
+	// The dictionary name is part of the key because it becomes the model's
+	// name, and primitive substitution is based on that name.
+	std::string key = lowerCaseString(dictName);
+
+	key += '\n';
+	key += subModelPath;
+	return key;
+}
+
+// NOTE: static function.
+bool LDLModel::statModelFile(
+	const char *filename,
+	time_t &mtime,
+	long long &size)
+{
+	struct stat statData;
+	std::string archivePath;
+
+	if (sm_libraryArchive != NULL && libraryArchivePath(filename, archivePath) &&
+		sm_libraryArchive->findArchiveEntry(archivePath.c_str(), mtime, size))
+	{
+		return true;
+	}
+	if (stat(filename, &statData) == 0)
+	{
+		mtime = statData.st_mtime;
+		size = (long long)statData.st_size;
+		return true;
+	}
+	return false;
+}
+
+// Returns a bit mask of the main model settings that change the result of
+// loading a library file.  Cached files loaded under different settings are
+// not reused.
+int LDLModel::getPartCacheSettings(void)
+{
+	int settings = 0;
+
+	if (m_mainModel->getSkipValidation())
+	{
+		settings |= 0x1;
+	}
+	if (m_mainModel->getTexmaps())
+	{
+		settings |= 0x2;
+	}
+	if (m_mainModel->getCheckPartTracker())
+	{
+		settings |= 0x4;
+	}
+	return settings;
+}
+
+// Checks that model and everything it references can be reused by the
+// current main model: every file must still be in the cache with an unchanged
+// stamp and search path, and none of their names may be taken by a different model (for
+// example an MPD sub-file that overrides a library file).
+bool LDLModel::cachedModelUsable(
+	const LDLModel *model,
+	int settings,
+	LDLModelSet &checkedModels)
+{
+	if (!checkedModels.insert(model).second)
+	{
+		return true;
+	}
+	TCObject *loadedModel = getLoadedModels()->objectForKey(model->m_name);
+	if (loadedModel != NULL)
+	{
+		// Already adopted by the current main model, or the name is in use by
+		// a different model.
+		return loadedModel == model;
+	}
+	LDLPartCacheKeyMap::const_iterator keyIt = sm_partCacheKeys.find(model);
+	if (keyIt == sm_partCacheKeys.end())
+	{
+		return false;
+	}
+	LDLPartCacheMap::iterator it = sm_partCache.find(keyIt->second);
+	time_t mtime;
+	long long size;
+
+	if (it->second.settings != settings ||
+		it->second.searchPath != m_mainModel->getSearchPath())
+	{
+		return false;
+	}
+	if (!statModelFile(it->second.path.c_str(), mtime, size) ||
+		mtime != it->second.mtime || size != it->second.size)
+	{
+		removePartCacheEntry(it);
+		return false;
+	}
+	if (model->m_fileLines != NULL)
+	{
+		int count = model->m_fileLines->getCount();
+
+		for (int i = 0; i < count; i++)
+		{
+			LDLFileLine *fileLine = (*model->m_fileLines)[i];
+
+			if (fileLine->getLineType() == LDLLineTypeModel)
+			{
+				LDLModelLine *modelLine = (LDLModelLine *)fileLine;
+				const LDLModel *highResModel = modelLine->getHighResModel();
+				const LDLModel *lowResModel = modelLine->getLowResModel();
+
+				if ((highResModel != NULL && !cachedModelUsable(highResModel,
+					settings, checkedModels)) || (lowResModel != NULL &&
+					!cachedModelUsable(lowResModel, settings, checkedModels)))
+				{
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// Registers model and everything it references with the current main model.
+void LDLModel::adoptCachedModel(LDLModel *model)
+{
+	TCHashDictionary *subModelDict = getLoadedModels();
+
+	if (subModelDict->objectForKey(model->m_name) != NULL)
+	{
+		return;
+	}
+	subModelDict->setObjectForKey(model, model->m_name);
+	model->m_mainModel = m_mainModel;
+	model->m_flags.noShrink =
+		sm_partCache[sm_partCacheKeys[model]].noShrink;
+	model->resendPartCacheErrors();
+	if (model->m_fileLines != NULL)
+	{
+		int count = model->m_fileLines->getCount();
+
+		for (int i = 0; i < count; i++)
+		{
+			LDLFileLine *fileLine = (*model->m_fileLines)[i];
+
+			if (fileLine->getLineType() == LDLLineTypeModel)
+			{
+				LDLModelLine *modelLine = (LDLModelLine *)fileLine;
+
+				if (modelLine->getHighResModel() != NULL)
+				{
+					adoptCachedModel(modelLine->getHighResModel());
+				}
+				if (modelLine->getLowResModel() != NULL)
+				{
+					adoptCachedModel(modelLine->getLowResModel());
+				}
+			}
+		}
+	}
+}
+
+// Sends the errors from this cached model's original parse to the current
+// main model's listeners, so that its output doesn't depend on which model
+// happened to load the file first.
+void LDLModel::resendPartCacheErrors(void)
+{
+	if (m_partCacheErrors != NULL)
+	{
+		int count = m_partCacheErrors->getCount();
+
+		for (int i = 0; i < count && !getLoadCanceled(); i++)
+		{
+			LDLError *alert = (*m_partCacheErrors)[i];
+
+			TCAlertManager::sendAlert(alert, this);
+			if (alert->getLoadCanceled())
+			{
+				cancelLoad();
+			}
+		}
+	}
+}
+
+LDLModel *LDLModel::cachedSubModel(
+	const char *dictName,
+	const std::string &subModelPath)
+{
+	LDLPartCacheMap::iterator it =
+		sm_partCache.find(partCacheKey(dictName, subModelPath));
+	LDLModelSet checkedModels;
+
+	if (it == sm_partCache.end())
+	{
+		sm_partCacheMisses++;
+		return NULL;
+	}
+	if (!cachedModelUsable(it->second.model, getPartCacheSettings(),
+		checkedModels))
+	{
+		sm_partCacheMisses++;
+		return NULL;
+	}
+	sm_partCacheHits++;
+	adoptCachedModel(it->second.model);
+	return it->second.model;
+}
+
+void LDLModel::cacheSubModel(
+	LDLModel *subModel,
+	const char *dictName,
+	const std::string &subModelPath)
+{
+	LDLPartCacheEntry entry;
+
+	if (getLoadCanceled() || subModel->isMPD() || subModel->m_fileLines == NULL)
+	{
+		return;
+	}
+	// Only cache complete trees: every file this one references must have
+	// been found, and must itself be in the cache.
+	int count = subModel->m_fileLines->getCount();
+	for (int i = 0; i < count; i++)
+	{
+		LDLFileLine *fileLine = (*subModel->m_fileLines)[i];
+
+		if (fileLine->getLineType() == LDLLineTypeModel)
+		{
+			LDLModelLine *modelLine = (LDLModelLine *)fileLine;
+			const LDLModel *highResModel = modelLine->getHighResModel();
+			const LDLModel *lowResModel = modelLine->getLowResModel();
+
+			if (highResModel == NULL || sm_partCacheKeys.find(highResModel) ==
+				sm_partCacheKeys.end() || (lowResModel != NULL &&
+				sm_partCacheKeys.find(lowResModel) == sm_partCacheKeys.end()))
+			{
+				return;
+			}
+		}
+	}
+	if (!statModelFile(subModelPath.c_str(), entry.mtime, entry.size))
+	{
+		return;
+	}
+	std::string key = partCacheKey(dictName, subModelPath);
+	LDLPartCacheMap::iterator it = sm_partCache.find(key);
+
+	if (it != sm_partCache.end())
+	{
+		removePartCacheEntry(it);
+	}
+	entry.model = subModel;
+	entry.path = subModelPath;
+	entry.searchPath = m_mainModel->getSearchPath();
+	entry.settings = getPartCacheSettings();
+	entry.noShrink = subModel->getNoShrinkFlag();
+	subModel->retain();
+	sm_partCache[key] = entry;
+	sm_partCacheKeys[subModel] = key;
+}
+
 void LDLModel::sendUnofficialWarningIfPart(
 	const LDLModel *subModel,
 	const LDLModelLine *fileLine,
@@ -425,6 +977,43 @@ bool LDLModel::openModelFile(
 	return modelStream.is_open() && !modelStream.fail();
 }
 
+// Opens subModelName inside dir.  When the file index is enabled, dirs that
+// don't contain the file are skipped without trying to open it, and files
+// that are found are opened using their real names.
+bool LDLModel::openSearchDirFile(
+	const char *dir,
+	const char *subModelName,
+	std::string &subModelPath,
+	std::ifstream &subModelStream,
+	bool isText)
+{
+	combinePathParts(subModelPath, dir, "/", subModelName);
+	if (sm_fileIndex != NULL)
+	{
+		std::string path;
+
+		switch (sm_fileIndex->findFile(dir, subModelName, path))
+		{
+		case LDLFileIndex::FRFound:
+			if (!openStream(path.c_str(), subModelStream))
+			{
+				return false;
+			}
+			subModelPath = path;
+			if (isText)
+			{
+				skipUtf8BomIfPresent(subModelStream);
+			}
+			return true;
+		case LDLFileIndex::FRNotFound:
+			return false;
+		default:
+			break;
+		}
+	}
+	return openModelFile(subModelPath.c_str(), subModelStream, isText);
+}
+
 bool LDLModel::isSubPart(const char *subModelName)
 {
 	return stringHasCaseInsensitivePrefix(subModelName, "s/") ||
@@ -458,7 +1047,9 @@ bool LDLModel::openSubModelNamed(
 	std::ifstream &subModelStream,
 	bool knownPart,
 	bool *pLoop /*= NULL*/,
-	bool isText /*= true*/)
+	bool isText /*= true*/,
+	std::string *archiveData /*= NULL*/,
+	bool inflate /*= true*/)
 {
 	TCStringArray *extraSearchDirs = m_mainModel->getExtraSearchDirs();
 
@@ -469,6 +1060,11 @@ bool LDLModel::openSubModelNamed(
 	subModelPath = subModelName;
 	if (isAbsolutePath(subModelPath.c_str()))
 	{
+		if (archiveData != NULL &&
+			openArchiveFile(subModelPath.c_str(), *archiveData, inflate))
+		{
+			return true;
+		}
 		return openModelFile(subModelPath.c_str(), subModelStream, isText,
 			knownPart);
 	}
@@ -496,7 +1092,12 @@ bool LDLModel::openSubModelNamed(
 			{
 				combinePathParts(subModelPath, searchDir->Dir, "/",
 					subModelName);
-				if (openModelFile(subModelPath.c_str(), subModelStream, isText))
+				// Files in the library archive take precedence over loose
+				// files in the same search directory.
+				if ((archiveData != NULL && openArchiveFile(
+					subModelPath.c_str(), *archiveData, inflate)) ||
+					openSearchDirFile(searchDir->Dir, subModelName,
+					subModelPath, subModelStream, isText))
 				{
 					char *mainModelPath = copyString(m_mainModel->getFilename());
 #ifdef WIN32
@@ -537,18 +1138,22 @@ bool LDLModel::openSubModelNamed(
 	}
 	else
 	{
+		std::string dirPath;
+
 		if (openModelFile(subModelPath.c_str(), subModelStream, isText))
 		{
 			return true;
 		}
-		combinePathParts(subModelPath, lDrawDir(), "/P/", subModelName);
-		if (openModelFile(subModelPath.c_str(), subModelStream, isText))
+		combinePathParts(dirPath, lDrawDir(), "/P");
+		if (openSearchDirFile(dirPath.c_str(), subModelName, subModelPath,
+			subModelStream, isText))
 		{
 			m_flags.loadingPrimitive = true;
 			return true;
 		}
-		combinePathParts(subModelPath, lDrawDir(), "/PARTS/", subModelName);
-		if (openModelFile(subModelPath.c_str(), subModelStream, isText))
+		combinePathParts(dirPath, lDrawDir(), "/PARTS");
+		if (openSearchDirFile(dirPath.c_str(), subModelName, subModelPath,
+			subModelStream, isText))
 		{
 			if (isSubPart(subModelName))
 			{
@@ -560,8 +1165,9 @@ bool LDLModel::openSubModelNamed(
 			}
 			return true;
 		}
-		combinePathParts(subModelPath, lDrawDir(), "/MODELS/", subModelName);
-		if (openModelFile(subModelPath.c_str(), subModelStream, isText))
+		combinePathParts(dirPath, lDrawDir(), "/MODELS");
+		if (openSearchDirFile(dirPath.c_str(), subModelName, subModelPath,
+			subModelStream, isText))
 		{
 			return true;
 		}
@@ -573,9 +1179,8 @@ bool LDLModel::openSubModelNamed(
 
 		for (i = 0; i < count; i++)
 		{
-			combinePathParts(subModelPath, (*extraSearchDirs)[i], "/",
-				subModelName);
-			if (openModelFile(subModelPath.c_str(), subModelStream, isText))
+			if (openSearchDirFile((*extraSearchDirs)[i], subModelName,
+				subModelPath, subModelStream, isText))
 			{
 				return true;
 			}
@@ -593,9 +1198,11 @@ bool LDLModel::initializeNewSubModel(LDLModel *subModel, const char *dictName)
 bool LDLModel::initializeNewSubModel(
 	LDLModel *subModel,
 	const char *dictName,
-	std::ifstream &subModelStream)
+	std::ifstream &subModelStream,
+	const std::string *archiveData /*= NULL*/)
 {
-	TCDictionary* subModelDict = getLoadedModels();
+	bool loaded = true;
+	TCHashDictionary* subModelDict = getLoadedModels();
 
 	subModelDict->setObjectForKey(subModel, dictName);
 	subModel->release();
@@ -619,7 +1226,22 @@ bool LDLModel::initializeNewSubModel(
 	{
 		subModel->m_flags.unofficial = true;
 	}
-	if (subModelStream.is_open() && !subModel->load(subModelStream))
+	if (subModel->m_fileLines != NULL)
+	{
+		// Read on a loader thread.
+		loaded = subModel->finishPrefetchedLoad();
+	}
+	else if (subModelStream.is_open())
+	{
+		loaded = subModel->load(subModelStream);
+	}
+	else if (archiveData != NULL)
+	{
+		std::istringstream archiveStream(*archiveData);
+
+		loaded = subModel->load(archiveStream);
+	}
+	if (!loaded)
 	{
 		subModelDict->removeObjectForKey(dictName);
 		return false;
@@ -1003,50 +1625,133 @@ static char *myFgets(char *buf, int bufSize, FILE *file)
 		}
 		buf[i] = (char)char1;
 	}
-	buf[bufSize - 1] = 0;
-	return buf;
+	buf[bufSize - 1] = 0;
+	return buf;
+}
+*/
+
+bool LDLModel::read(std::ifstream &stream)
+{
+	bool retValue = read((std::istream &)stream);
+
+	stream.close();
+	return retValue;
+}
+
+bool LDLModel::read(std::istream &stream)
+{
+	bool compile = false;
+	time_t mtime = 0;
+	long long size = 0;
+
+	m_fileLines = new LDLFileLineArray;
+	if (sm_libraryCache != NULL && m_filename != NULL &&
+		(isPart() || isSubPart() || isPrimitive()) &&
+		statModelFile(m_filename, mtime, size))
+	{
+		if (readCompiled(mtime, size))
+		{
+			readComments();
+			return !getLoadCanceled();
+		}
+		compile = true;
+	}
+	readLines(stream, true);
+	if (compile && !getLoadCanceled())
+	{
+		sm_libraryCache->addFile(m_filename, mtime, size, m_fileLines);
+	}
+	readComments();
+	return !getLoadCanceled();
 }
-*/
 
-bool LDLModel::read(std::ifstream &stream)
+// Splits the contents of stream into file lines.  Nothing here depends on
+// any other model, so it is safe to do on a loader thread, as long as
+// checkCanceled is false.
+void LDLModel::readLines(std::istream &stream, bool checkCanceled)
 {
 	std::string line;
 	int lineNumber = 1;
-	bool done = false;
-	bool retValue = true;
 
-	m_fileLines = new LDLFileLineArray;
-	while (!done && !getLoadCanceled())
+	while ((!checkCanceled || !getLoadCanceled()) &&
+		std::getline(stream, line))
 	{
-		if (std::getline(stream, line))
-		{
-			LDLFileLine *fileLine;
+		LDLFileLine *fileLine;
 
-			stripCRLF(&line[0]);
-			fileLine = LDLFileLine::initFileLine(this, line.c_str(), lineNumber);
-			lineNumber++;
-			m_fileLines->addObject(fileLine);
-			fileLine->release();
-			if (fileLine->getLineType() == LDLLineTypeComment)
-			{
-				// To a certain extent, this will actually parse the comment, but
-				// we really need to do some parsing prior to parsing the rest
-				// of the file.
-				readComment((LDLCommentLine *)fileLine);
-			}
-		}
-		else
+		stripCRLF(&line[0]);
+		fileLine = LDLFileLine::initFileLine(this, line.c_str(), lineNumber,
+			NULL, getLineArena());
+		lineNumber++;
+		m_fileLines->addObject(fileLine);
+		fileLine->release();
+	}
+}
+
+// To a certain extent, this will actually parse the comments, but we really
+// need to do some parsing prior to parsing the rest of the file.
+void LDLModel::readComments(void)
+{
+	int count = m_fileLines->getCount();
+
+	for (int i = 0; i < count && !getLoadCanceled(); i++)
+	{
+		LDLFileLine *fileLine = (*m_fileLines)[i];
+
+		if (fileLine->getLineType() == LDLLineTypeComment)
 		{
-			if (m_activeLineCount == 0)
-			{
-				m_activeLineCount = m_fileLines->getCount();
-			}
-			done = true;
+			readComment((LDLCommentLine *)fileLine);
 		}
 	}
-	stream.close();
+	if (m_activeLineCount == 0)
+	{
+		m_activeLineCount = count;
+	}
 	m_activeMPDModel = NULL;
-	return retValue && !getLoadCanceled();
+}
+
+// Creates this model's file lines from the compiled copy of its file in the
+// library cache, if the cache has an up to date one.  The text of the lines
+// isn't scanned; action lines get their numbers straight from the cache.
+// findFile only returns files whose compiled lines have all been checked, so
+// walking them here can't run off the end of the file's data.
+bool LDLModel::readCompiled(time_t mtime, long long size)
+{
+	int lineCount;
+	int i;
+	const LDLCompiledLine *compiledLine = sm_libraryCache->findFile(m_filename,
+		mtime, size, lineCount);
+
+	if (compiledLine == NULL)
+	{
+		return false;
+	}
+	for (i = 0; i < lineCount && !getLoadCanceled(); i++)
+	{
+		LDLFileLine *fileLine = LDLFileLine::initFileLine(this,
+			LDLLibraryCache::getText(compiledLine), i + 1,
+			(LDLLineType)compiledLine->lineType, NULL, getLineArena());
+
+		if (compiledLine->valueCount > 0 && fileLine->isActionLine())
+		{
+			((LDLActionLine *)fileLine)->setCompiledValues(
+				compiledLine->colorNumber,
+				LDLLibraryCache::getValues(compiledLine),
+				(int)compiledLine->valueCount);
+		}
+		m_fileLines->addObject(fileLine);
+		fileLine->release();
+		compiledLine = LDLLibraryCache::nextLine(compiledLine);
+	}
+	return true;
+}
+
+LDLLineArena *LDLModel::getLineArena(void)
+{
+	if (m_lineArena == NULL)
+	{
+		m_lineArena = new LDLLineArena;
+	}
+	return m_lineArena;
 }
 
 void LDLModel::reportProgress(const char *message, float progress,
@@ -1083,13 +1788,29 @@ void LDLModel::reportProgress(const wchar_t *message, float progress,
 
 bool LDLModel::load(std::ifstream &stream, bool trackProgress)
 {
-	bool retValue;
+	startLoad(trackProgress);
+	return finishLoad(read(stream), trackProgress);
+}
 
+bool LDLModel::load(std::istream &stream, bool trackProgress)
+{
+	startLoad(trackProgress);
+	return finishLoad(read(stream), trackProgress);
+}
+
+void LDLModel::startLoad(bool trackProgress)
+{
 	if (trackProgress)
 	{
 		reportProgress(LOAD_MESSAGE, 0.0f);
 	}
-	if (!read(stream))
+}
+
+bool LDLModel::finishLoad(bool readOK, bool trackProgress)
+{
+	bool retValue;
+
+	if (!readOK)
 	{
 		if (trackProgress)
 		{
@@ -1109,6 +1830,226 @@ bool LDLModel::load(std::ifstream &stream, bool trackProgress)
 	return retValue;
 }
 
+// Finishes loading a model whose lines were read on a loader thread.  This
+// does everything read() does after splitting the file into lines, and then
+// parses the model.
+bool LDLModel::finishPrefetchedLoad(void)
+{
+	time_t mtime;
+	long long size;
+	bool retValue;
+
+	if (sm_libraryCache != NULL && m_filename != NULL &&
+		(isPart() || isSubPart() || isPrimitive()) &&
+		statModelFile(m_filename, mtime, size))
+	{
+		sm_libraryCache->addFile(m_filename, mtime, size, m_fileLines);
+	}
+	readComments();
+	retValue = finishLoad(!getLoadCanceled(), false);
+	// The values scanned on the loader thread are about to be freed, so make
+	// sure that no line that didn't get parsed is still pointing at them.
+	for (int i = 0; i < m_fileLines->getCount(); i++)
+	{
+		LDLFileLine *fileLine = (*m_fileLines)[i];
+
+		if (fileLine->isActionLine())
+		{
+			((LDLActionLine *)fileLine)->clearCompiledValues();
+		}
+	}
+	return retValue;
+}
+
+// Reads the prefetched model's file, splits it into lines, and scans the
+// numbers in its action lines, so that parsing them on the main thread doesn't
+// have to.  Files in the library archive get inflated here.  If the file
+// can't be read, the model is left without any file lines.  This runs on a
+// loader thread, so it must not touch anything outside of prefetchedModel,
+// other than reading the open library archive's index.
+// NOTE: static function.
+void LDLModel::readPrefetchedModel(LDLPrefetchedModel *prefetchedModel)
+{
+	LDLModel *model = prefetchedModel->model;
+	std::ifstream fileStream;
+	std::istringstream dataStream;
+	std::istream *stream = &fileStream;
+	size_t valueCount = 0;
+	int count;
+	int i;
+
+	if (!prefetchedModel->archivePath.empty())
+	{
+		std::string data;
+
+		if (!sm_libraryArchive->inflateArchiveEntry(
+			prefetchedModel->archivePath.c_str(), prefetchedModel->data, data))
+		{
+			return;
+		}
+		if (data.compare(0, 3, "\xEF\xBB\xBF") == 0)
+		{
+			data.erase(0, 3);
+		}
+		dataStream.str(data);
+		stream = &dataStream;
+	}
+	else if (openStream(prefetchedModel->path.c_str(), fileStream))
+	{
+		skipUtf8BomIfPresent(fileStream);
+	}
+	else
+	{
+		return;
+	}
+	model->m_fileLines = new LDLFileLineArray;
+	model->readLines(*stream, false);
+	std::string().swap(prefetchedModel->data);
+	count = model->m_fileLines->getCount();
+	for (i = 0; i < count; i++)
+	{
+		LDLFileLine *fileLine = (*model->m_fileLines)[i];
+
+		valueCount += LDLActionLine::valueCountForLineType(
+			fileLine->getLineType());
+		if (fileLine->getLineType() == LDLLineTypeComment &&
+			((LDLCommentLine *)fileLine)->getMPDFilename())
+		{
+			prefetchedModel->mpd = true;
+		}
+	}
+	if (valueCount == 0)
+	{
+		return;
+	}
+	prefetchedModel->values.resize(valueCount);
+	float *values = &prefetchedModel->values[0];
+	for (i = 0; i < count; i++)
+	{
+		LDLFileLine *fileLine = (*model->m_fileLines)[i];
+		int lineValueCount =
+			LDLActionLine::valueCountForLineType(fileLine->getLineType());
+		int colorNumber;
+
+		if (lineValueCount > 0 && fileLine->isActionLine() &&
+			LDLActionLine::scanValues(fileLine->getLine(), colorNumber, values,
+			lineValueCount))
+		{
+			((LDLActionLine *)fileLine)->setCompiledValues(colorNumber, values,
+				lineValueCount);
+		}
+		values += lineValueCount;
+	}
+}
+
+// Finds the files referenced by this model's type 1 lines, and queues each
+// one that isn't already loaded into memory to be read on a loader thread.
+// The flags that finding a file sets are recorded with it, and applied when
+// subModelNamed gets to it, so that the resulting models are identical to the
+// ones a single-threaded load produces.  This gets called for prefetched
+// models as soon as their lines have been read, and again when they are
+// parsed, so it only does anything the first time.
+void LDLModel::prefetchSubModels(void)
+{
+	if (m_flags.subModelsPrefetched)
+	{
+		return;
+	}
+	m_flags.subModelsPrefetched = true;
+	TCHashDictionary *subModelDict = getLoadedModels();
+	bool loadingPart = m_flags.loadingPart;
+	bool loadingSubPart = m_flags.loadingSubPart;
+	bool loadingPrimitive = m_flags.loadingPrimitive;
+	bool loadingUnoffic = m_flags.loadingUnoffic;
+	int count = m_fileLines->getCount();
+
+	for (int i = 0; i < count && !getLoadCanceled(); i++)
+	{
+		LDLFileLine *fileLine = (*m_fileLines)[i];
+
+		if (fileLine->getLineType() != LDLLineTypeModel)
+		{
+			continue;
+		}
+		std::string dictName =
+			((LDLModelLine *)fileLine)->getSubModelName();
+
+		if (dictName.empty())
+		{
+			continue;
+		}
+		replaceStringCharacter(&dictName[0], '\\', '/');
+		if (subModelDict->objectForKey(dictName.c_str()) != NULL ||
+			m_mainModel->isPrefetched(dictName))
+		{
+			continue;
+		}
+		std::ifstream subModelStream;
+		std::string subModelPath;
+		std::string archiveData;
+		bool loop;
+
+		m_flags.loadingPart = false;
+		m_flags.loadingSubPart = false;
+		m_flags.loadingPrimitive = false;
+		m_flags.loadingUnoffic = false;
+		// Any file that gets found is closed again, and the loader thread
+		// reads it.  Files in the library archive only have their raw data
+		// read here, since inflating it is the slow part.
+		if (!openSubModelNamed(dictName.c_str(), subModelPath, subModelStream,
+			false, &loop, true, &archiveData, false))
+		{
+			continue;
+		}
+		bool libraryModel = m_flags.loadingPart || m_flags.loadingSubPart ||
+			m_flags.loadingPrimitive;
+		time_t mtime;
+		long long size;
+		int lineCount;
+
+		replaceStringCharacter(&subModelPath[0], '\\', '/');
+		if (libraryModel && ((sm_partCacheEnabled &&
+			sm_partCache.find(partCacheKey(dictName.c_str(), subModelPath)) !=
+			sm_partCache.end()) || (sm_libraryCache != NULL &&
+			statModelFile(subModelPath.c_str(), mtime, size) &&
+			sm_libraryCache->findFile(subModelPath.c_str(), mtime, size,
+			lineCount) != NULL)))
+		{
+			// Already in memory, or quick to load from the library cache.
+			continue;
+		}
+		LDLPrefetchedModel *prefetchedModel = new LDLPrefetchedModel;
+
+		prefetchedModel->model = new LDLModel;
+		prefetchedModel->model->setFilename(subModelPath.c_str());
+		prefetchedModel->model->m_mainModel = m_mainModel;
+		prefetchedModel->path = subModelPath;
+		prefetchedModel->loadingPart = m_flags.loadingPart;
+		prefetchedModel->loadingSubPart = m_flags.loadingSubPart;
+		prefetchedModel->loadingPrimitive = m_flags.loadingPrimitive;
+		prefetchedModel->loadingUnoffic = m_flags.loadingUnoffic;
+		if (subModelStream.is_open())
+		{
+			subModelStream.close();
+		}
+		else if (!libraryArchivePath(subModelPath.c_str(),
+			prefetchedModel->archivePath))
+		{
+			delete prefetchedModel;
+			continue;
+		}
+		else
+		{
+			prefetchedModel->data.swap(archiveData);
+		}
+		m_mainModel->prefetch(dictName, prefetchedModel);
+	}
+	m_flags.loadingPart = loadingPart;
+	m_flags.loadingSubPart = loadingSubPart;
+	m_flags.loadingPrimitive = loadingPrimitive;
+	m_flags.loadingUnoffic = loadingUnoffic;
+}
+
 int LDLModel::parseMPDMeta(int index, const char *filename)
 {
 	int i = index + 1;
@@ -1368,7 +2309,7 @@ int LDLModel::parseTexmapMeta(LDLCommentLine *commentLine)
 				std::string pathFilename = std::string("textures/") + filename;
 				bool delayedLoad = false;
 				std::string path;
-				TCDictionary* subModelDict = getLoadedModels();
+				TCHashDictionary* subModelDict = getLoadedModels();
 				LDLModel *texmapModel = (LDLModel*)subModelDict->objectForKey(filename.c_str());
 				if (texmapModel != NULL)
 				{
@@ -1695,6 +2636,10 @@ bool LDLModel::parse(void)
 		int i;
 		int count = m_fileLines->getCount();
 
+		if (m_mainModel->canPrefetch())
+		{
+			prefetchSubModels();
+		}
 		// ********************************************************************
 		// NOTE: This for loop does a number of things that aren't normally
 		// done (at least by me).  In one place (when a line needs to be
@@ -1884,6 +2829,12 @@ void LDLModel::sendAlert(LDLError *alert)
 		{
 			cancelLoad();
 		}
+		else if (m_partCacheErrors != NULL &&
+			sm_partCacheKeys.find(this) == sm_partCacheKeys.end())
+		{
+			// Still being loaded.
+			m_partCacheErrors->addObject(alert);
+		}
 	}
 }
 
@@ -2021,7 +2972,7 @@ void LDLModel::reportWarning(LDLErrorType type, CUCSTR format, ...)
 	va_end(argPtr);
 }
 
-TCDictionary *LDLModel::getLoadedModels(void)
+TCHashDictionary *LDLModel::getLoadedModels(void)
 {
 	return (m_mainModel->getLoadedModels());
 }
@@ -2200,8 +3151,7 @@ void LDLModel::scanPoints(
 	int step /*= -1*/,
 	bool watchBBoxIgnore /*= false*/) const
 {
-	if (this != m_mainModel && isPart() && m_mainModel->getBoundingBoxesOnly()
-		&& m_flags.haveBoundingBox)
+	if (usesBoundingBoxPoints())
 	{
 		TCVector boxPoints[8];
 		TCVector point;
@@ -2265,6 +3215,223 @@ void LDLModel::scanPoints(
 	}
 }
 
+// Returns true if scanPoints scans the corners of this model's bounding box
+// instead of its real points.
+bool LDLModel::usesBoundingBoxPoints(void) const
+{
+	return this != m_mainModel && isPart() &&
+		m_mainModel->getBoundingBoxesOnly() && m_flags.haveBoundingBox;
+}
+
+void LDLModel::scanHullPoints(
+	TCObject *scanner,
+	LDLScanPointCallback scanPointCallback,
+	const TCFloat *matrix,
+	int step /*= -1*/,
+	bool watchBBoxIgnore /*= false*/) const
+{
+	if (usesBoundingBoxPoints() || m_mainModel->isLoading())
+	{
+		// Models can still change while loading, so their hull points can't
+		// be cached yet.
+		scanPoints(scanner, scanPointCallback, matrix, step, watchBBoxIgnore);
+	}
+	else if (step < 0)
+	{
+		const LDLHullPoints *hullPoints = getHullPoints(watchBBoxIgnore);
+		TCVector point;
+		size_t i;
+
+		for (i = 0; i < hullPoints->points.size(); i++)
+		{
+			hullPoints->points[i].transformPoint(matrix, point);
+			((*scanner).*scanPointCallback)(point, NULL);
+		}
+		for (i = 0; i < hullPoints->modelLines.size(); i++)
+		{
+			scanHullModelLine(hullPoints->modelLines[i], scanner,
+				scanPointCallback, matrix, watchBBoxIgnore);
+		}
+	}
+	else
+	{
+		// Only the lines up to the given step count, so this model's own
+		// hull points can't be used, but its sub-models' can.
+		int curStep = 0;
+		bool emptyStep = true;
+
+		for (int i = 0; i < m_activeLineCount; i++)
+		{
+			LDLFileLine *fileLine = (*m_fileLines)[i];
+			LDLLineType lineType = fileLine->getLineType();
+
+			if (lineType == LDLLineTypeComment)
+			{
+				LDLCommentLine *commentLine = (LDLCommentLine *)fileLine;
+
+				if (commentLine->isStepMeta() && !emptyStep)
+				{
+					emptyStep = true;
+					if (++curStep > step)
+					{
+						break;
+					}
+				}
+			}
+			if (fileLine->isActionLine())
+			{
+				LDLActionLine *actionLine = (LDLActionLine *)fileLine;
+
+				emptyStep = false;
+				if (watchBBoxIgnore && actionLine->getBBoxIgnore())
+				{
+					continue;
+				}
+				if (lineType == LDLLineTypeModel)
+				{
+					scanHullModelLine((LDLModelLine *)actionLine, scanner,
+						scanPointCallback, matrix, watchBBoxIgnore);
+				}
+				else
+				{
+					actionLine->scanPoints(scanner, scanPointCallback, matrix,
+						watchBBoxIgnore);
+				}
+			}
+		}
+	}
+}
+
+void LDLModel::scanHullModelLine(
+	const LDLModelLine *modelLine,
+	TCObject *scanner,
+	LDLScanPointCallback scanPointCallback,
+	const TCFloat *matrix,
+	bool watchBBoxIgnore) const
+{
+	const LDLModel *model = modelLine->getModel();
+
+	if (model != NULL)
+	{
+		TCFloat newMatrix[16];
+
+		modelLine->getScanMatrix(matrix, newMatrix);
+		model->scanHullPoints(scanner, scanPointCallback, newMatrix, -1,
+			watchBBoxIgnore);
+	}
+}
+
+bool LDLModel::hullPointsCurrent(const LDLHullPoints *hullPoints) const
+{
+	return hullPoints->mainModel == m_mainModel &&
+		hullPoints->seamWidth == m_mainModel->getSeamWidth() &&
+		hullPoints->boundingBoxesOnly == m_mainModel->getBoundingBoxesOnly() &&
+		hullPoints->lowResStuds == m_mainModel->getLowResStuds() &&
+		hullPoints->controlPoints ==
+		m_mainModel->getScanConditionalControlPoints();
+}
+
+const LDLHullPoints *LDLModel::getHullPoints(bool watchBBoxIgnore) const
+{
+	bool controlPoints = m_mainModel->getScanConditionalControlPoints();
+	LDLHullPoints *&hullPoints =
+		m_hullPoints[(watchBBoxIgnore ? 1 : 0) + (controlPoints ? 2 : 0)];
+
+	if (hullPoints != NULL && !hullPointsCurrent(hullPoints))
+	{
+		delete hullPoints;
+		hullPoints = NULL;
+	}
+	if (hullPoints == NULL)
+	{
+		hullPoints = new LDLHullPoints;
+		hullPoints->mainModel = m_mainModel;
+		hullPoints->seamWidth = m_mainModel->getSeamWidth();
+		hullPoints->boundingBoxesOnly = m_mainModel->getBoundingBoxesOnly();
+		hullPoints->lowResStuds = m_mainModel->getLowResStuds();
+		hullPoints->controlPoints = controlPoints;
+		gatherHullPoints(hullPoints, watchBBoxIgnore);
+	}
+	return hullPoints;
+}
+
+// Fills in hullPoints with this model's own points, and the hull points of
+// its sub-models transformed by their matrices, and then throws out the ones
+// that can't be on the hull.
+void LDLModel::gatherHullPoints(
+	LDLHullPoints *hullPoints,
+	bool watchBBoxIgnore) const
+{
+	LDLModel *scanner = const_cast<LDLModel *>(this);
+	TCFloat identityMatrix[16];
+
+	TCVector::initIdentityMatrix(identityMatrix);
+	for (int i = 0; i < m_activeLineCount; i++)
+	{
+		LDLFileLine *fileLine = (*m_fileLines)[i];
+		LDLActionLine *actionLine;
+		LDLLineType lineType = fileLine->getLineType();
+
+		if (!fileLine->isActionLine())
+		{
+			continue;
+		}
+		actionLine = (LDLActionLine *)fileLine;
+		if (watchBBoxIgnore && actionLine->getBBoxIgnore())
+		{
+			continue;
+		}
+		if (lineType == LDLLineTypeModel)
+		{
+			const LDLModelLine *modelLine = (const LDLModelLine *)actionLine;
+			const LDLModel *model = modelLine->getModel();
+			const LDLHullPoints *subHullPoints;
+			const TCFloat *matrix = modelLine->getMatrix();
+			TCVector point;
+
+			if (model == NULL)
+			{
+				continue;
+			}
+			if (modelLine->canHaveSeams() ||
+				(model->isPart() && m_mainModel->getBoundingBoxesOnly()))
+			{
+				// The matrix or the points used for the sub-model depend on
+				// whether or not its bounding box has been calculated.
+				hullPoints->modelLines.push_back(modelLine);
+				continue;
+			}
+			subHullPoints = model->getHullPoints(watchBBoxIgnore);
+			if (!subHullPoints->modelLines.empty())
+			{
+				hullPoints->modelLines.push_back(modelLine);
+				continue;
+			}
+			for (size_t j = 0; j < subHullPoints->points.size(); j++)
+			{
+				subHullPoints->points[j].transformPoint(matrix, point);
+				hullPoints->points.push_back(point);
+			}
+		}
+		else
+		{
+			scanner->m_hullScanPoints = &hullPoints->points;
+			actionLine->scanPoints(scanner,
+				(LDLScanPointCallback)&LDLModel::scanHullPoint, identityMatrix,
+				watchBBoxIgnore);
+			scanner->m_hullScanPoints = NULL;
+		}
+	}
+	LDLConvexHull::reducePoints(hullPoints->points);
+}
+
+void LDLModel::scanHullPoint(
+	const TCVector &point,
+	LDLFileLine * /*pFileLine*/)
+{
+	m_hullScanPoints->push_back(point);
+}
+
 void LDLModel::getBoundingBox(TCVector &min, TCVector &max) const
 {
 	calcBoundingBox();
@@ -2344,9 +3511,10 @@ void LDLModel::calcBoundingBox(void) const
 		// NOTE: we cannot compute bounding boxes heirarchically due to
 		// rotation of child models.  With their rotation, their bounding
 		// boxes can easily stick out of the really minimum bounding box of
-		// their parent.
-		scanPoints(const_cast<LDLModel *>(this),
-			(LDLScanPointCallback)&LDLModel::scanBoundingBoxPoint, matrix, -1, true);
+		// their parent.  Their hull points can be transformed, though.
+		scanHullPoints(const_cast<LDLModel *>(this),
+			(LDLScanPointCallback)&LDLModel::scanBoundingBoxPoint, matrix, -1,
+			true);
 	}
 }
 
@@ -2401,7 +3569,7 @@ void LDLModel::calcMaxRadius(const TCVector &center, bool watchBBoxIgnore)
 		{
 			m_maxFullRadius = 0;
 		}
-		scanPoints(this,
+		scanHullPoints(this,
 			(LDLScanPointCallback)&LDLModel::scanRadiusSquaredPoint, matrix, -1,
 			watchBBoxIgnore);
 		if (watchBBoxIgnore)
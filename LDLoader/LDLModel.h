@@ -2,13 +2,16 @@
 #define __LDLMODEL_H__
 
 #include <TCFoundation/TCAlertSender.h>
+#include <TCFoundation/TCStlIncludes.h>
 #include <LDLoader/LDLFileLine.h>
 #include <LDLoader/LDLError.h>
+#include <LDLoader/LDLConvexHull.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <time.h>
 #include <fstream>
 
-class TCDictionary;
+class TCHashDictionary;
 class LDLMainModel;
 class LDLCommentLine;
 class LDLModelLine;
@@ -30,6 +33,47 @@ typedef bool (*LDLFileCaseCallback)(char *filename);
 typedef void (TCObject::*LDLScanPointCallback)(const TCVector &point,
 	const LDLFileLine *pFileLine);
 struct LDrawIniS;
+class LDLLibraryCache;
+class TCUnzip;
+class LDLFileIndex;
+struct LDLPrefetchedModel;
+
+// One parsed library file held in the process-wide part cache.  The file stamp
+// (mtime and size), the parse settings, and the search path in effect when it
+// was loaded must still match for the entry to be reused.  The search path
+// decides which files its sub-file names resolve to.
+struct LDLPartCacheEntry
+{
+	LDLModel *model;
+	std::string path;
+	std::string searchPath;
+	time_t mtime;
+	long long size;
+	int settings;
+	bool noShrink;
+};
+
+// The points of one LDLModel that might be on the convex hull of the points
+// that scanPoints scans, with its sub-models' points already transformed into
+// its space.  The main model settings that were in effect when the points were
+// gathered have to still match for them to be used.
+struct LDLHullPoints
+{
+	TCVectorVector points;
+	// Sub-model lines that get scanned every time instead of being included
+	// in points, because their points depend on things that can change.
+	std::vector<const LDLModelLine *> modelLines;
+	const LDLMainModel *mainModel;
+	float seamWidth;
+	bool boundingBoxesOnly;
+	bool lowResStuds;
+	bool controlPoints;
+};
+
+typedef TCTypedObjectArray<LDLError> LDLErrorArray;
+typedef std::map<std::string, LDLPartCacheEntry> LDLPartCacheMap;
+typedef std::map<const LDLModel *, std::string> LDLPartCacheKeyMap;
+typedef std::set<const LDLModel *> LDLModelSet;
 
 class LDLModel : public TCAlertSender
 {
@@ -55,9 +99,10 @@ public:
 	virtual const char *getAuthor(void) const { return m_author; }
 	virtual void setName(const char *name);
 	bool load(std::ifstream &stream, bool trackProgress = true);
+	bool load(std::istream &stream, bool trackProgress = true);
 	void print(int indent) const;
 	virtual bool parse(void);
-	virtual TCDictionary* getLoadedModels(void);
+	virtual TCHashDictionary* getLoadedModels(void);
 	virtual bool getLowResStuds(void) const;
 	virtual LDLError *newError(LDLErrorType type, const LDLFileLine &fileLine,
 		CUCSTR format, va_list argPtr);
@@ -72,6 +117,7 @@ public:
 		return m_fileLines;
 	}
 	virtual const IntList &getStepIndices(void) const { return m_stepIndices; }
+	void prefetchSubModels(void);
 	virtual int getActiveLineCount(void) const { return m_activeLineCount; }
 	virtual void setActiveLineCount(int value) { m_activeLineCount = value; }
 	virtual bool colorNumberIsTransparent(int colorNumber);
@@ -79,6 +125,13 @@ public:
 	virtual void scanPoints(TCObject *scanner,
 		LDLScanPointCallback scanPointCallback, const TCFloat *matrix,
 		int step = -1, bool watchBBoxIgnore = false) const;
+	// Works like scanPoints, except that it only scans a cached subset of the
+	// points that includes all the ones on their convex hull, and usually
+	// passes NULL for pFileLine.  Scanners that only look for extremes get
+	// the same results.
+	void scanHullPoints(TCObject *scanner,
+		LDLScanPointCallback scanPointCallback, const TCFloat *matrix,
+		int step = -1, bool watchBBoxIgnore = false) const;
 	virtual void getBoundingBox(TCVector &min, TCVector &max) const;
 	virtual TCFloat getMaxRadius(const TCVector &center, bool watchBBoxIgnore);
 
@@ -128,6 +181,17 @@ public:
 		return fileCaseCallback;
 	}
 	static bool openFile(const char *filename, std::ifstream &modelStream);
+	static void setPartCacheEnabled(bool value);
+	static bool getPartCacheEnabled(void) { return sm_partCacheEnabled; }
+	static void clearPartCache(void);
+	static void setLibraryCacheEnabled(bool value);
+	static bool getLibraryCacheEnabled(void) { return sm_libraryCacheEnabled; }
+	static void saveLibraryCache(void);
+	static bool setLibraryArchive(const char *filename);
+	static bool haveLibraryArchive(void) { return sm_libraryArchive != NULL; }
+	static void setFileIndexEnabled(bool value);
+	static bool getFileIndexEnabled(void) { return sm_fileIndex != NULL; }
+	static void refreshFileIndex(void);
 	static bool openStream(const char *filename, std::ifstream &stream);
 	static void combinePathParts(std::string &path, const std::string &left,
 		const std::string& middle, const std::string &right = std::string());
@@ -137,12 +201,25 @@ protected:
 		std::string &path);
 	virtual bool openSubModelNamed(const char* subModelName,
 		std::string &subModelPath, std::ifstream &fileStream, bool knownPart,
-		bool *pLoop = NULL, bool isText = true);
+		bool *pLoop = NULL, bool isText = true,
+		std::string *archiveData = NULL, bool inflate = true);
 	virtual bool initializeNewSubModel(LDLModel* subModel,
-		const char *dictName, std::ifstream &subModelStream);
+		const char *dictName, std::ifstream &subModelStream,
+		const std::string *archiveData = NULL);
 	virtual bool initializeNewSubModel(LDLModel* subModel,
 		const char *dictName);
 	virtual bool read(std::ifstream &stream);
+	virtual bool read(std::istream &stream);
+	void readLines(std::istream &stream, bool checkCanceled);
+	void readComments(void);
+	void startLoad(bool trackProgress);
+	bool finishLoad(bool readOK, bool trackProgress);
+	bool finishPrefetchedLoad(void);
+	bool readCompiled(time_t mtime, long long size);
+	LDLLineArena *getLineArena(void);
+	bool openSearchDirFile(const char *dir, const char *subModelName,
+		std::string &subModelPath, std::ifstream &subModelStream,
+		bool isText);
 	virtual int parseComment(int index, LDLCommentLine *commentLine);
 	virtual int parseMPDMeta(int index, const char *filename);
 	virtual int parseBFCMeta(LDLCommentLine *commentLine);
@@ -173,19 +250,50 @@ protected:
 	virtual void calcMaxRadius(const TCVector &center, bool watchBBoxIgnore);
 	void scanBoundingBoxPoint(const TCVector &point, LDLFileLine *pFileLine);
 	void scanRadiusSquaredPoint(const TCVector &point, LDLFileLine *pFileLine);
+	void scanHullPoint(const TCVector &point, LDLFileLine *pFileLine);
+	void scanHullModelLine(const LDLModelLine *modelLine, TCObject *scanner,
+		LDLScanPointCallback scanPointCallback, const TCFloat *matrix,
+		bool watchBBoxIgnore) const;
+	const LDLHullPoints *getHullPoints(bool watchBBoxIgnore) const;
+	void gatherHullPoints(LDLHullPoints *hullPoints,
+		bool watchBBoxIgnore) const;
+	bool hullPointsCurrent(const LDLHullPoints *hullPoints) const;
+	bool usesBoundingBoxPoints(void) const;
 	void sendUnofficialWarningIfPart(const LDLModel *subModel,
 		const LDLModelLine *fileLine, const char *subModelName);
 	void endTexmap(void);
 	void extractData();
+	int getPartCacheSettings(void);
+	LDLModel *cachedSubModel(const char *dictName,
+		const std::string &subModelPath);
+	void cacheSubModel(LDLModel *subModel, const char *dictName,
+		const std::string &subModelPath);
+	bool cachedModelUsable(const LDLModel *model, int settings,
+		LDLModelSet &checkedModels);
+	void adoptCachedModel(LDLModel *model);
+	void resendPartCacheErrors(void);
 
 	static bool verifyLDrawDir(const char *value);
+	static void openLibraryCache(void);
 	static void initCheckDirs();
+	static std::string partCacheKey(const char *dictName,
+		const std::string &subModelPath);
+	static bool statModelFile(const char *filename, time_t &mtime,
+		long long &size);
+	static bool libraryArchivePath(const char *filename,
+		std::string &archivePath);
+	static bool openArchiveFile(const char *filename,
+		std::string &archiveData, bool inflate = true);
+	static void removePartCacheEntry(LDLPartCacheMap::iterator it);
+	static void readPrefetchedModel(LDLPrefetchedModel *prefetchedModel);
 
 	char *m_filename;
 	char *m_name;
 	char *m_author;
 	char *m_description;
 	LDLFileLineArray *m_fileLines;
+	// Holds the file lines read from this model's file.
+	LDLLineArena *m_lineArena;
 	LDLModelArray *m_mpdTexmapModels;
 	LDLCommentLineArray *m_mpdTexmapLines;
 	TCImageArray *m_mpdTexmapImages;
@@ -199,6 +307,11 @@ protected:
 	TCVector m_center;
 	TCFloat m_maxRadius;
 	TCFloat m_maxFullRadius;
+	// Indexed by watchBBoxIgnore + 2 * getScanConditionalControlPoints().
+	mutable LDLHullPoints *m_hullPoints[4];
+	// Where scanHullPoint puts the points it gets while the hull points are
+	// being gathered.
+	TCVectorVector *m_hullScanPoints;
 	std::string m_texmapFilename;
 	TCImage *m_texmapImage;
 	LDLFileLine::TexmapType m_texmapType;
@@ -206,6 +319,9 @@ protected:
 	TCFloat m_texmapExtra[2];
 	std::vector<TCByte> m_data;
 	LDLCommentLine *m_dataLine;
+	// The errors and warnings sent while this library file was parsed, so
+	// that they can be sent again each time the part cache reuses it.
+	LDLErrorArray *m_partCacheErrors;
 	struct
 	{
 		// Private flags
@@ -227,6 +343,7 @@ protected:
 		bool texmapFallback:1;		// Temporal
 		bool texmapNext:1;			// Temporal
 		bool texmapValid:1;			// Temporal
+		bool subModelsPrefetched:1;	// Temporal
 		// Public flags
 		bool part:1;
 		bool subPart:1;
@@ -247,6 +364,15 @@ protected:
 	static LDrawIniS *sm_lDrawIni;
 	static int sm_modelCount;
 	static LDLFileCaseCallback fileCaseCallback;
+	static bool sm_partCacheEnabled;
+	static LDLPartCacheMap sm_partCache;
+	static LDLPartCacheKeyMap sm_partCacheKeys;
+	static int sm_partCacheHits;
+	static int sm_partCacheMisses;
+	static bool sm_libraryCacheEnabled;
+	static LDLLibraryCache *sm_libraryCache;
+	static TCUnzip *sm_libraryArchive;
+	static LDLFileIndex *sm_fileIndex;
 	static class LDLModelCleanup
 	{
 	public:
@@ -4,7 +4,6 @@
 #include <string.h>
 #include <stdio.h>
 #include <ctype.h>
-#include <sstream>
 #include <TCFoundation/TCMacros.h>
 #include <TCFoundation/TCVector.h>
 #include <TCFoundation/TCLocalStrings.h>
@@ -17,8 +16,9 @@
 #endif // WIN32
 
 LDLModelLine::LDLModelLine(LDLModel *parentModel, const char *line,
-						   int lineNumber, const char *originalLine)
-	:LDLActionLine(parentModel, line, lineNumber, originalLine),
+						   int lineNumber, const char *originalLine,
+						   LDLLineArena *arena)
+	:LDLActionLine(parentModel, line, lineNumber, originalLine, arena),
 	m_highResModel(NULL),
 	m_lowResModel(NULL)
 {
@@ -124,13 +124,35 @@ void LDLModelLine::fixLine(void)
 	}
 }
 
+std::string LDLModelLine::getFormattedName(void) const
+{
+	const char *spaceSpot = strchr(m_processedLine.c_str(), ' ');
+	int k;
+
+	for (k = 0; k < 13 && spaceSpot != NULL; k++)
+	{
+		spaceSpot = strchr(spaceSpot + 1, ' ');
+	}
+	if (spaceSpot != NULL)
+	{
+		return spaceSpot + 1;
+	}
+	return std::string();
+}
+
+// Returns the name of the file this line references, without parsing the
+// line.
+std::string LDLModelLine::getSubModelName(void)
+{
+	fixLine();
+	return getFormattedName();
+}
+
 bool LDLModelLine::parse(void)
 {
-	float x, y, z;
-	float a, b, c, d, e, f, g, h, i;
+	float values[12];
 	size_t k;
 	char subModelName[1024] = "";
-	int lineType;
 	const char *spaceSpot;
 
 	fixLine();
@@ -167,27 +189,9 @@ bool LDLModelLine::parse(void)
 			}
 		}
 	}
-	if (sscanf(m_processedLine.c_str(),
-		"%d %i %f %f %f %f %f %f %f %f %f %f %f %f", &lineType, &m_colorNumber,
-		&x, &y, &z, &a, &b, &c, &d, &e, &f, &g, &h, &i) == 14 &&
-		subModelName[0])
+	if (readValues(values, 12, m_processedLine.c_str()) && subModelName[0])
 	{
-		std::stringstream ss;
-		std::string prefix = getTypeAndColorPrefix();
-		if (!prefix.empty())
-		{
-			ss << prefix << "  ";
-		}
-		else
-		{
-			ss << "1 " << m_colorNumber << "  ";
-		}
-		ss << x << " " << y << " " << z << "  ";
-		ss << a << " " << b << " " << c << "  ";
-		ss << d << " " << e << " " << f << "  ";
-		ss << g << " " << h << " " << i << "  ";
-		ss << subModelName;
-		m_formattedLine = copyString(ss.str().c_str());
+		m_actionFlags.formatValueCount = 12;
 		//int red, green, blue, alpha;
 		m_highResModel = m_parentModel->subModelNamed(subModelName, false,
 			false, this);
@@ -221,7 +225,9 @@ bool LDLModelLine::parse(void)
 			m_lowResModel->retain();
 		}
 		//m_parentModel->getRGBA(m_colorNumber, red, green, blue, alpha);
-		setTransformation(x, y, z, a, b, c, d, e, f, g, h, i);
+		setTransformation(values[0], values[1], values[2], values[3],
+			values[4], values[5], values[6], values[7], values[8], values[9],
+			values[10], values[11]);
 		if (!getMainModel()->getSkipValidation())
 		{
 			TCFloat determinant = TCVector::determinant(m_matrix);
@@ -458,30 +464,47 @@ void LDLModelLine::scanPoints(
 	if (model)
 	{
 		TCFloat newMatrix[16];
-		float seamWidth = model->getMainModel()->getSeamWidth();
 
-		if (seamWidth > 0.0f && model->hasBoundingBox() && model->isPart() &&
-			(m_parentModel == NULL || !m_parentModel->isPart()))
-		{
-			TCFloat scaleMatrix[16];
-			TCFloat tempMatrix[16];
-			TCVector boundingMin, boundingMax;
-
-			model->getBoundingBox(boundingMin, boundingMax);
-			TCVector::calcScaleMatrix(seamWidth, scaleMatrix, boundingMin,
-				boundingMax);
-			TCVector::multMatrix(m_matrix, scaleMatrix, tempMatrix);
-			TCVector::multMatrix(matrix, tempMatrix, newMatrix);
-		}
-		else
-		{
-			TCVector::multMatrix(matrix, m_matrix, newMatrix);
-		}
+		getScanMatrix(matrix, newMatrix);
 		model->scanPoints(scanner, scanPointCallback, newMatrix, -1,
 			watchBBoxIgnore);
 	}
 }
 
+// Returns true if the matrix from getScanMatrix might include the seams scale,
+// which only happens for parts that are used directly by a non-part.
+bool LDLModelLine::canHaveSeams(void) const
+{
+	const LDLModel *model = getModel();
+
+	return model != NULL && model->getMainModel()->getSeamWidth() > 0.0f &&
+		model->isPart() && (m_parentModel == NULL || !m_parentModel->isPart());
+}
+
+// Sets newMatrix to the matrix that scanPoints uses for this line's model when
+// the given matrix is passed in.
+void LDLModelLine::getScanMatrix(const TCFloat *matrix, TCFloat *newMatrix) const
+{
+	const LDLModel *model = getModel();
+
+	if (canHaveSeams() && model->hasBoundingBox())
+	{
+		TCFloat scaleMatrix[16];
+		TCFloat tempMatrix[16];
+		TCVector boundingMin, boundingMax;
+
+		model->getBoundingBox(boundingMin, boundingMax);
+		TCVector::calcScaleMatrix(model->getMainModel()->getSeamWidth(),
+			scaleMatrix, boundingMin, boundingMax);
+		TCVector::multMatrix(m_matrix, scaleMatrix, tempMatrix);
+		TCVector::multMatrix(matrix, tempMatrix, newMatrix);
+	}
+	else
+	{
+		TCVector::multMatrix(matrix, m_matrix, newMatrix);
+	}
+}
+
 void LDLModelLine::setMatrix(const TCFloat *value)
 {
 	memcpy(m_matrix, value, sizeof(m_matrix));
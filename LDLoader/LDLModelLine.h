@@ -16,6 +16,7 @@ public:
 	LDLModel *getHighResModel(void) { return m_highResModel; }
 	void createLowResModel(LDLMainModel *mainModel, const char *name);
 	void createHighResModel(LDLMainModel *mainModel, const char *name);
+	std::string getSubModelName(void);
 	TCFloat *getMatrix(void) { return m_matrix; }
 	const TCFloat *getMatrix(void) const { return m_matrix; }
 	void setMatrix(const TCFloat *value);
@@ -27,8 +28,11 @@ public:
 	virtual void scanPoints(TCObject *scanner,
 		LDLScanPointCallback scanPointCallback, const TCFloat *matrix,
 		bool watchBBoxIgnore) const;
+	void getScanMatrix(const TCFloat *matrix, TCFloat *newMatrix) const;
+	bool canHaveSeams(void) const;
 	LDLModelLine(LDLModel *parentModel, const char *line, int lineNumber,
-		const char *originalLine = NULL);
+		const char *originalLine = NULL,
+		LDLLineArena *arena = NULL);
 	virtual int getColorNumber(void) const;
 protected:
 	LDLModelLine(const LDLModelLine &other);
@@ -40,6 +44,7 @@ protected:
 		TCFloat g, TCFloat h, TCFloat i);
 	virtual TCFloat tryToFixPlanarMatrix(void);
 	virtual void fixLine(void);
+	virtual std::string getFormattedName(void) const;
 
 	std::string m_processedLine;
 	LDLModel *m_highResModel;
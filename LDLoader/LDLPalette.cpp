@@ -154,15 +154,14 @@ static const TCULong standardColors[] =
 };
 
 LDLPalette::LDLPalette(void)
-	:m_customColors(new TCTypedObjectArray<CustomColor>)
 {
 	init();
 }
 
 LDLPalette::LDLPalette(const LDLPalette &other)
-	:m_customColors(new TCTypedObjectArray<CustomColor>)
 {
 	memcpy(m_colors, other.m_colors, sizeof(m_colors));
+	memcpy(m_packedColors, other.m_packedColors, sizeof(m_packedColors));
 }
 
 LDLPalette::~LDLPalette(void)
@@ -171,11 +170,10 @@ LDLPalette::~LDLPalette(void)
 
 void LDLPalette::dealloc(void)
 {
-	TCObject::release(m_customColors);
 	TCObject::dealloc();
 }
 
-void LDLPalette::initSpecularAndShininess(LDLColorInfo &color)
+void LDLPalette::initSpecularAndShininess(LDLColorInfo &color) const
 {
 	color.specular[0] = -100.0;
 	color.specular[1] = -100.0;
@@ -195,11 +193,15 @@ void LDLPalette::init(void)
 	initStandardColors();
 	initDitherColors();
 	initOtherColors();
+	for (i = 0; i < 512; i++)
+	{
+		updatePackedColor(i);
+	}
 }
 
 void LDLPalette::reset(void)
 {
-	m_customColors->removeAll();
+	m_customColors.clear();
 	init();
 }
 
@@ -335,42 +337,100 @@ void LDLPalette::initOtherColors(void)
 }
 
 int LDLPalette::getEdgeColorNumber(int colorNumber)
+{
+	LDLPackedColor packedColor;
+
+	getPackedColor(colorNumber, packedColor);
+	return packedColor.edgeColorNumber;
+}
+
+bool LDLPalette::getCustomColorInfo(int colorNumber, LDLColorInfo &colorInfo)
+{
+	CustomColorMap::const_iterator it = m_customColors.find(colorNumber);
+
+	if (it != m_customColors.end())
+	{
+		colorInfo = it->second.colorInfo;
+		return true;
+	}
+	return false;
+}
+
+void LDLPalette::getPackedColor(
+	int colorNumber,
+	LDLPackedColor &packedColor) const
 {
 	if (colorNumber < 512 && colorNumber >= 0)
 	{
-		return m_colors[colorNumber].edgeColorNumber;
+		packedColor = m_packedColors[colorNumber];
 	}
 	else
 	{
-		LDLColorInfo colorInfo;
+		CustomColorMap::const_iterator it = m_customColors.find(colorNumber);
 
-		if (getCustomColorInfo(colorNumber, colorInfo))
+		if (it != m_customColors.end())
 		{
-			return colorInfo.edgeColorNumber;
+			packedColor = it->second.packedColor;
 		}
 		else
 		{
-			return 0;
+			LDLColorInfo colorInfo;
+
+			initDirectColorInfo(colorNumber, colorInfo);
+			initPackedColor(packedColor, colorInfo);
+			packedColor.edgeColorNumber = 0;
 		}
 	}
 }
 
-bool LDLPalette::getCustomColorInfo(int colorNumber, LDLColorInfo &colorInfo)
+void LDLPalette::initPackedColor(
+	LDLPackedColor &packedColor,
+	const LDLColorInfo &colorInfo) const
 {
-	int i;
-	int count = m_customColors->getCount();
+	int r, g, b, a;
 
-	for (i = 0; i < count; i++)
+	getRGBA(colorInfo, r, g, b, a);
+	packedColor.rgba = colorForRGBA(r, g, b, a);
+	packedColor.edgeColorNumber = colorInfo.edgeColorNumber;
+	packedColor.transparent = a < 255;
+	packedColor.specular = colorInfo.specular[0] != -100.0f ||
+		colorInfo.specular[1] != -100.0f || colorInfo.specular[2] != -100.0f ||
+		colorInfo.specular[3] != -100.0f;
+	packedColor.shininess = colorInfo.shininess != -100.0f;
+	packedColor.luminance = colorInfo.luminance != -100.0f;
+}
+
+// Brings the packed version of the given color up to date.  This has to be
+// called whenever the color's LDLColorInfo changes.
+void LDLPalette::updatePackedColor(int colorNumber)
+{
+	if (colorNumber < 512 && colorNumber >= 0)
 	{
-		CustomColor *customColor = (*m_customColors)[i];
+		const LDLColorInfo &colorInfo = m_colors[colorNumber];
+		LDLPackedColor &packedColor = m_packedColors[colorNumber];
 
-		if (customColor->colorNumber == colorNumber)
+		if (isColorInfoSet(colorInfo))
 		{
-			colorInfo = customColor->colorInfo;
-			return true;
+			initPackedColor(packedColor, colorInfo);
+		}
+		else
+		{
+			LDLColorInfo defaultColorInfo;
+
+			initDirectColorInfo(colorNumber, defaultColorInfo);
+			initPackedColor(packedColor, defaultColorInfo);
+			packedColor.edgeColorNumber = colorInfo.edgeColorNumber;
+		}
+	}
+	else
+	{
+		CustomColorMap::iterator it = m_customColors.find(colorNumber);
+
+		if (it != m_customColors.end())
+		{
+			initPackedColor(it->second.packedColor, it->second.colorInfo);
 		}
 	}
-	return false;
 }
 
 bool LDLPalette::getCustomColorRGBA(int colorNumber, int &r, int &g, int &b,
@@ -387,7 +447,7 @@ bool LDLPalette::getCustomColorRGBA(int colorNumber, int &r, int &g, int &b,
 }
 
 int LDLPalette::getBlendedColorComponent(TCULong c1, TCULong c2, TCULong a1,
-										 TCULong a2)
+										 TCULong a2) const
 {
 	if (a1 == 0 && a2 == 0)
 	{
@@ -409,7 +469,7 @@ int LDLPalette::getBlendedColorComponent(TCULong c1, TCULong c2, TCULong a1,
 }
 
 void LDLPalette::getRGBA(const LDLColorInfo &colorInfo, int &r, int &g, int &b,
-						 int &a)
+						 int &a) const
 {
 	r = getBlendedColorComponent(colorInfo.color.r, colorInfo.ditherColor.r,
 		colorInfo.color.a, colorInfo.ditherColor.a);
@@ -421,7 +481,7 @@ void LDLPalette::getRGBA(const LDLColorInfo &colorInfo, int &r, int &g, int &b,
 }
 
 void LDLPalette::initColorInfo(LDLColorInfo &colorInfo, int r, int g, int b,
-							   int a)
+							   int a) const
 {
 	colorInfo.name[0] = 0;
 	colorInfo.color.r = (TCByte)r;
@@ -441,42 +501,62 @@ void LDLPalette::initColorInfo(LDLColorInfo &colorInfo, int r, int g, int b,
 
 bool LDLPalette::hasSpecular(int colorNumber)
 {
-	LDLColorInfo colorInfo = getAnyColorInfo(colorNumber);
+	LDLPackedColor packedColor;
 
-	if (colorInfo.specular[0] != -100.0f || colorInfo.specular[1] != -100.0f ||
-		colorInfo.specular[2] != -100.0f || colorInfo.specular[3] != -100.0f)
-	{
-		return true;
-	}
-	return false;
+	getPackedColor(colorNumber, packedColor);
+	return packedColor.specular;
 }
 
 bool LDLPalette::hasShininess(int colorNumber)
 {
-	return getAnyColorInfo(colorNumber).shininess != -100.0f;
+	LDLPackedColor packedColor;
+
+	getPackedColor(colorNumber, packedColor);
+	return packedColor.shininess;
 }
 
 bool LDLPalette::hasLuminance(int colorNumber)
 {
-	return getAnyColorInfo(colorNumber).luminance != -100.0f;
+	LDLPackedColor packedColor;
+
+	getPackedColor(colorNumber, packedColor);
+	return packedColor.luminance;
+}
+
+TCULong LDLPalette::getPackedRGBA(int colorNumber) const
+{
+	LDLPackedColor packedColor;
+
+	getPackedColor(colorNumber, packedColor);
+	return packedColor.rgba;
+}
+
+bool LDLPalette::isTransparent(int colorNumber) const
+{
+	LDLPackedColor packedColor;
+
+	getPackedColor(colorNumber, packedColor);
+	return packedColor.transparent;
+}
+
+// Returns true if colorInfo has been set to something, since unused entries
+// in m_colors are all zero, with an edge color of 255.
+// NOTE: static function.
+bool LDLPalette::isColorInfoSet(const LDLColorInfo &colorInfo)
+{
+	return colorInfo.color.r != 0 || colorInfo.color.g != 0 ||
+		colorInfo.color.b != 0 || colorInfo.color.a != 0 ||
+		colorInfo.edgeColorNumber != 255;
 }
 
 LDLColorInfo LDLPalette::getAnyColorInfo(int colorNumber)
 {
 	LDLColorInfo colorInfo;
-	int r, g, b, a;
 
-	// Default color is orange-ish opaque.
-	r = 255;
-	g = 128;
-	b = 0;
-	a = 255;
 	if (colorNumber < 512 && colorNumber >= 0)
 	{
 		colorInfo = m_colors[colorNumber];
-		if (colorInfo.color.r != 0 || colorInfo.color.g != 0 ||
-			colorInfo.color.b != 0 || colorInfo.color.a != 0 ||
-			colorInfo.edgeColorNumber != 255)
+		if (isColorInfoSet(colorInfo))
 		{
 			return colorInfo;
 		}
@@ -489,7 +569,24 @@ LDLColorInfo LDLPalette::getAnyColorInfo(int colorNumber)
 	{
 		return colorInfo;
 	}
-	else
+	initDirectColorInfo(colorNumber, colorInfo);
+	return colorInfo;
+}
+
+// Sets colorInfo to the color that the given number stands for when it isn't
+// in the palette, which is the default color unless it is a direct color.
+void LDLPalette::initDirectColorInfo(
+	int colorNumber,
+	LDLColorInfo &colorInfo) const
+{
+	int r, g, b, a;
+
+	// Default color is orange-ish opaque.
+	r = 255;
+	g = 128;
+	b = 0;
+	a = 255;
+	if (colorNumber >= 512 || colorNumber < 0)
 	{
 		if (colorNumber >= 0x2000000 && colorNumber < 0x4000000)
 		{
@@ -539,13 +636,16 @@ LDLColorInfo LDLPalette::getAnyColorInfo(int colorNumber)
 		}
 	}
 	initColorInfo(colorInfo, r, g, b, a);
-	return colorInfo;
 }
 
 void LDLPalette::getRGBA(int colorNumber, int& r, int& g, int& b, int& a)
 {
-	LDLColorInfo colorInfo = getAnyColorInfo(colorNumber);
-	getRGBA(colorInfo, r, g, b, a);
+	TCULong rgba = getPackedRGBA(colorNumber);
+
+	r = (int)(rgba >> 24);
+	g = (int)((rgba >> 16) & 0xFF);
+	b = (int)((rgba >> 8) & 0xFF);
+	a = (int)(rgba & 0xFF);
 }
 
 bool LDLPalette::isColorComment(const char *comment)
@@ -730,6 +830,7 @@ bool LDLPalette::parseLDrawOrgColorComment(const char *comment)
 		{
 			initSpecular(*colorInfo, 0.9f, 0.9f, 1.5f, -100.0f, 5.0f);
 		}
+		updatePackedColor(colorNumber);
 	}
 	return true;
 }
@@ -777,20 +878,19 @@ LDLColorInfo *LDLPalette::updateColor(int colorNumber, const LDLColor &color,
 	else
 	{
 		// A custom color was requested, but it won't fit into our main
-		// color array.  So add a new item in the m_customColors array, and
-		// it will be noticed during look-up.
-		CustomColor *customColor = new CustomColor;
+		// color array.  So put it in m_customColors, and it will be noticed
+		// during look-up.
+		CustomColor &customColor = m_customColors[colorNumber];
 
-		customColor->colorNumber = colorNumber;
-		colorInfo = &customColor->colorInfo;
-		m_customColors->addObject(customColor);
-		customColor->release();
+		colorInfo = &customColor.colorInfo;
+		initColorInfo(*colorInfo, 0, 0, 0, 0);
 	}
 	colorInfo->color = color;
 	colorInfo->ditherColor = ditherColor;
 	colorInfo->edgeColorNumber = edgeColorNumber;
 	colorInfo->luminance = luminance;
 	initSpecularAndShininess(*colorInfo);
+	updatePackedColor(colorNumber);
 	return colorInfo;
 }
 
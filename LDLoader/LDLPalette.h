@@ -5,6 +5,10 @@
 #include <TCFoundation/TCTypedObjectArray.h>
 #include <TCFoundation/TCStlIncludes.h>
 
+#ifdef USE_CPP11
+#include <unordered_map>
+#endif // USE_CPP11
+
 typedef std::map<std::string, int, less_no_case> CIStringIntMap;
 
 typedef struct
@@ -25,6 +29,19 @@ typedef struct
 	bool rubber;
 } LDLColorInfo;
 
+// The parts of an LDLColorInfo that get looked up for every line that uses
+// the color, worked out ahead of time and kept small enough that a number of
+// them fit in one cache line.
+typedef struct
+{
+	TCULong rgba;	// Blended with the dither color, and packed as RGBA.
+	int edgeColorNumber;
+	bool transparent;
+	bool specular;
+	bool shininess;
+	bool luminance;
+} LDLPackedColor;
+
 class LDLPalette : public TCObject
 {
 public:
@@ -32,7 +49,10 @@ public:
 	LDLPalette(const LDLPalette &other);
 	void reset(void);
 	void getRGBA(int colorNumber, int &r, int &g, int &b, int &a);
-	void getRGBA(const LDLColorInfo &colorInfo, int &r, int &g, int &b, int &a);
+	void getRGBA(const LDLColorInfo &colorInfo, int &r, int &g, int &b,
+		int &a) const;
+	TCULong getPackedRGBA(int colorNumber) const;
+	bool isTransparent(int colorNumber) const;
 	bool hasSpecular(int colorNumber);
 	bool hasShininess(int colorNumber);
 	bool hasLuminance(int colorNumber);
@@ -40,7 +60,11 @@ public:
 	bool isColorComment(const char *comment);
 	bool parseColorComment(const char *comment);
 	LDLColorInfo getAnyColorInfo(int colorNumber);
-	LDLColorInfo &getColorInfo(int index) { return m_colors[index]; }
+	const LDLColorInfo &getColorInfo(int index) const
+	{
+		return m_colors[index];
+	}
+	void getPackedColor(int colorNumber, LDLPackedColor &packedColor) const;
 	virtual int getColorNumberForRGB(TCByte r, TCByte g, TCByte b,
 		bool transparent);
 	int getColorNumberForName(const char *name) const;
@@ -57,7 +81,8 @@ protected:
 	void init(void);
 	void initStandardColors(void);
 	void initDitherColors(void);
-	void initColorInfo(LDLColorInfo &colorInfo, int r, int g, int b, int a);
+	void initColorInfo(LDLColorInfo &colorInfo, int r, int g, int b,
+		int a) const;
 	void initSpecular(int index, float sr, float sg, float sb, float sa,
 		float shininess);
 	void initRubber(int index);
@@ -68,26 +93,37 @@ protected:
 		TCByte a = 255);
 	bool parseLDLiteColorComment(const char *comment);
 	bool parseLDrawOrgColorComment(const char *comment);
-	void initSpecularAndShininess(LDLColorInfo &color);
+	void initSpecularAndShininess(LDLColorInfo &color) const;
 	bool getCustomColorRGBA(int colorNumber, int &r, int &g, int &b, int &a);
 	bool getCustomColorInfo(int colorNumber, LDLColorInfo &colorInfo);
+	void initDirectColorInfo(int colorNumber, LDLColorInfo &colorInfo) const;
+	void initPackedColor(LDLPackedColor &packedColor,
+		const LDLColorInfo &colorInfo) const;
+	void updatePackedColor(int colorNumber);
+	static bool isColorInfoSet(const LDLColorInfo &colorInfo);
 	int getBlendedColorComponent(TCULong c1, TCULong c2, TCULong a1,
-		TCULong a2);
+		TCULong a2) const;
 	virtual bool isColorNumberRGB(int colorNumber, TCByte r, TCByte g,
 		TCByte b);
 	virtual LDLColorInfo *updateColor(int colorNumber, const LDLColor &color,
 		const LDLColor &ditherColor, int edgeColorNumber,
 		float luminance = 1.0f);
 
-	class CustomColor : public TCObject
+	struct CustomColor
 	{
-	public:
-		int colorNumber;
 		LDLColorInfo colorInfo;
+		LDLPackedColor packedColor;
 	};
+#ifdef USE_CPP11
+	typedef std::unordered_map<int, CustomColor> CustomColorMap;
+#else // USE_CPP11
+	typedef std::map<int, CustomColor> CustomColorMap;
+#endif // !USE_CPP11
 
 	LDLColorInfo m_colors[512];
-	TCTypedObjectArray<CustomColor> *m_customColors;
+	LDLPackedColor m_packedColors[512];
+	// Colors whose numbers don't fit in m_colors.
+	CustomColorMap m_customColors;
 	CIStringIntMap m_namesMap;
 
 	static LDLPalette *sm_defaultPalette;
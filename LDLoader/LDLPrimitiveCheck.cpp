@@ -39,24 +39,14 @@ void LDLPrimitiveCheck::dealloc(void)
 	TCObject::dealloc();
 }
 
-TCFloat LDLPrimitiveCheck::startingFraction(const char *filename)
+TCFloat LDLPrimitiveCheck::startingFraction(const PrimitiveName &primitiveName)
 {
-	size_t i;
-
-	if (stringHasCaseInsensitivePrefix(filename, "48/") ||
-		stringHasCaseInsensitivePrefix(filename, "48\\"))
-	{
-		filename += 3;
-	}
-	sscanf(filename, "%d", &m_filenameNumerator);
-	for (i = 1; filename[i] != '-'; i++)
-	{
-		// Don't do anything.
-	}
-	sscanf(filename + i + 1, "%d", &m_filenameDenom);
+	m_filenameNumerator = primitiveName.numerator;
+	m_filenameDenom = primitiveName.denominator;
 	return (TCFloat)m_filenameNumerator / (TCFloat)m_filenameDenom;
 }
 
+// NOTE: static function.
 size_t LDLPrimitiveCheck::getStartingFractionLength(const char *filename)
 {
 	size_t i;
@@ -78,321 +68,252 @@ size_t LDLPrimitiveCheck::getStartingFractionLength(const char *filename)
 	return i >= 3 ? i : 0;
 }
 
-bool LDLPrimitiveCheck::isPrimitive(const char *filename, const char *suffix,
-								bool *is48)
+const LDLPrimitiveCheck::PrimitiveName &LDLPrimitiveCheck::getPrimitiveName(
+	const char *filename)
 {
-	size_t fileLen = strlen(filename);
-	size_t suffixLen = strlen(suffix);
-	size_t fracLen = getStartingFractionLength(filename);
+	PrimitiveNameMap::iterator it = m_primitiveNames.find(filename);
 
-	if (is48 != NULL)
-	{
-		*is48 = false;
-	}
-	if (fracLen > 0 && fileLen == suffixLen + fracLen &&
-		stringHasCaseInsensitiveSuffix(filename, suffix))
-	{
-		return true;
-	}
-	else if (is48 != NULL && (stringHasCaseInsensitivePrefix(filename, "48/") ||
-		stringHasCaseInsensitivePrefix(filename, "48\\")))
+	if (it == m_primitiveNames.end())
 	{
-		*is48 = true;
-		return isPrimitive(filename + 3, suffix, NULL);
-	}
-	return false;
-}
-
-bool LDLPrimitiveCheck::isCyli(const char *filename, bool *is48)
-{
-	return isPrimitive(filename, "cyli.dat", is48);
-}
-
-bool LDLPrimitiveCheck::isCyls(const char *filename, bool *is48)
-{
-	return isPrimitive(filename, "cyls.dat", is48);
-}
+		PrimitiveName primitiveName;
 
-bool LDLPrimitiveCheck::isCyls2(const char *filename, bool *is48)
-{
-	return isPrimitive(filename, "cyls2.dat", is48);
-}
-
-bool LDLPrimitiveCheck::isChrd(const char *filename, bool *is48)
-{
-	return isPrimitive(filename, "chrd.dat", is48);
+		classifyPrimitive(filename, primitiveName);
+		it = m_primitiveNames.insert(PrimitiveNameMap::value_type(filename,
+			primitiveName)).first;
+	}
+	return it->second;
 }
 
-bool LDLPrimitiveCheck::isDisc(const char *filename, bool *is48)
+int LDLPrimitiveCheck::countPrimitives(const StringVector &names)
 {
-	return isPrimitive(filename, "disc.dat", is48);
-}
+	int count = 0;
 
-bool LDLPrimitiveCheck::isNdis(const char *filename, bool *is48)
-{
-	return isPrimitive(filename, "ndis.dat", is48);
-}
-
-bool LDLPrimitiveCheck::isTNdis(const char *filename, bool *is48)
-{
-	if (isPrimitive(filename, "tndis.dat", is48))
+	for (size_t i = 0; i < names.size(); i++)
 	{
-		// tndis primitives must be less than a quarter circle.
-		return startingFraction(filename) < 0.25;
+		if (getPrimitiveName(names[i].c_str()).type != PTNone)
+		{
+			count++;
+		}
 	}
-	return false;
-}
-
-bool LDLPrimitiveCheck::isTang(const char *filename, bool *is48)
-{
-	return isPrimitive(filename, "tang.dat", is48);
+	return count;
 }
 
-bool LDLPrimitiveCheck::isEdge(const char *filename, bool *is48)
-{
-	return isPrimitive(filename, "edge.dat", is48);
-}
-
-bool LDLPrimitiveCheck::is1DigitCon(const char *filename, bool *is48)
+// NOTE: static function.
+void LDLPrimitiveCheck::classifyPrimitive(
+	const char *filename,
+	PrimitiveName &primitiveName)
 {
-	if (is48 != NULL)
+	// Primitives that are only recognized by their whole names.
+	static const struct
 	{
-		*is48 = false;
-	}
-	size_t fracLen = getStartingFractionLength(filename);
-	if (fracLen > 0 && strlen(filename) == fracLen + 8 &&
-		stringHasCaseInsensitivePrefix(filename + fracLen, "con") &&
-		isdigit(filename[fracLen + 3]) &&
-		stringHasCaseInsensitiveSuffix(filename, ".dat"))
+		const char *name;
+		PrimitiveType type;
+		bool isA;
+		bool is48;
+	} wholeNames[] =
+	{
+		{ "LDL-LOWRES:stu2.dat", PTStu2, false, false },
+		{ "LDL-LOWRES:stu22.dat", PTStu22, false, false },
+		{ "LDL-LOWRES:stu22a.dat", PTStu22, true, false },
+		{ "LDL-LOWRES:stu23.dat", PTStu23, false, false },
+		{ "LDL-LOWRES:stu23a.dat", PTStu23, true, false },
+		{ "LDL-LOWRES:stu24.dat", PTStu24, false, false },
+		{ "LDL-LOWRES:stu24a.dat", PTStu24, true, false },
+		{ "stud.dat", PTStud, false, false },
+		{ "1-8sphe.dat", PTEighthSphere, false, false },
+		{ "48/1-8sphe.dat", PTEighthSphere, false, true },
+		{ "48\\1-8sphe.dat", PTEighthSphere, false, true },
+		{ "1-8sphc.dat", PTEighthSphereCorner, false, false },
+		{ "48/1-8sphc.dat", PTEighthSphereCorner, false, true },
+		{ "48\\1-8sphc.dat", PTEighthSphereCorner, false, true },
+	};
+	size_t count = sizeof(wholeNames) / sizeof(wholeNames[0]);
+	size_t len;
+	size_t fracLen;
+	size_t i;
+
+	memset(&primitiveName, 0, sizeof(primitiveName));
+	primitiveName.type = PTNone;
+	for (i = 0; i < count; i++)
 	{
-		return true;
+		if (strcasecmp(filename, wholeNames[i].name) == 0)
+		{
+			primitiveName.type = wholeNames[i].type;
+			primitiveName.isA = wholeNames[i].isA;
+			primitiveName.is48 = wholeNames[i].is48;
+			return;
+		}
 	}
-	else if (is48 != NULL && (stringHasCaseInsensitivePrefix(filename, "48/") ||
-		stringHasCaseInsensitivePrefix(filename, "48\\")))
+	if (stringHasCaseInsensitivePrefix(filename, "48/") ||
+		stringHasCaseInsensitivePrefix(filename, "48\\"))
 	{
-		*is48 = true;
-		return is1DigitCon(filename + 3, NULL);
+		// None of the names below start with a digit followed by a slash, so
+		// the prefix can be skipped once up front.
+		primitiveName.is48 = true;
+		filename += 3;
 	}
-	return false;
-}
-
-bool LDLPrimitiveCheck::is2DigitCon(const char *filename, bool *is48)
-{
-	if (is48 != NULL)
+	len = strlen(filename);
+	fracLen = getStartingFractionLength(filename);
+	if (fracLen > 0)
 	{
-		*is48 = false;
+		classifyFractionPrimitive(filename, len, fracLen, primitiveName);
 	}
-	size_t fracLen = getStartingFractionLength(filename);
-	if (fracLen > 0 && strlen(filename) == fracLen + 9 &&
-		stringHasCaseInsensitivePrefix(filename + fracLen, "con") &&
-		isdigit(filename[fracLen + 3]) && isdigit(filename[fracLen + 4]) &&
-		stringHasCaseInsensitiveSuffix(filename, ".dat"))
+	else if (stringHasCaseInsensitivePrefix(filename, "ring"))
 	{
-		return true;
+		classifyOldRing(filename, len, primitiveName);
 	}
-	else if (is48 != NULL && (stringHasCaseInsensitivePrefix(filename, "48/") ||
-		stringHasCaseInsensitivePrefix(filename, "48\\")))
+	else
 	{
-		*is48 = true;
-		return is2DigitCon(filename + 3, NULL);
+		classifyTorus(filename, len, primitiveName);
 	}
-	return false;
 }
 
-bool LDLPrimitiveCheck::isCon(const char *filename, bool *is48)
-{
-	return is1DigitCon(filename, is48) || is2DigitCon(filename, is48);
-}
-
-bool LDLPrimitiveCheck::isOldRing(const char *filename, bool *is48)
+// Classifies names that start with a fraction, like 1-4cyli.dat, 1-4con3.dat,
+// or 1-4ring3.dat.
+// NOTE: static function.
+void LDLPrimitiveCheck::classifyFractionPrimitive(
+	const char *filename,
+	size_t len,
+	size_t fracLen,
+	PrimitiveName &primitiveName)
 {
-	size_t len = strlen(filename);
+	static const struct
+	{
+		const char *suffix;
+		PrimitiveType type;
+	} suffixes[] =
+	{
+		{ "cyli.dat", PTCylinder },
+		{ "cyls.dat", PTSlopedCylinder },
+		{ "cyls2.dat", PTSlopedCylinder2 },
+		{ "chrd.dat", PTChrd },
+		{ "disc.dat", PTDisc },
+		{ "ndis.dat", PTNotDisc },
+		{ "tndis.dat", PTTNotDisc },
+		{ "tang.dat", PTTangent },
+		{ "edge.dat", PTCircularEdge },
+	};
+	size_t count = sizeof(suffixes) / sizeof(suffixes[0]);
+	const char *suffix = filename + fracLen;
+	size_t suffixLen = len - fracLen;
+	size_t i;
 
-	if (is48 != NULL)
+	for (i = 1; filename[i] != '-'; i++)
 	{
-		*is48 = false;
+		// Don't do anything.
 	}
-	if (len >= 9 && len <= 12 &&
-		stringHasCaseInsensitivePrefix(filename, "ring") &&
-		stringHasCaseInsensitiveSuffix(filename, ".dat"))
+	if (!isdigit(filename[i + 1]))
 	{
-		size_t i;
-
-		for (i = 4; i < len - 5; i++)
+		// No denominator.
+		return;
+	}
+	sscanf(filename, "%d", &primitiveName.numerator);
+	sscanf(filename + i + 1, "%d", &primitiveName.denominator);
+	for (i = 0; i < count; i++)
+	{
+		if (strcasecmp(suffix, suffixes[i].suffix) == 0)
 		{
-			if (!isdigit(filename[i]))
+			if (suffixes[i].type == PTTNotDisc &&
+				(TCFloat)primitiveName.numerator /
+				(TCFloat)primitiveName.denominator >= 0.25)
 			{
-				return false;
+				// tndis primitives must be less than a quarter circle.
+				return;
 			}
+			primitiveName.type = suffixes[i].type;
+			return;
 		}
-		return true;
 	}
-	else if (is48 != NULL && (stringHasCaseInsensitivePrefix(filename, "48/") ||
-		stringHasCaseInsensitivePrefix(filename, "48\\")))
+	if (!stringHasCaseInsensitiveSuffix(suffix, ".dat"))
 	{
-		*is48 = true;
-		return isOldRing(filename + 3, NULL);
+		return;
 	}
-	else
-	{
-		return false;
-	}
-}
-
-bool LDLPrimitiveCheck::isRing(
-	const char *filename,
-	int &size,
-	bool &hasStartingFraction,
-	bool *is48)
-{
-	int offset = -1;
-	int rinLen;
-	size_t fracLen;
-
-	hasStartingFraction = true;
-	if (isOldRing(m_modelName, is48))
-	{
-		hasStartingFraction = false;
-		offset = 4;
-	}
-	else if (isRing(m_modelName, fracLen, is48))
+	if ((suffixLen == 8 || suffixLen == 9) &&
+		stringHasCaseInsensitivePrefix(suffix, "con") && isdigit(suffix[3]) &&
+		(suffixLen == 8 || isdigit(suffix[4])))
 	{
-		offset = (int)fracLen + 4;
+		primitiveName.type = PTCone;
+		sscanf(suffix + 3, "%d", &primitiveName.size);
 	}
-	else if (isRin(m_modelName, rinLen, is48))
+	else if (len >= 12 && toupper(suffix[0]) == 'R')
 	{
-		int fracLen;
-		int sfOffset = 0;
+		size_t rinLen = 1;
 
-		if (*is48)
+		// The ring can be spelled ring, rin, ri, or r, depending on how many
+		// digits its size has.
+		if (stringHasCaseInsensitivePrefix(suffix, "ring"))
 		{
-			sfOffset = 3;
+			rinLen = 4;
 		}
-		fracLen = (int)getStartingFractionLength(&filename[sfOffset]);
-		offset = fracLen + rinLen;
-	}
-	if (offset >= 0)
-	{
-		if (*is48)
+		else if (stringHasCaseInsensitivePrefix(suffix, "rin"))
 		{
-			offset += 3;
+			rinLen = 3;
+		}
+		else if (stringHasCaseInsensitivePrefix(suffix, "ri"))
+		{
+			rinLen = 2;
+		}
+		for (i = rinLen; isdigit(suffix[i]); i++)
+		{
+			// Don't do anything
+		}
+		if (i > rinLen && i == suffixLen - 4)
+		{
+			primitiveName.type = PTRing;
+			sscanf(suffix + rinLen, "%d", &primitiveName.size);
 		}
-		sscanf(filename + offset, "%d", &size);
-		return true;
-	}
-	else
-	{
-		return false;
 	}
 }
 
-bool LDLPrimitiveCheck::isRing(
+// Classifies the old ring primitives (ring1.dat through ring7777.dat), which
+// don't have a starting fraction.
+// NOTE: static function.
+void LDLPrimitiveCheck::classifyOldRing(
 	const char *filename,
-	size_t &fracLen,
-	bool *is48)
+	size_t len,
+	PrimitiveName &primitiveName)
 {
-	if (is48 != NULL)
-	{
-		*is48 = false;
-	}
-	fracLen = getStartingFractionLength(filename);
-	if (fracLen > 0 && strlen(filename) == fracLen + 9 &&
-		stringHasCaseInsensitivePrefix(filename + fracLen, "ring") &&
-		isdigit(filename[fracLen + 4]) &&
+	if (len >= 9 && len <= 12 &&
+		stringHasCaseInsensitivePrefix(filename, "ring") &&
+		isdigit(filename[4]) &&
 		stringHasCaseInsensitiveSuffix(filename, ".dat"))
 	{
-		return true;
-	}
-	else if (is48 != NULL && (stringHasCaseInsensitivePrefix(filename, "48/") ||
-		stringHasCaseInsensitivePrefix(filename, "48\\")))
-	{
-		*is48 = true;
-		return isRing(filename + 3, fracLen, NULL);
-	}
-	else
-	{
-		return false;
-	}
-}
-
-bool LDLPrimitiveCheck::isRin(const char *filename, int &rinLen, bool *is48)
-{
-	rinLen = 0;
-	if (is48 != NULL)
-	{
-		*is48 = false;
-	}
-	if (is48 != NULL && (stringHasCaseInsensitivePrefix(filename, "48/") ||
-		stringHasCaseInsensitivePrefix(filename, "48\\")))
-	{
-		*is48 = true;
-		return isRin(filename + 3, rinLen, NULL);
-	}
-	else
-	{
-		size_t fracLen = getStartingFractionLength(filename);
-		size_t len = strlen(filename);
+		size_t i;
 
-		if (len >= 12 && fracLen > 0 &&
-			stringHasCaseInsensitiveSuffix(filename, ".dat"))
+		for (i = 4; i < len - 5; i++)
 		{
-			if (stringHasCaseInsensitivePrefix(filename + fracLen, "ring"))
-			{
-				rinLen = 4;
-			}
-			else if (stringHasCaseInsensitivePrefix(filename + fracLen, "rin"))
-			{
-				rinLen = 3;
-			}
-			else if (stringHasCaseInsensitivePrefix(filename + fracLen, "ri"))
-			{
-				rinLen = 2;
-			}
-			else if (stringHasCaseInsensitivePrefix(filename + fracLen, "r"))
-			{
-				rinLen = 1;
-			}
-			if (rinLen > 0)
+			if (!isdigit(filename[i]))
 			{
-				size_t i;
-
-				for (i = fracLen + rinLen; isdigit(filename[i]); i++)
-				{
-					// Don't do anything
-				}
-				if (i > fracLen + rinLen && i == len - 4)
-				{
-					return true;
-				}
+				return;
 			}
 		}
-		return false;
+		primitiveName.type = PTOldRing;
+		sscanf(filename + 4, "%d", &primitiveName.size);
 	}
 }
 
-bool LDLPrimitiveCheck::isTorus(
+// Classifies tori, like t04o1429.dat, r04o1429.dat, or tm04i3333.dat.  The
+// two digits after the prefix are the denominator of the fraction, and the
+// four after the type letter are the size.
+// NOTE: static function.
+void LDLPrimitiveCheck::classifyTorus(
 	const char *filename,
-	bool allowR,
-	bool &isMixed,
-	bool *is48)
+	size_t len,
+	PrimitiveName &primitiveName)
 {
-	if (is48 != NULL)
+	char prefix = (char)toupper(filename[0]);
+	size_t prefixSize = 1;
+
+	if (prefix != 'T' && prefix != 'R')
 	{
-		*is48 = false;
+		return;
 	}
-	size_t len = strlen(filename);
-	size_t expectedLen = 12;
-	size_t prefixSize = 1;
-	isMixed = false;
-	if (len == 13 && (toupper(filename[0]) == 'T' ||
-		toupper(filename[0]) == 'R') && toupper(filename[1]) == 'M')
+	if (len == 13 && toupper(filename[1]) == 'M')
 	{
-		expectedLen = 13;
 		prefixSize = 2;
-		isMixed = true;
+		primitiveName.isMixed = true;
 	}
-	if (len == expectedLen && (toupper(filename[0]) == 'T' ||
-		(toupper(filename[0]) == 'R' && allowR)) &&
+	if (len == prefixSize + 11 &&
 		isdigit(filename[prefixSize]) &&
 		isdigit(filename[prefixSize + 1]) &&
 		isdigit(filename[prefixSize + 3]) &&
@@ -401,77 +322,29 @@ bool LDLPrimitiveCheck::isTorus(
 		isdigit(filename[prefixSize + 6]) &&
 		stringHasCaseInsensitiveSuffix(filename, ".dat"))
 	{
-		return true;
-	}
-	else if (is48 != NULL && (stringHasCaseInsensitivePrefix(filename, "48/") ||
-		stringHasCaseInsensitivePrefix(filename, "48\\")))
-	{
-		*is48 = true;
-		return isTorus(filename + 3, allowR, isMixed, NULL);
+		switch (toupper(filename[prefixSize + 2]))
+		{
+		case 'O':
+			primitiveName.type = PTTorusO;
+			break;
+		case 'I':
+			primitiveName.type = PTTorusI;
+			break;
+		case 'Q':
+			primitiveName.type = PTTorusQ;
+			break;
+		default:
+			primitiveName.isMixed = false;
+			return;
+		}
+		primitiveName.isR = prefix == 'R';
+		primitiveName.numerator = 1;
+		sscanf(filename + prefixSize, "%d", &primitiveName.denominator);
+		sscanf(filename + prefixSize + 3, "%d", &primitiveName.size);
 	}
 	else
 	{
-		return false;
-	}
-}
-
-bool LDLPrimitiveCheck::isTorusO(
-	const char *filename,
-	bool &isMixed,
-	bool &is48)
-{
-	if (isTorus(filename, allowRTori(), isMixed, &is48))
-	{
-		size_t spot = isMixed ? 4 : 3;
-		if (is48)
-		{
-			spot += 3;
-		}
-		return toupper(filename[spot]) == 'O';
-	}
-	else
-	{
-		return false;
-	}
-}
-
-bool LDLPrimitiveCheck::isTorusI(
-	const char *filename,
-	bool &isMixed,
-	bool &is48)
-{
-	if (isTorus(filename, false, isMixed, &is48))
-	{
-		size_t spot = isMixed ? 4 : 3;
-		if (is48)
-		{
-			spot += 3;
-		}
-		return toupper(filename[spot]) == 'I';
-	}
-	else
-	{
-		return false;
-	}
-}
-
-bool LDLPrimitiveCheck::isTorusQ(
-	const char *filename,
-	bool &isMixed,
-	bool &is48)
-{
-	if (isTorus(filename, false, isMixed, &is48))
-	{
-		size_t spot = isMixed ? 4 : 3;
-		if (is48)
-		{
-			spot += 3;
-		}
-		return toupper(filename[spot]) == 'Q';
-	}
-	else
-	{
-		return false;
+		primitiveName.isMixed = false;
 	}
 }
 
@@ -560,175 +433,104 @@ bool LDLPrimitiveCheck::performPrimitiveSubstitution(
 
 	if (getPrimitiveSubstitutionFlag())
 	{
-		bool is48;
-		bool isMixed;
-		int size;
-		bool hasStartingFraction;
-
 		if (!m_modelName)
 		{
 			return false;
 		}
-		if (strcasecmp(m_modelName, "LDL-LOWRES:stu2.dat") == 0)
-		{
-			return substituteStu2();
-		}
-		else if (strcasecmp(m_modelName, "LDL-LOWRES:stu22.dat") == 0)
-		{
-			return substituteStu22(false, bfc);
-		}
-		else if (strcasecmp(m_modelName, "LDL-LOWRES:stu22a.dat") == 0)
-		{
-			return substituteStu22(true, bfc);
-		}
-		else if (strcasecmp(m_modelName, "LDL-LOWRES:stu23.dat") == 0)
-		{
-			return substituteStu23(false, bfc);
-		}
-		else if (strcasecmp(m_modelName, "LDL-LOWRES:stu23a.dat") == 0)
-		{
-			return substituteStu23(true, bfc);
-		}
-		else if (strcasecmp(m_modelName, "LDL-LOWRES:stu24.dat") == 0)
-		{
-			return substituteStu24(false, bfc);
-		}
-		else if (strcasecmp(m_modelName, "LDL-LOWRES:stu24a.dat") == 0)
-		{
-			return substituteStu24(true, bfc);
-		}
-		else if (strcasecmp(m_modelName, "stud.dat") == 0)
+		const PrimitiveName &primitiveName = getPrimitiveName(m_modelName);
+		bool is48 = primitiveName.is48;
+		bool isA = primitiveName.isA;
+		int size = primitiveName.size;
+
+		switch (primitiveName.type)
 		{
+		case PTNone:
+			break;
+		case PTStud:
 			return substituteStud();
-		}
-		else if (strcasecmp(m_modelName, "1-8sphe.dat") == 0)
-		{
-			return substituteEighthSphere(bfc);
-		}
-		else if (strcasecmp(m_modelName, "48/1-8sphe.dat") == 0 ||
-			strcasecmp(m_modelName, "48\\1-8sphe.dat") == 0)
-		{
-			return substituteEighthSphere(bfc, true);
-		}
-		else if (strcasecmp(m_modelName, "1-8sphc.dat") == 0)
-		{
-			return substituteEighthSphereCorner(bfc);
-		}
-		else if (strcasecmp(m_modelName, "48/1-8sphc.dat") == 0 ||
-			strcasecmp(m_modelName, "48\\1-8sphc.dat") == 0)
-		{
-			return substituteEighthSphereCorner(bfc, true);
-		}
-		else if (isCyli(m_modelName, &is48))
-		{
-			return substituteCylinder(startingFraction(m_modelName),
+		case PTStu2:
+			return substituteStu2();
+		case PTStu22:
+			return substituteStu22(isA, bfc);
+		case PTStu23:
+			return substituteStu23(isA, bfc);
+		case PTStu24:
+			return substituteStu24(isA, bfc);
+		case PTEighthSphere:
+			return substituteEighthSphere(bfc, is48);
+		case PTEighthSphereCorner:
+			return substituteEighthSphereCorner(bfc, is48);
+		case PTCylinder:
+			return substituteCylinder(startingFraction(primitiveName), bfc,
+				is48);
+		case PTSlopedCylinder:
+			return substituteSlopedCylinder(startingFraction(primitiveName),
 				bfc, is48);
-		}
-		else if (isCyls(m_modelName, &is48))
-		{
-			return substituteSlopedCylinder(startingFraction(m_modelName), bfc,
+		case PTSlopedCylinder2:
+			return substituteSlopedCylinder2(startingFraction(primitiveName),
+				bfc, is48);
+		case PTChrd:
+			return substituteChrd(startingFraction(primitiveName), bfc, is48);
+		case PTDisc:
+			return substituteDisc(startingFraction(primitiveName), bfc, is48);
+		case PTNotDisc:
+			return substituteNotDisc(startingFraction(primitiveName), bfc,
 				is48);
-		}
-		else if (isCyls2(m_modelName, &is48))
-		{
-			return substituteSlopedCylinder2(startingFraction(m_modelName), bfc,
+		case PTTNotDisc:
+			return substituteTNotDisc(startingFraction(primitiveName), bfc,
 				is48);
-		}
-		else if (isChrd(m_modelName, &is48))
-		{
-			return substituteChrd(startingFraction(m_modelName), bfc,
+		case PTTangent:
+			return substituteTangent(startingFraction(primitiveName), bfc,
 				is48);
-		}
-		else if (isDisc(m_modelName, &is48))
-		{
-			return substituteDisc(startingFraction(m_modelName), bfc,
+		case PTCircularEdge:
+			return substituteCircularEdge(startingFraction(primitiveName),
 				is48);
-		}
-		else if (isNdis(m_modelName, &is48))
-		{
-			return substituteNotDisc(startingFraction(m_modelName),
-									 bfc, is48);
-		}
-		else if (isTNdis(m_modelName, &is48))
-		{
-			return substituteTNotDisc(startingFraction(m_modelName),
-									  bfc, is48);
-		}
-		else if (isTang(m_modelName, &is48))
-		{
-			return substituteTangent(startingFraction(m_modelName),
-				bfc, is48);
-		}
-		else if (isEdge(m_modelName, &is48))
-		{
-			return substituteCircularEdge(startingFraction(m_modelName), is48);
-		}
-		else if (isCon(m_modelName, &is48))
-		{
-			int offset = 0;
-
-			if (is48)
-			{
-				offset = 3;
-			}
-			size_t fracLen = getStartingFractionLength(&m_modelName[offset]);
-			sscanf(m_modelName + fracLen + 3 + offset, "%d", &size);
-			return substituteCone(startingFraction(m_modelName), size,
-				bfc, is48);
-		}
-		else if (isRing(m_modelName, size, hasStartingFraction, &is48))
-		{
-			if (hasStartingFraction)
-			{
-				return substituteRing(startingFraction(m_modelName), size,
-					bfc, is48);
-			}
-			else
-			{
-				return substituteRing(1.0f, size, bfc, is48, true);
-			}
-		}
-		else if (isTorus(m_modelName, true, isMixed, &is48))
-		{
-			TCFloat fraction;
-			int offset = 0;
-			const char *name = m_modelName;
-
-			if (isMixed)
-			{
-				++name;
-			}
-			if (is48)
-			{
-				name += 3;
-			}
-			m_filenameNumerator = 1;
-			sscanf(name + 1 + offset, "%d", &m_filenameDenom);
-			sscanf(name + 4 + offset, "%d", &size);
-			fraction = 1.0f / (TCFloat)m_filenameDenom;
-			if (isTorusO(m_modelName, isMixed, is48))
+		case PTCone:
+			return substituteCone(startingFraction(primitiveName), size, bfc,
+				is48);
+		case PTRing:
+			return substituteRing(startingFraction(primitiveName), size, bfc,
+				is48);
+		case PTOldRing:
+			return substituteRing(1.0f, size, bfc, is48, true);
+		case PTTorusO:
+		case PTTorusI:
+		case PTTorusQ:
 			{
-				int rOffset = 0;
+				bool isMixed = primitiveName.isMixed;
+				TCFloat fraction;
 
-				if (is48)
+				m_filenameNumerator = 1;
+				m_filenameDenom = primitiveName.denominator;
+				fraction = 1.0f / (TCFloat)m_filenameDenom;
+				if (primitiveName.type == PTTorusO)
 				{
-					rOffset = 3;
+					if (primitiveName.isR)
+					{
+						if (!allowRTori())
+						{
+							break;
+						}
+						size = -size;
+					}
+					return substituteTorusIO(false, fraction, size, bfc,
+						isMixed, is48);
 				}
-				if (toupper(m_modelName[rOffset]) == 'R')
+				else if (primitiveName.isR)
 				{
-					size = -size;
+					// Only outside tori come in an r version.
+					break;
+				}
+				else if (primitiveName.type == PTTorusI)
+				{
+					return substituteTorusIO(true, fraction, size, bfc,
+						isMixed, is48);
+				}
+				else
+				{
+					return substituteTorusQ(fraction, size, bfc, isMixed,
+						is48);
 				}
-				return substituteTorusIO(false, fraction, size, bfc, isMixed,
-					is48);
-			}
-			else if (isTorusI(m_modelName, isMixed, is48))
-			{
-				return substituteTorusIO(true, fraction, size, bfc, isMixed,
-					is48);
-			}
-			else if (isTorusQ(m_modelName, isMixed, is48))
-			{
-				return substituteTorusQ(fraction, size, bfc, isMixed, is48);
 			}
 		}
 	}
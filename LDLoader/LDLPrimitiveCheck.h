@@ -2,6 +2,7 @@
 #define __LDLPRIMITIVECHECK_H__
 
 #include <TCFoundation/TCAlertSender.h>
+#include <TCFoundation/TCStlIncludes.h>
 
 #include <string.h>
 
@@ -27,7 +28,58 @@ public:
 	virtual void setAlertSender(TCObject *value) { m_alertSender = value; }
 	virtual void setTexmapsFlag(bool value ) { m_flags.texmaps = value; }
 	virtual bool getTexmapsFlag(void) const { return m_flags.texmaps != false; }
+	// Classifies each of names the way performPrimitiveSubstitution does, and
+	// returns how many of them are primitives it knows how to substitute.
+	// LDrawModelViewer uses this to time the classifier over the p directory.
+	int countPrimitives(const StringVector &names);
 protected:
+	enum PrimitiveType
+	{
+		PTNone,
+		PTStud,
+		PTStu2,
+		PTStu22,
+		PTStu23,
+		PTStu24,
+		PTEighthSphere,
+		PTEighthSphereCorner,
+		PTCylinder,
+		PTSlopedCylinder,
+		PTSlopedCylinder2,
+		PTChrd,
+		PTDisc,
+		PTNotDisc,
+		PTTNotDisc,
+		PTTangent,
+		PTCircularEdge,
+		PTCone,
+		PTRing,
+		PTOldRing,
+		PTTorusO,
+		PTTorusI,
+		PTTorusQ
+	};
+	// Everything performPrimitiveSubstitution needs to know about a model
+	// name, worked out in one pass by classifyPrimitive.
+	struct PrimitiveName
+	{
+		PrimitiveType type;
+		// Starting fraction, for types whose names begin with one.
+		int numerator;
+		int denominator;
+		// Cone, ring, or torus size.
+		int size;
+		bool is48;
+		// stu22a.dat, stu23a.dat, or stu24a.dat.
+		bool isA;
+		// Torus whose name starts with tm or rm.
+		bool isMixed;
+		// Torus whose name starts with r instead of t.
+		bool isR;
+	};
+	typedef std::map<std::string, PrimitiveName, less_no_case>
+		PrimitiveNameMap;
+
 	virtual ~LDLPrimitiveCheck(void);
 	virtual void dealloc(void);
 	virtual bool performPrimitiveSubstitution(LDLModel *ldlModel,
@@ -71,33 +123,17 @@ protected:
 	virtual bool substituteRing(TCFloat /*fraction*/, int /*size*/,
 		bool /*bfc*/, bool /*is48*/ = false, bool /*isOld*/ = false)
 		{ return false; }
-	virtual TCFloat startingFraction(const char *filename);
-	virtual size_t getStartingFractionLength(const char *filename);
-	virtual bool isPrimitive(const char *filename, const char *suffix,
-		bool *is48 = NULL);
-	virtual bool isCyli(const char *filename, bool *is48 = NULL);
-	virtual bool isCyls(const char *filename, bool *is48 = NULL);
-	virtual bool isCyls2(const char *filename, bool *is48 = NULL);
-	virtual bool isChrd(const char *filename, bool *is48 = NULL);
-	virtual bool isDisc(const char *filename, bool *is48 = NULL);
-	virtual bool isNdis(const char *filename, bool *is48 = NULL);
-	virtual bool isTNdis(const char *filename, bool *is48 = NULL);
-	virtual bool isTang(const char *filename, bool *is48 = NULL);
-	virtual bool isEdge(const char *filename, bool *is48 = NULL);
-	virtual bool is1DigitCon(const char *filename, bool *is48 = NULL);
-	virtual bool is2DigitCon(const char *filename, bool *is48 = NULL);
-	virtual bool isCon(const char *filename, bool *is48 = NULL);
-	virtual bool isOldRing(const char *filename, bool *is48 = NULL);
-	virtual bool isRing(const char *filename, int &size,
-		bool &hasStartingFraction, bool *is48 = NULL);
-	virtual bool isRing(const char *filename, size_t &fracLen,
-		bool *is48 = NULL);
-	virtual bool isRin(const char *filename, int &rinLen, bool *is48 = NULL);
-	virtual bool isTorus(const char *filename, bool allowR, bool &isMixed,
-		bool *is48 = NULL);
-	virtual bool isTorusO(const char *filename, bool &isMixed, bool &is48);
-	virtual bool isTorusI(const char *filename, bool &isMixed, bool &is48);
-	virtual bool isTorusQ(const char *filename, bool &isMixed, bool &is48);
+	virtual TCFloat startingFraction(const PrimitiveName &primitiveName);
+	virtual const PrimitiveName &getPrimitiveName(const char *filename);
+	static void classifyPrimitive(const char *filename,
+		PrimitiveName &primitiveName);
+	static void classifyFractionPrimitive(const char *filename, size_t len,
+		size_t fracLen, PrimitiveName &primitiveName);
+	static void classifyOldRing(const char *filename, size_t len,
+		PrimitiveName &primitiveName);
+	static void classifyTorus(const char *filename, size_t len,
+		PrimitiveName &primitiveName);
+	static size_t getStartingFractionLength(const char *filename);
 	virtual bool allowRTori(void) const { return true; }
 	virtual int getNumCircleSegments(TCFloat fraction = 0.0f, bool is48 = false);
 	virtual int getUsedCircleSegments(int numSegments, TCFloat fraction);
@@ -107,6 +143,8 @@ protected:
 	int m_filenameNumerator;
 	int m_filenameDenom;
 	const char *m_modelName;
+	// Results of classifyPrimitive for every model name seen so far.
+	PrimitiveNameMap m_primitiveNames;
 	struct
 	{
 		bool primitiveSubstitution:1;
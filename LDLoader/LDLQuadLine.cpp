@@ -12,8 +12,9 @@
 #endif // WIN32
 
 LDLQuadLine::LDLQuadLine(LDLModel *parentModel, const char *line,
-						 int lineNumber, const char *originalLine)
-	:LDLShapeLine(parentModel, line, lineNumber, originalLine),
+						 int lineNumber, const char *originalLine,
+						 LDLLineArena *arena)
+	:LDLShapeLine(parentModel, line, lineNumber, originalLine, arena),
 	m_colinearIndex(-1),
 	m_matchingIndex(-1)
 {
@@ -28,36 +29,16 @@ LDLQuadLine::LDLQuadLine(const LDLQuadLine &other)
 
 bool LDLQuadLine::parse(void)
 {
-	float x1, y1, z1;
-	float x2, y2, z2;
-	float x3, y3, z3;
-	float x4, y4, z4;
-	int lineType;
-
-	if (sscanf(m_line, "%d %i %f %f %f %f %f %f %f %f %f %f %f %f", &lineType,
-		&m_colorNumber, &x1, &y1, &z1, &x2, &y2, &z2, &x3, &y3, &z3,
-		&x4, &y4, &z4) == 14)
-	{
-		std::string prefix = getTypeAndColorPrefix();
-		std::stringstream ss;
-		if (!prefix.empty())
-		{
-			ss << prefix << "  ";
-		}
-		else
-		{
-			ss << "4 " << m_colorNumber << "  ";
-		}
-		ss << x1 << " " << y1 << " " << z1 << "  ";
-		ss << x2 << " " << y2 << " " << z2 << "  ";
-		ss << x3 << " " << y3 << " " << z3 << "  ";
-		ss << x4 << " " << y4 << " " << z4 << "  ";
-		m_formattedLine = copyString(ss.str().c_str());
+	float values[12];
+
+	if (readValues(values, 12))
+	{
+		m_actionFlags.formatValueCount = 12;
 		m_points = new TCVector[4];
-		m_points[0] = TCVector(x1, y1, z1);
-		m_points[1] = TCVector(x2, y2, z2);
-		m_points[2] = TCVector(x3, y3, z3);
-		m_points[3] = TCVector(x4, y4, z4);
+		m_points[0] = TCVector(values[0], values[1], values[2]);
+		m_points[1] = TCVector(values[3], values[4], values[5]);
+		m_points[2] = TCVector(values[6], values[7], values[8]);
+		m_points[3] = TCVector(values[9], values[10], values[11]);
 		if (!getMainModel()->getSkipValidation())
 		{
 			// Note that we don't care what the second matching index is,
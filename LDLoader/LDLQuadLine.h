@@ -15,7 +15,8 @@ public:
 	virtual LDLFileLineArray *getReplacementLines(void);
 protected:
 	LDLQuadLine(LDLModel *parentModel, const char *line, int lineNumber,
-		const char *originalLine = NULL);
+		const char *originalLine = NULL,
+		LDLLineArena *arena = NULL);
 	LDLQuadLine(const LDLQuadLine &other);
 	void swapPointsIfNeeded(void);
 	void checkForColinearPoints(void);
@@ -9,8 +9,9 @@
 #endif // WIN32
 
 LDLShapeLine::LDLShapeLine(LDLModel *parentModel, const char *line,
-						   int lineNumber, const char *originalLine)
-	:LDLActionLine(parentModel, line, lineNumber, originalLine),
+						   int lineNumber, const char *originalLine,
+						   LDLLineArena *arena)
+	:LDLActionLine(parentModel, line, lineNumber, originalLine, arena),
 	m_points(NULL)
 {
 }
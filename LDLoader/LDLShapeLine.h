@@ -20,7 +20,8 @@ public:
 		bool watchBBoxIgnore) const;
 protected:
 	LDLShapeLine(LDLModel *parentModel, const char *line, int lineNumber,
-		const char *originalLine = NULL);
+		const char *originalLine = NULL,
+		LDLLineArena *arena = NULL);
 	LDLShapeLine(const LDLShapeLine &other);
 	virtual void dealloc(void);
 	int middleIndex(const TCVector &p1, const TCVector &p2, const TCVector &p3)
@@ -11,8 +11,9 @@
 #endif // WIN32
 
 LDLTriangleLine::LDLTriangleLine(LDLModel *parentModel, const char *line,
-							   int lineNumber, const char *originalLine)
-	:LDLShapeLine(parentModel, line, lineNumber, originalLine),
+							   int lineNumber, const char *originalLine,
+							   LDLLineArena *arena)
+	:LDLShapeLine(parentModel, line, lineNumber, originalLine, arena),
 	m_colinearIndex(-1),
 	m_matchingIndex(-1)
 {
@@ -27,32 +28,15 @@ LDLTriangleLine::LDLTriangleLine(const LDLTriangleLine &other)
 
 bool LDLTriangleLine::parse(void)
 {
-	float x1, y1, z1;
-	float x2, y2, z2;
-	float x3, y3, z3;
-	int lineType;
+	float values[9];
 
-	if (sscanf(m_line, "%d %i %f %f %f %f %f %f %f %f %f", &lineType,
-		&m_colorNumber, &x1, &y1, &z1, &x2, &y2, &z2, &x3, &y3, &z3) == 11)
+	if (readValues(values, 9))
 	{
-		std::string prefix = getTypeAndColorPrefix();
-		std::stringstream ss;
-		if (!prefix.empty())
-		{
-			ss << prefix << "  ";
-		}
-		else
-		{
-			ss << "3 " << m_colorNumber << "  ";
-		}
-		ss << x1 << " " << y1 << " " << z1 << "  ";
-		ss << x2 << " " << y2 << " " << z2 << "  ";
-		ss << x3 << " " << y3 << " " << z3 << "  ";
-		m_formattedLine = copyString(ss.str().c_str());
+		m_actionFlags.formatValueCount = 9;
 		m_points = new TCVector[3];
-		m_points[0] = TCVector(x1, y1, z1);
-		m_points[1] = TCVector(x2, y2, z2);
-		m_points[2] = TCVector(x3, y3, z3);
+		m_points[0] = TCVector(values[0], values[1], values[2]);
+		m_points[1] = TCVector(values[3], values[4], values[5]);
+		m_points[2] = TCVector(values[6], values[7], values[8]);
 		if (!getMainModel()->getSkipValidation())
 		{
 			// Note that we don't care what the second matching index is,
@@ -16,7 +16,8 @@ public:
 	virtual LDLFileLineArray *getReplacementLines(void);
 protected:
 	LDLTriangleLine(LDLModel *parentModel, const char *line, int lineNumber,
-		const char *originalLine = NULL);
+		const char *originalLine = NULL,
+		LDLLineArena *arena = NULL);
 	LDLTriangleLine(const LDLTriangleLine &other);
 	void checkForColinearPoints(void);
 	int getColinearIndex(void);
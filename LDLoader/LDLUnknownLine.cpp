@@ -8,8 +8,9 @@
 #endif // WIN32
 
 LDLUnknownLine::LDLUnknownLine(LDLModel *parentModel, const char *line,
-							   int lineNumber, const char *originalLine)
-	:LDLFileLine(parentModel, line, lineNumber, originalLine)
+							   int lineNumber, const char *originalLine,
+							   LDLLineArena *arena)
+	:LDLFileLine(parentModel, line, lineNumber, originalLine, arena)
 {
 }
 
@@ -11,7 +11,8 @@ public:
 	virtual LDLLineType getLineType(void) const { return LDLLineTypeUnknown; }
 protected:
 	LDLUnknownLine(LDLModel *parentModel, const char *line, int lineNumber,
-		const char *originalLine = NULL);
+		const char *originalLine = NULL,
+		LDLLineArena *arena = NULL);
 	LDLUnknownLine(const LDLUnknownLine &other);
 	virtual ~LDLUnknownLine(void);
 
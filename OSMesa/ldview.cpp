@@ -1,7 +1,10 @@
 #include <stdio.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <string>
 #include <map>
@@ -13,6 +16,8 @@
 #include <TCFoundation/TCAlertManager.h>
 #include <TCFoundation/TCProgressAlert.h>
 #include <TCFoundation/TCLocalStrings.h>
+#include <TCFoundation/TCPngOptions.h>
+#include <LDLib/LDUserDefaultsKeys.h>
 #include <GL/osmesa.h>
 #include <TRE/TREMainModel.h>
 #include "StudLogo.h"
@@ -20,6 +25,13 @@
 
 typedef std::map<std::string, std::string> StringMap;
 
+// State of a -Jobs worker process.
+static int *s_nextModelIndex = NULL;
+static int s_claimedModelIndex = -1;
+static std::string s_jobsDir;
+static int s_stdoutFd = -1;
+static int s_stderrFd = -1;
+
 #define DEPTH_BPP 24
 // Note: buffer contains only color buffer, not depth and stencil.
 #define BYTES_PER_PIXEL 4
@@ -250,17 +262,11 @@ bool fileCaseCallback(char *filename)
 	return false;
 }
 
-int main(int argc, char *argv[])
+void doCommandLine(void)
 {
 	void *buffer;
 	OSMesaContext ctx;
-	int stringTableSize = sizeof(LDViewMessages_bytes);
-	char *stringTable = new char[sizeof(LDViewMessages_bytes) + 1];
 
-	memcpy(stringTable, LDViewMessages_bytes, stringTableSize);
-	stringTable[stringTableSize] = 0;
-	TCLocalStrings::setStringTable(stringTable);
-	setupDefaults(argv);
 	if ((buffer = setupContext(ctx)) != NULL)
 	{
 		//ProgressHandler *progressHandler = new ProgressHandler;
@@ -273,6 +279,239 @@ int main(int argc, char *argv[])
 		free(buffer);
 		//TCObject::release(progressHandler);
 	}
+}
+
+std::string jobFilename(int modelIndex, const char *extension)
+{
+	char filename[64];
+
+	sprintf(filename, "/%d%s", modelIndex, extension);
+	return s_jobsDir + filename;
+}
+
+bool redirectOutput(int fd, const std::string &filename)
+{
+	int fileFd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fileFd < 0)
+	{
+		return false;
+	}
+	dup2(fileFd, fd);
+	close(fileFd);
+	return true;
+}
+
+// Model callback used by -Jobs worker processes.  Each worker goes through all
+// of the models on the command line, but only processes the ones it manages to
+// claim from the shared model counter.  The output from each model goes into
+// its own files, which get renamed once the model is done, so that the parent
+// process can print them in order.
+bool jobModelCallback(int modelIndex, bool finished)
+{
+	fflush(stdout);
+	fflush(stderr);
+	if (finished)
+	{
+		dup2(s_stdoutFd, STDOUT_FILENO);
+		dup2(s_stderrFd, STDERR_FILENO);
+		// The parent waits for the .out file, so it has to be renamed last.
+		rename(jobFilename(modelIndex, ".err.tmp").c_str(),
+			jobFilename(modelIndex, ".err").c_str());
+		rename(jobFilename(modelIndex, ".out.tmp").c_str(),
+			jobFilename(modelIndex, ".out").c_str());
+		return true;
+	}
+	if (s_claimedModelIndex < modelIndex)
+	{
+		s_claimedModelIndex = __sync_fetch_and_add(s_nextModelIndex, 1);
+	}
+	if (s_claimedModelIndex != modelIndex)
+	{
+		return false;
+	}
+	redirectOutput(STDOUT_FILENO, jobFilename(modelIndex, ".out.tmp"));
+	redirectOutput(STDERR_FILENO, jobFilename(modelIndex, ".err.tmp"));
+	return true;
+}
+
+// Adds -key=value to the command line, unless key was already given on it.
+void addDefaultCommandLineArg(const char *key, const char *value)
+{
+	if (TCUserDefaults::commandLineStringForKey(key).empty())
+	{
+		std::string arg = "-";
+
+		arg += key;
+		arg += "=";
+		arg += value;
+		TCUserDefaults::addCommandLineArg(arg.c_str());
+	}
+}
+
+void runJob(int jobIndex)
+{
+	if (jobIndex > 0)
+	{
+		// Output that doesn't belong to any one model is the same in every
+		// worker, so only the first one shows it.
+		redirectOutput(STDOUT_FILENO, "/dev/null");
+		redirectOutput(STDERR_FILENO, "/dev/null");
+	}
+	s_stdoutFd = dup(STDOUT_FILENO);
+	s_stderrFd = dup(STDERR_FILENO);
+	setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+	// The workers already keep all the processors busy, so by default they
+	// write their images on the same thread that renders them.
+	addDefaultCommandLineArg(SNAPSHOT_ENCODE_THREADS_KEY, "0");
+	TCPngOptions::setDefaultThreadCount(1);
+	LDSnapshotTaker::setModelCallback(jobModelCallback);
+	doCommandLine();
+}
+
+bool printFile(const std::string &filename, FILE *stream)
+{
+	FILE *file = fopen(filename.c_str(), "rb");
+	char buf[4096];
+	size_t count;
+
+	if (file == NULL)
+	{
+		return false;
+	}
+	while ((count = fread(buf, 1, sizeof(buf), file)) > 0)
+	{
+		fwrite(buf, 1, count, stream);
+	}
+	fclose(file);
+	fflush(stream);
+	remove(filename.c_str());
+	return true;
+}
+
+// Prints the output of the finished models in order, starting at
+// modelIndex, and returns the index of the first model that hasn't been
+// printed yet.  Once all the workers are done, the output of models whose
+// workers died part way through is printed too.
+int printJobOutput(int modelIndex, bool workersDone)
+{
+	while (modelIndex < *s_nextModelIndex)
+	{
+		if (printFile(jobFilename(modelIndex, ".out"), stdout))
+		{
+			printFile(jobFilename(modelIndex, ".err"), stderr);
+		}
+		else if (workersDone)
+		{
+			if (printFile(jobFilename(modelIndex, ".out.tmp"), stdout))
+			{
+				printFile(jobFilename(modelIndex, ".err.tmp"), stderr);
+				fprintf(stderr, "Job for model %d did not finish.\n",
+					modelIndex + 1);
+			}
+		}
+		else
+		{
+			break;
+		}
+		modelIndex++;
+	}
+	return modelIndex;
+}
+
+// Renders the models on the command line with jobCount worker processes.
+// Each worker has its own OSMesa context and model viewer.  Returns false if
+// none of the workers could be started.
+bool runJobs(int jobCount)
+{
+	const char *tmpDir = getenv("TMPDIR");
+	std::string dirTemplate;
+	int startedCount = 0;
+	int runningCount;
+	int modelIndex = 0;
+	int status;
+
+	if (tmpDir == NULL || tmpDir[0] == 0)
+	{
+		tmpDir = "/tmp";
+	}
+	dirTemplate = tmpDir;
+	dirTemplate += "/ldviewXXXXXX";
+	if (mkdtemp(&dirTemplate[0]) == NULL)
+	{
+		printf("Error creating temporary directory for -Jobs.\n");
+		return false;
+	}
+	s_jobsDir = dirTemplate;
+	s_nextModelIndex = (int *)mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (s_nextModelIndex == MAP_FAILED)
+	{
+		printf("Error creating shared memory for -Jobs.\n");
+		rmdir(s_jobsDir.c_str());
+		return false;
+	}
+	*s_nextModelIndex = 0;
+	// Unless told otherwise, the workers share the parsed parts library
+	// through the library cache file, instead of each one parsing the parts
+	// that it uses from scratch.
+	addDefaultCommandLineArg(LIBRARY_CACHE_KEY, "1");
+	fflush(stdout);
+	fflush(stderr);
+	for (int i = 0; i < jobCount; i++)
+	{
+		pid_t pid = fork();
+
+		if (pid == 0)
+		{
+			runJob(i);
+			TCAutoreleasePool::processReleases();
+			fflush(stdout);
+			fflush(stderr);
+			_exit(0);
+		}
+		else if (pid < 0)
+		{
+			printf("Error starting -Jobs worker process.\n");
+			break;
+		}
+		startedCount++;
+	}
+	runningCount = startedCount;
+	while (runningCount > 0)
+	{
+		while (runningCount > 0 && waitpid(-1, &status, WNOHANG) > 0)
+		{
+			runningCount--;
+		}
+		modelIndex = printJobOutput(modelIndex, false);
+		if (runningCount > 0)
+		{
+			usleep(20000);
+		}
+	}
+	printJobOutput(modelIndex, true);
+	munmap(s_nextModelIndex, sizeof(int));
+	s_nextModelIndex = NULL;
+	rmdir(s_jobsDir.c_str());
+	return startedCount > 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int stringTableSize = sizeof(LDViewMessages_bytes);
+	char *stringTable = new char[sizeof(LDViewMessages_bytes) + 1];
+	int jobCount;
+
+	memcpy(stringTable, LDViewMessages_bytes, stringTableSize);
+	stringTable[stringTableSize] = 0;
+	TCLocalStrings::setStringTable(stringTable);
+	setupDefaults(argv);
+	jobCount = (int)TCUserDefaults::longForKey(JOBS_KEY, 1, false);
+	if (jobCount <= 1 || !runJobs(jobCount))
+	{
+		doCommandLine();
+	}
 	TCAutoreleasePool::processReleases();
 	return 0;
 }
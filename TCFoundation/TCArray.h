@@ -190,6 +190,19 @@ public:
 		return count;
 	}
 
+	// Changes the count without touching the items.  This is for when the
+	// items have been filled in directly through getItems(), so newCount
+	// can't be more than the capacity.
+	int setCount(unsigned newCount)
+	{
+		if (newCount <= allocated)
+		{
+			count = newCount;
+			return 1;
+		}
+		return 0;
+	}
+
 	virtual void shrinkToFit(void)
 	{
 		setCapacity(count);
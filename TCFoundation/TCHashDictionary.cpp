@@ -0,0 +1,223 @@
+#include "TCHashDictionary.h"
+#include "TCObjectArray.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#if defined(_MSC_VER) && _MSC_VER >= 1400 && defined(_DEBUG)
+#define new DEBUG_CLIENTBLOCK
+#endif // _DEBUG
+
+// The table always has a power of two number of slots, and grows before it
+// gets more than three quarters full.
+#define INITIAL_SLOT_COUNT 64
+
+TCHashDictionary::TCHashDictionary(
+	bool caseSensitive /*= true*/,
+	bool slashSensitive /*= true*/)
+	: m_objects(new TCObjectArray)
+	, m_count(0)
+	, m_caseSensitive(caseSensitive)
+	, m_slashSensitive(slashSensitive)
+{
+#ifdef _LEAK_DEBUG
+	strcpy(className, "TCHashDictionary");
+#endif
+}
+
+TCHashDictionary::~TCHashDictionary(void)
+{
+}
+
+void TCHashDictionary::dealloc(void)
+{
+	TCObject::release(m_objects);
+	TCObject::dealloc();
+}
+
+char TCHashDictionary::normalizedChar(char character) const
+{
+	if (!m_slashSensitive && character == '\\')
+	{
+		return '/';
+	}
+	if (!m_caseSensitive)
+	{
+		return (char)tolower((unsigned char)character);
+	}
+	return character;
+}
+
+// FNV-1a hash of the normalized form of key.
+TCULong TCHashDictionary::hashKey(const char *key) const
+{
+	TCULong hash = 2166136261U;
+
+	for (const char *spot = key; *spot; spot++)
+	{
+		hash ^= (unsigned char)normalizedChar(*spot);
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+bool TCHashDictionary::keysMatch(
+	const std::string &normalizedKey,
+	const char *key) const
+{
+	size_t i;
+
+	for (i = 0; i < normalizedKey.size() && key[i]; i++)
+	{
+		if (normalizedKey[i] != normalizedChar(key[i]))
+		{
+			return false;
+		}
+	}
+	return i == normalizedKey.size() && key[i] == 0;
+}
+
+// Returns the slot that holds key, or the empty slot where key would go if
+// it isn't in the table.  The table must not be empty.
+int TCHashDictionary::slotForKey(const char *key, TCULong hash) const
+{
+	size_t mask = m_entries.size() - 1;
+	size_t slot = hash & mask;
+
+	while (true)
+	{
+		const Entry &entry = m_entries[slot];
+
+		if (entry.index == -1 ||
+			(entry.hash == hash && keysMatch(entry.key, key)))
+		{
+			return (int)slot;
+		}
+		slot = (slot + 1) & mask;
+	}
+}
+
+void TCHashDictionary::grow(void)
+{
+	EntryVector oldEntries;
+	size_t slotCount = m_entries.empty() ? INITIAL_SLOT_COUNT :
+		m_entries.size() * 2;
+	Entry emptyEntry;
+
+	emptyEntry.hash = 0;
+	emptyEntry.index = -1;
+	oldEntries.swap(m_entries);
+	m_entries.resize(slotCount, emptyEntry);
+	for (size_t i = 0; i < oldEntries.size(); i++)
+	{
+		Entry &oldEntry = oldEntries[i];
+
+		if (oldEntry.index != -1)
+		{
+			size_t slot = oldEntry.hash & (slotCount - 1);
+
+			while (m_entries[slot].index != -1)
+			{
+				slot = (slot + 1) & (slotCount - 1);
+			}
+			m_entries[slot].key.swap(oldEntry.key);
+			m_entries[slot].hash = oldEntry.hash;
+			m_entries[slot].index = oldEntry.index;
+		}
+	}
+}
+
+void TCHashDictionary::setObjectForKey(TCObject *object, const char *key)
+{
+	TCULong hash = hashKey(key);
+
+	if ((size_t)(m_count + 1) * 4 > m_entries.size() * 3)
+	{
+		grow();
+	}
+	Entry &entry = m_entries[slotForKey(key, hash)];
+
+	if (entry.index == -1)
+	{
+		entry.key.resize(strlen(key));
+		for (size_t i = 0; i < entry.key.size(); i++)
+		{
+			entry.key[i] = normalizedChar(key[i]);
+		}
+		entry.hash = hash;
+		entry.index = m_objects->getCount();
+		m_objects->addObject(object);
+		m_count++;
+	}
+	else
+	{
+		m_objects->replaceObject(object, entry.index);
+	}
+}
+
+TCObject *TCHashDictionary::objectForKey(const char *key) const
+{
+	if (m_count == 0)
+	{
+		return NULL;
+	}
+	const Entry &entry = m_entries[slotForKey(key, hashKey(key))];
+
+	if (entry.index == -1)
+	{
+		return NULL;
+	}
+	return (*m_objects)[entry.index];
+}
+
+bool TCHashDictionary::removeObjectForKey(const char *key)
+{
+	if (m_count == 0)
+	{
+		return false;
+	}
+	size_t mask = m_entries.size() - 1;
+	size_t slot = slotForKey(key, hashKey(key));
+	int index = m_entries[slot].index;
+
+	if (index == -1)
+	{
+		return false;
+	}
+	m_objects->removeObjectAtIndex(index);
+	m_count--;
+	m_entries[slot].index = -1;
+	m_entries[slot].key.clear();
+	// Move any entries after the removed one that belong at or before its
+	// slot back, so that lookups don't stop at the hole it left.
+	for (size_t next = (slot + 1) & mask; m_entries[next].index != -1;
+		next = (next + 1) & mask)
+	{
+		size_t home = m_entries[next].hash & mask;
+
+		if ((next > slot && (home <= slot || home > next)) ||
+			(next < slot && home <= slot && home > next))
+		{
+			m_entries[slot].key.swap(m_entries[next].key);
+			m_entries[slot].hash = m_entries[next].hash;
+			m_entries[slot].index = m_entries[next].index;
+			m_entries[next].index = -1;
+			slot = next;
+		}
+	}
+	for (size_t i = 0; i < m_entries.size(); i++)
+	{
+		if (m_entries[i].index > index)
+		{
+			m_entries[i].index--;
+		}
+	}
+	return true;
+}
+
+void TCHashDictionary::removeAll(void)
+{
+	m_objects->removeAll();
+	m_entries.clear();
+	m_count = 0;
+}
@@ -0,0 +1,52 @@
+#ifndef __TCHASHDICTIONARY_H__
+#define __TCHASHDICTIONARY_H__
+
+#include <TCFoundation/TCObject.h>
+#include <TCFoundation/TCStlIncludes.h>
+
+class TCObjectArray;
+
+// Dictionary that finds its keys in an open-addressing hash table, so that
+// inserts and lookups take constant time instead of the O(n) inserts and
+// binary searches of TCDictionary.  Keys can be made case-insensitive, and/or
+// insensitive to the difference between forward and back slashes; either way,
+// keys are compared in their normalized form.  allObjects() returns the
+// objects in the order in which their keys were first added.
+class TCExport TCHashDictionary : public TCObject
+{
+public:
+	explicit TCHashDictionary(bool caseSensitive = true,
+		bool slashSensitive = true);
+	void setObjectForKey(TCObject *object, const char *key);
+	TCObject *objectForKey(const char *key) const;
+	bool removeObjectForKey(const char *key);
+	void removeAll(void);
+	TCObjectArray *allObjects(void) { return m_objects; }
+	int getCount(void) const { return m_count; }
+	bool isCaseSensitive(void) const { return m_caseSensitive; }
+	bool isSlashSensitive(void) const { return m_slashSensitive; }
+protected:
+	struct Entry
+	{
+		std::string key;	// Normalized.
+		TCULong hash;
+		int index;			// Index in m_objects; -1 if the slot is empty.
+	};
+	typedef std::vector<Entry> EntryVector;
+
+	virtual ~TCHashDictionary(void);
+	virtual void dealloc(void);
+	char normalizedChar(char character) const;
+	TCULong hashKey(const char *key) const;
+	bool keysMatch(const std::string &normalizedKey, const char *key) const;
+	int slotForKey(const char *key, TCULong hash) const;
+	void grow(void);
+
+	TCObjectArray *m_objects;
+	EntryVector m_entries;
+	int m_count;
+	bool m_caseSensitive;
+	bool m_slashSensitive;
+};
+
+#endif // __TCHASHDICTIONARY_H__
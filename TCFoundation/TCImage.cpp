@@ -291,6 +291,23 @@ bool TCImage::saveFile(
 	return false;
 }
 
+bool TCImage::saveFileOnThread(
+	const char *filename,
+	TCImageProgressCallback progressCallback /*= NULL*/,
+	void *progressUserData /*= NULL*/)
+{
+	TCImageFormat *imageFormat = newFormatWithName(formatName);
+	bool retValue = false;
+
+	if (imageFormat)
+	{
+		imageFormat->setProgressCallback(progressCallback, progressUserData);
+		retValue = imageFormat->saveFile(this, filename);
+		imageFormat->release();
+	}
+	return retValue;
+}
+
 TCImageFormat *TCImage::formatForFile(const char *filename)
 {
 	TCImageFormat *retValue = NULL;
@@ -356,6 +373,34 @@ TCImageFormat *TCImage::formatWithName(char *name)
 	return NULL;
 }
 
+// Creates a new instance of one of the standard formats.  Formats added with
+// addImageFormat are not supported.
+TCImageFormat *TCImage::newFormatWithName(const char *name)
+{
+	if (name)
+	{
+#ifndef NO_PNG_IMAGE_FORMAT
+		if (strcmp(name, "PNG") == 0)
+		{
+			return new TCPngImageFormat;
+		}
+#endif // NO_PNG_IMAGE_FORMAT
+#ifndef NO_BMP_IMAGE_FORMAT
+		if (strcmp(name, "BMP") == 0)
+		{
+			return new TCBmpImageFormat;
+		}
+#endif // NO_BMP_IMAGE_FORMAT
+#ifndef NO_JPG_IMAGE_FORMAT
+		if (strcmp(name, "JPG") == 0)
+		{
+			return new TCJpegImageFormat;
+		}
+#endif // NO_JPG_IMAGE_FORMAT
+	}
+	return NULL;
+}
+
 TCImage *TCImage::createSubImage(int x, int y, int cx, int cy)
 {
 	TCImage *newImage;
@@ -406,112 +451,181 @@ void TCImage::setComment(const char *value)
 
 void TCImage::autoCrop(void)
 {
-	autoCrop(imageData[0], imageData[1], imageData[2]);
+	autoCrop(imageData);
 }
 
 void TCImage::autoCrop(TCUShort r, TCUShort g, TCUShort b)
 {
-	int minx = 0;
-	int maxx = width - 1;
-	int miny = 0;
-	int maxy = height - 1;
-	int bytesPerLine;
-	bool found = false;
-	int x;
-	int y;
+	TCByte background[8] = { 0 };
+
+	if (dataFormat == TCRgb16 || dataFormat == TCRgba16)
+	{
+		// 16-bit channels are in native byte order, and 8-bit values map to
+		// 16 bits by repeating the byte (255 becomes 65535).
+		TCUShort channels[4] = { (TCUShort)(r * 257), (TCUShort)(g * 257),
+			(TCUShort)(b * 257), 0 };
+
+		memcpy(background, channels, sizeof(channels));
+	}
+	else
+	{
+		background[0] = (TCByte)r;
+		background[1] = (TCByte)g;
+		background[2] = (TCByte)b;
+	}
+	autoCrop(background);
+}
 
-	bytesPerLine = roundUp(width * bytesPerPixel, 4);
-	for (x = 0; x < width && !found; x++)
+// Returns true if any of the bytes from start up to (but not including) end
+// in data differ from the same bytes in background.  If mask is not NULL, only
+// the bits that are set in it are compared.
+// NOTE: static function.
+bool TCImage::spanDiffers(
+	const TCByte *data,
+	const TCByte *background,
+	const TCByte *mask,
+	int start,
+	int end)
+{
+	if (mask == NULL)
 	{
-		int xOffset = x * bytesPerPixel;
+		// The C runtime's memcmp is vectorized on just about every platform.
+		return memcmp(data + start, background + start, end - start) != 0;
+	}
+	else
+	{
+		TCByte diff = 0;
 
-		for (y = 0; y < height && !found; y++)
+		// No early out, so that the compiler can vectorize this.
+		for (int i = start; i < end; i++)
 		{
-			int offset = xOffset + y * bytesPerLine;
+			diff |= (data[i] ^ background[i]) & mask[i];
+		}
+		return diff != 0;
+	}
+}
 
-			if (imageData[offset] != r || imageData[offset + 1] != g ||
-				imageData[offset + 2] != b)
-			{
-				found = true;
-				minx = x;
-			}
+// Crops to the smallest box that contains all the pixels that don't match
+// the background pixel (which is bytesPerPixel long).  The image is scanned a
+// row at a time, with each row compared against a whole row of background
+// pixels.  Rows above and below the box get compared in full, but rows inside
+// it only get their parts to the left and right of the box found so far
+// compared, so every pixel gets looked at no more than once, and most of them
+// not at all.
+void TCImage::autoCrop(const TCByte *background)
+{
+	int rowSize = getRowSize();
+	int rowBytes = width * bytesPerPixel;
+	int channelSize = 1;
+	int minx = width;
+	int maxx = -1;
+	int miny;
+	int maxy;
+	int x, y;
+	TCByte *backgroundRow = new TCByte[rowBytes];
+	TCByte *maskRow = NULL;
+
+	for (x = 0; x < width; x++)
+	{
+		memcpy(&backgroundRow[x * bytesPerPixel], background, bytesPerPixel);
+	}
+	if (dataFormat == TCRgb16 || dataFormat == TCRgba16)
+	{
+		channelSize = 2;
+	}
+	if (dataFormat == TCRgba8 || dataFormat == TCRgba16)
+	{
+		// Alpha isn't compared.
+		maskRow = new TCByte[rowBytes];
+		memset(maskRow, 0xFF, rowBytes);
+		for (x = 0; x < width; x++)
+		{
+			memset(&maskRow[x * bytesPerPixel + 3 * channelSize], 0,
+				channelSize);
 		}
 	}
-	if (found)
+	for (miny = 0; miny < height; miny++)
 	{
-		found = false;
-		for (y = 0; y < height && !found; y++)
+		if (spanDiffers(&imageData[miny * rowSize], backgroundRow, maskRow, 0,
+			rowBytes))
 		{
-			int yOffset = y * bytesPerLine;
-
-			for (x = 0; x < width && !found; x++)
+			break;
+		}
+	}
+	if (miny < height)
+	{
+		for (maxy = height - 1; maxy > miny; maxy--)
+		{
+			if (spanDiffers(&imageData[maxy * rowSize], backgroundRow,
+				maskRow, 0, rowBytes))
 			{
-				int offset = yOffset + x * bytesPerPixel;
-
-				if (imageData[offset] != r || imageData[offset + 1] != g ||
-					imageData[offset + 2] != b)
-				{
-					found = true;
-					miny = y;
-				}
+				break;
 			}
 		}
-		found = false;
-		for (x = width - 1; x >= 0 && !found; x--)
+		for (y = miny; y <= maxy; y++)
 		{
-			int xOffset = x * bytesPerPixel;
+			const TCByte *row = &imageData[y * rowSize];
 
-			for (y = 0; y < height && !found; y++)
+			if (minx > 0 && spanDiffers(row, backgroundRow, maskRow, 0,
+				minx * bytesPerPixel))
 			{
-				int offset = xOffset + y * bytesPerLine;
-
-				if (imageData[offset] != r || imageData[offset + 1] != g ||
-					imageData[offset + 2] != b)
+				for (x = 0; x < minx; x++)
 				{
-					found = true;
-					maxx = x;
+					if (spanDiffers(row, backgroundRow, maskRow,
+						x * bytesPerPixel, (x + 1) * bytesPerPixel))
+					{
+						minx = x;
+						break;
+					}
 				}
 			}
-		}
-		found = false;
-		for (y = height - 1; y >= 0 && !found; y--)
-		{
-			int yOffset = y * bytesPerLine;
-
-			for (x = 0; x < width && !found; x++)
+			if (maxx < width - 1 && spanDiffers(row, backgroundRow, maskRow,
+				(maxx + 1) * bytesPerPixel, rowBytes))
 			{
-				int offset = yOffset + x * bytesPerPixel;
-
-				if (imageData[offset] != r || imageData[offset + 1] != g ||
-					imageData[offset + 2] != b)
+				for (x = width - 1; x > maxx; x--)
 				{
-					found = true;
-					maxy = y;
+					if (spanDiffers(row, backgroundRow, maskRow,
+						x * bytesPerPixel, (x + 1) * bytesPerPixel))
+					{
+						maxx = x;
+						break;
+					}
 				}
 			}
 		}
 	}
 	else
 	{
-		maxx = 0;
-		maxy = 0;
+		// Nothing but background: leave a single pixel.
+		minx = maxx = 0;
+		miny = maxy = 0;
 	}
-	int newWidth;
-	int newHeight;
-	int newBytesPerLine;
+	delete[] backgroundRow;
+	delete[] maskRow;
+	crop(minx, miny, maxx - minx + 1, maxy - miny + 1);
+}
+
+// Cuts the image down to the given rectangle, and records where it was in
+// croppedX and croppedY.
+void TCImage::crop(int x, int y, int cx, int cy)
+{
+	int rowSize = getRowSize();
+	int newRowSize;
 	TCByte *newImageData;
 
-	croppedX = minx;
-	croppedY = miny;
-	newWidth = maxx - minx + 1;
-	newHeight = maxy - miny + 1;
-	newBytesPerLine = roundUp(newWidth * bytesPerPixel, 4);
-	newImageData = new TCByte[newHeight * newBytesPerLine];
-	for (y = 0; y < newHeight; y++)
+	croppedX = x;
+	croppedY = y;
+	if (cx == width && cy == height)
+	{
+		return;
+	}
+	newRowSize = roundUp(cx * bytesPerPixel, lineAlignment);
+	newImageData = new TCByte[cy * newRowSize];
+	for (int i = 0; i < cy; i++)
 	{
-		memcpy(&newImageData[y * newBytesPerLine],
-			&imageData[(y + miny) * bytesPerLine + minx * bytesPerPixel],
-			newBytesPerLine);
+		memcpy(&newImageData[i * newRowSize],
+			&imageData[(i + y) * rowSize + x * bytesPerPixel],
+			cx * bytesPerPixel);
 	}
 	if (!userImageData)
 	{
@@ -519,8 +633,8 @@ void TCImage::autoCrop(TCUShort r, TCUShort g, TCUShort b)
 	}
 	imageData = newImageData;
 	userImageData = false;
-	width = newWidth;
-	height = newHeight;
+	width = cx;
+	height = cy;
 }
 
 TCImageOptions *TCImage::getCompressionOptions(void)
@@ -58,11 +58,21 @@ public:
 	virtual bool saveFile(const char *filename,
 		TCImageProgressCallback progressCallback = NULL,
 		void *progressUserData = NULL);
+	// Same as saveFile, but uses a private instance of the image format, so
+	// it can be called from any thread, as long as nothing else is using the
+	// image at the same time.  The compression options are not saved, and
+	// getCompressionOptions must already have been called on the main thread.
+	virtual bool saveFileOnThread(const char *filename,
+		TCImageProgressCallback progressCallback = NULL,
+		void *progressUserData = NULL);
 	char *getFormatName(void) { return formatName; }
 	virtual void setFormatName(const char *value);
 	virtual TCImage *createSubImage(int x, int y, int cx, int cy);
 	virtual void setComment(const char *value);
+	// Crops off the edges that match the given background color, ignoring
+	// alpha.  r, g, and b are 8-bit values, even for 16-bit images.
 	virtual void autoCrop(TCUShort r, TCUShort g, TCUShort b);
+	// Crops off the edges that match the color of the first pixel.
 	virtual void autoCrop(void);
 	const char *getComment(void) { return comment; }
 	virtual TCImageOptions *getCompressionOptions(void);
@@ -96,8 +106,14 @@ protected:
 	virtual ~TCImage(void);
 	virtual void dealloc(void);
 	virtual void syncImageData(void);
+	void autoCrop(const TCByte *background);
+	void crop(int x, int y, int cx, int cy);
+
+	static bool spanDiffers(const TCByte *data, const TCByte *background,
+		const TCByte *mask, int start, int end);
 
 	static TCImageFormat *formatWithName(char *name);
+	static TCImageFormat *newFormatWithName(const char *name);
 	static TCImageFormat *formatForData(const TCByte *data, long length);
 	static TCImageFormat *formatForFile(const char *filename);
 	static TCImageFormat *formatForFile(FILE *file);
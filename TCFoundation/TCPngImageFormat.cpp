@@ -1,20 +1,408 @@
 #ifndef NO_PNG_IMAGE_FORMAT
 #include "TCPngImageFormat.h"
+#include "TCPngOptions.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <zlib.h>
 #include "mystring.h"
 
+#ifdef USE_CPP11
+#include <thread>
+#else
+#ifndef _NO_BOOST
+#ifdef WIN32
+#pragma warning(push)
+#pragma warning(disable:4244 4512)
+#endif // WIN32
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#ifdef WIN32
+#pragma warning(pop)
+#endif // WIN32
+#endif // !_NO_BOOST
+#endif
+
 #ifdef WIN32
 #if defined(_MSC_VER) && _MSC_VER >= 1400 && defined(_DEBUG)
 #define new DEBUG_CLIENTBLOCK
 #endif // _DEBUG
 #endif // WIN32
 
+// Amount of image data in each band when encoding with more than one thread.
+// This doesn't depend on the number of threads, so the file comes out the same
+// no matter how many there are.
+#define PNG_BAND_SIZE (1024 * 1024)
+
+// Filters and deflates bands of rows from an image on separate threads.  Each
+// band is a separate raw deflate stream that ends with a sync flush (except
+// for the last one), so the bands can be joined into a single zlib stream for
+// the IDAT chunks.
+class TCPngBandEncoder
+{
+public:
+	TCPngBandEncoder(TCImage *image, int bytesPerPixel, TCPngOptions *options)
+		: m_image(image)
+		, m_bytesPerPixel(bytesPerPixel)
+		, m_compressionLevel(-1)
+		, m_filterStrategy(TCPngOptions::FSAdaptive)
+	{
+		int height = image->getHeight();
+		int bandRows;
+
+		m_rowBytes = image->getWidth() * bytesPerPixel;
+		bandRows = getBandRows(m_rowBytes);
+		for (int row = 0; row < height; row += bandRows)
+		{
+			Band band;
+
+			band.firstRow = row;
+			band.rowCount = std::min(bandRows, height - row);
+			band.adler = 0;
+			band.succeeded = false;
+			m_bands.push_back(band);
+		}
+		if (options != NULL)
+		{
+			m_compressionLevel = options->getCompressionLevel();
+			m_filterStrategy = options->getFilterStrategy();
+		}
+		m_zeroRow.resize(m_rowBytes, 0);
+	}
+	int getBandCount(void) const { return (int)m_bands.size(); }
+	void encodeBands(int first, int step)
+	{
+		for (int i = first; i < getBandCount(); i += step)
+		{
+			encodeBand(i);
+		}
+	}
+	bool encodeBand(int index);
+	bool write(png_structp pngPtr);
+
+	static int getBandRows(int rowBytes)
+	{
+		return std::max(PNG_BAND_SIZE / rowBytes, 1);
+	}
+	static void threadProc(TCPngBandEncoder *encoder, int first, int step)
+	{
+		encoder->encodeBands(first, step);
+	}
+protected:
+	struct Band
+	{
+		int firstRow;
+		int rowCount;
+		std::vector<TCByte> data;
+		uLong adler;
+		bool succeeded;
+	};
+	typedef std::vector<Band> BandVector;
+
+	const TCByte *getRow(int row) const
+	{
+		if (m_image->getFlipped())
+		{
+			row = m_image->getHeight() - row - 1;
+		}
+		return m_image->getImageData() + row * m_image->getRowSize();
+	}
+	void filterRow(int filter, const TCByte *row, const TCByte *prevRow,
+		TCByte *dest) const;
+	static int filterCost(const TCByte *filtered, int count);
+	static TCByte paethPredictor(int a, int b, int c);
+	static bool deflateData(z_stream &zStream, int flush,
+		std::vector<TCByte> &output);
+
+	TCImage *m_image;
+	int m_bytesPerPixel;
+	int m_rowBytes;
+	int m_compressionLevel;
+	TCPngOptions::FilterStrategy m_filterStrategy;
+	std::vector<TCByte> m_zeroRow;
+	BandVector m_bands;
+};
+
+// NOTE: static function.
+TCByte TCPngBandEncoder::paethPredictor(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+
+	if (pa <= pb && pa <= pc)
+	{
+		return (TCByte)a;
+	}
+	else if (pb <= pc)
+	{
+		return (TCByte)b;
+	}
+	else
+	{
+		return (TCByte)c;
+	}
+}
+
+// Fills dest with the filter type followed by the filtered row.
+void TCPngBandEncoder::filterRow(
+	int filter,
+	const TCByte *row,
+	const TCByte *prevRow,
+	TCByte *dest) const
+{
+	int bpp = m_bytesPerPixel;
+	int i;
+
+	*dest++ = (TCByte)filter;
+	switch (filter)
+	{
+	case PNG_FILTER_VALUE_SUB:
+		for (i = 0; i < bpp; i++)
+		{
+			dest[i] = row[i];
+		}
+		for (; i < m_rowBytes; i++)
+		{
+			dest[i] = (TCByte)(row[i] - row[i - bpp]);
+		}
+		break;
+	case PNG_FILTER_VALUE_UP:
+		for (i = 0; i < m_rowBytes; i++)
+		{
+			dest[i] = (TCByte)(row[i] - prevRow[i]);
+		}
+		break;
+	case PNG_FILTER_VALUE_AVG:
+		for (i = 0; i < bpp; i++)
+		{
+			dest[i] = (TCByte)(row[i] - (prevRow[i] >> 1));
+		}
+		for (; i < m_rowBytes; i++)
+		{
+			dest[i] = (TCByte)(row[i] - ((row[i - bpp] + prevRow[i]) >> 1));
+		}
+		break;
+	case PNG_FILTER_VALUE_PAETH:
+		for (i = 0; i < bpp; i++)
+		{
+			dest[i] = (TCByte)(row[i] - prevRow[i]);
+		}
+		for (; i < m_rowBytes; i++)
+		{
+			dest[i] = (TCByte)(row[i] - paethPredictor(row[i - bpp],
+				prevRow[i], prevRow[i - bpp]));
+		}
+		break;
+	default:
+		memcpy(dest, row, m_rowBytes);
+		break;
+	}
+}
+
+// Returns the sum of the filtered bytes treated as signed values, which is
+// the same heuristic libpng uses to pick a filter for each row.
+// NOTE: static function.
+int TCPngBandEncoder::filterCost(const TCByte *filtered, int count)
+{
+	int cost = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		int value = filtered[i];
+
+		cost += value < 128 ? value : 256 - value;
+	}
+	return cost;
+}
+
+// Deflates all of zStream's input into output.
+// NOTE: static function.
+bool TCPngBandEncoder::deflateData(
+	z_stream &zStream,
+	int flush,
+	std::vector<TCByte> &output)
+{
+	TCByte buf[16384];
+	int result;
+
+	do
+	{
+		zStream.next_out = buf;
+		zStream.avail_out = sizeof(buf);
+		result = deflate(&zStream, flush);
+		if (result == Z_STREAM_ERROR)
+		{
+			return false;
+		}
+		output.insert(output.end(), buf, buf + sizeof(buf) -
+			zStream.avail_out);
+	} while (zStream.avail_out == 0);
+	return flush != Z_FINISH || result == Z_STREAM_END;
+}
+
+bool TCPngBandEncoder::encodeBand(int index)
+{
+	Band &band = m_bands[index];
+	bool last = index == getBandCount() - 1;
+	int filteredSize = m_rowBytes + 1;
+	int filterCount = m_filterStrategy == TCPngOptions::FSAdaptive ? 5 : 1;
+	std::vector<TCByte> filtered(filteredSize * filterCount);
+	int strategy = Z_FILTERED;
+	z_stream zStream;
+
+	if (m_filterStrategy == TCPngOptions::FSNone)
+	{
+		strategy = Z_DEFAULT_STRATEGY;
+	}
+	memset(&zStream, 0, sizeof(zStream));
+	// Negative window bits: raw deflate data, with no zlib header.
+	if (deflateInit2(&zStream, m_compressionLevel, Z_DEFLATED, -MAX_WBITS, 8,
+		strategy) != Z_OK)
+	{
+		return false;
+	}
+	band.data.reserve(band.rowCount * m_rowBytes / 2);
+	band.adler = adler32(0L, Z_NULL, 0);
+	band.succeeded = true;
+	for (int row = band.firstRow; row < band.firstRow + band.rowCount &&
+		band.succeeded; row++)
+	{
+		const TCByte *rowData = getRow(row);
+		const TCByte *prevRow = row > 0 ? getRow(row - 1) : &m_zeroRow[0];
+		TCByte *rowFiltered = &filtered[0];
+
+		if (filterCount > 1)
+		{
+			int bestCost = 0;
+
+			for (int filter = 0; filter < filterCount; filter++)
+			{
+				TCByte *dest = &filtered[filter * filteredSize];
+				int cost;
+
+				filterRow(filter, rowData, prevRow, dest);
+				cost = filterCost(dest + 1, m_rowBytes);
+				if (filter == 0 || cost < bestCost)
+				{
+					bestCost = cost;
+					rowFiltered = dest;
+				}
+			}
+		}
+		else
+		{
+			filterRow((int)m_filterStrategy - (int)TCPngOptions::FSNone,
+				rowData, prevRow, rowFiltered);
+		}
+		band.adler = adler32(band.adler, rowFiltered, filteredSize);
+		zStream.next_in = rowFiltered;
+		zStream.avail_in = filteredSize;
+		band.succeeded = deflateData(zStream, Z_NO_FLUSH, band.data);
+	}
+	if (band.succeeded)
+	{
+		// The sync flush ends the band on a byte boundary without ending the
+		// deflate stream, so the next band's data can follow it directly.
+		band.succeeded = deflateData(zStream, last ? Z_FINISH : Z_SYNC_FLUSH,
+			band.data);
+	}
+	deflateEnd(&zStream);
+	return band.succeeded;
+}
+
+// Writes the encoded bands as IDAT chunks (one per band), wrapped in a zlib
+// header and trailer.
+bool TCPngBandEncoder::write(png_structp pngPtr)
+{
+	int level = m_compressionLevel < 0 ? 6 : m_compressionLevel;
+	TCByte header[2];
+	TCByte trailer[4];
+	uLong adler = 0;
+	int i;
+
+	for (i = 0; i < getBandCount(); i++)
+	{
+		const Band &band = m_bands[i];
+
+		if (!band.succeeded)
+		{
+			return false;
+		}
+		if (i == 0)
+		{
+			adler = band.adler;
+		}
+		else
+		{
+			adler = adler32_combine(adler, band.adler,
+				(z_off_t)band.rowCount * (m_rowBytes + 1));
+		}
+	}
+	// Deflate with a 32K window, and the level in the same form zlib uses.
+	header[0] = 0x78;
+	if (level < 2)
+	{
+		header[1] = 0;
+	}
+	else if (level < 6)
+	{
+		header[1] = 1 << 6;
+	}
+	else if (level == 6)
+	{
+		header[1] = 2 << 6;
+	}
+	else
+	{
+		header[1] = 3 << 6;
+	}
+	header[1] += 31 - (header[0] * 256 + header[1]) % 31;
+	for (i = 0; i < 4; i++)
+	{
+		trailer[i] = (TCByte)(adler >> (24 - i * 8));
+	}
+	for (i = 0; i < getBandCount(); i++)
+	{
+		Band &band = m_bands[i];
+		bool first = i == 0;
+		bool last = i == getBandCount() - 1;
+		png_uint_32 length = (png_uint_32)band.data.size();
+
+		if (first)
+		{
+			length += sizeof(header);
+		}
+		if (last)
+		{
+			length += sizeof(trailer);
+		}
+		png_write_chunk_start(pngPtr, (png_bytep)"IDAT", length);
+		if (first)
+		{
+			png_write_chunk_data(pngPtr, header, sizeof(header));
+		}
+		if (!band.data.empty())
+		{
+			png_write_chunk_data(pngPtr, &band.data[0], band.data.size());
+		}
+		if (last)
+		{
+			png_write_chunk_data(pngPtr, trailer, sizeof(trailer));
+		}
+		png_write_chunk_end(pngPtr);
+		// Free the memory as soon as possible.
+		std::vector<TCByte>().swap(band.data);
+	}
+	return true;
+}
+
 TCPngImageFormat::TCPngImageFormat(void)
 	:commentData(NULL),
-	commentDataCount(0)
+	commentDataCount(0),
+	bandEncoder(NULL)
 {
 	name = "PNG";
 #ifdef _LEAK_DEBUG
@@ -32,6 +420,7 @@ void TCPngImageFormat::dealloc(void)
 	{
 		deleteStringArray(commentData, commentDataCount);
 	}
+	delete bandEncoder;
 	TCImageFormat::dealloc();
 }
 
@@ -323,7 +712,10 @@ bool TCPngImageFormat::saveFile(TCImage *limage, FILE *file)
 				int height = limage->getHeight();
 				int pngColorType = 0;
 				int bitDepth;
+				int bytesPerPixel = 0;
 				TCByte *imageData = limage->getImageData();
+				TCPngOptions *options =
+					(TCPngOptions *)limage->getCompressionOptions();
 				bool failed = false;
 
 				if (limage->getComment() && strlen(limage->getComment()) > 0)
@@ -365,18 +757,22 @@ bool TCPngImageFormat::saveFile(TCImage *limage, FILE *file)
 				case TCRgb8:
 					pngColorType = PNG_COLOR_TYPE_RGB;
 					bitDepth = 8;
+					bytesPerPixel = 3;
 					break;
 				case TCRgba8:
 					pngColorType = PNG_COLOR_TYPE_RGB_ALPHA;
 					bitDepth = 8;
+					bytesPerPixel = 4;
 					break;
 				case TCRgb16:
 					pngColorType = PNG_COLOR_TYPE_RGB;
 					bitDepth = 16;
+					bytesPerPixel = 6;
 					break;
 				case TCRgba16:
 					pngColorType = PNG_COLOR_TYPE_RGB_ALPHA;
 					bitDepth = 16;
+					bytesPerPixel = 8;
 					break;
 				default:
 					failed = true;
@@ -384,34 +780,57 @@ bool TCPngImageFormat::saveFile(TCImage *limage, FILE *file)
 				}
 				if (!failed)
 				{
+					int bandRows = TCPngBandEncoder::getBandRows(width *
+						bytesPerPixel);
+					int threadCount = getThreadCount(options,
+						(height + bandRows - 1) / bandRows);
+
 					png_init_io(lpngPtr, file);
 					png_set_sRGB(lpngPtr, linfoPtr, PNG_sRGB_INTENT_PERCEPTUAL);
 					png_set_IHDR(lpngPtr, linfoPtr, width, height, bitDepth,
 						pngColorType, PNG_INTERLACE_NONE,
 						PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+					setupCompression(lpngPtr, options);
 					png_write_info(lpngPtr, linfoPtr);
 					callProgressCallback(_UC("SavingPNG"), 0.0f);
-					for (i = 0; i < height; i++)
+					if (threadCount > 1)
 					{
-						if (!callProgressCallback(NULL,
-							(float)(i) / (float)height))
-						{
-							canceled = true;
-							break;
-						}
-						if (limage->getFlipped())
+						bandEncoder = new TCPngBandEncoder(limage,
+							bytesPerPixel, options);
+						if (encodeBands(bandEncoder, threadCount) &&
+							bandEncoder->write(lpngPtr))
 						{
-							png_write_row(lpngPtr,
-								imageData + (height - i - 1) * rowSize);
+							// Everything else was written by png_write_info.
+							png_write_chunk(lpngPtr, (png_bytep)"IEND", NULL,
+								0);
+							retValue = true;
 						}
-						else
+					}
+					else
+					{
+						for (i = 0; i < height; i++)
 						{
-							png_write_row(lpngPtr, imageData + i * rowSize);
+							if (!callProgressCallback(NULL,
+								(float)(i) / (float)height))
+							{
+								canceled = true;
+								break;
+							}
+							if (limage->getFlipped())
+							{
+								png_write_row(lpngPtr,
+									imageData + (height - i - 1) * rowSize);
+							}
+							else
+							{
+								png_write_row(lpngPtr,
+									imageData + i * rowSize);
+							}
 						}
+						png_write_end(lpngPtr, linfoPtr);
+						retValue = true;
 					}
-					png_write_end(lpngPtr, linfoPtr);
 					callProgressCallback(NULL, 1.0f);
-					retValue = true;
 				}
 			}
 			png_destroy_write_struct(&lpngPtr, &linfoPtr);
@@ -421,8 +840,140 @@ bool TCPngImageFormat::saveFile(TCImage *limage, FILE *file)
 			png_destroy_write_struct(&lpngPtr, (png_infopp)NULL);
 		}
 	}
+	// This is a member so that it still gets deleted if libpng jumps back
+	// to the setjmp.
+	delete bandEncoder;
+	bandEncoder = NULL;
 	callProgressCallback(NULL, 2.0f);
 	debugPrintf(2, "TCPngImageFormat::saveFile() 2\n");
 	return retValue && !canceled;
 }
+
+void TCPngImageFormat::setupCompression(
+	png_structp lpngPtr,
+	TCPngOptions *options)
+{
+	if (options == NULL)
+	{
+		return;
+	}
+	if (options->getCompressionLevel() >= 0)
+	{
+		png_set_compression_level(lpngPtr, options->getCompressionLevel());
+	}
+	switch (options->getFilterStrategy())
+	{
+	case TCPngOptions::FSNone:
+		png_set_filter(lpngPtr, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+		break;
+	case TCPngOptions::FSSub:
+		png_set_filter(lpngPtr, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB);
+		break;
+	case TCPngOptions::FSUp:
+		png_set_filter(lpngPtr, PNG_FILTER_TYPE_BASE, PNG_FILTER_UP);
+		break;
+	case TCPngOptions::FSAverage:
+		png_set_filter(lpngPtr, PNG_FILTER_TYPE_BASE, PNG_FILTER_AVG);
+		break;
+	case TCPngOptions::FSPaeth:
+		png_set_filter(lpngPtr, PNG_FILTER_TYPE_BASE, PNG_FILTER_PAETH);
+		break;
+	default:
+		// Adaptive filtering is libpng's default.
+		break;
+	}
+}
+
+// Returns the number of threads to encode the image with.  1 means the image
+// gets written by libpng as a single stream.
+// NOTE: static function.
+int TCPngImageFormat::getThreadCount(TCPngOptions *options, int bandCount)
+{
+	int threadCount = TCPngOptions::getDefaultThreadCount();
+
+	if (options != NULL)
+	{
+		threadCount = options->getThreadCount();
+	}
+#if defined(USE_CPP11) || !defined(_NO_BOOST)
+	if (threadCount <= 0)
+	{
+#ifdef USE_CPP11
+		threadCount = (int)std::thread::hardware_concurrency();
+#else // USE_CPP11
+		threadCount = (int)boost::thread::hardware_concurrency();
+#endif // !USE_CPP11
+	}
+#else // USE_CPP11 || !_NO_BOOST
+	threadCount = 1;
+#endif // !USE_CPP11 && _NO_BOOST
+	if (threadCount > bandCount)
+	{
+		threadCount = bandCount;
+	}
+	if (threadCount < 1)
+	{
+		threadCount = 1;
+	}
+	return threadCount;
+}
+
+// Encodes all the bands, with this thread doing its share while reporting
+// progress.
+bool TCPngImageFormat::encodeBands(
+	TCPngBandEncoder *encoder,
+	int threadCount)
+{
+	int bandCount = encoder->getBandCount();
+	bool retValue = true;
+	int i;
+#ifdef USE_CPP11
+	std::vector<std::thread> threads;
+
+	for (i = 1; i < threadCount; i++)
+	{
+		threads.emplace_back(TCPngBandEncoder::threadProc, encoder, i,
+			threadCount);
+	}
+#else // USE_CPP11
+#ifndef _NO_BOOST
+	boost::thread_group threadGroup;
+
+	for (i = 1; i < threadCount; i++)
+	{
+		threadGroup.create_thread(boost::bind(TCPngBandEncoder::threadProc,
+			encoder, i, threadCount));
+	}
+#endif // !_NO_BOOST
+#endif // !USE_CPP11
+	for (i = 0; i < bandCount; i += threadCount)
+	{
+		if (!callProgressCallback(NULL, (float)i / (float)bandCount))
+		{
+			canceled = true;
+			retValue = false;
+			break;
+		}
+		if (!encoder->encodeBand(i))
+		{
+			retValue = false;
+		}
+	}
+#ifdef USE_CPP11
+	for (i = 0; i < (int)threads.size(); i++)
+	{
+		threads[i].join();
+	}
+#else // USE_CPP11
+#ifndef _NO_BOOST
+	threadGroup.join_all();
+#endif // !_NO_BOOST
+#endif // !USE_CPP11
+	return retValue;
+}
+
+TCImageOptions *TCPngImageFormat::newCompressionOptions(void)
+{
+	return new TCPngOptions;
+}
 #endif // NO_PNG_IMAGE_FORMAT
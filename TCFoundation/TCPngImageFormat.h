@@ -9,6 +9,9 @@
 
 #include <png.h>
 
+class TCPngOptions;
+class TCPngBandEncoder;
+
 class TCExport TCPngImageFormat : public TCImageFormat
 {
 public:
@@ -19,6 +22,7 @@ public:
 	virtual bool loadData(TCImage *image, TCByte *data, long length);
 	virtual bool loadFile(TCImage *image, FILE *file);
 	virtual bool saveFile(TCImage *image, FILE *file);
+	virtual TCImageOptions *newCompressionOptions(void);
 protected:
 	virtual ~TCPngImageFormat(void);
 	virtual void dealloc(void);
@@ -28,6 +32,10 @@ protected:
 	void rowCallback(png_bytep rowData, png_uint_32 rowNum, int pass);
 	void errorCallback(png_const_charp msg);
 	float passToFraction(int pass);
+	void setupCompression(png_structp lpngPtr, TCPngOptions *options);
+	bool encodeBands(TCPngBandEncoder *encoder, int threadCount);
+
+	static int getThreadCount(TCPngOptions *options, int bandCount);
 
 	static void staticErrorCallback(png_structp pngPtr, png_const_charp msg);
 	static void staticInfoCallback(png_structp pngPtr, png_infop infoPtr);
@@ -44,6 +52,7 @@ protected:
 	jmp_buf jumpBuf;
 	bool canceled;
 	int numPasses;
+	TCPngBandEncoder *bandEncoder;
 };
 
 #endif // NO_PNG_IMAGE_FORMAT
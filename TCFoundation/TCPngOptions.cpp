@@ -0,0 +1,52 @@
+#include "TCPngOptions.h"
+#include "TCUserDefaults.h"
+
+#ifdef WIN32
+#if defined(_MSC_VER) && _MSC_VER >= 1400 && defined(_DEBUG)
+#define new DEBUG_CLIENTBLOCK
+#endif // _DEBUG
+#endif // WIN32
+
+int TCPngOptions::sm_defaultCompressionLevel = -1;
+TCPngOptions::FilterStrategy TCPngOptions::sm_defaultFilterStrategy =
+	FSAdaptive;
+int TCPngOptions::sm_defaultThreadCount = 0;
+
+TCPngOptions::TCPngOptions(bool compress /*= true*/):
+TCImageOptions(compress),
+m_compressionLevel(sm_defaultCompressionLevel),
+m_filterStrategy(sm_defaultFilterStrategy),
+m_threadCount(sm_defaultThreadCount)
+{
+#ifdef _LEAK_DEBUG
+	strcpy(className, "TCPngOptions");
+#endif
+	m_formatName = "PNG";
+	if (m_compress)
+	{
+		m_compressionLevel = (int)TCUserDefaults::longForKey(
+			"PNGCompressionLevel", m_compressionLevel);
+		m_filterStrategy =
+			(FilterStrategy)TCUserDefaults::longForKey("PNGFilterStrategy",
+			m_filterStrategy);
+		m_threadCount = (int)TCUserDefaults::longForKey("PNGEncodeThreads",
+			m_threadCount);
+	}
+	if (m_compressionLevel < -1 || m_compressionLevel > 9)
+	{
+		m_compressionLevel = -1;
+	}
+	if (m_filterStrategy < FSAdaptive || m_filterStrategy > FSPaeth)
+	{
+		m_filterStrategy = FSAdaptive;
+	}
+}
+
+TCPngOptions::~TCPngOptions(void)
+{
+}
+
+void TCPngOptions::dealloc(void)
+{
+	TCImageOptions::dealloc();
+}
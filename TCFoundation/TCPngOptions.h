@@ -0,0 +1,68 @@
+#ifndef __TCPNGOPTIONS_H__
+#define __TCPNGOPTIONS_H__
+
+#include <TCFoundation/TCImageOptions.h>
+
+class TCExport TCPngOptions : public TCImageOptions
+{
+public:
+	enum FilterStrategy
+	{
+		// Pick the best filter for each row.
+		FSAdaptive,
+		FSNone,
+		FSSub,
+		FSUp,
+		FSAverage,
+		FSPaeth,
+	};
+
+	TCPngOptions(bool compress = true);
+
+	// -1 is zlib's default level.
+	void setCompressionLevel(int value) { m_compressionLevel = value; }
+	int getCompressionLevel(void) const { return m_compressionLevel; }
+	static void setDefaultCompressionLevel(int value)
+	{
+		sm_defaultCompressionLevel = value;
+	}
+	static int getDefaultCompressionLevel(void)
+	{
+		return sm_defaultCompressionLevel;
+	}
+
+	void setFilterStrategy(FilterStrategy value) { m_filterStrategy = value; }
+	FilterStrategy getFilterStrategy(void) const { return m_filterStrategy; }
+	static void setDefaultFilterStrategy(FilterStrategy value)
+	{
+		sm_defaultFilterStrategy = value;
+	}
+	static FilterStrategy getDefaultFilterStrategy(void)
+	{
+		return sm_defaultFilterStrategy;
+	}
+
+	// 0 means one thread per processor.  1 writes the image as a single
+	// stream with libpng.
+	void setThreadCount(int value) { m_threadCount = value; }
+	int getThreadCount(void) const { return m_threadCount; }
+	static void setDefaultThreadCount(int value)
+	{
+		sm_defaultThreadCount = value;
+	}
+	static int getDefaultThreadCount(void) { return sm_defaultThreadCount; }
+
+protected:
+	virtual ~TCPngOptions(void);
+	virtual void dealloc(void);
+
+	int m_compressionLevel;
+	FilterStrategy m_filterStrategy;
+	int m_threadCount;
+
+	static int sm_defaultCompressionLevel;
+	static FilterStrategy sm_defaultFilterStrategy;
+	static int sm_defaultThreadCount;
+};
+
+#endif // __TCPNGOPTIONS_H__
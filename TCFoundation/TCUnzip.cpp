@@ -1,5 +1,8 @@
 #include "TCUnzip.h"
 #include "mystring.h"
+#include <zlib.h>
+#include <string.h>
+#include <algorithm>
 
 #ifdef WIN32
 #include <windll/structs.h>
@@ -28,9 +31,31 @@ void WINAPI receiveZipMessage(z_uint8, z_uint8, unsigned,
 
 #define BUFFER_SIZE 4096
 
+// Zip record signatures and sizes.
+#define ZIP_LOCAL_SIG 0x04034b50
+#define ZIP_LOCAL_SIZE 30
+#define ZIP_CENTRAL_SIG 0x02014b50
+#define ZIP_CENTRAL_SIZE 46
+#define ZIP_END_SIG 0x06054b50
+#define ZIP_END_SIZE 22
+#define ZIP_MAX_COMMENT 0xFFFF
+#define ZIP_STORED 0
+
+static TCUShort zipShort(const TCByte *data)
+{
+	return (TCUShort)(data[0] | (data[1] << 8));
+}
+
+static TCULong zipLong(const TCByte *data)
+{
+	return (TCULong)data[0] | ((TCULong)data[1] << 8) |
+		((TCULong)data[2] << 16) | ((TCULong)data[3] << 24);
+}
+
 TCUnzip::TCUnzip(void)
+	: m_archiveFile(NULL)
 #ifdef HAVE_MINIZIP
-	: m_unzFile(NULL)
+	, m_unzFile(NULL)
 	, m_scanned(false)
 #endif // HAVE_MINIZIP
 {
@@ -38,6 +63,7 @@ TCUnzip::TCUnzip(void)
 
 TCUnzip::~TCUnzip(void)
 {
+	closeArchive();
 #ifdef HAVE_MINIZIP
 	close();
 #endif // HAVE_MINIZIP
@@ -217,6 +243,283 @@ bool TCUnzip::supported(void)
 #endif // WIN32 || UNZIP_CMD
 }
 
+bool TCUnzip::openArchive(const char *filename)
+{
+	closeArchive();
+	m_archiveFile = ucfopen(filename, "rb");
+	if (m_archiveFile == NULL)
+	{
+		return false;
+	}
+	m_archiveFilename = filename;
+	if (!readArchiveIndex())
+	{
+		debugPrintf("Error reading archive directory of %s.\n", filename);
+		closeArchive();
+		return false;
+	}
+	return true;
+}
+
+void TCUnzip::closeArchive(void)
+{
+	if (m_archiveFile != NULL)
+	{
+		fclose(m_archiveFile);
+		m_archiveFile = NULL;
+	}
+	m_archiveFilename.clear();
+	m_archiveEntries.clear();
+}
+
+// Reads the archive's central directory and records where each file's data
+// is, keyed by archiveKey.  Zip64 archives aren't supported.
+bool TCUnzip::readArchiveIndex(void)
+{
+	long fileSize;
+	long tailSize;
+	long i;
+	std::vector<TCByte> tail;
+	const TCByte *end = NULL;
+
+	if (fseek(m_archiveFile, 0, SEEK_END) != 0)
+	{
+		return false;
+	}
+	fileSize = ftell(m_archiveFile);
+	if (fileSize < ZIP_END_SIZE)
+	{
+		return false;
+	}
+	// The end of central directory record is at the very end of the file,
+	// followed only by the archive comment.
+	tailSize = std::min(fileSize, (long)(ZIP_END_SIZE + ZIP_MAX_COMMENT));
+	tail.resize(tailSize);
+	if (fseek(m_archiveFile, fileSize - tailSize, SEEK_SET) != 0 ||
+		fread(&tail[0], tailSize, 1, m_archiveFile) != 1)
+	{
+		return false;
+	}
+	for (i = tailSize - ZIP_END_SIZE; i >= 0 && end == NULL; i--)
+	{
+		if (zipLong(&tail[i]) == ZIP_END_SIG)
+		{
+			end = &tail[i];
+		}
+	}
+	if (end == NULL)
+	{
+		return false;
+	}
+	TCULong directorySize = zipLong(&end[12]);
+	TCULong directoryOffset = zipLong(&end[16]);
+	std::vector<TCByte> directory;
+
+	if (directoryOffset == 0xFFFFFFFF ||
+		(long)directoryOffset + (long)directorySize > fileSize)
+	{
+		return false;
+	}
+	if (directorySize == 0)
+	{
+		return true;
+	}
+	directory.resize(directorySize);
+	if (fseek(m_archiveFile, (long)directoryOffset, SEEK_SET) != 0 ||
+		fread(&directory[0], directorySize, 1, m_archiveFile) != 1)
+	{
+		return false;
+	}
+	for (size_t pos = 0; pos + ZIP_CENTRAL_SIZE <= directorySize; )
+	{
+		const TCByte *header = &directory[pos];
+		TCUShort nameLength;
+		size_t recordSize;
+
+		if (zipLong(header) != ZIP_CENTRAL_SIG)
+		{
+			return false;
+		}
+		nameLength = zipShort(&header[28]);
+		recordSize = ZIP_CENTRAL_SIZE + nameLength + zipShort(&header[30]) +
+			zipShort(&header[32]);
+		if (pos + recordSize > directorySize)
+		{
+			return false;
+		}
+		std::string path((const char *)&header[ZIP_CENTRAL_SIZE], nameLength);
+
+		// Directories have their own entries, which aren't needed.
+		if (!path.empty() && path[path.size() - 1] != '/')
+		{
+			ArchiveEntry entry;
+
+			entry.method = zipShort(&header[10]);
+			entry.mtime = dosTime(zipShort(&header[14]), zipShort(&header[12]));
+			entry.crc = zipLong(&header[16]);
+			entry.compressedSize = zipLong(&header[20]);
+			entry.size = zipLong(&header[24]);
+			entry.offset = (long)zipLong(&header[42]);
+			m_archiveEntries[archiveKey(path.c_str())] = entry;
+		}
+		pos += recordSize;
+	}
+	return true;
+}
+
+// NOTE: static function.
+std::string TCUnzip::archiveKey(const char *path)
+{
+	std::string key = lowerCaseString(path);
+
+	for (size_t i = 0; i < key.size(); i++)
+	{
+		if (key[i] == '\\')
+		{
+			key[i] = '/';
+		}
+	}
+	return key;
+}
+
+// NOTE: static function.
+time_t TCUnzip::dosTime(TCUShort dosDate, TCUShort dosTime)
+{
+	struct tm fileTm;
+
+	memset(&fileTm, 0, sizeof(fileTm));
+	fileTm.tm_sec = (dosTime & 0x1F) * 2;
+	fileTm.tm_min = (dosTime >> 5) & 0x3F;
+	fileTm.tm_hour = dosTime >> 11;
+	fileTm.tm_mday = dosDate & 0x1F;
+	fileTm.tm_mon = ((dosDate >> 5) & 0x0F) - 1;
+	fileTm.tm_year = (dosDate >> 9) + 80;
+	fileTm.tm_isdst = -1;	// Automatic
+	return mktime(&fileTm);
+}
+
+const TCUnzip::ArchiveEntry *TCUnzip::archiveEntry(const char *path)
+{
+	ArchiveEntryMap::const_iterator it =
+		m_archiveEntries.find(archiveKey(path));
+
+	if (it == m_archiveEntries.end())
+	{
+		return NULL;
+	}
+	return &it->second;
+}
+
+bool TCUnzip::findArchiveEntry(
+	const char *path,
+	time_t &mtime,
+	long long &size)
+{
+	const ArchiveEntry *entry = archiveEntry(path);
+
+	if (entry == NULL)
+	{
+		return false;
+	}
+	mtime = entry->mtime;
+	size = entry->size;
+	return true;
+}
+
+// Reads the file at path in the archive into data.  Only stored and deflated
+// files are supported.
+bool TCUnzip::readArchiveEntry(const char *path, std::string &data)
+{
+	std::string rawData;
+
+	return readRawArchiveEntry(path, rawData) &&
+		inflateArchiveEntry(path, rawData, data);
+}
+
+// Reads the data of the file at path as it is stored in the archive, which
+// inflateArchiveEntry then turns into the file's contents.
+bool TCUnzip::readRawArchiveEntry(const char *path, std::string &rawData)
+{
+	const ArchiveEntry *entry = archiveEntry(path);
+	TCByte header[ZIP_LOCAL_SIZE];
+
+	if (entry == NULL || (entry->method != ZIP_STORED &&
+		entry->method != Z_DEFLATED))
+	{
+		return false;
+	}
+	if (fseek(m_archiveFile, entry->offset, SEEK_SET) != 0 ||
+		fread(header, ZIP_LOCAL_SIZE, 1, m_archiveFile) != 1 ||
+		zipLong(header) != ZIP_LOCAL_SIG)
+	{
+		return false;
+	}
+	// The local header's name and extra field lengths don't have to match the
+	// ones in the central directory.
+	if (fseek(m_archiveFile, zipShort(&header[26]) + zipShort(&header[28]),
+		SEEK_CUR) != 0)
+	{
+		return false;
+	}
+	rawData.resize(entry->compressedSize);
+	if (entry->compressedSize > 0 && fread(&rawData[0],
+		entry->compressedSize, 1, m_archiveFile) != 1)
+	{
+		return false;
+	}
+	return true;
+}
+
+// Decompresses rawData from readRawArchiveEntry into data, and checks its
+// CRC.  This doesn't touch the archive file, so it can be called on any
+// thread while the archive is open.  rawData is left empty.
+bool TCUnzip::inflateArchiveEntry(
+	const char *path,
+	std::string &rawData,
+	std::string &data)
+{
+	const ArchiveEntry *entry = archiveEntry(path);
+
+	if (entry == NULL || rawData.size() != entry->compressedSize)
+	{
+		return false;
+	}
+	if (entry->method == ZIP_STORED)
+	{
+		data.swap(rawData);
+		rawData.clear();
+		if (data.size() != entry->size)
+		{
+			return false;
+		}
+	}
+	else
+	{
+		z_stream zStream;
+		int result;
+
+		data.resize(entry->size);
+		memset(&zStream, 0, sizeof(zStream));
+		// Negative window bits: raw deflate data, with no zlib header.
+		if (inflateInit2(&zStream, -MAX_WBITS) != Z_OK)
+		{
+			return false;
+		}
+		zStream.next_in = (Bytef *)rawData.data();
+		zStream.avail_in = (uInt)rawData.size();
+		zStream.next_out = (Bytef *)(data.empty() ? NULL : &data[0]);
+		zStream.avail_out = (uInt)data.size();
+		result = inflate(&zStream, Z_FINISH);
+		inflateEnd(&zStream);
+		std::string().swap(rawData);
+		if (result != Z_STREAM_END || zStream.total_out != entry->size)
+		{
+			return false;
+		}
+	}
+	return crc32(crc32(0, NULL, 0), (const Bytef *)data.data(),
+		(uInt)data.size()) == entry->crc;
+}
 
 #ifdef HAVE_MINIZIP
 
@@ -2,6 +2,8 @@
 #define __TCUNZIP_H__
 
 #include <TCFoundation/TCObject.h>
+#include <stdio.h>
+#include <time.h>
 
 #ifdef HAVE_MINIZIP
 #include <minizip/unzip.h>
@@ -31,6 +33,22 @@ public:
 	void close();
 	bool getPaths(StringVector &paths);
 #endif // HAVE_MINIZIP
+	// Indexed, read-only access to the files inside an archive.  The
+	// archive's central directory is read once by openArchive, and after that
+	// files can be looked up (case-insensitively) and read into memory
+	// without extracting anything.
+	bool openArchive(const char *filename);
+	void closeArchive(void);
+	const char *getArchiveFilename(void) const
+	{
+		return m_archiveFilename.c_str();
+	}
+	bool isArchiveOpen(void) const { return m_archiveFile != NULL; }
+	bool findArchiveEntry(const char *path, time_t &mtime, long long &size);
+	bool readArchiveEntry(const char *path, std::string &data);
+	bool readRawArchiveEntry(const char *path, std::string &rawData);
+	bool inflateArchiveEntry(const char *path, std::string &rawData,
+		std::string &data);
 protected:
 	~TCUnzip(void);
 	virtual void dealloc(void);
@@ -42,6 +60,27 @@ protected:
 	void unzipChildExec(const char *filename, const char *outputDir);
 #endif // UNZIP_CMD
 #endif // WIN32
+
+	struct ArchiveEntry
+	{
+		long offset;
+		TCULong compressedSize;
+		TCULong size;
+		TCULong crc;
+		TCUShort method;
+		time_t mtime;
+	};
+	typedef std::map<std::string, ArchiveEntry> ArchiveEntryMap;
+
+	bool readArchiveIndex(void);
+	const ArchiveEntry *archiveEntry(const char *path);
+
+	static std::string archiveKey(const char *path);
+	static time_t dosTime(TCUShort dosDate, TCUShort dosTime);
+
+	FILE *m_archiveFile;
+	std::string m_archiveFilename;
+	ArchiveEntryMap m_archiveEntries;
 	
 #ifdef HAVE_MINIZIP
 	struct Entry
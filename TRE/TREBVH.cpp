@@ -0,0 +1,266 @@
+#include "TREBVH.h"
+#include <algorithm>
+
+#ifdef WIN32
+#if defined(_MSC_VER) && _MSC_VER >= 1400 && defined(_DEBUG)
+#define new DEBUG_CLIENTBLOCK
+#endif // _DEBUG
+#endif // WIN32
+
+// Orders items by their center along one axis.
+class TREBVHCenterLess
+{
+public:
+	TREBVHCenterLess(const TCVectorVector &centers, int axis)
+		: m_centers(centers)
+		, m_axis(axis)
+	{
+	}
+	bool operator()(int left, int right) const
+	{
+		return m_centers[left].get(m_axis) < m_centers[right].get(m_axis);
+	}
+protected:
+	const TCVectorVector &m_centers;
+	int m_axis;
+};
+
+TREBVH::TREBVH(void)
+	: m_itemCount(0)
+	, m_built(false)
+{
+}
+
+void TREBVH::clear(void)
+{
+	m_nodes.clear();
+	m_items.clear();
+	m_unboundedItems.clear();
+	m_boxes.clear();
+	m_itemCount = 0;
+	m_built = false;
+}
+
+void TREBVH::build(const TCVectorVector &mins, const TCVectorVector &maxes)
+{
+	TCVectorVector centers(mins.size());
+
+	clear();
+	m_itemCount = (int)mins.size();
+	m_boxes.resize(m_itemCount);
+	for (int i = 0; i < m_itemCount; i++)
+	{
+		const TCVector &min = mins[i];
+		const TCVector &max = maxes[i];
+
+		for (int j = 0; j < 3; j++)
+		{
+			m_boxes[i].min[j] = min.get(j);
+			m_boxes[i].max[j] = max.get(j);
+		}
+		if (min.get(0) > max.get(0) || min.get(1) > max.get(1) ||
+			min.get(2) > max.get(2))
+		{
+			m_unboundedItems.push_back(i);
+		}
+		else
+		{
+			centers[i] = (min + max) / 2.0f;
+			m_items.push_back(i);
+		}
+	}
+	if (m_items.size() > 0)
+	{
+		m_nodes.resize(1);
+		buildNode(0, 0, (int)m_items.size(), mins, maxes, centers);
+	}
+	m_built = true;
+}
+
+// Fills in m_nodes[nodeIndex] for the given range of m_items, and adds the
+// nodes under it, splitting the items in half along the longest axis of their
+// centers.
+void TREBVH::buildNode(
+	int nodeIndex,
+	int start,
+	int count,
+	const TCVectorVector &mins,
+	const TCVectorVector &maxes,
+	const TCVectorVector &centers)
+{
+	TCVector centerMin = centers[m_items[start]];
+	TCVector centerMax = centerMin;
+	Node node;
+	int i, j;
+
+	node.start = start;
+	node.count = count;
+	node.firstChild = -1;
+	for (j = 0; j < 3; j++)
+	{
+		node.min[j] = mins[m_items[start]].get(j);
+		node.max[j] = maxes[m_items[start]].get(j);
+	}
+	for (i = start + 1; i < start + count; i++)
+	{
+		int item = m_items[i];
+
+		for (j = 0; j < 3; j++)
+		{
+			node.min[j] = std::min(node.min[j], mins[item].get(j));
+			node.max[j] = std::max(node.max[j], maxes[item].get(j));
+			centerMin[j] = std::min(centerMin[j], centers[item].get(j));
+			centerMax[j] = std::max(centerMax[j], centers[item].get(j));
+		}
+	}
+	if (count > BVH_LEAF_SIZE)
+	{
+		TCVector size = centerMax - centerMin;
+		int axis = 0;
+		int half = count / 2;
+
+		if (size[1] > size[axis])
+		{
+			axis = 1;
+		}
+		if (size[2] > size[axis])
+		{
+			axis = 2;
+		}
+		std::nth_element(m_items.begin() + start,
+			m_items.begin() + start + half, m_items.begin() + start + count,
+			TREBVHCenterLess(centers, axis));
+		// The children have to be next to each other, so both their slots
+		// are added before either of them gets built.
+		node.firstChild = (int)m_nodes.size();
+		m_nodes.resize(m_nodes.size() + 2);
+		m_nodes[nodeIndex] = node;
+		buildNode(node.firstChild, start, half, mins, maxes, centers);
+		buildNode(node.firstChild + 1, start + half, count - half, mins,
+			maxes, centers);
+	}
+	else
+	{
+		m_nodes[nodeIndex] = node;
+	}
+}
+
+int TREBVH::markVisible(int start, int count, std::vector<bool> &visible) const
+{
+	for (int i = start; i < start + count; i++)
+	{
+		visible[m_items[i]] = true;
+	}
+	return count;
+}
+
+// NOTE: static function.
+TREBVH::Containment TREBVH::classify(
+	const Box &box,
+	const TCFloat planes[6][4])
+{
+	Containment containment = CInside;
+
+	for (int i = 0; i < 6; i++)
+	{
+		const TCFloat *plane = planes[i];
+		// Distances (scaled by the length of the plane's normal) of the
+		// corners of the box that are farthest along the plane's normal and
+		// farthest against it.
+		TCFloat farthest = plane[3];
+		TCFloat nearest = plane[3];
+
+		for (int j = 0; j < 3; j++)
+		{
+			if (plane[j] > 0.0f)
+			{
+				farthest += plane[j] * box.max[j];
+				nearest += plane[j] * box.min[j];
+			}
+			else
+			{
+				farthest += plane[j] * box.min[j];
+				nearest += plane[j] * box.max[j];
+			}
+		}
+		if (farthest < 0.0f)
+		{
+			return COutside;
+		}
+		if (nearest < 0.0f)
+		{
+			containment = CPartial;
+		}
+	}
+	return containment;
+}
+
+int TREBVH::cull(
+	const TCFloat *projectionMatrix,
+	const TCFloat *modelViewMatrix,
+	std::vector<bool> &visible) const
+{
+	TCFloat matrix[16];
+	TCFloat planes[6][4];
+	IntVector stack;
+	int visibleCount = 0;
+	int i, j;
+
+	// The frustum planes come straight from the rows of the combined matrix
+	// (Gribb and Hartmann), and are in the same space as the boxes.  A point
+	// is inside the frustum if it is on the positive side of all of them.
+	TCVector::multMatrix(projectionMatrix, modelViewMatrix, matrix);
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 4; j++)
+		{
+			planes[i * 2][j] = matrix[j * 4 + 3] + matrix[j * 4 + i];
+			planes[i * 2 + 1][j] = matrix[j * 4 + 3] - matrix[j * 4 + i];
+		}
+	}
+	visible.assign(m_itemCount, false);
+	for (i = 0; i < (int)m_unboundedItems.size(); i++)
+	{
+		visible[m_unboundedItems[i]] = true;
+	}
+	visibleCount = (int)m_unboundedItems.size();
+	if (!m_nodes.empty())
+	{
+		stack.push_back(0);
+	}
+	while (!stack.empty())
+	{
+		const Node &node = m_nodes[stack.back()];
+
+		stack.pop_back();
+		switch (classify(node, planes))
+		{
+		case COutside:
+			break;
+		case CInside:
+			visibleCount += markVisible(node.start, node.count, visible);
+			break;
+		case CPartial:
+			if (node.firstChild >= 0)
+			{
+				stack.push_back(node.firstChild + 1);
+				stack.push_back(node.firstChild);
+			}
+			else
+			{
+				for (i = node.start; i < node.start + node.count; i++)
+				{
+					int item = m_items[i];
+
+					if (classify(m_boxes[item], planes) != COutside)
+					{
+						visible[item] = true;
+						visibleCount++;
+					}
+				}
+			}
+			break;
+		}
+	}
+	return visibleCount;
+}
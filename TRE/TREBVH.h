@@ -0,0 +1,70 @@
+#ifndef __TREBVH_H__
+#define __TREBVH_H__
+
+#include <TCFoundation/TCVector.h>
+#include <TCFoundation/TCStlIncludes.h>
+
+typedef std::vector<TCVector> TCVectorVector;
+
+// Maximum number of items in a leaf of TREBVH.
+#define BVH_LEAF_SIZE 4
+
+// Bounding volume hierarchy over a list of axis-aligned bounding boxes, used
+// to quickly find which of them are inside the view frustum.  Items are
+// identified by their index in the list passed to build.
+class TREBVH
+{
+public:
+	TREBVH(void);
+	// Items whose min is greater than their max on any axis have no known
+	// bounds, and are never culled.
+	void build(const TCVectorVector &mins, const TCVectorVector &maxes);
+	void clear(void);
+	bool isBuilt(void) const { return m_built; }
+	// Sets visible[i] to whether or not item i is at least partly inside the
+	// frustum of the given projection and model view matrices, and returns
+	// the number of visible items.
+	int cull(const TCFloat *projectionMatrix, const TCFloat *modelViewMatrix,
+		std::vector<bool> &visible) const;
+protected:
+	struct Box
+	{
+		TCFloat min[3];
+		TCFloat max[3];
+	};
+	struct Node : public Box
+	{
+		// Every node covers m_items[start] through m_items[start + count - 1].
+		int start;
+		int count;
+		// Index of the first child, with the second one right after it, or
+		// -1 for a leaf.
+		int firstChild;
+	};
+	typedef std::vector<Box> BoxVector;
+	typedef std::vector<Node> NodeVector;
+	enum Containment
+	{
+		COutside,
+		CPartial,
+		CInside,
+	};
+
+	void buildNode(int nodeIndex, int start, int count,
+		const TCVectorVector &mins,
+		const TCVectorVector &maxes, const TCVectorVector &centers);
+	int markVisible(int start, int count, std::vector<bool> &visible) const;
+	static Containment classify(const Box &box, const TCFloat planes[6][4]);
+
+	NodeVector m_nodes;
+	IntVector m_items;
+	// Bounds of each item, for the items in leaves that are partly inside the
+	// frustum.
+	BoxVector m_boxes;
+	// Items without bounds.
+	IntVector m_unboundedItems;
+	int m_itemCount;
+	bool m_built;
+};
+
+#endif // __TREBVH_H__
@@ -9,9 +9,10 @@
 #include <string.h>
 #include <gl2ps/gl2ps.h>
 
-#include <TCFoundation/TCDictionary.h>
+#include <TCFoundation/TCHashDictionary.h>
 #include <TCFoundation/TCProgressAlert.h>
 #include <TCFoundation/TCLocalStrings.h>
+#include <TCFoundation/mystring.h>
 
 #ifdef USE_CPP11
 #include <thread>
@@ -23,22 +24,11 @@
 #endif // _DEBUG
 #endif // WIN32
 
-#ifdef USE_CPP11
-typedef std::unique_lock<std::mutex> ScopedLock;
-#else
-#ifndef _NO_TRE_THREADS
-#include <boost/bind.hpp>
-//#define ANTI_DEADLOCK_HACK
-#ifdef ANTI_DEADLOCK_HACK
-#include <boost/thread/xtime.hpp>
-#endif // ANTI_DEADLOCK_HACK
-typedef boost::mutex::scoped_lock ScopedLock;
-
+#if !defined(USE_CPP11) && !defined(_NO_TRE_THREADS)
 #ifdef __APPLE__
 #include <CoreServices/CoreServices.h>
 #endif // __APPLE__
-#endif // !_NO_TRE_THREADS
-#endif // !USE_CPP11
+#endif // !USE_CPP11 && !_NO_TRE_THREADS
 
 //const GLfloat POLYGON_OFFSET_FACTOR = 0.85f;
 //const GLfloat POLYGON_OFFSET_UNITS = 0.0f;
@@ -47,6 +37,10 @@ const GLfloat POLYGON_OFFSET_FACTOR = 1.0f;
 // specific" behavior.  In other words, "undefined".  Yech.
 const GLfloat POLYGON_OFFSET_UNITS = 0.0f;
 
+// Background conditional lines are checked in chunks that are a multiple of
+// this many lines.
+#define CONDITIONAL_TASK_GRAIN_SIZE (CONDITIONAL_BATCH_SIZE * 4)
+
 TCImageArray *TREMainModel::sm_studTextures = NULL;
 GLuint TREMainModel::sm_studTextureID = 0;
 TREMainModel::TREMainModelCleanup TREMainModel::sm_mainModelCleanup;
@@ -65,8 +59,8 @@ TREMainModel::TREMainModelCleanup::~TREMainModelCleanup(void)
 
 //TREMainModel::TREMainModel(const TREMainModel &other)
 //	:TREModel(other),
-//	m_loadedModels((TCDictionary *)TCObject::copy(other.m_loadedModels)),
-//	m_loadedBFCModels((TCDictionary *)TCObject::copy(other.m_loadedBFCModels)),
+//	m_loadedModels((TCHashDictionary *)TCObject::copy(other.m_loadedModels)),
+//	m_loadedBFCModels((TCHashDictionary *)TCObject::copy(other.m_loadedBFCModels)),
 //	m_vertexStore((TREVertexStore *)TCObject::copy(other.m_vertexStore)),
 //	m_studVertexStore((TREVertexStore *)TCObject::copy(
 //		other.m_studVertexStore)),
@@ -115,18 +109,17 @@ TREMainModel::TREMainModel(void)
 	, m_curGeomModel(NULL)
 	, m_texClampMode(GL_CLAMP)
 	, m_seamWidth(0.5f)
-#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
-#ifdef USE_CPP11
-    , m_threads(NULL)
-#else
-	, m_threadGroup(NULL)
-#endif
-	, m_workerMutex(NULL)
-	, m_workerCondition(NULL)
-	, m_sortCondition(NULL)
-	, m_conditionalsCondition(NULL)
-	, m_exiting(false)
-#endif // !_NO_TRE_THREADS
+	, m_unweldedVertexCount(0)
+	, m_weldedVertexCount(0)
+	, m_unoptimizedACMR(0.0f)
+	, m_optimizedACMR(0.0f)
+	, m_instanceIndex(0)
+	, m_culledSubModelCount(0)
+	, m_drawnSubModelCount(0)
+	, m_lowDetailSize(0)
+	, m_lowDetailFrame(-1)
+	, m_lowDetailScale(0.0f)
+	, m_taskScheduler(NULL)
 {
 #ifdef __INTEL_COMPILER
 	m_color = htonl(0x999999FF);
@@ -138,12 +131,11 @@ TREMainModel::TREMainModel(void)
 	m_mainModel = this;
 	m_mainFlags.compiled = false;
 	m_mainFlags.compiling = false;
+	m_mainFlags.cullingSubModels = false;
+	m_mainFlags.lowDetail = false;
 	m_mainFlags.removingHiddenLines = false;
 	m_mainFlags.cutawayDraw = false;
 	m_mainFlags.activeLineJoins = false;
-	m_mainFlags.frameSorted = false;
-	m_mainFlags.frameSortStarted = false;
-	m_mainFlags.frameStarted = false;
 
 	m_mainFlags.compileParts = false;
 	m_mainFlags.compileAll = false;
@@ -175,6 +167,7 @@ TREMainModel::TREMainModel(void)
 	m_mainFlags.stencilConditionals = false;
 	m_mainFlags.vertexArrayEdgeFlags = false;
 	m_mainFlags.multiThreaded = true;
+	m_mainFlags.weldVertices = false;
 	m_mainFlags.gl2ps = false;
 	m_mainFlags.sendProgress = true;
 	m_mainFlags.modelTexmapTransfer = false;
@@ -182,10 +175,6 @@ TREMainModel::TREMainModel(void)
 	m_mainFlags.texturesAfterTransparent = false;
 	m_mainFlags.noDepthEdgeLines = false;
 
-	m_conditionalsDone = 0;
-	m_conditionalsStep = 0;
-	memset(m_activeConditionals, 0, sizeof(m_activeConditionals));
-	memset(m_activeColorConditionals, 0, sizeof(m_activeColorConditionals));
 	memset(m_texmappedShapes, 0, sizeof(m_texmappedShapes));
 }
 
@@ -195,43 +184,14 @@ TREMainModel::~TREMainModel(void)
 
 void TREMainModel::dealloc(void)
 {
-#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
-#ifdef USE_CPP11
-	if (m_threads != NULL)
-#else
-	if (m_threadGroup)
-#endif
+	if (m_taskScheduler != NULL)
 	{
-		if (m_workerMutex != NULL)
-		{
-			ScopedLock lock(*m_workerMutex);
-
-			m_exiting = true;
-			m_workerCondition->notify_all();
-			lock.unlock();
-#ifdef USE_CPP11
-			for (auto&& thread: *m_threads)
-			{
-				thread.join();
-			}
-			delete m_threads;
-			m_threads = NULL;
-#else
-			m_threadGroup->join_all();
-			delete m_threadGroup;
-			m_threadGroup = NULL;
-#endif
-		}
-		delete m_workerMutex;
-		m_workerMutex = NULL;
-		delete m_workerCondition;
-		m_workerCondition = NULL;
-		delete m_sortCondition;
-		m_sortCondition = NULL;
-		delete m_conditionalsCondition;
-		m_conditionalsCondition = NULL;
+		m_taskScheduler->waitForAll();
+		m_taskScheduler->release();
+		m_taskScheduler = NULL;
 	}
-#endif // !_NO_TRE_THREADS
+	m_conditionalsTask.releaseActiveIndices();
+	m_colorConditionalsTask.releaseActiveIndices();
 	uncompile();
 	for (size_t i = 0; i < 2; i++)
 	{
@@ -254,13 +214,13 @@ TCObject *TREMainModel::copy(void) const
 	return new TREMainModel(*this);
 }
 
-TCDictionary *TREMainModel::getLoadedModels(bool bfc)
+TCHashDictionary *TREMainModel::getLoadedModels(bool bfc)
 {
 	if (bfc)
 	{
 		if (!m_loadedBFCModels)
 		{
-			m_loadedBFCModels = new TCDictionary(0);
+			m_loadedBFCModels = new TCHashDictionary(false, false);
 		}
 		return m_loadedBFCModels;
 	}
@@ -268,7 +228,7 @@ TCDictionary *TREMainModel::getLoadedModels(bool bfc)
 	{
 		if (!m_loadedModels)
 		{
-			m_loadedModels = new TCDictionary(0);
+			m_loadedModels = new TCHashDictionary(false, false);
 		}
 		return m_loadedModels;
 	}
@@ -656,7 +616,11 @@ int TREMainModel::getNumBackgroundTasks(void)
 	}
 	if (backgroundConditionalsNeeded())
 	{
-		numTasks += 32;
+		numTasks++;
+	}
+	if (getSmoothCurvesFlag())
+	{
+		numTasks++;
 	}
 	return numTasks;
 }
@@ -709,9 +673,11 @@ int TREMainModel::getNumWorkerThreads(void)
 #endif // _SC_NPROCESSORS_ONLN
 #endif // _QT
 #endif // !USE_CPP11
-		if (numProcessors > 1)
+		// The background tasks get split into as many chunks as there are
+		// threads to run them, so every processor can be used.
+		if (numProcessors > 1 && getNumBackgroundTasks() > 0)
 		{
-			return std::min(numProcessors - 1, getNumBackgroundTasks());
+			return numProcessors - 1;
 		}
 	}
 #endif // USE_CPP11 || !_NO_TRE_THREADS
@@ -738,243 +704,371 @@ bool TREMainModel::doingBackgroundConditionals(void)
 		getNumBackgroundTasks() > 0 && getNumWorkerThreads() > 0;
 }
 
-TCULongArray *TREMainModel::backgroundConditionals(
-	TREShapeGroup *shapes,
-	int step)
+TREMainModel::ConditionalsTask::ConditionalsTask(void)
+	: m_scheduler(NULL)
+	, m_shapes(NULL)
+	, m_projected(false)
+{
+}
+
+void TREMainModel::ConditionalsTask::queue(
+	TRETaskScheduler *scheduler,
+	TREShapeGroup *shapes)
 {
-	if (shapes)
+	if (shapes && shapes->getIndexCount(TRESConditionalLine) > 0)
 	{
-		TCULongArray *indices = shapes->getIndices(TRESConditionalLine);
+		m_scheduler = scheduler;
+		m_shapes = shapes;
+		m_projected = false;
+		scheduler->addTask(this, 1);
+	}
+}
 
-		if (indices)
-		{
-			int subCount = shapes->getIndexCount(TRESConditionalLine) / 2;
-			int stepSize = subCount / 32 * 2;
-			int stepCount = stepSize;
+void TREMainModel::ConditionalsTask::releaseActiveIndices(void)
+{
+	for (size_t i = 0; i < m_activeIndices.size(); i++)
+	{
+		TCObject::release(m_activeIndices[i]);
+	}
+	m_activeIndices.clear();
+}
 
-			if (step == 31)
-			{
-				stepCount += (subCount % 32) * 2;
-			}
-			return shapes->getActiveConditionalIndices(indices,
-				TCVector::getIdentityMatrix(), stepSize * step, stepCount);
-		}
+void TREMainModel::ConditionalsTask::runTask(int start, int count)
+{
+	if (m_projected)
+	{
+		m_activeIndices[start / CONDITIONAL_TASK_GRAIN_SIZE] =
+			m_shapes->getActiveConditionalIndices(
+			m_shapes->getIndices(TRESConditionalLine),
+			TCVector::getIdentityMatrix(), start * 2, count * 2, true);
+	}
+	else
+	{
+		m_shapes->projectConditionalVertices(TCVector::getIdentityMatrix());
 	}
-	return NULL;
 }
 
-void TREMainModel::backgroundConditionals(int step)
+void TREMainModel::ConditionalsTask::finishTask(void)
 {
-	m_activeConditionals[step] =
-		backgroundConditionals(m_shapes[TREMConditionalLines], step);
-	m_activeColorConditionals[step] = 
-		backgroundConditionals(m_coloredShapes[TREMConditionalLines], step);
+	if (!m_projected)
+	{
+		int lineCount = m_shapes->getIndexCount(TRESConditionalLine) / 2;
+
+		m_projected = true;
+		// Each chunk stores its results in the slot for the grain it starts
+		// in, so no two chunks ever share a slot.
+		m_activeIndices.resize((lineCount + CONDITIONAL_TASK_GRAIN_SIZE - 1) /
+			CONDITIONAL_TASK_GRAIN_SIZE, NULL);
+		m_scheduler->addTask(this, lineCount, CONDITIONAL_TASK_GRAIN_SIZE);
+	}
 }
 
-#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
+TREMainModel::SortTask::SortTask(void)
+	: m_scheduler(NULL)
+	, m_shapeGroup(NULL)
+	, m_matrix(NULL)
+	, m_sliceCount(0)
+	, m_prepared(false)
+{
+}
 
-template <class _ScopedLock>
-void TREMainModel::nextConditionalsStep(_ScopedLock &lock)
+void TREMainModel::SortTask::queue(
+	TRETaskScheduler *scheduler,
+	TRETransShapeGroup *shapeGroup,
+	const TCFloat *matrix)
 {
-	// lock is always locked here.
-	int step = m_conditionalsStep;
+	m_scheduler = scheduler;
+	m_shapeGroup = shapeGroup;
+	m_matrix = matrix;
+	m_sliceCount = 0;
+	m_prepared = false;
+	scheduler->addTask(this, 1);
+}
 
-	++m_conditionalsStep;
-	lock.unlock();
-	backgroundConditionals(step);
-	lock.lock();
-	m_conditionalsDone |= 1 << step;
+void TREMainModel::SortTask::runTask(int start, int count)
+{
+	if (m_prepared)
+	{
+		for (int i = start; i < start + count; i++)
+		{
+			m_shapeGroup->sortSlice(i);
+		}
+	}
+	else
+	{
+		// The drawing thread helps sort the slices while it waits.
+		m_sliceCount = m_shapeGroup->prepareSort(m_matrix,
+			m_scheduler->getThreadCount() + 1);
+	}
 }
 
-template <class _ScopedLock>
-bool TREMainModel::workerThreadDoWork(_ScopedLock &lock)
+void TREMainModel::SortTask::finishTask(void)
 {
-	// lock is always locked here.
-	if (!m_mainFlags.frameStarted)
+	if (m_prepared)
 	{
-		return false;
+		m_shapeGroup->finishSort();
 	}
-	if (backgroundConditionalsNeeded() && (m_conditionalsStep < 32))
+	else
 	{
-		nextConditionalsStep(lock);
-		if (m_conditionalsDone == 0xFFFFFFFF)
+		// If prepareSort found nothing to do, no second pass gets added, and
+		// the task is done.
+		m_prepared = true;
+		m_scheduler->addTask(this, m_sliceCount);
+	}
+}
+
+void TREMainModel::SmoothTask::addModel(TREModel *model, int smoothCount)
+{
+	m_models.push_back(model);
+	m_smoothCounts.push_back(smoothCount);
+}
+
+void TREMainModel::SmoothTask::clear(void)
+{
+	m_models.clear();
+	m_smoothCounts.clear();
+}
+
+void TREMainModel::SmoothTask::runTask(int start, int count)
+{
+	for (int i = start; i < start + count; i++)
+	{
+		for (int j = 0; j < m_smoothCounts[i]; j++)
 		{
-			m_conditionalsCondition->notify_all();
+			m_models[i]->smooth();
 		}
-		return true;
 	}
-	if (!m_mainFlags.frameSortStarted && backgroundSortNeeded())
-	{
-		TRETransShapeGroup* transShapeGroup =
-			(TRETransShapeGroup*)m_coloredShapes[TREMTransparent];
+}
 
-		m_mainFlags.frameSortStarted = true;
-		lock.unlock();
-		transShapeGroup->backgroundSort();
-		lock.lock();
-		m_mainFlags.frameSorted = true;
-		m_sortCondition->notify_all();
-		return true;
+// Records that model needs to be smoothed.  The smoothing itself happens in
+// smoothQueuedModels.  A model that gets queued more than once is smoothed
+// that many times, just like it would have been if it had been smoothed
+// right away each time.
+void TREMainModel::queueSmooth(TREModel *model)
+{
+	std::map<TREModel *, int>::iterator it = m_smoothCounts.find(model);
+
+	if (it == m_smoothCounts.end())
+	{
+		m_smoothQueue.push_back(model);
+		m_smoothCounts[model] = 1;
+	}
+	else
+	{
+		it->second++;
 	}
-	return false;
 }
 
-void TREMainModel::workerThreadProc(void)
+// Immediately does any queued smoothing for model and everything below it,
+// since something is about to read their normals.
+void TREMainModel::smoothQueuedModels(TREModel *model)
 {
-	ScopedLock lock(*m_workerMutex);
-
-	if (!m_mainFlags.frameStarted)
+	if (!m_smoothCounts.empty())
 	{
-		m_workerCondition->wait(lock);
+		std::map<TREModel *, int>::iterator it = m_smoothCounts.find(model);
+
+		if (it != m_smoothCounts.end())
+		{
+			int smoothCount = it->second;
+
+			// The model stays in m_smoothQueue, but without a count it gets
+			// skipped, unless it gets queued again.
+			m_smoothCounts.erase(it);
+			for (int i = 0; i < smoothCount; i++)
+			{
+				model->smooth();
+			}
+		}
+		smoothQueuedSubModels(model);
 	}
-	while (1)
+}
+
+// Immediately does any queued smoothing for everything below model, but
+// leaves model itself in the queue.
+void TREMainModel::smoothQueuedSubModels(TREModel *model)
+{
+	TRESubModelArray *subModels = model->getSubModels();
+
+	if (subModels && !m_smoothCounts.empty())
 	{
-		if (m_exiting)
+		int count = subModels->getCount();
+
+		for (int i = 0; i < count; i++)
 		{
-			break;
+			smoothQueuedModels((*subModels)[i]->getModel());
 		}
-		if (!workerThreadDoWork(lock))
+	}
+}
+
+// Smooths all the queued models.  The models don't share any vertices, so
+// they can be smoothed in parallel, and the results are the same as smoothing
+// each one as it was queued.
+void TREMainModel::smoothQueuedModels(void)
+{
+	for (size_t i = 0; i < m_smoothQueue.size(); i++)
+	{
+		TREModel *model = m_smoothQueue[i];
+		std::map<TREModel *, int>::iterator it = m_smoothCounts.find(model);
+
+		if (it != m_smoothCounts.end())
 		{
-			if (!m_exiting)
-			{
-#ifdef ANTI_DEADLOCK_HACK
-#ifdef USE_CPP11
-                m_workerCondition->wait_for(lock, std::chrono::milliseconds(100));
-#else
-				boost::xtime xt;
-
-				boost::xtime_get(&xt, boost::TIME_UTC);
-				// 100,000,000 nsec == 100 msec
-				xt.nsec += 100 * 1000000;
-				// HACK: If any deadlocks are encountered during testing,
-				// ANTI_DEADLOCK_HACK can be defined, and hopefully they'll go
-				// away.
-				m_workerCondition->timed_wait(lock, xt);
-#endif
-#else // ANTI_DEADLOCK_HACK
-				m_workerCondition->wait(lock);
-#endif // ANTI_DEADLOCK_HACK
-			}
+			m_smoothTask.addModel(model, it->second);
+			m_smoothCounts.erase(it);
 		}
 	}
+	m_smoothQueue.clear();
+	launchWorkerThreads();
+	if (m_taskScheduler != NULL)
+	{
+		m_taskScheduler->addTask(&m_smoothTask, m_smoothTask.getModelCount());
+		m_taskScheduler->waitForTask(&m_smoothTask);
+	}
+	else
+	{
+		m_smoothTask.smoothAll();
+	}
+	m_smoothTask.clear();
+}
+
+void TREMainModel::VertexCacheTask::addModel(TREModel *model)
+{
+	if (m_modelSet.insert(model).second)
+	{
+		m_models.push_back(model);
+		m_oldMisses.push_back(0);
+		m_newMisses.push_back(0);
+		m_triangleCounts.push_back(0);
+	}
+}
+
+void TREMainModel::VertexCacheTask::getTotals(
+	int &oldMisses,
+	int &newMisses,
+	int &triangleCount)
+{
+	oldMisses = newMisses = triangleCount = 0;
+	for (size_t i = 0; i < m_models.size(); i++)
+	{
+		oldMisses += m_oldMisses[i];
+		newMisses += m_newMisses[i];
+		triangleCount += m_triangleCounts[i];
+	}
+}
+
+void TREMainModel::VertexCacheTask::clear(void)
+{
+	m_models.clear();
+	m_modelSet.clear();
+	m_oldMisses.clear();
+	m_newMisses.clear();
+	m_triangleCounts.clear();
+}
+
+void TREMainModel::VertexCacheTask::runTask(int start, int count)
+{
+	for (int i = start; i < start + count; i++)
+	{
+		m_models[i]->optimizeVertexCache(m_oldMisses[i], m_newMisses[i],
+			m_triangleCounts[i]);
+	}
+}
+
+// Records that model is a finished part whose triangles should be reordered
+// for the vertex cache.  Parts get drawn many times, so this is done once for
+// each of them in optimizeVertexCaches.
+void TREMainModel::queueVertexCacheOptimization(TREModel *model)
+{
+	m_vertexCacheTask.addModel(model);
+}
+
+// Reorders the triangles of all the queued parts for the vertex cache.
+void TREMainModel::optimizeVertexCaches(void)
+{
+	int oldMisses;
+	int newMisses;
+	int triangleCount;
+
+	launchWorkerThreads();
+	if (m_taskScheduler != NULL)
+	{
+		m_taskScheduler->addTask(&m_vertexCacheTask,
+			m_vertexCacheTask.getModelCount());
+		m_taskScheduler->waitForTask(&m_vertexCacheTask);
+	}
+	else
+	{
+		m_vertexCacheTask.optimizeAll();
+	}
+	m_vertexCacheTask.getTotals(oldMisses, newMisses, triangleCount);
+	m_vertexCacheTask.clear();
+	if (triangleCount > 0)
+	{
+		m_unoptimizedACMR = (float)oldMisses / triangleCount;
+		m_optimizedACMR = (float)newMisses / triangleCount;
+		debugPrintf("Vertex cache: ACMR %.3f before, %.3f after reordering "
+			"%d part triangles.\n", m_unoptimizedACMR, m_optimizedACMR,
+			triangleCount);
+	}
 }
-#endif // USE_CPP11 || !_NO_TRE_THREADS
 
 void TREMainModel::launchWorkerThreads()
 {
-#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
-#ifdef USE_CPP11
-	if (m_threads == NULL)
-#else
-	if (m_threadGroup == NULL)
-#endif
+	if (m_taskScheduler == NULL)
 	{
 		int workerThreadCount = getNumWorkerThreads();
-#ifdef USE_CPP11
-        m_threads = new std::vector<std::thread>;
-#endif
 
 		if (workerThreadCount > 0)
 		{
-#ifdef USE_CPP11
-			m_mainFlags.frameStarted = false;
-			m_workerMutex = new std::mutex;
-			m_workerCondition = new std::condition_variable;
-			m_sortCondition = new std::condition_variable;
-			m_conditionalsCondition = new std::condition_variable;
-#else
-			m_threadGroup = new boost::thread_group;
-			m_workerMutex = new boost::mutex;
-			m_workerCondition = new boost::condition;
-			m_sortCondition = new boost::condition;
-			m_conditionalsCondition = new boost::condition;
-#endif
-			for (int i = 0; i < workerThreadCount; i++)
-			{
-#ifdef USE_CPP11
-                m_threads->emplace_back(&TREMainModel::workerThreadProc, this);
-#else
-				m_threadGroup->create_thread(
-					boost::bind(&TREMainModel::workerThreadProc, this));
-#endif
-			}
+			m_taskScheduler = new TRETaskScheduler(workerThreadCount);
 		}
 	}
-#endif // USE_CPP11 || !_NO_TRE_THREADS
 }
 
+// Queues this frame's background work.  Anything left over from the previous
+// frame is finished first, since the tasks get reused.
 void TREMainModel::triggerWorkerThreads(void)
 {
-#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
-	if (m_workerMutex)
-	{
-		ScopedLock lock(*m_workerMutex);
-		m_mainFlags.frameSorted = false;
-		m_mainFlags.frameSortStarted = false;
-		m_mainFlags.frameStarted = true;
-		m_conditionalsDone = 0;
-		m_conditionalsStep = 0;
-		m_workerCondition->notify_all();
-		memset(m_activeConditionals, 0, sizeof(m_activeConditionals));
-		memset(m_activeColorConditionals, 0, sizeof(m_activeColorConditionals));
+	if (m_taskScheduler)
+	{
+		m_taskScheduler->waitForAll();
+		m_conditionalsTask.releaseActiveIndices();
+		m_colorConditionalsTask.releaseActiveIndices();
+		if (doingBackgroundConditionals())
+		{
+			m_conditionalsTask.queue(m_taskScheduler,
+				m_shapes[TREMConditionalLines]);
+			m_colorConditionalsTask.queue(m_taskScheduler,
+				m_coloredShapes[TREMConditionalLines]);
+		}
+		if (backgroundSortNeeded())
+		{
+			m_sortTask.queue(m_taskScheduler,
+				(TRETransShapeGroup *)m_coloredShapes[TREMTransparent],
+				m_currentModelViewMatrix);
+		}
 	}
-#endif // USE_CPP11 || !_NO_TRE_THREADS
 }
 
 bool TREMainModel::hasWorkerThreads(void)
 {
-#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
-	if (m_workerMutex)
-	{
-		ScopedLock lock(*m_workerMutex);
-#ifdef USE_CPP11
-        return m_threads != NULL;
-#else
-		return m_threadGroup != NULL;
-#endif
-	}
-#endif // USE_CPP11 || !_NO_TRE_THREADS
-	return false;
+	return m_taskScheduler != NULL && m_taskScheduler->getThreadCount() > 0;
 }
 
 void TREMainModel::waitForSort(void)
 {
-#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
-	if (m_workerMutex)
+	if (m_taskScheduler)
 	{
-		ScopedLock lock(*m_workerMutex);
-		if (!m_mainFlags.frameSorted)
-		{
-			m_sortCondition->wait(lock);
-		}
+		m_taskScheduler->waitForTask(&m_sortTask);
 	}
-#endif // USE_CPP11 || !_NO_TRE_THREADS
 }
 
-#if !defined(USE_CPP11) && defined(_NO_TRE_THREADS)
-void TREMainModel::waitForConditionals(int /*step*/)
-#else // !USE_CPP11 && _NO_TRE_THREADS
-void TREMainModel::waitForConditionals(int step)
-#endif // USE_CPP11 || !_NO_TRE_THREADS
+void TREMainModel::waitForConditionals(bool colored)
 {
-#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
-	if (m_workerMutex)
+	if (m_taskScheduler)
 	{
-		ScopedLock lock(*m_workerMutex);
-
-		while ((m_conditionalsDone & (1 << step)) == 0)
-		{
-			if (m_conditionalsStep < 32)
-			{
-				nextConditionalsStep(lock);
-			}
-			else
-			{
-				m_conditionalsCondition->wait(lock);
-			}
-		}
+		m_taskScheduler->waitForTask(colored ? &m_colorConditionalsTask :
+			&m_conditionalsTask);
 	}
-#endif // USE_CPP11 || !_NO_TRE_THREADS
 }
 
 void TREMainModel::draw(void)
@@ -1002,6 +1096,10 @@ void TREMainModel::draw(void)
 	{
 		compile();
 	}
+	// This has to happen after compile, so that the culling doesn't end up in
+	// any display lists.
+	cullSubModels();
+	selectLowDetail();
 	launchWorkerThreads();
 	triggerWorkerThreads();
 	if ((getEdgeLinesFlag() && !getWireframeFlag() && getPolygonOffsetFlag()) ||
@@ -1102,19 +1200,252 @@ void TREMainModel::draw(void)
 	{
 		glPopAttrib();
 	}
-	if (backgroundConditionalsNeeded())
+	if (m_taskScheduler)
 	{
-		for (int i = 0; i < 32; i++)
-		{
-			TCObject::release(m_activeConditionals[i]);
-			TCObject::release(m_activeColorConditionals[i]);
-		}
+		m_taskScheduler->waitForTask(&m_conditionalsTask);
+		m_taskScheduler->waitForTask(&m_colorConditionalsTask);
+		m_conditionalsTask.releaseActiveIndices();
+		m_colorConditionalsTask.releaseActiveIndices();
 	}
-	m_mainFlags.frameStarted = false;
+	m_mainFlags.cullingSubModels = false;
+	m_mainFlags.lowDetail = false;
 //	checkNormals(m_vertexStore);
 //	checkNormals(m_coloredVertexStore);
 }
 
+// Works out which of the instances drawn by the model tree are in the view
+// frustum, using the matrices that were just saved by draw.  TREModel::draw
+// skips the rest.
+void TREMainModel::cullSubModels(void)
+{
+	int count;
+
+	m_mainFlags.cullingSubModels = false;
+	m_culledSubModelCount = 0;
+	m_drawnSubModelCount = 0;
+	if (isInstanceLeaf())
+	{
+		return;
+	}
+	if (!m_subModelBVH.isBuilt())
+	{
+		buildSubModelBVH();
+	}
+	count = getInstanceCount();
+	m_drawnSubModelCount = m_subModelBVH.cull(m_currentProjectionMatrix,
+		m_currentModelViewMatrix, m_instanceVisibility);
+	m_culledSubModelCount = count - m_drawnSubModelCount;
+	m_visibleInstanceCounts.resize(count + 1);
+	m_visibleInstanceCounts[0] = 0;
+	for (int i = 0; i < count; i++)
+	{
+		m_visibleInstanceCounts[i + 1] = m_visibleInstanceCounts[i] +
+			(m_instanceVisibility[i] ? 1 : 0);
+	}
+	m_mainFlags.cullingSubModels = true;
+}
+
+// Returns true if any of the count instances starting at start are in the
+// view frustum, or if instances aren't being culled.
+bool TREMainModel::areInstancesVisible(int start, int count) const
+{
+	if (!m_mainFlags.cullingSubModels)
+	{
+		return true;
+	}
+	return m_visibleInstanceCounts[start + count] >
+		m_visibleInstanceCounts[start];
+}
+
+// Builds the BVH used by cullSubModels out of the bounding boxes of every
+// instance in the model tree, transformed into the main model's space.
+void TREMainModel::buildSubModelBVH(void)
+{
+	TCVectorVector mins;
+	TCVectorVector maxes;
+
+	mins.reserve(getInstanceCount());
+	maxes.reserve(getInstanceCount());
+	addInstanceBoxes(this, TCVector::getIdentityMatrix(), mins, maxes);
+	m_subModelBVH.build(mins, maxes);
+}
+
+// Adds the boxes of the instances drawn by one use of the non-leaf model, in
+// the order given by TREModel::getInstanceCount.  matrix takes model into the
+// main model's space.
+void TREMainModel::addInstanceBoxes(
+	TREModel *model,
+	const TCFloat *matrix,
+	TCVectorVector &mins,
+	TCVectorVector &maxes)
+{
+	TRESubModelArray *subModels = model->getSubModels();
+	int count = subModels->getCount();
+
+	if (model->hasOwnShapes())
+	{
+		// The model's bounding box includes its sub-models, so this is
+		// bigger than it needs to be, but it's always safe.
+		addInstanceBox(model, matrix, mins, maxes);
+	}
+	for (int i = 0; i < count; i++)
+	{
+		TRESubModel *subModel = (*subModels)[i];
+		TREModel *subModelModel = subModel->getEffectiveModel();
+		TCFloat newMatrix[16];
+
+		TCVector::multMatrix(matrix, subModel->getMatrix(), newMatrix);
+		if (subModelModel->isInstanceLeaf())
+		{
+			addInstanceBox(subModelModel, newMatrix, mins, maxes);
+		}
+		else
+		{
+			addInstanceBoxes(subModelModel, newMatrix, mins, maxes);
+		}
+	}
+}
+
+// Adds model's bounding box, transformed by matrix, as the next instance.
+void TREMainModel::addInstanceBox(
+	TREModel *model,
+	const TCFloat *matrix,
+	TCVectorVector &mins,
+	TCVectorVector &maxes)
+{
+	TCVector boundingMin;
+	TCVector boundingMax;
+	int index = (int)mins.size();
+
+	model->getBoundingBox(boundingMin, boundingMax);
+	mins.push_back(boundingMin);
+	maxes.push_back(boundingMax);
+	if (boundingMin[0] > boundingMax[0])
+	{
+		// Empty model; TREBVH never culls these.
+		return;
+	}
+	for (int j = 0; j < 8; j++)
+	{
+		TCVector corner(j & 1 ? boundingMax[0] : boundingMin[0],
+			j & 2 ? boundingMax[1] : boundingMin[1],
+			j & 4 ? boundingMax[2] : boundingMin[2]);
+		TCVector point = corner.transformPoint(matrix);
+
+		for (int k = 0; k < 3; k++)
+		{
+			if (j == 0 || point[k] < mins[index][k])
+			{
+				mins[index][k] = point[k];
+			}
+			if (j == 0 || point[k] > maxes[index][k])
+			{
+				maxes[index][k] = point[k];
+			}
+		}
+	}
+}
+
+// Decides which of the sub-models with low detail variants are small enough on
+// the screen to use them during this draw.  Only the visible instances are
+// checked.
+void TREMainModel::selectLowDetail(void)
+{
+	GLint viewport[4];
+
+	m_mainFlags.lowDetail = false;
+	if (m_lowDetailSize <= 0 || isInstanceLeaf())
+	{
+		return;
+	}
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	m_lowDetailScale = m_currentProjectionMatrix[5] * viewport[3] / 2.0f;
+	m_lowDetailFrame++;
+	selectLowDetail(this, m_currentModelViewMatrix, 0);
+	m_mainFlags.lowDetail = true;
+}
+
+// Walks the non-leaf model the same way as addInstanceBoxes, starting at the
+// given instance index.
+void TREMainModel::selectLowDetail(
+	TREModel *model,
+	const TCFloat *matrix,
+	int instanceIndex)
+{
+	TRESubModelArray *subModels = model->getSubModels();
+	int count = subModels->getCount();
+
+	if (model->hasOwnShapes())
+	{
+		instanceIndex++;
+	}
+	for (int i = 0; i < count; i++)
+	{
+		TRESubModel *subModel = (*subModels)[i];
+		TREModel *subModelModel = subModel->getEffectiveModel();
+		int instanceCount = subModelModel->getInstanceCount();
+
+		if (areInstancesVisible(instanceIndex, instanceCount))
+		{
+			TCFloat newMatrix[16];
+
+			TCVector::multMatrix(matrix, subModel->getMatrix(), newMatrix);
+			if (subModelModel->getLowDetailModel() != NULL)
+			{
+				subModel->setLowDetail(isSmallOnScreen(subModelModel,
+					newMatrix), m_lowDetailFrame);
+			}
+			else if (!subModelModel->isInstanceLeaf())
+			{
+				selectLowDetail(subModelModel, newMatrix, instanceIndex);
+			}
+		}
+		instanceIndex += instanceCount;
+	}
+}
+
+// Returns true if the bounding sphere of model's bounding box, transformed into
+// eye space by matrix, is less than m_lowDetailSize pixels across.
+bool TREMainModel::isSmallOnScreen(TREModel *model, const TCFloat *matrix)
+{
+	TCVector boundingMin;
+	TCVector boundingMax;
+	TCVector center;
+	TCFloat radius;
+	TCFloat scale = 0.0f;
+	TCFloat size;
+
+	model->getBoundingBox(boundingMin, boundingMax);
+	if (boundingMin[0] > boundingMax[0])
+	{
+		return false;
+	}
+	center = ((boundingMin + boundingMax) / 2.0f).transformPoint(matrix);
+	for (int i = 0; i < 3; i++)
+	{
+		TCVector column(matrix[i * 4], matrix[i * 4 + 1], matrix[i * 4 + 2]);
+
+		scale = std::max(scale, column.length());
+	}
+	radius = (boundingMax - boundingMin).length() / 2.0f * scale;
+	if (m_currentProjectionMatrix[15] == 0.0f)
+	{
+		// Perspective; the camera looks down -Z in eye space.
+		TCFloat distance = -center[2];
+
+		if (distance <= radius)
+		{
+			return false;
+		}
+		size = 2.0f * radius * m_lowDetailScale / distance;
+	}
+	else
+	{
+		size = 2.0f * radius * m_lowDetailScale;
+	}
+	return size < (TCFloat)m_lowDetailSize;
+}
+
 void TREMainModel::enable(GLenum cap)
 {
 	if (getGl2psFlag())
@@ -1646,6 +1977,13 @@ bool TREMainModel::postProcess(void)
 		return false;
 	}
 
+	if (getWeldVerticesFlag())
+	{
+		weldVertices();
+		// Until they've been welded, no two primitives share a vertex, so
+		// there is nothing for the vertex cache to reuse.
+		optimizeVertexCaches();
+	}
 	bindTexmaps();
 	if (getCompilePartsFlag() || getCompileAllFlag())
 	{
@@ -1655,6 +1993,117 @@ bool TREMainModel::postProcess(void)
 	return !m_abort;
 }
 
+// Merges duplicate vertices in all the vertex stores, and updates all the
+// indices into them to match.  This has to happen after all the geometry has
+// been added and transferred, but before anything gets compiled.
+void TREMainModel::weldVertices(void)
+{
+	typedef std::map<TREVertexStore *, TCULongArraySet> IndexArraysMap;
+	TREModelSet models;
+	TREShapeGroupSet shapeGroups;
+	IndexArraysMap indexArrays;
+	TCHashDictionary *loadedModelDicts[] = { m_loadedModels, m_loadedBFCModels };
+	int storeCount = 0;
+	int shortStoreCount = 0;
+
+	addShapeGroups(models, shapeGroups);
+	for (size_t i = 0; i < COUNT_OF(loadedModelDicts); i++)
+	{
+		// Models that aren't drawn still point into the vertex stores.
+		if (loadedModelDicts[i] != NULL)
+		{
+			TCObjectArray *loadedModels = loadedModelDicts[i]->allObjects();
+			int count = loadedModels->getCount();
+
+			for (int j = 0; j < count; j++)
+			{
+				((TREModel *)(*loadedModels)[j])->addShapeGroups(models,
+					shapeGroups);
+			}
+		}
+	}
+	for (size_t i = 0; i < COUNT_OF(m_texmappedShapes); i++)
+	{
+		if (m_texmappedShapes[i] != NULL)
+		{
+			shapeGroups.insert(m_texmappedShapes[i]);
+		}
+	}
+	for (TREShapeGroupSet::iterator it = shapeGroups.begin();
+		it != shapeGroups.end(); ++it)
+	{
+		TREShapeGroup *shapeGroup = *it;
+
+		if (shapeGroup->getVertexStore() != NULL)
+		{
+			shapeGroup->addVertexIndexArrays(
+				indexArrays[shapeGroup->getVertexStore()]);
+		}
+	}
+	m_unweldedVertexCount = 0;
+	m_weldedVertexCount = 0;
+	for (IndexArraysMap::iterator it = indexArrays.begin();
+		it != indexArrays.end(); ++it)
+	{
+		TREVertexStore *vertexStore = it->first;
+		TCULongArraySet &arrays = it->second;
+		TREVertexArray *vertices = vertexStore->getVertices();
+		TCULongArraySet::iterator itArray;
+		int vertexCount;
+
+		if (vertices == NULL || vertices->getCount() == 0)
+		{
+			continue;
+		}
+		IntVector remap(vertices->getCount(), -1);
+
+		for (itArray = arrays.begin(); itArray != arrays.end(); ++itArray)
+		{
+			TCULong *values = (*itArray)->getValues();
+			int count = (*itArray)->getCount();
+
+			for (int i = 0; i < count; i++)
+			{
+				remap[values[i]] = 0;
+			}
+		}
+		storeCount++;
+		m_unweldedVertexCount += vertices->getCount();
+		vertexCount = vertexStore->weldVertices(remap);
+		m_weldedVertexCount += vertexCount;
+		if (vertexCount <= 65536)
+		{
+			shortStoreCount++;
+		}
+		for (itArray = arrays.begin(); itArray != arrays.end(); ++itArray)
+		{
+			TCULong *values = (*itArray)->getValues();
+			int count = (*itArray)->getCount();
+
+			for (int i = 0; i < count; i++)
+			{
+				values[i] = remap[values[i]];
+			}
+		}
+	}
+	for (TREShapeGroupSet::iterator it = shapeGroups.begin();
+		it != shapeGroups.end(); ++it)
+	{
+		if ((*it)->getVertexStore() != NULL)
+		{
+			(*it)->verticesWelded();
+		}
+	}
+	if (m_unweldedVertexCount > 0)
+	{
+		debugPrintf("Vertex weld: %d vertices welded to %d (%.1f%%), %d of %d "
+			"vertex stores using 16-bit indices.\n", m_unweldedVertexCount,
+			m_weldedVertexCount,
+			100.0 * m_weldedVertexCount / m_unweldedVertexCount,
+			shortStoreCount, storeCount);
+	}
+}
+
 void TREMainModel::transferTexmapped(void)
 {
 	SectionList sectionList;
@@ -2457,6 +2906,7 @@ void TREMainModel::finish(void)
 	transferTexmapped();
 	//flattenNonUniform();
 	finishParts();
+	smoothQueuedModels();
 	findLights();
 	flattenConditionals();
 	if (m_stepCounts.size() > 0)
@@ -4,34 +4,10 @@
 #include <TRE/TREModel.h>
 #include <TCFoundation/TCImage.h>
 #include <TCFoundation/TCStlIncludes.h>
+#include <TRE/TRETaskScheduler.h>
+#include <TRE/TREBVH.h>
 
-#ifdef USE_CPP11
-#include <thread>
-#include <mutex>
-#include <condition_variable>
-#include <vector>
-#else
-#if defined(_MSC_VER) && _MSC_VER <= 1200	// VS 6
-#define _NO_TRE_THREADS
-#else  // VS 6
-#ifdef _NO_BOOST
-#define _NO_TRE_THREADS
-#endif // _NO_BOOST
-#endif // VS 6
-#ifndef _NO_TRE_THREADS
-#ifdef WIN32
-#pragma warning(push)
-#pragma warning(disable:4244 4512)
-#endif // WIN32
-#include <boost/thread.hpp>
-#include <boost/thread/condition.hpp>
-#ifdef WIN32
-#pragma warning(pop)
-#endif // WIN32
-#endif // !_NO_TRE_THREADS
-#endif
-
-class TCDictionary;
+class TCHashDictionary;
 class TREVertexStore;
 class TREColoredShapeGroup;
 class TRETransShapeGroup;
@@ -43,6 +19,7 @@ extern const GLfloat POLYGON_OFFSET_UNITS;
 
 typedef std::list<TCVector> TCVectorList;
 typedef std::list<TREMSection> SectionList;
+typedef std::vector<TCULongArray *> TCULongArrayVector;
 
 class TREMainModel : public TREModel
 {
@@ -50,7 +27,7 @@ public:
 	TREMainModel(void);
 	//TREMainModel(const TREMainModel &other);
 	virtual TCObject *copy(void) const;
-	virtual TCDictionary* getLoadedModels(bool bfc);
+	virtual TCHashDictionary* getLoadedModels(bool bfc);
 	void draw(void);
 	virtual TREVertexStore *getVertexStore(void) { return m_vertexStore; }
 	virtual TREVertexStore *getStudVertexStore(void)
@@ -159,6 +136,20 @@ public:
 	{
 		return m_mainFlags.multiThreaded != false;
 	}
+	void setWeldVerticesFlag(bool value) { m_mainFlags.weldVertices = value; }
+	bool getWeldVerticesFlag(void) const
+	{
+		return m_mainFlags.weldVertices != false;
+	}
+	// Total vertex count of the vertex stores before and after welding.  Both
+	// are 0 if the vertices weren't welded.
+	int getUnweldedVertexCount(void) const { return m_unweldedVertexCount; }
+	int getWeldedVertexCount(void) const { return m_weldedVertexCount; }
+	// ACMR (average cache miss ratio) of the part triangles before and after
+	// they were reordered for the vertex cache.  Both are 0 if the vertices
+	// weren't welded.
+	float getUnoptimizedACMR(void) const { return m_unoptimizedACMR; }
+	float getOptimizedACMR(void) const { return m_optimizedACMR; }
 	void setSaveAlphaFlag(bool value) { m_mainFlags.saveAlpha = value; }
 	bool getSaveAlphaFlag(void) { return m_mainFlags.saveAlpha != false; }
 	void setGl2psFlag(bool value) { m_mainFlags.gl2ps = value; }
@@ -290,18 +281,46 @@ public:
 	{
 		return m_currentProjectionMatrix;
 	}
+	// Which of the culling instances (see TREModel::getInstanceCount) are in
+	// the view frustum during the current draw, or NULL if they aren't being
+	// culled.
+	const std::vector<bool> *getInstanceVisibility(void) const
+	{
+		return m_mainFlags.cullingSubModels ? &m_instanceVisibility : NULL;
+	}
+	bool areInstancesVisible(int start, int count) const;
+	// Used by TREModel::draw to pass the index of a sub-model's first
+	// instance down to it.
+	void setInstanceIndex(int value) { m_instanceIndex = value; }
+	int getInstanceIndex(void) const { return m_instanceIndex; }
+	// Number of instances that were culled and drawn during the last draw.
+	int getCulledSubModelCount(void) const { return m_culledSubModelCount; }
+	int getDrawnSubModelCount(void) const { return m_drawnSubModelCount; }
+	// Sub-models whose parts have a low detail variant use it when they are
+	// smaller than this many pixels on the screen.  0 disables this.
+	void setLowDetailSize(int value) { m_lowDetailSize = value; }
+	int getLowDetailSize(void) const { return m_lowDetailSize; }
+	// The frame number passed to TRESubModel::setLowDetail during the current
+	// draw, or -1 if low detail variants aren't being used.
+	int getLowDetailFrame(void) const
+	{
+		return m_mainFlags.lowDetail ? m_lowDetailFrame : -1;
+	}
 	bool hasWorkerThreads(void);
 	void waitForSort(void);
-	void waitForConditionals(int step);
-	const TCULongArray *getActiveConditionals(int step) const
+	void waitForConditionals(bool colored);
+	// The active conditionals found in the background are split into one
+	// array per chunk of work, some of which may be NULL.
+	const TCULongArrayVector &getActiveConditionals(bool colored) const
 	{
-		return m_activeConditionals[step];
-	}
-	const TCULongArray *getActiveColorConditionals(int step) const
-	{
-		return m_activeColorConditionals[step];
+		return colored ? m_colorConditionalsTask.getActiveIndices() :
+			m_conditionalsTask.getActiveIndices();
 	}
 	bool doingBackgroundConditionals(void);
+	void queueSmooth(TREModel *model);
+	void smoothQueuedModels(TREModel *model);
+	void smoothQueuedSubModels(TREModel *model);
+	void queueVertexCacheOptimization(TREModel *model);
 	virtual TCObject *getAlertSender(void) { return m_alertSender; }
 	virtual void setAlertSender(TCObject *value) { m_alertSender = value; }
 	int getStep(void) const { return m_step; }
@@ -420,6 +439,83 @@ protected:
 		TPOPTransparent,
 		TPOPTexmaps
 	} TREPolygonOffsetPurpose;
+	// Finds the conditional lines in one flattened shape group that should be
+	// drawn.  The first pass projects the group's vertices, and the second
+	// checks the lines, producing one array of active indices per chunk.
+	class ConditionalsTask : public TRETask
+	{
+	public:
+		ConditionalsTask(void);
+		void queue(TRETaskScheduler *scheduler, TREShapeGroup *shapes);
+		const TCULongArrayVector &getActiveIndices(void) const
+		{
+			return m_activeIndices;
+		}
+		void releaseActiveIndices(void);
+	protected:
+		virtual void runTask(int start, int count);
+		virtual void finishTask(void);
+
+		TRETaskScheduler *m_scheduler;
+		TREShapeGroup *m_shapes;
+		TCULongArrayVector m_activeIndices;
+		bool m_projected;
+	};
+	// Smooths the normals of the models passed to queueSmooth.  Each item is
+	// one model, and different models are smoothed at the same time, but each
+	// model's smooths run in order on one thread.
+	class SmoothTask : public TRETask
+	{
+	public:
+		void addModel(TREModel *model, int smoothCount);
+		int getModelCount(void) const { return (int)m_models.size(); }
+		void smoothAll(void) { runTask(0, getModelCount()); }
+		void clear(void);
+	protected:
+		virtual void runTask(int start, int count);
+
+		std::vector<TREModel *> m_models;
+		IntVector m_smoothCounts;
+	};
+	// Reorders the triangles and quads of the models passed to
+	// queueVertexCacheOptimization for the vertex cache.  Each item is one
+	// model.
+	class VertexCacheTask : public TRETask
+	{
+	public:
+		void addModel(TREModel *model);
+		int getModelCount(void) const { return (int)m_models.size(); }
+		void optimizeAll(void) { runTask(0, getModelCount()); }
+		void getTotals(int &oldMisses, int &newMisses, int &triangleCount);
+		void clear(void);
+	protected:
+		virtual void runTask(int start, int count);
+
+		std::vector<TREModel *> m_models;
+		std::set<TREModel *> m_modelSet;
+		IntVector m_oldMisses;
+		IntVector m_newMisses;
+		IntVector m_triangleCounts;
+	};
+	// Sorts the transparent triangles.  The first pass splits them into
+	// slices, the second sorts each slice, and finishTask merges them.
+	class SortTask : public TRETask
+	{
+	public:
+		SortTask(void);
+		void queue(TRETaskScheduler *scheduler,
+			TRETransShapeGroup *shapeGroup, const TCFloat *matrix);
+	protected:
+		virtual void runTask(int start, int count);
+		virtual void finishTask(void);
+
+		TRETaskScheduler *m_scheduler;
+		TRETransShapeGroup *m_shapeGroup;
+		const TCFloat *m_matrix;
+		int m_sliceCount;
+		bool m_prepared;
+	};
+
 	GLfloat getPolygonOffsetFactor(TREPolygonOffsetPurpose purpose);
 	void populateTrianglesMap(TRETexmappedShapeGroup *shapeGroup,
 		TRETrianglesMap &triangles);
@@ -494,20 +590,26 @@ protected:
 	virtual void passOnePrep(void);
 	virtual void passTwoPrep(void);
 	virtual void passThreePrep(void);
-#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
-	template <class _ScopedLock> bool workerThreadDoWork(_ScopedLock &lock);
-	template <class _ScopedLock> void nextConditionalsStep(_ScopedLock &lock);
-	void workerThreadProc(void);
-#endif // USE_CPP11 || !_NO_TRE_THREADS
 	void launchWorkerThreads(void);
+	void cullSubModels(void);
+	void buildSubModelBVH(void);
+	void addInstanceBoxes(TREModel *model, const TCFloat *matrix,
+		TCVectorVector &mins, TCVectorVector &maxes);
+	void addInstanceBox(TREModel *model, const TCFloat *matrix,
+		TCVectorVector &mins, TCVectorVector &maxes);
+	void selectLowDetail(void);
+	void selectLowDetail(TREModel *model, const TCFloat *matrix,
+		int instanceIndex);
+	bool isSmallOnScreen(TREModel *model, const TCFloat *matrix);
 	int getNumWorkerThreads(void);
 	int getNumBackgroundTasks(void);
 	void triggerWorkerThreads(void);
 	bool backgroundSortNeeded(void);
 	bool backgroundConditionalsNeeded(void);
 	void flattenConditionals(void);
-	void backgroundConditionals(int step);
-	TCULongArray *backgroundConditionals(TREShapeGroup *shapes, int step);
+	void weldVertices(void);
+	void smoothQueuedModels(void);
+	void optimizeVertexCaches(void);
 	TREModel *getCurGeomModel(void);
 	void drawTexmapped(bool transparent);
 	void drawTexmappedInternal(bool texture, bool colorMaterialOff,
@@ -522,8 +624,8 @@ protected:
 	static void loadStudMipTextures(TCImage *mainImage);
 
 	TCObject *m_alertSender;
-	TCDictionary *m_loadedModels;
-	TCDictionary *m_loadedBFCModels;
+	TCHashDictionary *m_loadedModels;
+	TCHashDictionary *m_loadedBFCModels;
 	TREVertexStore *m_vertexStore;
 	TREVertexStore *m_studVertexStore;
 	TREVertexStore *m_coloredVertexStore;
@@ -545,10 +647,6 @@ protected:
 	TCULongList m_lightColors;
 	TCFloat m_currentModelViewMatrix[16];
 	TCFloat m_currentProjectionMatrix[16];
-	TCULong m_conditionalsDone;
-	int m_conditionalsStep;
-	TCULongArray *m_activeConditionals[32];
-	TCULongArray *m_activeColorConditionals[32];
 	int m_step;
 	int m_numSteps;
 	int m_transferStep;
@@ -561,22 +659,33 @@ protected:
 	TexmapInfoList m_mainTexmapInfos;
 	GLint m_texClampMode;
 	TCFloat m_seamWidth;
-#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
-#ifdef USE_CPP11
-    std::vector<std::thread> *m_threads;
-	std::mutex *m_workerMutex;
-	std::condition_variable *m_workerCondition;
-	std::condition_variable *m_sortCondition;
-	std::condition_variable *m_conditionalsCondition;
-#else
-	boost::thread_group *m_threadGroup;
-	boost::mutex *m_workerMutex;
-	boost::condition *m_workerCondition;
-	boost::condition *m_sortCondition;
-	boost::condition *m_conditionalsCondition;
-#endif
-	bool m_exiting;
-#endif // USE_CPP11 || !_NO_TRE_THREADS
+	int m_unweldedVertexCount;
+	int m_weldedVertexCount;
+	float m_unoptimizedACMR;
+	float m_optimizedACMR;
+	TREBVH m_subModelBVH;
+	std::vector<bool> m_instanceVisibility;
+	// Number of visible instances before each index in m_instanceVisibility,
+	// plus one more entry for the total.
+	IntVector m_visibleInstanceCounts;
+	int m_instanceIndex;
+	int m_culledSubModelCount;
+	int m_drawnSubModelCount;
+	int m_lowDetailSize;
+	int m_lowDetailFrame;
+	// Screen pixels per unit of eye space at a distance of 1 (perspective) or
+	// at any distance (orthographic), for the current draw.
+	TCFloat m_lowDetailScale;
+	TRETaskScheduler *m_taskScheduler;
+	ConditionalsTask m_conditionalsTask;
+	ConditionalsTask m_colorConditionalsTask;
+	SortTask m_sortTask;
+	SmoothTask m_smoothTask;
+	// Models waiting to be smoothed, in the order they were first queued,
+	// along with how many times each one still needs to be smoothed.
+	std::vector<TREModel *> m_smoothQueue;
+	std::map<TREModel *, int> m_smoothCounts;
+	VertexCacheTask m_vertexCacheTask;
 	struct
 	{
 		// The following are temporal
@@ -585,9 +694,8 @@ protected:
 		bool removingHiddenLines:1;	// This one is changed externally
 		bool cutawayDraw:1;			// This one is changed externally
 		bool activeLineJoins:1;
-		bool frameSorted:1;
-		bool frameSortStarted:1;
-		bool frameStarted:1;
+		bool cullingSubModels:1;
+		bool lowDetail:1;
 		// The following aren't temporal
 		bool compileParts:1;
 		bool compileAll:1;
@@ -621,6 +729,7 @@ protected:
 		bool stencilConditionals:1;
 		bool vertexArrayEdgeFlags:1;
 		bool multiThreaded:1;
+		bool weldVertices:1;
 		bool saveAlpha:1;
 		bool gl2ps:1;
 		bool sendProgress:1;
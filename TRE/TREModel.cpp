@@ -83,9 +83,11 @@ TREModel::TREModel(void)
 	m_subModels(NULL),
 	m_unMirroredModel(NULL),
 	m_invertedModel(NULL),
+	m_lowDetailModel(NULL),
 	m_sectionsPresent(0),
 	m_coloredSectionsPresent(0),
-	m_curStepIndex(0)
+	m_curStepIndex(0),
+	m_instanceCount(-1)
 {
 #ifdef _LEAK_DEBUG
 	strcpy(className, "TREModel");
@@ -111,6 +113,7 @@ TREModel::TREModel(void)
 	m_flags.unMirrored = false;
 	m_flags.inverted = false;
 	m_flags.flattened = false;
+	m_flags.curved = false;
 }
 
 TREModel::TREModel(const TREModel &other)
@@ -119,11 +122,13 @@ TREModel::TREModel(const TREModel &other)
 	m_subModels((TRESubModelArray *)TCObject::copy(other.m_subModels)),
 	m_unMirroredModel((TREModel *)TCObject::copy(other.m_unMirroredModel)),
 	m_invertedModel((TREModel *)TCObject::copy(other.m_invertedModel)),
+	m_lowDetailModel((TREModel *)TCObject::copy(other.m_lowDetailModel)),
 	m_sectionsPresent(other.m_sectionsPresent),
 	m_coloredSectionsPresent(other.m_coloredSectionsPresent),
 	m_boundingMin(other.m_boundingMin),
 	m_boundingMax(other.m_boundingMax),
 	m_curStepIndex(other.m_curStepIndex),
+	m_instanceCount(-1),
 	m_stepCounts(other.m_stepCounts),
 	m_flags(other.m_flags)
 {
@@ -155,11 +160,14 @@ TREModel::TREModel(const TREModel &other, bool shallow)
 		(TREModel *)TCObject::copy(other.m_unMirroredModel)),
 	m_invertedModel(shallow ? NULL :
 		(TREModel *)TCObject::copy(other.m_invertedModel)),
+	m_lowDetailModel(shallow ? NULL :
+		(TREModel *)TCObject::copy(other.m_lowDetailModel)),
 	m_sectionsPresent(other.m_sectionsPresent),
 	m_coloredSectionsPresent(other.m_coloredSectionsPresent),
 	m_boundingMin(other.m_boundingMin),
 	m_boundingMax(other.m_boundingMax),
 	m_curStepIndex(other.m_curStepIndex),
+	m_instanceCount(-1),
 	m_stepCounts(other.m_stepCounts),
 	m_flags(other.m_flags)
 {
@@ -215,6 +223,7 @@ void TREModel::dealloc(void)
 		TCObject::release(m_invertedModel);
 	}
 	m_invertedModel = NULL;
+	TCObject::release(m_lowDetailModel);
 	uncompile(false);
 	for (i = 0; i <= TREMLast; i++)
 	{
@@ -276,6 +285,12 @@ void TREModel::unMirror(TREModel *originalModel)
 			}
 		}
 	}
+	if (originalModel->m_lowDetailModel != NULL)
+	{
+		m_lowDetailModel =
+			originalModel->m_lowDetailModel->getUnMirroredModel();
+		m_lowDetailModel->retain();
+	}
 	if (originalModel->m_subModels)
 	{
 		int count;
@@ -331,6 +346,11 @@ void TREModel::invert(TREModel *originalModel)
 			}
 		}
 	}
+	if (originalModel->m_lowDetailModel != NULL)
+	{
+		m_lowDetailModel = originalModel->m_lowDetailModel->getInvertedModel();
+		m_lowDetailModel->retain();
+	}
 	if (originalModel->m_subModels)
 	{
 		int count;
@@ -364,6 +384,137 @@ void TREModel::invert(TREModel *originalModel)
 	}
 }
 
+void TREModel::setLowDetailModel(TREModel *value)
+{
+	if (value != m_lowDetailModel)
+	{
+		TCObject::release(m_lowDetailModel);
+		m_lowDetailModel = value;
+		TCObject::retain(m_lowDetailModel);
+	}
+}
+
+// Returns true if this model or any of its sub-models had a curved primitive
+// substituted into it.
+bool TREModel::hasCurves(void)
+{
+	if (m_flags.curved)
+	{
+		return true;
+	}
+	if (m_subModels != NULL)
+	{
+		int count = m_subModels->getCount();
+
+		for (int i = 0; i < count; i++)
+		{
+			if ((*m_subModels)[i]->getModel()->hasCurves())
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Returns true if this model or any of its sub-models contains texture mapped
+// geometry.
+bool TREModel::hasTexmaps(void)
+{
+	if (!m_texmapInfos.empty())
+	{
+		return true;
+	}
+	if (m_subModels != NULL)
+	{
+		int count = m_subModels->getCount();
+
+		for (int i = 0; i < count; i++)
+		{
+			if ((*m_subModels)[i]->getModel()->hasTexmaps())
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Returns true if this model or any of its sub-models contains geometry with
+// its own color.
+bool TREModel::hasColoredShapes(void)
+{
+	for (int i = 0; i <= TREMLast; i++)
+	{
+		if (m_coloredShapes[i] != NULL)
+		{
+			return true;
+		}
+	}
+	if (m_subModels != NULL)
+	{
+		int count = m_subModels->getCount();
+
+		for (int i = 0; i < count; i++)
+		{
+			if ((*m_subModels)[i]->getModel()->hasColoredShapes())
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Parts are drawn as a unit, often from their own display list, and models
+// with no sub-models have nothing to cull inside them.
+bool TREModel::isInstanceLeaf(void)
+{
+	return m_flags.part || m_subModels == NULL || m_subModels->getCount() == 0;
+}
+
+// Returns true if this model contains any geometry of its own, as opposed to
+// only in its sub-models.
+bool TREModel::hasOwnShapes(void)
+{
+	for (int i = 0; i <= TREMLast; i++)
+	{
+		if (m_shapes[i] != NULL || m_coloredShapes[i] != NULL)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Returns the number of instances that TREMainModel culls separately when this
+// model is drawn once.  A leaf is a single instance.  Otherwise, this model's
+// own geometry (if any) is one instance, followed by the instances of each of
+// its sub-models in order.  This is the order that TREModel::draw visits them
+// in.
+int TREModel::getInstanceCount(void)
+{
+	if (m_instanceCount < 0)
+	{
+		if (isInstanceLeaf())
+		{
+			m_instanceCount = 1;
+		}
+		else
+		{
+			int count = m_subModels->getCount();
+
+			m_instanceCount = hasOwnShapes() ? 1 : 0;
+			for (int i = 0; i < count; i++)
+			{
+				m_instanceCount +=
+					(*m_subModels)[i]->getEffectiveModel()->getInstanceCount();
+			}
+		}
+	}
+	return m_instanceCount;
+}
+
 void TREModel::setName(const char *name)
 {
 	delete[] m_name;
@@ -422,12 +573,22 @@ void TREModel::compile(
 				{
 					subSkipTexmapped = true;
 				}
-				subModel->getEffectiveModel()->compile(section, colored,
+				TREModel *model = subModel->getEffectiveModel();
+
+				model->compile(section, colored,
 					nonUniform | subModel->getNonUniformFlag(),
 					subSkipTexmapped);
+				if (model->m_lowDetailModel != NULL)
+				{
+					model->m_lowDetailModel->compile(section, colored,
+						nonUniform | subModel->getNonUniformFlag(),
+						subSkipTexmapped);
+				}
 			}
 		}
-		if (m_mainModel->getCompileAllFlag() ||
+		// With compile all, each culling instance gets its own display list,
+		// so that TREMainModel can still cull the instances one at a time.
+		if ((m_mainModel->getCompileAllFlag() && isInstanceLeaf()) ||
 			(m_flags.part && m_mainModel->getCompilePartsFlag()))
 		{
 			GLuint listID = glGenLists(1);
@@ -510,7 +671,24 @@ void TREModel::draw(
 	}
 	else if (isSectionPresent(section, colored))
 	{
-		if (!subModelsOnly)
+		bool culling = !isInstanceLeaf() &&
+			m_mainModel->getInstanceVisibility() != NULL;
+		int instanceIndex = 0;
+		bool ownShapesVisible = true;
+
+		if (culling)
+		{
+			// Our parent sets the index of our first instance right before
+			// drawing us.
+			instanceIndex = this == m_mainModel ? 0 :
+				m_mainModel->getInstanceIndex();
+			if (hasOwnShapes())
+			{
+				ownShapesVisible = m_mainModel->areInstancesVisible(
+					instanceIndex++, 1);
+			}
+		}
+		if (!subModelsOnly && ownShapesVisible)
 		{
 			TREShapeGroup *shapeGroup;
 
@@ -568,6 +746,22 @@ void TREModel::draw(
 				TRESubModel *subModel = (*m_subModels)[i];
 				bool subSkipTexmapped = skipTexmapped;
 
+				if (culling)
+				{
+					int instanceCount =
+						subModel->getEffectiveModel()->getInstanceCount();
+					bool visible = m_mainModel->areInstancesVisible(
+						instanceIndex, instanceCount);
+
+					m_mainModel->setInstanceIndex(instanceIndex);
+					instanceIndex += instanceCount;
+					if (!visible)
+					{
+						// Outside the view frustum.
+						continue;
+					}
+				}
+
 				if (subModel->getTransferredFlag())
 				{
 					subSkipTexmapped = true;
@@ -1331,14 +1525,13 @@ void TREModel::smooth(void)
 
 void TREModel::finishShapeNormals(TREConditionalMap &conditionalMap)
 {
-	TREConditionalMap::iterator it = conditionalMap.begin();
+	int count = conditionalMap.getCount();
 
-	while (it != conditionalMap.end())
+	for (int i = 0; i < count; i++)
 	{
-		TRESmoother &smoother0 = it->second;
+		TRESmoother &smoother0 = conditionalMap.valueAtIndex(i);
 
 		smoother0.finish();
-		it++;
 	}
 }
 
@@ -1573,16 +1766,12 @@ int TREModel::getConditionalLine(TREConditionalMap &conditionalMap,
 	if (!smoother)
 	{
 		TREVertexKey pointKey(point0);
-		TREConditionalMap::iterator it = conditionalMap.find(pointKey);
 
-		if (it == conditionalMap.end())
+		smoother = conditionalMap.find(pointKey);
+		if (smoother == NULL)
 		{
 			return -1;
 		}
-		else
-		{
-			smoother = &(*it).second;
-		}
 	}
 	count = smoother->getVertexCount();
 	for (i = 0; i < count; i++)
@@ -1634,11 +1823,11 @@ void TREModel::fillEdgeMap(TREEdgeMap &edgeMap, TREShapeGroup *shapeGroup)
 
 				if (vertex0Key < vertex1Key)
 				{
-					edgeMap[vertex0Key].insert(vertex1Key);
+					edgeMap.add(TREVertexKeyPair(vertex0Key, vertex1Key), true);
 				}
 				else if (vertex1Key < vertex0Key)
 				{
-					edgeMap[vertex1Key].insert(vertex0Key);
+					edgeMap.add(TREVertexKeyPair(vertex1Key, vertex0Key), true);
 				}
 				else
 				{
@@ -1663,16 +1852,8 @@ bool TREModel::findEdge(const TREEdgeMap& edgeMap,
 	}
 	else
 	{
-		TREEdgeMap::const_iterator it0 = edgeMap.find(vertex0Key);
-		if (it0 != edgeMap.end())
-		{
-			TREVertexKeySet::const_iterator it1 = it0->second.find(vertex1Key);
-			if (it1 != it0->second.end()) {
-				return true;
-			}
-		}
+		return edgeMap.find(TREVertexKeyPair(vertex0Key, vertex1Key)) != NULL;
 	}
-	return false;
 }
 
 /*
@@ -1749,28 +1930,18 @@ void TREModel::addConditionalPoint(TREConditionalMap &conditionalMap,
 								   const TREVertexArray *vertices, int index0,
 								   int index1, const TREVertexKey &vertexKey)
 {
-	TREConditionalMap::iterator it = conditionalMap.find(vertexKey);
+	TRESmoother *smoother = conditionalMap.find(vertexKey);
 
-	if (it == conditionalMap.end())
+	if (smoother == NULL)
 	{
-		// Note that this would probably be more clear if we used the []
-		// operator of map.  However, that would require extra lookups, and
-		// we're trying to keep the lookups to a minimum.
-		TREConditionalMap::value_type newValue(vertexKey,
+		// Only construct a new smoother when the point isn't in the map yet,
+		// since that allocates its vertex array.
+		smoother = &conditionalMap.add(vertexKey,
 			TRESmoother(vertices->vertexAtIndex(index0)));
-
-		// The insert function returns a pair, where the first of the pair is
-		// an iterator pointing to the newly inserted item, and the second of
-		// the pair is a boolean saying whether or not an insertion occurred.
-		// Since we got here, we know the item doesn't already exist, so we
-		// really don't care about the second of the pair.
-		it = conditionalMap.insert(newValue).first;
 	}
-	// If the item didn't originally exist, it gets set during insertion above.
-	// If the item did exist, it's set in the find() call.  Note that not all
-	// the vertices that match are necessarily equal.  However, this won't
-	// effect the results.
-	(*it).second.addVertex(vertices->vertexAtIndex(index1));
+	// Note that not all the vertices that match are necessarily equal.
+	// However, this won't effect the results.
+	smoother->addVertex(vertices->vertexAtIndex(index1));
 }
 
 void TREModel::scaleConditionalControlPoint(
@@ -1816,10 +1987,16 @@ void TREModel::scaleConditionalControlPoints(TREShapeGroup *shapeGroup)
 	}
 }
 
+// Returns true if flatten() would pull in the geometry of any sub-models.
+bool TREModel::canFlatten(void) const
+{
+	return m_subModels && m_subModels->getCount() &&
+		!m_mainModel->getShowAllConditionalFlag();
+}
+
 void TREModel::flatten(void)
 {
-	if (m_subModels && m_subModels->getCount() &&
-		!m_mainModel->getShowAllConditionalFlag())
+	if (canFlatten())
 	{
 		flatten(this, TCVector::getIdentityMatrix(), 0, false, 0, false, false);
 		if (m_subModels)
@@ -3382,11 +3559,16 @@ bool TREModel::checkShapeGroupPresent(TREShapeGroup *shapeGroup,
 
 		for (i = 0; i < count; i++)
 		{
-			if ((*m_subModels)[i]->getEffectiveModel()->
-				checkSectionPresent(section, colored))
+			TREModel *model = (*m_subModels)[i]->getEffectiveModel();
+
+			if (model->checkSectionPresent(section, colored))
 			{
 				setSectionPresent(section, colored);
 			}
+			if (model->m_lowDetailModel != NULL)
+			{
+				model->m_lowDetailModel->checkSectionPresent(section, colored);
+			}
 		}
 	}
 	return isSectionPresent(section, colored);
@@ -3442,7 +3624,13 @@ void TREModel::uncompile(bool includeSubModels /*= true*/)
 
 		for (i = 0; i < count; i++)
 		{
-			(*m_subModels)[i]->getEffectiveModel()->uncompile();
+			TREModel *model = (*m_subModels)[i]->getEffectiveModel();
+
+			model->uncompile();
+			if (model->m_lowDetailModel != NULL)
+			{
+				model->m_lowDetailModel->uncompile();
+			}
 		}
 	}
 }
@@ -4193,11 +4381,26 @@ void TREModel::finishPart(void)
 {
 	if (m_mainModel->getFlattenPartsFlag())
 	{
+		if (canFlatten())
+		{
+			// Flattening copies the normals of the sub-models, so they have
+			// to be smoothed first if they were going to be.  Once this model
+			// has been flattened it has no sub-models left, so its own queued
+			// smoothing is left for the parallel pass.
+			m_mainModel->smoothQueuedSubModels(this);
+		}
 		flatten();
 	}
 	if (m_mainModel->getSmoothCurvesFlag())
 	{
-		smooth();
+		// The main model does the smoothing after all the parts have been
+		// finished, so that different parts can be smoothed in parallel.
+		m_mainModel->queueSmooth(this);
+	}
+	m_mainModel->queueVertexCacheOptimization(this);
+	if (m_lowDetailModel != NULL)
+	{
+		m_lowDetailModel->finishPart();
 	}
 }
 
@@ -4229,6 +4432,72 @@ void TREModel::shrinkParts(void)
 		}
 	}}
 
+// Adds the shape groups of this model and of all the models it uses to
+// shapeGroups.  models holds the models that have already been visited.
+void TREModel::addShapeGroups(
+	TREModelSet &models,
+	TREShapeGroupSet &shapeGroups)
+{
+	if (!models.insert(this).second)
+	{
+		return;
+	}
+	for (int i = 0; i <= TREMLast; i++)
+	{
+		if (m_shapes[i] != NULL)
+		{
+			shapeGroups.insert(m_shapes[i]);
+		}
+		if (m_coloredShapes[i] != NULL)
+		{
+			shapeGroups.insert(m_coloredShapes[i]);
+		}
+	}
+	if (m_unMirroredModel != NULL)
+	{
+		m_unMirroredModel->addShapeGroups(models, shapeGroups);
+	}
+	if (m_invertedModel != NULL)
+	{
+		m_invertedModel->addShapeGroups(models, shapeGroups);
+	}
+	if (m_lowDetailModel != NULL)
+	{
+		m_lowDetailModel->addShapeGroups(models, shapeGroups);
+	}
+	if (m_subModels != NULL)
+	{
+		int count = m_subModels->getCount();
+
+		for (int i = 0; i < count; i++)
+		{
+			(*m_subModels)[i]->getModel()->addShapeGroups(models, shapeGroups);
+		}
+	}
+}
+
+// Reorders this model's own triangles and quads for the vertex cache.  The
+// transparent section is skipped, since it gets sorted every frame anyway.
+void TREModel::optimizeVertexCache(
+	int &oldMisses,
+	int &newMisses,
+	int &triangleCount)
+{
+	for (int i = 0; i < TREMTransparent; i++)
+	{
+		if (m_shapes[i] != NULL)
+		{
+			m_shapes[i]->optimizeVertexCache(oldMisses, newMisses,
+				triangleCount);
+		}
+		if (m_coloredShapes[i] != NULL)
+		{
+			m_coloredShapes[i]->optimizeVertexCache(oldMisses, newMisses,
+				triangleCount);
+		}
+	}
+}
+
 void TREModel::finishParts(void)
 {
 	if (isPart())
@@ -5,12 +5,13 @@
 #include <TCFoundation/TCTypedObjectArray.h>
 #include <TRE/TREShapeGroup.h>
 #include <TRE/TREColoredShapeGroup.h>
-#include <TRE/TREVertexKey.h>
+#include <TRE/TREVertexKeyMap.h>
 #include <TRE/TRESmoother.h>
 #include <TCFoundation/TCVector.h>
 #include <TCFoundation/TCStlIncludes.h>
 
 struct TREVertex;
+class TREModel;
 class TRESubModel;
 class TREMainModel;
 class TREColoredShapeGroup;
@@ -36,9 +37,11 @@ typedef TCTypedObjectArray<TRESubModel> TRESubModelArray;
 typedef TCTypedObjectArray<TREShapeGroup> TREShapeGroupArray;
 typedef TCTypedObjectArray<TREColoredShapeGroup> TREColoredShapeGroupArray;
 typedef TCTypedObjectArray<TRENormalInfo> TRENormalInfoArray;
-typedef std::map<TREVertexKey, TRESmoother> TREConditionalMap;
-typedef std::set<TREVertexKey> TREVertexKeySet;
-typedef std::map<TREVertexKey, TREVertexKeySet> TREEdgeMap;
+typedef std::set<TREModel *> TREModelSet;
+typedef std::set<TREShapeGroup *> TREShapeGroupSet;
+typedef TREVertexKeyMap<TRESmoother> TREConditionalMap;
+// Only the keys matter in TREEdgeMap; it is used as a set of edges.
+typedef TREVertexKeyMap<bool, TREVertexKeyPair> TREEdgeMap;
 
 typedef enum
 {
@@ -204,6 +207,24 @@ public:
 	virtual void setNoShrinkFlag(bool value) { m_flags.noShrink = value; }
 	virtual bool getNoShrinkFlag(void) { return m_flags.noShrink != false; }
 	virtual bool isFlattened(void) { return m_flags.flattened != false; }
+	// Set on models that had a curved primitive substituted into them, and
+	// therefore have geometry that depends on the curve quality.
+	void setCurvedFlag(bool value) { m_flags.curved = value; }
+	bool getCurvedFlag(void) const { return m_flags.curved != false; }
+	bool hasCurves(void);
+	bool hasTexmaps(void);
+	bool hasColoredShapes(void);
+	// The low detail model is a copy of this one that was parsed with the
+	// lowest curve quality.  Sub-models draw it instead of this one when they
+	// are small enough on the screen.
+	void setLowDetailModel(TREModel *value);
+	TREModel *getLowDetailModel(void) const { return m_lowDetailModel; }
+	// Returns true if each use of this model is culled as a whole, instead of
+	// by culling its sub-models one at a time.
+	bool isInstanceLeaf(void);
+	bool hasOwnShapes(void);
+	int getInstanceCount(void);
+	bool canFlatten(void) const;
 	virtual void flatten(void);
 	virtual void smooth(void);
 	virtual void addCylinder(const TCVector &center, TCFloat radius,
@@ -287,6 +308,10 @@ public:
 	virtual void finishPart(void);
 	virtual void finishParts(void);
 	virtual void shrinkParts(void);
+	virtual void addShapeGroups(TREModelSet &models,
+		TREShapeGroupSet &shapeGroups);
+	virtual void optimizeVertexCache(int &oldMisses, int &newMisses,
+		int &triangleCount);
 
 	TREShapeGroup **getShapes(void) { return m_shapes; }
 	TREColoredShapeGroup **getColoredShapes(void) { return m_coloredShapes; }
@@ -421,11 +446,15 @@ protected:
 	GLuint m_texColoredListIDs[TREMLast + 1];
 	TREModel *m_unMirroredModel;
 	TREModel *m_invertedModel;
+	TREModel *m_lowDetailModel;
 	TCULong m_sectionsPresent;
 	TCULong m_coloredSectionsPresent;
 	TCVector m_boundingMin;
 	TCVector m_boundingMax;
 	int m_curStepIndex;
+	// Number of culling instances drawn by one use of this model, or -1 if
+	// that hasn't been worked out yet.  See getInstanceCount.
+	int m_instanceCount;
 	IntVector m_stepCounts;
 	TexmapInfoList m_texmapInfos;
 	struct
@@ -437,6 +466,7 @@ protected:
 		bool unMirrored:1;
 		bool inverted:1;
 		bool flattened:1;
+		bool curved:1;
 	} m_flags;
 };
 
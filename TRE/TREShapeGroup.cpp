@@ -1,6 +1,7 @@
 #include "TREShapeGroup.h"
 #include "TREVertexArray.h"
 #include "TREVertexStore.h"
+#include "TREVertexCache.h"
 #include "TREModel.h"
 #include "TREMainModel.h"
 #include "TREGLExtensions.h"
@@ -302,12 +303,11 @@ void TREShapeGroup::drawShapeType(
 		{
 			count = tempCount;
 		}
-		glDrawElements(modeForShapeType(shapeType), count, GL_UNSIGNED_INT,
-			&indexArray->getValues()[offset]);
+		drawElements(modeForShapeType(shapeType), shapeType, indexArray,
+			offset, count);
 		if (shapeType == TRESLine && m_mainModel->getActiveLineJoinsFlag())
 		{
-			glDrawElements(GL_POINTS, count, GL_UNSIGNED_INT,
-				indexArray->getValues());
+			drawElements(GL_POINTS, shapeType, indexArray, 0, count);
 		}
 		if (m_mainModel->getDrawNormalsFlag() && shapeType != TRESLine)
 		{
@@ -316,6 +316,30 @@ void TREShapeGroup::drawShapeType(
 	}
 }
 
+// Draws count indices from indexArray starting at offset, using the 16-bit
+// copy of the indices if there is one.
+void TREShapeGroup::drawElements(
+	GLenum mode,
+	TREShapeType shapeType,
+	TCULongArray *indexArray,
+	int offset,
+	int count)
+{
+	ShapeTypeGLushortVectorMap::const_iterator it =
+		m_shortIndices.find(shapeType);
+
+	if (it != m_shortIndices.end() &&
+		it->second.size() == (size_t)indexArray->getCount())
+	{
+		glDrawElements(mode, count, GL_UNSIGNED_SHORT, &it->second[0] + offset);
+	}
+	else
+	{
+		glDrawElements(mode, count, GL_UNSIGNED_INT,
+			&indexArray->getValues()[offset]);
+	}
+}
+
 void TREShapeGroup::drawNormals(
 	TCULongArray *indexArray,
 	int count,
@@ -552,6 +576,22 @@ int TREShapeGroup::turnVector(TCFloat vx1, TCFloat vy1, TCFloat vx2,
 	return 0;
 }
 
+// NOTE: static function.
+void TREShapeGroup::projectPoint(
+	const TCFloat *point,
+	const TCFloat *matrix,
+	TCFloat &x,
+	TCFloat &y)
+{
+	TCFloat tw = 1.0f / (matrix[3] * point[0] + matrix[7] * point[1] +
+		matrix[11] * point[2] + matrix[15]);
+
+	x = (matrix[0] * point[0] + matrix[4] * point[1] + matrix[8] * point[2] +
+		matrix[12]) * tw;
+	y = (matrix[1] * point[0] + matrix[5] * point[1] + matrix[9] * point[2] +
+		matrix[13]) * tw;
+}
+
 void TREShapeGroup::transformPoint(const TCVector &point, const TCFloat *matrix,
 								   TCFloat *tx, TCFloat *ty)
 {
@@ -568,51 +608,6 @@ void TREShapeGroup::transformPoint(const TCVector &point, const TCFloat *matrix,
 	*ty = (matrix[1]*x + matrix[5]*y + matrix[9]*z + matrix[13]) * tw;
 }
 
-bool TREShapeGroup::shouldDrawConditional(TCULong index1, TCULong index2,
-										  TCULong cpIndex1, TCULong cpIndex2,
-										  const TCFloat *matrix)
-{
-	// Use matrix--which contains a combination of the projection and the
-	// model-view matrix--to calculate coords in the plane of the screen, so
-	// we can test optional lines.
-	TCFloat s1x, s1y;
-	TCFloat s2x, s2y;
-	TCFloat s3x, s3y;
-	TCFloat s4x, s4y;
-	TREVertexArray *vertices = m_vertexStore->getVertices();
-	TREVertexArray *controlPoints = vertices; //m_vertexStore->getControlPoints();
-	const TREVertex &v1 = (*vertices)[index1];
-	const TREVertex &v2 = (*vertices)[index2];
-	const TREVertex &v3 = (*controlPoints)[cpIndex1];
-	const TREVertex &v4 = (*controlPoints)[cpIndex2];
-	TCVector p1 = TCVector(v1.v[0], v1.v[1], v1.v[2]);
-	TCVector p2 = TCVector(v2.v[0], v2.v[1], v2.v[2]);
-	TCVector p3 = TCVector(v3.v[0], v3.v[1], v3.v[2]);
-	TCVector p4 = TCVector(v4.v[0], v4.v[1], v4.v[2]);
-
-	// Only draw optional line p1-p2 if p3 and p4 are on the same side of p1-p2.
-	// Note that we don't actually adjust for the window size, because it
-	// doesn't effect the calculation.  Also, we don't care what the z value is,
-	// so we don't bother to compute it.
-	transformPoint(p1, matrix, &s1x, &s1y);
-	transformPoint(p2, matrix, &s2x, &s2y);
-	transformPoint(p3, matrix, &s3x, &s3y);
-	transformPoint(p4, matrix, &s4x, &s4y);
-
-	// If we do not turn the same direction \_/ for both test points
-	// then they're on opposite sides of segment p1-p2 and we should
-	// skip drawing this conditional line.
-	if (turnVector(s2x-s1x, s2y-s1y, s3x-s2x, s3y-s2y) == 
-		turnVector(s2x-s1x, s2y-s1y, s4x-s2x, s4y-s2y))
-	{
-		return true;	// Draw it
-	}
-	else
-	{
-		return false;	// Skip it.
-	}
-}
-
 /*
 static void printULongArray(TCULongArray *array)
 {
@@ -749,19 +744,13 @@ void TREShapeGroup::drawConditionalLines(void)
 				{
 					if (m_mainModel->doingBackgroundConditionals())
 					{
-						for (int i = 0; i < 32; i++)
+						m_mainModel->waitForConditionals(isColored());
+						const TCULongArrayVector &activeConditionals =
+							m_mainModel->getActiveConditionals(isColored());
+
+						for (size_t i = 0; i < activeConditionals.size(); i++)
 						{
-							m_mainModel->waitForConditionals(i);
-							if (isColored())
-							{
-								drawConditionalLines(
-									m_mainModel->getActiveColorConditionals(i));
-							}
-							else
-							{
-								drawConditionalLines(
-									m_mainModel->getActiveConditionals(i));
-							}
+							drawConditionalLines(activeConditionals[i]);
 						}
 						return;
 					}
@@ -800,26 +789,16 @@ void TREShapeGroup::drawConditionalLines(const TCULongArray *activeIndices)
 	}
 }
 
-TCULongArray *TREShapeGroup::getActiveConditionalIndices(
-	TCULongArray *indices,
-	const TCFloat *modelMatrix /*= NULL*/,
-	int start /*= 0*/,
-	int count /*= -1*/)
+// Calculates the matrix that takes points in the conditional lines to the
+// plane of the screen.  If modelMatrix is NULL, the current OpenGL
+// model-view matrix is used.
+void TREShapeGroup::getConditionalMatrix(
+	const TCFloat *modelMatrix,
+	TCFloat *matrix)
 {
-	int i;
 	TCFloat modelViewMatrix[16];
 	const TCFloat *projectionMatrix = m_mainModel->getCurrentProjectionMatrix();
-	TCFloat matrix[16];
-	TCULongArray *activeIndices = new TCULongArray;
-	bool showAllConditional =
-		m_vertexStore->getShowAllConditionalFlag();
-	bool showConditionalControlPoints =
-		m_vertexStore->getConditionalControlPointsFlag();
 
-	if (count == -1)
-	{
-		count = indices->getCount();
-	}
 	if (modelMatrix)
 	{
 		const TCFloat *mainModelViewMatrix =
@@ -832,28 +811,170 @@ TCULongArray *TREShapeGroup::getActiveConditionalIndices(
 		treGlGetFloatv(GL_MODELVIEW_MATRIX, modelViewMatrix);
 	}
 	TCVector::multMatrix(projectionMatrix, modelViewMatrix, matrix);
-	for (i = start; i < start + count; i += 2)
+}
+
+// Projects the vertices used by this group's conditional lines onto the
+// screen, so that getActiveConditionalIndices can be told to use the results.
+// The vertex store is shared with other shape groups, so only the range of
+// vertices that the conditional lines actually refer to is projected.
+void TREShapeGroup::projectConditionalVertices(const TCFloat *modelMatrix)
+{
+	TCULongArray *indices = getIndices(TRESConditionalLine);
+
+	if (indices && indices->getCount() > 0 && m_controlPointIndices)
 	{
-		TCULong index1 = (*indices)[i];
-		TCULong index2 = (*indices)[i + 1];
-		TCULong cpIndex1 = (*m_controlPointIndices)[i];
-		TCULong cpIndex2 = (*m_controlPointIndices)[i + 1];
+		TCFloat matrix[16];
+		TCULong minIndex = (*indices)[0];
+		TCULong maxIndex = minIndex;
+		TCULongArray *indexArrays[2] = { indices, m_controlPointIndices };
 
-		if (showAllConditional ||
-			shouldDrawConditional(index1, index2, cpIndex1,
-			cpIndex2, matrix))
+		for (int i = 0; i < 2; i++)
 		{
-			activeIndices->addValue(index1);
-			activeIndices->addValue(index2);
-			if (showConditionalControlPoints)
+			const TCULong *values = indexArrays[i]->getValues();
+			int count = indexArrays[i]->getCount();
+
+			for (int j = 0; j < count; j++)
 			{
-				activeIndices->addValue(index1);
-				activeIndices->addValue(cpIndex1);
-				activeIndices->addValue(index1);
-				activeIndices->addValue(cpIndex2);
+				TCULong index = values[j];
+
+				minIndex = std::min(minIndex, index);
+				maxIndex = std::max(maxIndex, index);
 			}
 		}
+		getConditionalMatrix(modelMatrix, matrix);
+		m_vertexStore->projectVertices(matrix, (int)minIndex,
+			(int)(maxIndex - minIndex + 1));
+	}
+}
+
+// Returns the indices of the conditional lines in the given range that should
+// be drawn.  A conditional line is drawn when its two control points are on
+// the same side of it on the screen.  The lines are checked in batches: the
+// screen coordinates of the batch's points are gathered first, and then all
+// the side tests are done in one simple loop that the compiler can
+// vectorize.  If useProjectedVertices is true, projectConditionalVertices
+// must have been called with the same modelMatrix earlier in the frame, and
+// the screen coordinates come from that instead of being calculated again
+// for every line that uses a point.
+TCULongArray *TREShapeGroup::getActiveConditionalIndices(
+	TCULongArray *indices,
+	const TCFloat *modelMatrix /*= NULL*/,
+	int start /*= 0*/,
+	int count /*= -1*/,
+	bool useProjectedVertices /*= false*/)
+{
+	TCFloat matrix[16];
+	bool showAllConditional =
+		m_vertexStore->getShowAllConditionalFlag();
+	bool showConditionalControlPoints =
+		m_vertexStore->getConditionalControlPointsFlag();
+	const TCFloat *projectedVertices = NULL;
+	const TREVertex *vertices = m_vertexStore->getVertices()->getVertices();
+	const TCULong *lineIndices;
+	const TCULong *controlPointIndices;
+	TCFloat points[8][CONDITIONAL_BATCH_SIZE];
+	bool visible[CONDITIONAL_BATCH_SIZE];
+	int lineCount;
+	int activeCount = 0;
+	TCULongArray *activeIndices;
+	TCULong *activeValues;
+
+	if (count == -1)
+	{
+		count = indices->getCount();
 	}
+	lineCount = count / 2;
+	activeIndices = new TCULongArray(lineCount *
+		(showConditionalControlPoints ? 6 : 2));
+	activeValues = activeIndices->getValues();
+	lineIndices = indices->getValues() + start;
+	controlPointIndices = m_controlPointIndices->getValues() + start;
+	if (useProjectedVertices)
+	{
+		projectedVertices = m_vertexStore->getProjectedVertices();
+	}
+	getConditionalMatrix(modelMatrix, matrix);
+	for (int batchStart = 0; batchStart < lineCount;
+		batchStart += CONDITIONAL_BATCH_SIZE)
+	{
+		int batchSize = std::min(CONDITIONAL_BATCH_SIZE,
+			lineCount - batchStart);
+		const TCULong *batchIndices = lineIndices + batchStart * 2;
+		const TCULong *batchControlPointIndices =
+			controlPointIndices + batchStart * 2;
+		int i;
+
+		if (showAllConditional)
+		{
+			for (i = 0; i < batchSize; i++)
+			{
+				visible[i] = true;
+			}
+		}
+		else
+		{
+			for (i = 0; i < batchSize; i++)
+			{
+				TCULong pointIndices[4] =
+				{
+					batchIndices[i * 2],
+					batchIndices[i * 2 + 1],
+					batchControlPointIndices[i * 2],
+					batchControlPointIndices[i * 2 + 1]
+				};
+
+				for (int j = 0; j < 4; j++)
+				{
+					if (projectedVertices)
+					{
+						points[j * 2][i] =
+							projectedVertices[pointIndices[j] * 2];
+						points[j * 2 + 1][i] =
+							projectedVertices[pointIndices[j] * 2 + 1];
+					}
+					else
+					{
+						projectPoint(vertices[pointIndices[j]].v, matrix,
+							points[j * 2][i], points[j * 2 + 1][i]);
+					}
+				}
+			}
+			// Only draw the line p1-p2 if p3 and p4 are on the same side of
+			// it.  This is the same test as two calls to turnVector.
+			for (i = 0; i < batchSize; i++)
+			{
+				TCFloat dx = points[2][i] - points[0][i];
+				TCFloat dy = points[3][i] - points[1][i];
+				TCFloat turn1 = dx * (points[5][i] - points[3][i]) -
+					dy * (points[4][i] - points[2][i]);
+				TCFloat turn2 = dx * (points[7][i] - points[3][i]) -
+					dy * (points[6][i] - points[2][i]);
+
+				visible[i] = ((turn1 > 0.0f) - (turn1 < 0.0f)) ==
+					((turn2 > 0.0f) - (turn2 < 0.0f));
+			}
+		}
+		for (i = 0; i < batchSize; i++)
+		{
+			if (visible[i])
+			{
+				TCULong index1 = batchIndices[i * 2];
+
+				activeValues[activeCount++] = index1;
+				activeValues[activeCount++] = batchIndices[i * 2 + 1];
+				if (showConditionalControlPoints)
+				{
+					activeValues[activeCount++] = index1;
+					activeValues[activeCount++] =
+						batchControlPointIndices[i * 2];
+					activeValues[activeCount++] = index1;
+					activeValues[activeCount++] =
+						batchControlPointIndices[i * 2 + 1];
+				}
+			}
+		}
+	}
+	activeIndices->setCount(activeCount);
 	return activeIndices;
 }
 
@@ -2264,6 +2385,96 @@ void TREShapeGroup::cleanupTransfer(void)
 	}
 }
 
+// Adds all the arrays that hold indices into the vertex store to indexArrays.
+void TREShapeGroup::addVertexIndexArrays(TCULongArraySet &indexArrays)
+{
+	if (m_indices != NULL)
+	{
+		int count = m_indices->getCount();
+
+		for (int i = 0; i < count; i++)
+		{
+			indexArrays.insert((*m_indices)[i]);
+		}
+	}
+	if (m_controlPointIndices != NULL)
+	{
+		indexArrays.insert(m_controlPointIndices);
+	}
+}
+
+// Called after TREMainModel::weldVertices has welded the vertex store and
+// updated all the indices into it.  If the store now has few enough vertices,
+// this makes 16-bit copies of the indices that drawShapeType uses.  (Strips
+// and conditional lines keep using the 32-bit indices.)
+void TREShapeGroup::verticesWelded(void)
+{
+	TREVertexArray *vertices = m_vertexStore->getVertices();
+	TREShapeType shapeTypes[] = { TRESLine, TRESTriangle, TRESQuad };
+
+	deleteMultiDrawIndices();
+	m_shortIndices.clear();
+	if (vertices == NULL || vertices->getCount() > 65536)
+	{
+		return;
+	}
+	for (size_t i = 0; i < COUNT_OF(shapeTypes); i++)
+	{
+		TCULongArray *indices = getIndices(shapeTypes[i]);
+
+		if (indices != NULL && indices->getCount() > 0)
+		{
+			GLushortVector &shortIndices = m_shortIndices[shapeTypes[i]];
+			int count = indices->getCount();
+
+			shortIndices.resize(count);
+			for (int j = 0; j < count; j++)
+			{
+				shortIndices[j] = (GLushort)(*indices)[j];
+			}
+		}
+	}
+}
+
+// Reorders the triangles and quads for the post-transform vertex cache.  The
+// miss counts before and after (from TREVertexCache::countMisses) get added
+// to oldMisses and newMisses, and the number of triangles drawn (with each
+// quad counting as two) gets added to triangleCount, so that the caller can
+// work out the ACMR.  Indices that are split into steps are left alone.  Any
+// 16-bit copies made by verticesWelded are updated to match.
+void TREShapeGroup::optimizeVertexCache(
+	int &oldMisses,
+	int &newMisses,
+	int &triangleCount)
+{
+	TREShapeType shapeTypes[] = { TRESTriangle, TRESQuad };
+
+	for (size_t i = 0; i < COUNT_OF(shapeTypes); i++)
+	{
+		TREShapeType shapeType = shapeTypes[i];
+		TCULongArray *indices = getIndices(shapeType);
+		int primSize = shapeType == TRESTriangle ? 3 : 4;
+
+		if (indices != NULL && indices->getCount() > 0 &&
+			m_stepCounts[shapeType].empty())
+		{
+			oldMisses += TREVertexCache::countMisses(indices);
+			TREVertexCache::optimize(indices, primSize);
+			newMisses += TREVertexCache::countMisses(indices);
+			triangleCount += indices->getCount() / primSize * (primSize - 2);
+			if (m_shortIndices.find(shapeType) != m_shortIndices.end())
+			{
+				GLushortVector &shortIndices = m_shortIndices[shapeType];
+
+				for (size_t j = 0; j < shortIndices.size(); j++)
+				{
+					shortIndices[j] = (GLushort)(*indices)[j];
+				}
+			}
+		}
+	}
+}
+
 TCULongArray *TREShapeGroup::getTransferIndices(
 	TRESTransferType type,
 	TREShapeType shapeType)
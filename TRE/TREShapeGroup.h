@@ -8,10 +8,16 @@
 #include <TCFoundation/TCStlIncludes.h>
 #include <TRE/TREGL.h>
 
+// Number of conditional lines whose visibility is checked together by
+// TREShapeGroup::getActiveConditionalIndices.
+#define CONDITIONAL_BATCH_SIZE 64
+
 typedef void (TCObject::*TREScanPointCallback)(const TCVector &point);
 
 typedef TCTypedObjectArray<TCULongArray> TCULongArrayArray;
+typedef std::set<TCULongArray *> TCULongArraySet;
 typedef std::vector<GLboolean> GLbooleanVector;
+typedef std::vector<GLushort> GLushortVector;
 
 struct TREVertex;
 class TREVertexStore;
@@ -35,6 +41,7 @@ typedef enum TREShapeType
 } TREShapeType;
 
 typedef std::map<TREShapeType, IntVector> ShapeTypeIntVectorMap;
+typedef std::map<TREShapeType, GLushortVector> ShapeTypeGLushortVectorMap;
 
 class TREShapeGroup : public TCObject
 {
@@ -89,7 +96,9 @@ public:
 	void setModel(TREModel *value);
 	TREMainModel *getMainModel(void) { return m_mainModel; }
 	virtual TCULongArray *getActiveConditionalIndices(TCULongArray *indices,
-		const TCFloat *modelMatrix = NULL, int start = 0, int count = -1);
+		const TCFloat *modelMatrix = NULL, int start = 0, int count = -1,
+		bool useProjectedVertices = false);
+	void projectConditionalVertices(const TCFloat *modelMatrix);
 	virtual void nextStep(void);
 	virtual void updateConditionalsStepCount(int step);
 	virtual int getIndexCount(TREShapeType shapeType);
@@ -98,6 +107,10 @@ public:
 	virtual void drawShapeType(TREShapeType shapeType, int offset = 0,
 		int count = -1);
 	virtual void cleanupTransfer(void);
+	virtual void addVertexIndexArrays(TCULongArraySet &indexArrays);
+	virtual void verticesWelded(void);
+	virtual void optimizeVertexCache(int &oldMisses, int &newMisses,
+		int &triangleCount);
 
 	static GLenum modeForShapeType(TREShapeType shapeType);
 	static int numPointsForShapeType(TREShapeType shapeType);
@@ -107,6 +120,8 @@ public:
 
 	static void transformPoint(const TCVector &point, const TCFloat *matrix,
 		TCFloat *tx, TCFloat *ty);
+	static void projectPoint(const TCFloat *point, const TCFloat *matrix,
+		TCFloat &x, TCFloat &y);
 	static int turnVector(TCFloat vx1, TCFloat vy1, TCFloat vx2, TCFloat vy2);
 	static bool isTexmappedShapeType(TREShapeType shapeType);
 protected:
@@ -151,8 +166,7 @@ protected:
 	virtual void transfer(TRESTransferType type, TCULong color,
 		TREShapeType shapeType, TCULongArray *indices,
 		TCULongArray *transferIndices, const TCFloat *matrix, bool bfcInvert);
-	virtual bool shouldDrawConditional(TCULong index1, TCULong index2,
-		TCULong cpIndex1, TCULong cpIndex2, const TCFloat *matrix);
+	void getConditionalMatrix(const TCFloat *modelMatrix, TCFloat *matrix);
 	virtual bool isColored(void) { return false; }
 	virtual void recordTransfer(TCULongArray *transferIndices, int index,
 		int shapeSize);
@@ -208,6 +222,8 @@ protected:
 		TCULongArray *stripCounts, const TCFloat *matrix,
 		const TCFloat *unshrinkMatrix);
 	virtual void nextStep(TREShapeType shapeType);
+	void drawElements(GLenum mode, TREShapeType shapeType,
+		TCULongArray *indexArray, int offset, int count);
 	virtual bool shouldTransferIndex(TRESTransferType type,
 		TREShapeType shapeType, TCULong color, int index,
 		const TCFloat *matrix);
@@ -228,6 +244,10 @@ protected:
 	ShapeTypeIntVectorMap m_stepCounts;
 	bool m_bfc;
 	TCULongArrayArray *m_transferIndices;
+	// 16-bit copies of the line, triangle, and quad indices, for drawing.
+	// These are only filled in by verticesWelded, and only when the vertex
+	// store is small enough.
+	ShapeTypeGLushortVectorMap m_shortIndices;
 };
 
 #endif // __TRESHAPEGROUP_H__
@@ -15,7 +15,8 @@ TRESubModel::TRESubModel(void)
 	m_unMirroredSubModel(NULL),
 	m_invertedSubModel(NULL),
 	m_color(0),
-	m_edgeColor(0)
+	m_edgeColor(0),
+	m_lowDetailFrame(-1)
 {
 #ifdef _LEAK_DEBUG
 	strcpy(className, "TRESubModel");
@@ -31,6 +32,7 @@ TRESubModel::TRESubModel(const TRESubModel &other)
 		other.m_invertedSubModel)),
 	m_color(other.m_color),
 	m_edgeColor(other.m_edgeColor),
+	m_lowDetailFrame(-1),
 	m_flags(other.m_flags)
 {
 #ifdef _LEAK_DEBUG
@@ -48,6 +50,7 @@ TRESubModel::TRESubModel(const TRESubModel &other, bool shallow)
 		(TRESubModel *)TCObject::copy(other.m_invertedSubModel)),
 	m_color(other.m_color),
 	m_edgeColor(other.m_edgeColor),
+	m_lowDetailFrame(-1),
 	m_flags(other.m_flags)
 {
 #ifdef _LEAK_DEBUG
@@ -200,6 +203,19 @@ void TRESubModel::setMatrix(const TCFloat *matrix)
 	}
 }
 
+void TRESubModel::setLowDetail(bool value, int frame)
+{
+	if (frame == m_lowDetailFrame)
+	{
+		m_flags.lowDetail = m_flags.lowDetail && value;
+	}
+	else
+	{
+		m_flags.lowDetail = value;
+		m_lowDetailFrame = frame;
+	}
+}
+
 TREModel *TRESubModel::getEffectiveModel(void) const
 {
 	if (m_flags.mirrorMatrix)
@@ -313,9 +329,16 @@ void TRESubModel::draw(
 			}
 		}
 	}
+	TREModel *model = getEffectiveModel();
+
+	if (getLowDetail(model->getMainModel()->getLowDetailFrame()) &&
+		model->getLowDetailModel() != NULL)
+	{
+		model = model->getLowDetailModel();
+	}
 	glPushMatrix();
 	treGlMultMatrixf(m_matrix);
-	getEffectiveModel()->draw(section, colored, subModelsOnly,
+	model->draw(section, colored, subModelsOnly,
 		getNonUniformFlag() | nonUniform, skipTexmapped);
 	glPopMatrix();
 	if (!colored)
@@ -477,6 +500,10 @@ void TRESubModel::shrink(TCFloat amount)
 		TCVector::multMatrix(m_matrix, scaleMatrix, tempMatrix);
 		memcpy(m_matrix, tempMatrix, sizeof(m_matrix));
 		m_model->unshrinkNormals(scaleMatrix);
+		if (m_model->getLowDetailModel() != NULL)
+		{
+			m_model->getLowDetailModel()->unshrinkNormals(scaleMatrix);
+		}
 		m_flags.shrunk = true;
 	}
 }
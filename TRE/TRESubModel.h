@@ -39,6 +39,15 @@ public:
 	void setLightFlag(bool value) { m_flags.light = value; }
 	bool getTransferredFlag(void) const { return m_flags.transferred != false; }
 	void setTransferredFlag(bool value) { m_flags.transferred = value; }
+	// Marks whether or not this sub-model should draw its model's low detail
+	// variant during the given frame.  If a sub-model is reached more than
+	// once in a frame, it only gets the low detail variant if every instance
+	// is small enough.
+	void setLowDetail(bool value, int frame);
+	bool getLowDetail(int frame) const
+	{
+		return m_flags.lowDetail && m_lowDetailFrame == frame;
+	}
 /*
 	virtual void drawColored(void);
 	virtual void drawDefaultColor(void);
@@ -78,6 +87,7 @@ protected:
 	TCULong m_edgeColor;
 	GLfloat m_specular[4];
 	GLfloat m_shininess;
+	int m_lowDetailFrame;
 	struct {
 		bool colorSet:1;
 		bool unMirrored:1;
@@ -90,6 +100,7 @@ protected:
 		bool light:1;
 		bool transferred:1;
 		bool shrunk:1;
+		bool lowDetail:1;
 	} m_flags;
 };
 
@@ -0,0 +1,468 @@
+#include "TRETaskScheduler.h"
+
+#ifdef WIN32
+#if defined(_MSC_VER) && _MSC_VER >= 1400 && defined(_DEBUG)
+#define new DEBUG_CLIENTBLOCK
+#endif // _DEBUG
+#endif // WIN32
+
+#ifdef USE_CPP11
+typedef std::unique_lock<std::mutex> ScopedLock;
+#else
+#ifndef _NO_TRE_THREADS
+#include <boost/bind.hpp>
+typedef boost::mutex::scoped_lock ScopedLock;
+#else // !_NO_TRE_THREADS
+// Without threads, there is nothing to lock.
+class ScopedLock
+{
+public:
+	ScopedLock(void) {}
+	void lock(void) {}
+	void unlock(void) {}
+};
+#endif // _NO_TRE_THREADS
+#endif // !USE_CPP11
+
+#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
+#define QUEUE_LOCK(name, queueIndex) \
+	ScopedLock name(*m_queueMutexes[queueIndex])
+#else // USE_CPP11 || !_NO_TRE_THREADS
+#define QUEUE_LOCK(name, queueIndex) ScopedLock name
+#endif // !USE_CPP11 && _NO_TRE_THREADS
+
+TRETask::TRETask(void)
+	: m_remaining(0)
+	, m_nextCount(0)
+	, m_nextGrainSize(1)
+	, m_queued(false)
+	, m_finishing(false)
+{
+}
+
+TRETask::~TRETask(void)
+{
+}
+
+TRETaskScheduler::TRETaskScheduler(int threadCount)
+	: m_threadCount(threadCount)
+	, m_queuedTaskCount(0)
+#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
+#ifdef USE_CPP11
+	, m_threads(NULL)
+	, m_mutex(new std::mutex)
+	, m_workCondition(new std::condition_variable)
+	, m_doneCondition(new std::condition_variable)
+#else
+	, m_threadGroup(NULL)
+	, m_mutex(new boost::mutex)
+	, m_workCondition(new boost::condition)
+	, m_doneCondition(new boost::condition)
+#endif
+	, m_exiting(false)
+#endif // USE_CPP11 || !_NO_TRE_THREADS
+{
+#ifdef _LEAK_DEBUG
+	strcpy(className, "TRETaskScheduler");
+#endif // _LEAK_DEBUG
+#if !defined(USE_CPP11) && defined(_NO_TRE_THREADS)
+	m_threadCount = 0;
+#endif // !USE_CPP11 && _NO_TRE_THREADS
+	// The queues have to exist before any worker threads start.
+	m_queues.resize(m_threadCount + 1);
+#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
+	for (int i = 0; i <= m_threadCount; i++)
+	{
+#ifdef USE_CPP11
+		m_queueMutexes.push_back(new std::mutex);
+#else
+		m_queueMutexes.push_back(new boost::mutex);
+#endif
+	}
+	if (m_threadCount > 0)
+	{
+#ifdef USE_CPP11
+		m_threads = new std::vector<std::thread>;
+#else
+		m_threadGroup = new boost::thread_group;
+#endif
+		for (int i = 0; i < m_threadCount; i++)
+		{
+#ifdef USE_CPP11
+			m_threads->emplace_back(&TRETaskScheduler::workerThreadProc, this,
+				i);
+#else
+			m_threadGroup->create_thread(
+				boost::bind(&TRETaskScheduler::workerThreadProc, this, i));
+#endif
+		}
+	}
+#endif // USE_CPP11 || !_NO_TRE_THREADS
+}
+
+TRETaskScheduler::~TRETaskScheduler(void)
+{
+}
+
+// Any tasks that are still queued are dropped, so the owner of the tasks
+// should call waitForAll first.
+void TRETaskScheduler::dealloc(void)
+{
+#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
+	{
+		ScopedLock lock(*m_mutex);
+
+		m_exiting = true;
+		m_workCondition->notify_all();
+	}
+#ifdef USE_CPP11
+	if (m_threads != NULL)
+	{
+		for (auto&& thread: *m_threads)
+		{
+			thread.join();
+		}
+		delete m_threads;
+	}
+#else
+	if (m_threadGroup != NULL)
+	{
+		m_threadGroup->join_all();
+		delete m_threadGroup;
+	}
+#endif
+	for (size_t i = 0; i < m_queueMutexes.size(); i++)
+	{
+		delete m_queueMutexes[i];
+	}
+	delete m_mutex;
+	delete m_workCondition;
+	delete m_doneCondition;
+#endif // USE_CPP11 || !_NO_TRE_THREADS
+	TCObject::dealloc();
+}
+
+// Queues count items of task to be run.  If this is called from the task's
+// own finishTask, the new pass is only queued after finishTask returns.
+void TRETaskScheduler::addTask(
+	TRETask *task,
+	int count,
+	int grainSize /*= 1*/)
+{
+#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
+	ScopedLock lock(*m_mutex);
+#else // USE_CPP11 || !_NO_TRE_THREADS
+	ScopedLock lock;
+#endif // !USE_CPP11 && _NO_TRE_THREADS
+
+	if (count <= 0)
+	{
+		return;
+	}
+	if (task->m_finishing)
+	{
+		task->m_nextCount = count;
+		task->m_nextGrainSize = grainSize;
+		return;
+	}
+	if (!task->m_queued)
+	{
+		task->m_queued = true;
+		m_queuedTaskCount++;
+	}
+	queueRanges(task, count, grainSize);
+}
+
+void TRETaskScheduler::queueRanges(TRETask *task, int count, int grainSize)
+{
+	int queueCount = (int)m_queues.size();
+	int grains = (count + grainSize - 1) / grainSize;
+	int start = 0;
+
+	task->m_remaining = count;
+	for (int i = 0; i < queueCount && start < count; i++)
+	{
+		int end = std::min(count,
+			(int)((long long)grains * (i + 1) / queueCount) * grainSize);
+
+		if (end > start)
+		{
+			Range range = { task, start, end, grainSize };
+			QUEUE_LOCK(queueLock, i);
+
+			m_queues[i].push_back(range);
+			start = end;
+		}
+	}
+	notifyAll();
+}
+
+void TRETaskScheduler::notifyAll(void)
+{
+#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
+	m_workCondition->notify_all();
+	m_doneCondition->notify_all();
+#endif // USE_CPP11 || !_NO_TRE_THREADS
+}
+
+// Runs chunk with no locks held, and then does the task's bookkeeping under
+// the main lock.
+void TRETaskScheduler::runChunk(const Range &chunk)
+{
+	TRETask *task = chunk.task;
+	int count = chunk.end - chunk.start;
+
+	task->runTask(chunk.start, count);
+#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
+	ScopedLock lock(*m_mutex);
+#else // USE_CPP11 || !_NO_TRE_THREADS
+	ScopedLock lock;
+#endif // !USE_CPP11 && _NO_TRE_THREADS
+
+	task->m_remaining -= count;
+	if (task->m_remaining == 0)
+	{
+		task->m_finishing = true;
+		lock.unlock();
+		task->finishTask();
+		lock.lock();
+		task->m_finishing = false;
+		if (task->m_nextCount > 0)
+		{
+			queueRanges(task, task->m_nextCount, task->m_nextGrainSize);
+			task->m_nextCount = 0;
+		}
+		else
+		{
+			task->m_queued = false;
+			m_queuedTaskCount--;
+			notifyAll();
+		}
+	}
+}
+
+// Helps run queued work until task has finished.  Returns right away if task
+// isn't queued.
+void TRETaskScheduler::waitForTask(TRETask *task)
+{
+#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
+	ScopedLock lock(*m_mutex);
+#else // USE_CPP11 || !_NO_TRE_THREADS
+	ScopedLock lock;
+#endif // !USE_CPP11 && _NO_TRE_THREADS
+
+	while (task->m_queued)
+	{
+		Range chunk;
+
+		if (takeChunk(m_threadCount, chunk))
+		{
+			lock.unlock();
+			runChunk(chunk);
+			lock.lock();
+		}
+		else
+		{
+#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
+			m_doneCondition->wait(lock);
+#else // USE_CPP11 || !_NO_TRE_THREADS
+			break;
+#endif // !USE_CPP11 && _NO_TRE_THREADS
+		}
+	}
+}
+
+// Helps run queued work until no tasks are left.
+void TRETaskScheduler::waitForAll(void)
+{
+#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
+	ScopedLock lock(*m_mutex);
+#else // USE_CPP11 || !_NO_TRE_THREADS
+	ScopedLock lock;
+#endif // !USE_CPP11 && _NO_TRE_THREADS
+
+	while (m_queuedTaskCount > 0)
+	{
+		Range chunk;
+
+		if (takeChunk(m_threadCount, chunk))
+		{
+			lock.unlock();
+			runChunk(chunk);
+			lock.lock();
+		}
+		else
+		{
+#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
+			m_doneCondition->wait(lock);
+#else // USE_CPP11 || !_NO_TRE_THREADS
+			break;
+#endif // !USE_CPP11 && _NO_TRE_THREADS
+		}
+	}
+}
+
+// NOTE: static function.
+int TRETaskScheduler::grainCount(const Range &range)
+{
+	return (range.end - range.start + range.grainSize - 1) / range.grainSize;
+}
+
+// NOTE: static function.
+// Finds the range in queue with the most grains left, and returns that number
+// of grains, or 0 if queue is empty.  The queue's lock must be held.
+int TRETaskScheduler::biggestRange(RangeList &queue, RangeList::iterator &it)
+{
+	int biggestGrains = 0;
+
+	for (RangeList::iterator rangeIt = queue.begin(); rangeIt != queue.end();
+		++rangeIt)
+	{
+		int grains = grainCount(*rangeIt);
+
+		if (grains > biggestGrains)
+		{
+			it = rangeIt;
+			biggestGrains = grains;
+		}
+	}
+	return biggestGrains;
+}
+
+// Takes the next chunk of work for the given queue, stealing from another
+// queue if this one is empty.  Only the queue locks are used, so the main
+// lock may or may not be held.
+bool TRETaskScheduler::takeChunk(int queueIndex, Range &chunk)
+{
+	Range stolen;
+
+	{
+		QUEUE_LOCK(queueLock, queueIndex);
+
+		if (cutChunk(m_queues[queueIndex], chunk))
+		{
+			return true;
+		}
+	}
+	// The queue's lock isn't held while stealing, so that two threads
+	// stealing from each other can't deadlock.
+	if (!stealRange(queueIndex, stolen))
+	{
+		return false;
+	}
+	QUEUE_LOCK(queueLock, queueIndex);
+
+	m_queues[queueIndex].push_back(stolen);
+	return cutChunk(m_queues[queueIndex], chunk);
+}
+
+// Cuts a chunk from the front of the first range in queue.  The chunk is a
+// share of that range based on the number of queues, so that chunks get
+// smaller as the range runs down.  The queue's lock must be held.
+bool TRETaskScheduler::cutChunk(RangeList &queue, Range &chunk)
+{
+	if (queue.empty())
+	{
+		return false;
+	}
+	Range &range = queue.front();
+	int chunkGrains = std::max(1, grainCount(range) / (int)m_queues.size());
+
+	chunk = range;
+	chunk.end = std::min(range.end, range.start + chunkGrains *
+		range.grainSize);
+	if (chunk.end == range.end)
+	{
+		queue.pop_front();
+	}
+	else
+	{
+		range.start = chunk.end;
+	}
+	return true;
+}
+
+// Takes the back half of the biggest range in any other queue.  Each queue is
+// looked at under its own lock, and the victim's lock is taken again to do
+// the split, so the search starts over if the victim ran out of work in
+// between.
+bool TRETaskScheduler::stealRange(int queueIndex, Range &stolen)
+{
+	int queueCount = (int)m_queues.size();
+
+	for (;;)
+	{
+		int victimIndex = -1;
+		int victimGrains = 0;
+
+		for (int i = 0; i < queueCount; i++)
+		{
+			if (i != queueIndex)
+			{
+				RangeList::iterator it;
+				QUEUE_LOCK(queueLock, i);
+				int grains = biggestRange(m_queues[i], it);
+
+				if (grains > victimGrains)
+				{
+					victimIndex = i;
+					victimGrains = grains;
+				}
+			}
+		}
+		if (victimIndex < 0)
+		{
+			return false;
+		}
+		RangeList &victimQueue = m_queues[victimIndex];
+		RangeList::iterator victimRange;
+		QUEUE_LOCK(queueLock, victimIndex);
+
+		victimGrains = biggestRange(victimQueue, victimRange);
+		if (victimGrains > 0)
+		{
+			stolen = *victimRange;
+			if (victimGrains > 1)
+			{
+				stolen.start += victimGrains / 2 * stolen.grainSize;
+				victimRange->end = stolen.start;
+			}
+			else
+			{
+				victimQueue.erase(victimRange);
+			}
+			return true;
+		}
+	}
+}
+
+#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
+// Work is only taken under the main lock when the thread might be about to
+// sleep: queueRanges fills the queues with the main lock held, so checking
+// for work under it guarantees that a wakeup can't be missed.  Once the
+// thread has work, it keeps taking chunks with only the queue locks until
+// none are left.
+void TRETaskScheduler::workerThreadProc(int queueIndex)
+{
+	ScopedLock lock(*m_mutex);
+
+	while (!m_exiting)
+	{
+		Range chunk;
+
+		if (takeChunk(queueIndex, chunk))
+		{
+			lock.unlock();
+			do
+			{
+				runChunk(chunk);
+			} while (takeChunk(queueIndex, chunk));
+			lock.lock();
+		}
+		else
+		{
+			m_workCondition->wait(lock);
+		}
+	}
+}
+#endif // USE_CPP11 || !_NO_TRE_THREADS
@@ -0,0 +1,136 @@
+#ifndef __TRETASKSCHEDULER_H__
+#define __TRETASKSCHEDULER_H__
+
+#include <TCFoundation/TCObject.h>
+#include <TCFoundation/TCStlIncludes.h>
+
+#ifdef USE_CPP11
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#else
+#if defined(_MSC_VER) && _MSC_VER <= 1200	// VS 6
+#define _NO_TRE_THREADS
+#else  // VS 6
+#ifdef _NO_BOOST
+#define _NO_TRE_THREADS
+#endif // _NO_BOOST
+#endif // VS 6
+#ifndef _NO_TRE_THREADS
+#ifdef WIN32
+#pragma warning(push)
+#pragma warning(disable:4244 4512)
+#endif // WIN32
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#ifdef WIN32
+#pragma warning(pop)
+#endif // WIN32
+#endif // !_NO_TRE_THREADS
+#endif
+
+class TRETaskScheduler;
+
+// A piece of work made up of count items that TRETaskScheduler can split into
+// chunks and run on any of its threads.  A task can add itself to the
+// scheduler again from finishTask in order to run another pass over a
+// different number of items; it only counts as done once a pass finishes
+// without doing so.
+class TRETask
+{
+public:
+	TRETask(void);
+	virtual ~TRETask(void);
+	bool isQueued(void) const { return m_queued; }
+protected:
+	// Called once for every chunk, with the lock released, from whichever
+	// thread took the chunk.
+	virtual void runTask(int start, int count) = 0;
+	// Called once after every chunk of a pass has run, from the thread that
+	// ran the last one.
+	virtual void finishTask(void) {}
+
+	int m_remaining;
+	int m_nextCount;
+	int m_nextGrainSize;
+	bool m_queued;
+	bool m_finishing;
+
+	friend class TRETaskScheduler;
+};
+
+// Runs TRETasks on a pool of worker threads.  When a task is added, its items
+// are split into one contiguous range per thread, and each thread takes
+// chunks off the front of its own ranges, with the chunks getting smaller as
+// the range runs down.  A thread that runs out of work
+// steals the back half of the biggest range left in any other thread's
+// queue, so that uneven work doesn't leave threads idle.  Threads that call
+// waitForTask take part in the work too, through a queue of their own.  With
+// no worker threads, all the work gets done by waitForTask.
+//
+// Each queue has its own lock, so a thread taking work from its own queue
+// only ever contends with a thread stealing from it.  The main lock covers
+// the task bookkeeping and the sleeping and waking of threads; queue locks
+// may be taken while it is held, but never the other way around, and no
+// thread holds more than one queue lock at a time.
+class TRETaskScheduler : public TCObject
+{
+public:
+	TRETaskScheduler(int threadCount);
+	int getThreadCount(void) const { return m_threadCount; }
+	// Chunk boundaries are always multiples of grainSize, so the chunk
+	// that starts at item i is the only one that starts in i's grain.
+	void addTask(TRETask *task, int count, int grainSize = 1);
+	void waitForTask(TRETask *task);
+	void waitForAll(void);
+protected:
+	struct Range
+	{
+		TRETask *task;
+		int start;
+		int end;
+		int grainSize;
+	};
+	typedef std::list<Range> RangeList;
+	typedef std::vector<RangeList> RangeListVector;
+
+	virtual ~TRETaskScheduler(void);
+	virtual void dealloc(void);
+	void queueRanges(TRETask *task, int count, int grainSize);
+	void notifyAll(void);
+	bool takeChunk(int queueIndex, Range &chunk);
+	bool cutChunk(RangeList &queue, Range &chunk);
+	bool stealRange(int queueIndex, Range &stolen);
+	void runChunk(const Range &chunk);
+#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
+	void workerThreadProc(int queueIndex);
+#endif // USE_CPP11 || !_NO_TRE_THREADS
+
+	static int grainCount(const Range &range);
+	static int biggestRange(RangeList &queue, RangeList::iterator &it);
+
+	int m_threadCount;
+	int m_queuedTaskCount;
+	// One queue per worker thread, followed by one shared by all the other
+	// threads that help out in waitForTask.
+	RangeListVector m_queues;
+#if defined(USE_CPP11) || !defined(_NO_TRE_THREADS)
+#ifdef USE_CPP11
+	std::vector<std::thread> *m_threads;
+	std::vector<std::mutex *> m_queueMutexes;
+	std::mutex *m_mutex;
+	std::condition_variable *m_workCondition;
+	std::condition_variable *m_doneCondition;
+#else
+	boost::thread_group *m_threadGroup;
+	std::vector<boost::mutex *> m_queueMutexes;
+	boost::mutex *m_mutex;
+	boost::condition *m_workCondition;
+	boost::condition *m_doneCondition;
+#endif
+	bool m_exiting;
+#endif // USE_CPP11 || !_NO_TRE_THREADS
+};
+
+#endif // __TRETASKSCHEDULER_H__
@@ -54,3 +54,17 @@ void TRETexmappedShapeGroup::stepChanged(void)
 	m_indices->replaceObject(indicesCopy, index);
 	TCObject::release(indicesCopy);
 }
+
+void TRETexmappedShapeGroup::addVertexIndexArrays(TCULongArraySet &indexArrays)
+{
+	TREColoredShapeGroup::addVertexIndexArrays(indexArrays);
+	if (m_origIndices != NULL)
+	{
+		indexArrays.insert(m_origIndices);
+	}
+}
+
+void TRETexmappedShapeGroup::verticesWelded(void)
+{
+	// stepChanged replaces the triangle indices, so they stay 32-bit.
+}
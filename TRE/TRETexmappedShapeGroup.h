@@ -12,6 +12,8 @@ public:
 	void draw(void);
 	void setStepCounts(const IntVector &value);
 	void stepChanged(void);
+	virtual void addVertexIndexArrays(TCULongArraySet &indexArrays);
+	virtual void verticesWelded(void);
 protected:
 	~TRETexmappedShapeGroup(void);
 	virtual void dealloc(void);
@@ -4,6 +4,7 @@
 #include "TREMainModel.h"
 #include <TCFoundation/TCMacros.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef WIN32
 #if defined(_MSC_VER) && _MSC_VER >= 1400 && defined(_DEBUG)
@@ -11,8 +12,16 @@
 #endif // _DEBUG
 #endif // WIN32
 
+// Triangles are only split into multiple sort slices when each slice gets at
+// least this many.
+#define MIN_SORT_SLICE_SIZE 4096
+// When the previous frame's order is reused, a slice that needs more than
+// this many moves per triangle to fix gets radix sorted instead.
+#define MAX_INSERTION_MOVES 4
+
 TRETransShapeGroup::TRETransShapeGroup(void)
-	:m_sortedTriangles(NULL),
+	:m_haveSortedTriangles(false),
+	m_haveSortOrder(false),
 	m_origIndices(NULL)
 	//m_useSortThread(false),
 	//m_sortThread(NULL)
@@ -21,9 +30,13 @@ TRETransShapeGroup::TRETransShapeGroup(void)
 
 TRETransShapeGroup::TRETransShapeGroup(const TRETransShapeGroup &other)
 	:TREColoredShapeGroup(other),
-	m_sortedTriangles((TRESortedTriangleArray *)TCObject::copy(
-		other.m_sortedTriangles)),
-		m_origIndices((TCULongArray *)TCObject::copy(other.m_origIndices))
+	m_haveSortedTriangles(other.m_haveSortedTriangles),
+	m_triangleIndices(other.m_triangleIndices),
+	m_centerX(other.m_centerX),
+	m_centerY(other.m_centerY),
+	m_centerZ(other.m_centerZ),
+	m_haveSortOrder(false),
+	m_origIndices((TCULongArray *)TCObject::copy(other.m_origIndices))
 {
 }
 
@@ -34,7 +47,6 @@ TRETransShapeGroup::~TRETransShapeGroup(void)
 void TRETransShapeGroup::dealloc(void)
 {
 	TCObject::release(m_origIndices);
-	TCObject::release(m_sortedTriangles);
 	TREColoredShapeGroup::dealloc();
 }
 
@@ -55,35 +67,9 @@ void TRETransShapeGroup::draw(bool sort)
 	drawShapeType(TRESTriangle);
 }
 
-void TRETransShapeGroup::backgroundSort(void)
-{
-	memcpy(m_sortMatrix, m_mainModel->getCurrentModelViewMatrix(),
-		sizeof(m_sortMatrix));
-	sortShapes();
-}
-
-static int triangleCompareFunc(const void *left, const void *right)
-{
-	TRESortedTriangle *leftTriangle = *(TRESortedTriangle **)left;
-	TRESortedTriangle *rightTriangle = *(TRESortedTriangle **)right;
-
-	if (leftTriangle->depth > rightTriangle->depth)
-	{
-		return -1;
-	}
-	else if (leftTriangle->depth < rightTriangle->depth)
-	{
-		return 1;
-	}
-	else
-	{
-		return 0;
-	}
-}
-
 void TRETransShapeGroup::initSortedTriangles(void)
 {
-	if (!m_sortedTriangles)
+	if (!m_haveSortedTriangles)
 	{
 		TCULongArray *indices = getIndices(TRESTriangle);
 
@@ -104,66 +90,343 @@ void TRETransShapeGroup::initSortedTriangles(void)
 					count = stepCounts[step];
 				}
 			}
-			m_sortedTriangles = new TRESortedTriangleArray(count / 3);
-			for (i = 0; i < count; i += 3)
+			count /= 3;
+			m_triangleIndices.resize(count * 3);
+			m_centerX.resize(count);
+			m_centerY.resize(count);
+			m_centerZ.resize(count);
+			for (i = 0; i < count; i++)
 			{
-				TRESortedTriangle *sortedTriangle = new TRESortedTriangle;
 				TCFloat midX = 0.0f;
 				TCFloat midY = 0.0f;
 				TCFloat midZ = 0.0f;
 
-				sortedTriangle->indices[0] = (*indices)[i];
-				sortedTriangle->indices[1] = (*indices)[i + 1];
-				sortedTriangle->indices[2] = (*indices)[i + 2];
 				for (j = 0; j < 3; j++)
 				{
-					const TREVertex &vertex =
-						(*vertices)[sortedTriangle->indices[j]];
+					TCULong index = (*indices)[i * 3 + j];
+					const TREVertex &vertex = (*vertices)[index];
 
+					m_triangleIndices[i * 3 + j] = index;
 					midX += vertex.v[0];
 					midY += vertex.v[1];
 					midZ += vertex.v[2];
 				}
-				sortedTriangle->center = TCVector(midX * oneThird,
-					midY * oneThird, midZ * oneThird);
-				m_sortedTriangles->addObject(sortedTriangle);
-				sortedTriangle->release();
+				m_centerX[i] = midX * oneThird;
+				m_centerY[i] = midY * oneThird;
+				m_centerZ[i] = midZ * oneThird;
 			}
+			m_sortKeys.resize(count);
+			m_sortOrder.resize(count);
+			m_tempKeys.resize(count);
+			m_tempOrder.resize(count);
+			m_haveSortedTriangles = true;
+			m_haveSortOrder = false;
 		}
-		else
+	}
+}
+
+// Gets ready to sort the triangles based on their distance from the eye
+// when transformed by matrix, and splits them into at most maxSliceCount
+// slices.  Each slice then gets sorted by sortSlice (which can be called
+// for different slices on different threads at the same time), and after
+// all of them are done, finishSort puts the triangles in order.  Returns the
+// number of slices, which is 0 if the triangles are already in order.
+//
+// Once the triangles have been sorted, their indices are left in that order,
+// so if the matrix hasn't changed since then, there's nothing to do.  If it
+// has, each slice starts with the previous order, which is usually close to
+// right when the camera has only moved a little.
+int TRETransShapeGroup::prepareSort(const TCFloat *matrix, int maxSliceCount)
+{
+	int count;
+	int sliceCount;
+
+	if (matrix != m_sortMatrix)
+	{
+		memcpy(m_sortMatrix, matrix, sizeof(m_sortMatrix));
+	}
+	initSortedTriangles();
+	count = (int)m_centerX.size();
+	if (count == 0)
+	{
+		return 0;
+	}
+	if (m_haveSortOrder &&
+		memcmp(m_sortMatrix, m_lastSortMatrix, sizeof(m_sortMatrix)) == 0)
+	{
+		return 0;
+	}
+	memcpy(m_lastSortMatrix, m_sortMatrix, sizeof(m_sortMatrix));
+	sliceCount = std::max(1, std::min(maxSliceCount,
+		count / MIN_SORT_SLICE_SIZE));
+	m_sliceStarts.resize(sliceCount + 1);
+	for (int i = 0; i <= sliceCount; i++)
+	{
+		m_sliceStarts[i] = (int)((long long)count * i / sliceCount);
+	}
+	return sliceCount;
+}
+
+void TRETransShapeGroup::sortSlice(int slice)
+{
+	int start = m_sliceStarts[slice];
+	int end = m_sliceStarts[slice + 1];
+	const TCFloat *matrix = m_sortMatrix;
+	const TCFloat *centerX = &m_centerX[0];
+	const TCFloat *centerY = &m_centerY[0];
+	const TCFloat *centerZ = &m_centerZ[0];
+	TCULong *keys = &m_sortKeys[0];
+	TCULong *order = &m_sortOrder[0];
+
+	if (m_haveSortOrder)
+	{
+		for (int i = start; i < end; i++)
+		{
+			keys[i] = depthKey(matrix, centerX[order[i]], centerY[order[i]],
+				centerZ[order[i]]);
+		}
+		if (insertionSort(keys + start, order + start, end - start,
+			(end - start) * MAX_INSERTION_MOVES))
 		{
 			return;
 		}
 	}
+	else
+	{
+		// This loop is kept simple, with the centers in separate arrays, so
+		// that the compiler can vectorize it.
+		for (int i = start; i < end; i++)
+		{
+			keys[i] = depthKey(matrix, centerX[i], centerY[i], centerZ[i]);
+			order[i] = (TCULong)i;
+		}
+	}
+	radixSort(keys + start, order + start, &m_tempKeys[start],
+		&m_tempOrder[start], end - start);
+}
+
+void TRETransShapeGroup::finishSort(void)
+{
+	TCULong *keys = &m_sortKeys[0];
+	TCULong *order = &m_sortOrder[0];
+	TCULong *outKeys = &m_tempKeys[0];
+	TCULong *outOrder = &m_tempOrder[0];
+	IntVector starts = m_sliceStarts;
+	TCULong *values = getIndices(TRESTriangle)->getValues();
+	const TCULong *triangleIndices = &m_triangleIndices[0];
+	int count = (int)m_centerX.size();
+
+	// Merge pairs of sorted slices until only one is left.
+	while (starts.size() > 2)
+	{
+		IntVector newStarts;
+		size_t rangeCount = starts.size() - 1;
+
+		for (size_t i = 0; i < rangeCount; i += 2)
+		{
+			newStarts.push_back(starts[i]);
+			if (i + 1 < rangeCount)
+			{
+				mergeSlices(keys, order, outKeys, outOrder, starts[i],
+					starts[i + 1], starts[i + 2]);
+			}
+			else
+			{
+				int rangeSize = starts[i + 1] - starts[i];
+
+				memcpy(&outKeys[starts[i]], &keys[starts[i]],
+					rangeSize * sizeof(TCULong));
+				memcpy(&outOrder[starts[i]], &order[starts[i]],
+					rangeSize * sizeof(TCULong));
+			}
+		}
+		newStarts.push_back(starts.back());
+		starts.swap(newStarts);
+		std::swap(keys, outKeys);
+		std::swap(order, outOrder);
+	}
+	for (int i = 0; i < count; i++)
+	{
+		const TCULong *srcIndices = &triangleIndices[order[i] * 3];
+
+		values[i * 3] = srcIndices[0];
+		values[i * 3 + 1] = srcIndices[1];
+		values[i * 3 + 2] = srcIndices[2];
+	}
+	if (order != &m_sortOrder[0])
+	{
+		// Keep the order where the next sort will look for it.
+		m_sortKeys.swap(m_tempKeys);
+		m_sortOrder.swap(m_tempOrder);
+	}
+	m_haveSortOrder = true;
 }
 
 void TRETransShapeGroup::sortShapes(void)
 {
-	int i;
-	int count;
-	TCULong *values;
-	TCULongArray *indices = getIndices(TRESTriangle);
-	int offset = 0;
+	if (prepareSort(m_sortMatrix, 1) > 0)
+	{
+		sortSlice(0);
+		finishSort();
+	}
+}
 
-	initSortedTriangles();
-	count = m_sortedTriangles->getCount();
-	for (i = 0; i < count; i++)
+// NOTE: static function.
+TCULong TRETransShapeGroup::depthKey(
+	const TCFloat *matrix,
+	TCFloat x,
+	TCFloat y,
+	TCFloat z)
+{
+	TCFloat eyeX = matrix[0] * x + matrix[4] * y + matrix[8] * z + matrix[12];
+	TCFloat eyeY = matrix[1] * x + matrix[5] * y + matrix[9] * z + matrix[13];
+	TCFloat eyeZ = matrix[2] * x + matrix[6] * y + matrix[10] * z + matrix[14];
+	float depth = (float)(eyeX * eyeX + eyeY * eyeY + eyeZ * eyeZ);
+	TCULong depthBits;
+
+	// depth is never negative, so its bits sort in the same order it does.
+	// Flipping them puts the farthest triangles first.
+	memcpy(&depthBits, &depth, sizeof(depthBits));
+	return ~depthBits;
+}
+
+// Insertion sort of keys, with values carried along, for when they are
+// already almost in order.  Gives up and returns false if that takes more
+// than maxMoves moves, leaving keys and values in some other order.
+// NOTE: static function.
+bool TRETransShapeGroup::insertionSort(
+	TCULong *keys,
+	TCULong *values,
+	int count,
+	int maxMoves)
+{
+	int moves = 0;
+
+	for (int i = 1; i < count; i++)
 	{
-		TRESortedTriangle *sortedTriangle = (*m_sortedTriangles)[i];
-		sortedTriangle->depth =
-			sortedTriangle->center.transformPoint(m_sortMatrix).
-			lengthSquared();
+		TCULong key = keys[i];
+
+		if (key < keys[i - 1])
+		{
+			TCULong value = values[i];
+			int j = i;
+
+			do
+			{
+				keys[j] = keys[j - 1];
+				values[j] = values[j - 1];
+				j--;
+			} while (j > 0 && key < keys[j - 1]);
+			keys[j] = key;
+			values[j] = value;
+			moves += i - j;
+			if (moves > maxMoves)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// LSD radix sort of keys, eight bits at a time, with values carried along.
+// Passes where every key has the same byte are skipped.  The results end up
+// back in keys and values.
+// NOTE: static function.
+void TRETransShapeGroup::radixSort(
+	TCULong *keys,
+	TCULong *values,
+	TCULong *tempKeys,
+	TCULong *tempValues,
+	int count)
+{
+	TCULong *srcKeys = keys;
+	TCULong *srcValues = values;
+	TCULong *dstKeys = tempKeys;
+	TCULong *dstValues = tempValues;
+	int counts[256];
+
+	if (count < 2)
+	{
+		return;
+	}
+	for (int shift = 0; shift < 32; shift += 8)
+	{
+		int i;
+		int total = 0;
+
+		memset(counts, 0, sizeof(counts));
+		for (i = 0; i < count; i++)
+		{
+			counts[(srcKeys[i] >> shift) & 0xFF]++;
+		}
+		if (counts[(srcKeys[0] >> shift) & 0xFF] == count)
+		{
+			continue;
+		}
+		for (i = 0; i < 256; i++)
+		{
+			int bucketCount = counts[i];
+
+			counts[i] = total;
+			total += bucketCount;
+		}
+		for (i = 0; i < count; i++)
+		{
+			TCULong key = srcKeys[i];
+			int dst = counts[(key >> shift) & 0xFF]++;
+
+			dstKeys[dst] = key;
+			dstValues[dst] = srcValues[i];
+		}
+		std::swap(srcKeys, dstKeys);
+		std::swap(srcValues, dstValues);
 	}
-	qsort(m_sortedTriangles->getItems(), count, sizeof(void *),
-		triangleCompareFunc);
-	values = indices->getValues();
-	for (i = 0; i < count; i++, offset += 3)
+	if (srcKeys != keys)
 	{
-		TRESortedTriangle *sortedTriangle = (*m_sortedTriangles)[i];
+		memcpy(keys, srcKeys, count * sizeof(TCULong));
+		memcpy(values, srcValues, count * sizeof(TCULong));
+	}
+}
+
+// Merges the sorted ranges [start, middle) and [middle, end) of keys and
+// values into the same range of outKeys and outValues.
+// NOTE: static function.
+void TRETransShapeGroup::mergeSlices(
+	const TCULong *keys,
+	const TCULong *values,
+	TCULong *outKeys,
+	TCULong *outValues,
+	int start,
+	int middle,
+	int end)
+{
+	int left = start;
+	int right = middle;
+	int dst = start;
 
-		values[offset] = sortedTriangle->indices[0];
-		values[offset + 1] = sortedTriangle->indices[1];
-		values[offset + 2] = sortedTriangle->indices[2];
+	while (left < middle && right < end)
+	{
+		if (keys[right] < keys[left])
+		{
+			outKeys[dst] = keys[right];
+			outValues[dst++] = values[right++];
+		}
+		else
+		{
+			outKeys[dst] = keys[left];
+			outValues[dst++] = values[left++];
+		}
+	}
+	while (left < middle)
+	{
+		outKeys[dst] = keys[left];
+		outValues[dst++] = values[left++];
+	}
+	while (right < end)
+	{
+		outKeys[dst] = keys[right];
+		outValues[dst++] = values[right++];
 	}
 }
 
@@ -183,6 +446,21 @@ void TRETransShapeGroup::stepChanged(void)
 
 	m_indices->replaceObject(indicesCopy, index);
 	TCObject::release(indicesCopy);
-	TCObject::release(m_sortedTriangles);
-	m_sortedTriangles = NULL;
+	m_haveSortedTriangles = false;
+}
+
+void TRETransShapeGroup::addVertexIndexArrays(TCULongArraySet &indexArrays)
+{
+	TREColoredShapeGroup::addVertexIndexArrays(indexArrays);
+	if (m_origIndices != NULL)
+	{
+		indexArrays.insert(m_origIndices);
+	}
+}
+
+void TRETransShapeGroup::verticesWelded(void)
+{
+	// The triangle indices get reordered by every sort, so they stay 32-bit.
+	m_haveSortedTriangles = false;
+	m_haveSortOrder = false;
 }
@@ -2,17 +2,7 @@
 #define __TRETRANSSHAPEGROUP_H__
 
 #include <TRE/TREColoredShapeGroup.h>
-#include <TCFoundation/TCTypedObjectArray.h>
-
-class TRESortedTriangle: public TCObject
-{
-public:
-	TCULong indices[3];
-	TCVector center;
-	TCFloat depth;
-};
-
-typedef TCTypedObjectArray<TRESortedTriangle> TRESortedTriangleArray;
+#include <TCFoundation/TCStlIncludes.h>
 
 // A shape group for handling sorted transparent shapes.
 class TRETransShapeGroup: public TREColoredShapeGroup
@@ -21,19 +11,52 @@ public:
 	TRETransShapeGroup(void);
 	TRETransShapeGroup(const TRETransShapeGroup &other);
 	virtual void draw(bool sort);
-	virtual void backgroundSort(void);
+	int prepareSort(const TCFloat *matrix, int maxSliceCount);
+	void sortSlice(int slice);
+	void finishSort(void);
 	void setStepCounts(const IntVector &value);
 	void stepChanged(void);
+	virtual void addVertexIndexArrays(TCULongArraySet &indexArrays);
+	virtual void verticesWelded(void);
 protected:
+	typedef std::vector<TCULong> ULongVector;
+	typedef std::vector<TCFloat> FloatVector;
+
 	~TRETransShapeGroup(void);
 	virtual void dealloc(void);
 	virtual void sortShapes(void);
 	virtual void initSortedTriangles(void);
 
-	TRESortedTriangleArray *m_sortedTriangles;
+	static TCULong depthKey(const TCFloat *matrix, TCFloat x, TCFloat y,
+		TCFloat z);
+	static bool insertionSort(TCULong *keys, TCULong *values, int count,
+		int maxMoves);
+	static void radixSort(TCULong *keys, TCULong *values, TCULong *tempKeys,
+		TCULong *tempValues, int count);
+	static void mergeSlices(const TCULong *keys, const TCULong *values,
+		TCULong *outKeys, TCULong *outValues, int start, int middle, int end);
+
+	// The triangles to sort, in their original order.  Each one's vertex
+	// indices are in m_triangleIndices, and the coordinates of its center
+	// are in m_centerX, m_centerY, and m_centerZ.
+	bool m_haveSortedTriangles;
+	ULongVector m_triangleIndices;
+	FloatVector m_centerX;
+	FloatVector m_centerY;
+	FloatVector m_centerZ;
+	// Sort keys and triangle numbers.  Each slice sorts its own range, and
+	// finishSort merges the ranges.  After a sort, m_sortOrder holds the
+	// order the triangles were put in, and m_lastSortMatrix the matrix that
+	// was used.
+	bool m_haveSortOrder;
+	ULongVector m_sortKeys;
+	ULongVector m_sortOrder;
+	ULongVector m_tempKeys;
+	ULongVector m_tempOrder;
+	IntVector m_sliceStarts;
 	TCULongArray *m_origIndices;
 	TCFloat m_sortMatrix[16];
+	TCFloat m_lastSortMatrix[16];
 };
 
 #endif // __TRETRANSSHAPEGROUP_H__
-
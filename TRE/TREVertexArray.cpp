@@ -64,6 +64,19 @@ bool TREVertexArray::addEmptyValues(int count)
 	}
 }
 
+bool TREVertexArray::setCount(unsigned int newCount)
+{
+	if (newCount <= m_allocated)
+	{
+		m_count = newCount;
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
 bool TREVertexArray::setCapacity(unsigned int newCapacity, bool updateCount /*= false*/, bool clear /*= false*/)
 {
 	if (newCapacity >= m_count)
@@ -34,6 +34,7 @@ public:
 	virtual TREVertex &operator[](unsigned int index);
 	int getCount(void) const { return m_count; }
 	virtual bool addEmptyValues(int count);
+	virtual bool setCount(unsigned int newCount);
 	virtual void shrinkToFit(void) { setCapacity(m_count); }
 	virtual bool setCapacity(unsigned newCapacity, bool updateCount = false, bool clear = false);
 //	virtual void sortUsingFunction(TCArraySortFunction function);
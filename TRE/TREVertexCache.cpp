@@ -0,0 +1,274 @@
+#include "TREVertexCache.h"
+#include <math.h>
+#include <algorithm>
+
+#ifdef WIN32
+#if defined(_MSC_VER) && _MSC_VER >= 1400 && defined(_DEBUG)
+#define new DEBUG_CLIENTBLOCK
+#endif // _DEBUG
+#endif // WIN32
+
+// Size of the LRU cache modeled while scoring vertices, along with the scoring
+// constants from Forsyth's article.
+#define VERTEX_CACHE_LRU_SIZE 32
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_PRIM_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+
+// NOTE: static function.
+float TREVertexCache::vertexScore(
+	int cachePosition,
+	int primCount,
+	int primSize)
+{
+	float score = 0.0f;
+
+	if (primCount == 0)
+	{
+		// No primitives left that use this vertex.
+		return -1.0f;
+	}
+	if (cachePosition >= 0)
+	{
+		if (cachePosition < primSize)
+		{
+			// The vertex was used by the last primitive.  It gets a fixed
+			// score so that the next primitive doesn't just reuse the same
+			// edge over and over.
+			score = LAST_PRIM_SCORE;
+		}
+		else
+		{
+			float scale = 1.0f / (VERTEX_CACHE_LRU_SIZE - primSize);
+
+			score = 1.0f - (cachePosition - primSize) * scale;
+			score = (float)pow(score, CACHE_DECAY_POWER);
+		}
+	}
+	// Favor vertices with few primitives left, so that lone primitives don't
+	// get left behind to be picked up later with a cold cache.
+	score += VALENCE_BOOST_SCALE *
+		(float)pow((float)primCount, -VALENCE_BOOST_POWER);
+	return score;
+}
+
+// NOTE: static function.
+void TREVertexCache::optimize(TCULongArray *indices, int primSize)
+{
+	int primCount = indices->getCount() / primSize;
+	int indexCount = primCount * primSize;
+	TCULong *values = indices->getValues();
+
+	if (primCount < 3)
+	{
+		return;
+	}
+	std::vector<TCULong> vertices(values, values + indexCount);
+	int vertexCount;
+	int i, j;
+
+	// The indices point into a vertex store that is shared by lots of shape
+	// groups, so they are mapped to a dense range first.
+	std::sort(vertices.begin(), vertices.end());
+	vertices.erase(std::unique(vertices.begin(), vertices.end()),
+		vertices.end());
+	vertexCount = (int)vertices.size();
+
+	IntVector localIndices(indexCount);
+	IntVector primStarts(vertexCount + 1, 0);
+
+	for (i = 0; i < indexCount; i++)
+	{
+		int vertex = (int)(std::lower_bound(vertices.begin(), vertices.end(),
+			values[i]) - vertices.begin());
+
+		localIndices[i] = vertex;
+		primStarts[vertex + 1]++;
+	}
+	for (i = 0; i < vertexCount; i++)
+	{
+		primStarts[i + 1] += primStarts[i];
+	}
+	// vertexPrims holds the primitives that use each vertex, starting at
+	// primStarts[vertex].  The first primsLeft[vertex] of them are the ones
+	// that haven't been added yet.
+	IntVector vertexPrims(indexCount);
+	IntVector primsLeft(vertexCount, 0);
+
+	for (i = 0; i < indexCount; i++)
+	{
+		int vertex = localIndices[i];
+
+		vertexPrims[primStarts[vertex] + primsLeft[vertex]++] = i / primSize;
+	}
+
+	// cacheStamps[vertex] is set to the number of the step where the vertex
+	// got put in the new cache, so that checking for duplicates is quick.
+	IntVector cacheStamps(vertexCount, -1);
+	int maxPrimsLeft = *std::max_element(primsLeft.begin(), primsLeft.end());
+	std::vector<float> cacheScores(VERTEX_CACHE_LRU_SIZE);
+	std::vector<float> valenceScores(maxPrimsLeft + 1);
+	std::vector<float> vertexScores(vertexCount);
+	std::vector<float> primScores(primCount, 0.0f);
+	std::vector<bool> primsAdded(primCount, false);
+	IntVector cache;
+	IntVector newCache;
+	std::vector<TCULong> newValues;
+	int bestPrim = 0;
+	int nextPrim = 0;
+
+	// pow is slow, so the part of the score that comes from each cache
+	// position, and the part that comes from each number of primitives left,
+	// are only worked out once.
+	for (i = 0; i < VERTEX_CACHE_LRU_SIZE; i++)
+	{
+		cacheScores[i] = vertexScore(i, 1, primSize) -
+			vertexScore(-1, 1, primSize);
+	}
+	for (i = 0; i <= maxPrimsLeft; i++)
+	{
+		valenceScores[i] = vertexScore(-1, i, primSize);
+	}
+	for (i = 0; i < vertexCount; i++)
+	{
+		vertexScores[i] = valenceScores[primsLeft[i]];
+	}
+	for (i = 0; i < indexCount; i++)
+	{
+		primScores[i / primSize] += vertexScores[localIndices[i]];
+	}
+	for (i = 1; i < primCount; i++)
+	{
+		if (primScores[i] > primScores[bestPrim])
+		{
+			bestPrim = i;
+		}
+	}
+	newValues.reserve(indexCount);
+	cache.reserve(VERTEX_CACHE_LRU_SIZE + primSize);
+	newCache.reserve(VERTEX_CACHE_LRU_SIZE + primSize);
+	for (int added = 0; added < primCount; added++)
+	{
+		float bestScore = -1.0f;
+		int *primVertices;
+
+		if (bestPrim < 0)
+		{
+			// Nothing in the cache leads anywhere, so start again from the
+			// first primitive that hasn't been added.  Doing this instead of
+			// looking for the best score among all the primitives keeps the
+			// whole thing linear.
+			while (primsAdded[nextPrim])
+			{
+				nextPrim++;
+			}
+			bestPrim = nextPrim;
+		}
+		primVertices = &localIndices[bestPrim * primSize];
+		primsAdded[bestPrim] = true;
+		newValues.insert(newValues.end(), values + bestPrim * primSize,
+			values + (bestPrim + 1) * primSize);
+		newCache.clear();
+		for (i = 0; i < primSize; i++)
+		{
+			int vertex = primVertices[i];
+			int *prims = &vertexPrims[primStarts[vertex]];
+			int count = primsLeft[vertex];
+
+			j = 0;
+			while (prims[j] != bestPrim)
+			{
+				j++;
+			}
+			// Replace bestPrim with the last primitive that is left.
+			prims[j] = prims[count - 1];
+			primsLeft[vertex]--;
+			if (cacheStamps[vertex] != added)
+			{
+				cacheStamps[vertex] = added;
+				newCache.push_back(vertex);
+			}
+		}
+		for (i = 0; i < (int)cache.size(); i++)
+		{
+			if (cacheStamps[cache[i]] != added)
+			{
+				newCache.push_back(cache[i]);
+			}
+		}
+		cache.swap(newCache);
+		// Update the scores of everything that is in the cache, or just fell
+		// out of it, along with the primitives that use them.
+		for (i = 0; i < (int)cache.size(); i++)
+		{
+			int vertex = cache[i];
+			int position = i < VERTEX_CACHE_LRU_SIZE ? i : -1;
+			float oldScore = vertexScores[vertex];
+			float newScore;
+			int *prims = &vertexPrims[primStarts[vertex]];
+
+			newScore = valenceScores[primsLeft[vertex]];
+			if (position >= 0 && primsLeft[vertex] > 0)
+			{
+				newScore += cacheScores[position];
+			}
+			vertexScores[vertex] = newScore;
+			for (j = 0; j < primsLeft[vertex]; j++)
+			{
+				primScores[prims[j]] += newScore - oldScore;
+			}
+		}
+		bestPrim = -1;
+		for (i = 0; i < (int)cache.size() && i < VERTEX_CACHE_LRU_SIZE; i++)
+		{
+			int vertex = cache[i];
+			int *prims = &vertexPrims[primStarts[vertex]];
+
+			for (j = 0; j < primsLeft[vertex]; j++)
+			{
+				if (primScores[prims[j]] > bestScore)
+				{
+					bestPrim = prims[j];
+					bestScore = primScores[prims[j]];
+				}
+			}
+		}
+		if (cache.size() > VERTEX_CACHE_LRU_SIZE)
+		{
+			cache.resize(VERTEX_CACHE_LRU_SIZE);
+		}
+	}
+	std::copy(newValues.begin(), newValues.end(), values);
+}
+
+// NOTE: static function.
+int TREVertexCache::countMisses(const TCULongArray *indices, int cacheSize)
+{
+	int count = indices->getCount();
+	const TCULong *values = indices->getValues();
+	std::vector<TCULong> fifo;
+	int next = 0;
+	int misses = 0;
+
+	fifo.reserve(cacheSize);
+	for (int i = 0; i < count; i++)
+	{
+		TCULong index = values[i];
+
+		if (std::find(fifo.begin(), fifo.end(), index) == fifo.end())
+		{
+			misses++;
+			if ((int)fifo.size() < cacheSize)
+			{
+				fifo.push_back(index);
+			}
+			else
+			{
+				fifo[next] = index;
+				next = (next + 1) % cacheSize;
+			}
+		}
+	}
+	return misses;
+}
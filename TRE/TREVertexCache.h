@@ -0,0 +1,30 @@
+#ifndef __TREVERTEXCACHE_H__
+#define __TREVERTEXCACHE_H__
+
+#include <TCFoundation/TCTypedValueArray.h>
+#include <TCFoundation/TCStlIncludes.h>
+
+// Number of entries in the FIFO post-transform cache that countMisses
+// simulates.
+#define VERTEX_CACHE_FIFO_SIZE 16
+
+// Reorders the primitives in an index list so that the GPU's post-transform
+// vertex cache gets reused as much as possible, using Tom Forsyth's "Linear-
+// Speed Vertex Cache Optimisation".  Each primitive keeps its own vertex order,
+// so winding (and therefore BFC) is unchanged.
+class TREVertexCache
+{
+public:
+	// primSize is the number of indices per primitive: 3 for triangles, and
+	// 4 for quads.
+	static void optimize(TCULongArray *indices, int primSize);
+	// Returns the number of vertices that would have to be transformed when
+	// drawing indices, with a FIFO cache of the given size.  Dividing this by
+	// the number of triangles gives the ACMR (average cache miss ratio).
+	static int countMisses(const TCULongArray *indices,
+		int cacheSize = VERTEX_CACHE_FIFO_SIZE);
+protected:
+	static float vertexScore(int cachePosition, int primCount, int primSize);
+};
+
+#endif // __TREVERTEXCACHE_H__
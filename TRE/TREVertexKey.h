@@ -58,6 +58,10 @@ public:
 			return false;
 		}
 	}
+	bool operator==(const TREVertexKey &other) const
+	{
+		return x == other.x && y == other.y && z == other.z;
+	}
 	TREVertexKey &operator=(const TREVertexKey &other)
 	{
 		x = other.x;
@@ -65,8 +69,36 @@ public:
 		z = other.z;
 		return *this;
 	}
+	size_t hash(void) const
+	{
+		// Multiplying each coordinate by a different large prime keeps points
+		// that are near each other from landing in the same part of the table.
+		return ((size_t)x * 73856093) ^ ((size_t)y * 19349663) ^
+			((size_t)z * 83492791);
+	}
 private:
 	long x, y, z;
 };
 
+// Key for an edge between two points.  The lesser of the two points' keys is
+// always passed in as key0.
+class TREVertexKeyPair
+{
+public:
+	TREVertexKeyPair(const TREVertexKey &key0, const TREVertexKey &key1)
+		:m_key0(key0),
+		m_key1(key1) {}
+	bool operator==(const TREVertexKeyPair &other) const
+	{
+		return m_key0 == other.m_key0 && m_key1 == other.m_key1;
+	}
+	size_t hash(void) const
+	{
+		return m_key0.hash() * 31 + m_key1.hash();
+	}
+private:
+	TREVertexKey m_key0;
+	TREVertexKey m_key1;
+};
+
 #endif // __TREVERTEXKEY_H__
@@ -0,0 +1,89 @@
+#ifndef __TREVERTEXKEYMAP_H__
+#define __TREVERTEXKEYMAP_H__
+
+#include <TRE/TREVertexKey.h>
+#include <TCFoundation/TCStlIncludes.h>
+#include <deque>
+
+// Hash table from vertex keys (or anything else with hash() and operator==)
+// to values.  It uses open addressing with linear probing, so adding an entry
+// doesn't allocate a node.  The values are stored in a deque in the order
+// they were added, so pointers to them stay valid as more entries get added,
+// and they can be walked with getCount and valueAtIndex.
+template <class Value, class Key = TREVertexKey>
+class TREVertexKeyMap
+{
+public:
+	TREVertexKeyMap(void) {}
+	Value *find(const Key &key)
+	{
+		int index = findIndex(key);
+
+		return index >= 0 ? &m_values[index] : NULL;
+	}
+	const Value *find(const Key &key) const
+	{
+		int index = findIndex(key);
+
+		return index >= 0 ? &m_values[index] : NULL;
+	}
+	// Returns the value for key, first adding a copy of value for it if key
+	// isn't in the map yet.
+	Value &add(const Key &key, const Value &value)
+	{
+		size_t slot;
+
+		if ((m_keys.size() + 1) * 4 > m_slots.size() * 3)
+		{
+			grow();
+		}
+		slot = findSlot(key);
+		if (m_slots[slot] < 0)
+		{
+			m_slots[slot] = (int)m_keys.size();
+			m_keys.push_back(key);
+			m_values.push_back(value);
+		}
+		return m_values[m_slots[slot]];
+	}
+	int getCount(void) const { return (int)m_keys.size(); }
+	Value &valueAtIndex(int index) { return m_values[index]; }
+protected:
+	// Returns the slot that holds key, or the empty slot where it would go.
+	size_t findSlot(const Key &key) const
+	{
+		size_t mask = m_slots.size() - 1;
+		size_t hash = key.hash();
+		size_t slot = (hash ^ (hash >> 16)) & mask;
+
+		while (m_slots[slot] >= 0 && !(m_keys[m_slots[slot]] == key))
+		{
+			slot = (slot + 1) & mask;
+		}
+		return slot;
+	}
+	int findIndex(const Key &key) const
+	{
+		if (m_slots.empty())
+		{
+			return -1;
+		}
+		return m_slots[findSlot(key)];
+	}
+	void grow(void)
+	{
+		size_t newSize = m_slots.empty() ? 64 : m_slots.size() * 2;
+
+		m_slots.assign(newSize, -1);
+		for (size_t i = 0; i < m_keys.size(); i++)
+		{
+			m_slots[findSlot(m_keys[i])] = (int)i;
+		}
+	}
+
+	std::vector<int> m_slots;
+	std::vector<Key> m_keys;
+	std::deque<Value> m_values;
+};
+
+#endif // __TREVERTEXKEYMAP_H__
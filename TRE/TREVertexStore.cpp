@@ -1,8 +1,10 @@
 #include "TREVertexStore.h"
 #include "TREVertexArray.h"
+#include "TREVertexKeyMap.h"
 #include "TREGLExtensions.h"
 #include <TCFoundation/TCVector.h>
 #include <TCFoundation/TCMacros.h>
+#include <math.h>
 #include <string.h>
 
 #ifdef WIN32
@@ -35,6 +37,53 @@ int TREVertexStore::sm_varSize = 0;
 
 #define BUFFER_OFFSET(i) ((char *)NULL + (i))
 
+// Number of low mantissa bits that are rounded off of each value before
+// weldVertices compares vertices.  Values that are within about one part in
+// 2^(23 - WELD_ROUNDED_BITS) of each other are treated as equal.
+#define WELD_ROUNDED_BITS 6
+// Values closer to zero than this are treated as zero by weldVertices.
+#define WELD_ZERO_EPSILON 1e-6f
+#define WELD_KEY_SIZE 11
+
+// The quantized position, normal, texture coordinates, color, and edge flag
+// of a vertex.  weldVertices merges vertices that have the same key.
+class TREWeldKey
+{
+public:
+	bool operator==(const TREWeldKey &other) const
+	{
+		return memcmp(m_values, other.m_values, sizeof(m_values)) == 0;
+	}
+	size_t hash(void) const
+	{
+		size_t value = 0;
+
+		for (int i = 0; i < WELD_KEY_SIZE; i++)
+		{
+			value = (value ^ m_values[i]) * 16777619;
+		}
+		return value;
+	}
+
+	TCULong m_values[WELD_KEY_SIZE];
+};
+
+static TCULong quantizeWeldValue(TCFloat value)
+{
+	float floatValue = (float)value;
+	TCULong bits;
+
+	if (fabs(floatValue) < WELD_ZERO_EPSILON)
+	{
+		return 0;
+	}
+	memcpy(&bits, &floatValue, sizeof(bits));
+	// Round to the nearest value with the low bits clear.  A carry out of the
+	// mantissa correctly bumps the exponent.
+	bits += 1 << (WELD_ROUNDED_BITS - 1);
+	return bits & ~((1 << WELD_ROUNDED_BITS) - 1);
+}
+
 TREVertexStore::TREVertexStore(void)
 	:m_vertices(NULL),
 	m_normals(NULL),
@@ -766,6 +815,158 @@ void TREVertexStore::setLightingFlag(bool value)
 	sm_activeVertexStore = NULL;
 }
 
+// Transforms count vertices starting at first by matrix (which includes the
+// projection), and records the resulting x and y, so that code that needs the
+// screen-space positions of those vertices can look them up with
+// getProjectedVertices instead of recomputing them.
+void TREVertexStore::projectVertices(
+	const TCFloat *matrix,
+	int first,
+	int count)
+{
+	int vertexCount = m_vertices ? m_vertices->getCount() : 0;
+	const TREVertex *vertices;
+
+	if (first + count > vertexCount)
+	{
+		count = vertexCount - first;
+	}
+	if (count <= 0)
+	{
+		return;
+	}
+	vertices = m_vertices->getVertices();
+	if (m_projectedVertices.size() < (size_t)vertexCount * 2)
+	{
+		m_projectedVertices.resize(vertexCount * 2);
+	}
+	for (int i = first; i < first + count; i++)
+	{
+		const TCFloat *v = vertices[i].v;
+		TCFloat tw = 1.0f / (matrix[3] * v[0] + matrix[7] * v[1] +
+			matrix[11] * v[2] + matrix[15]);
+
+		m_projectedVertices[i * 2] = (matrix[0] * v[0] + matrix[4] * v[1] +
+			matrix[8] * v[2] + matrix[12]) * tw;
+		m_projectedVertices[i * 2 + 1] = (matrix[1] * v[0] + matrix[5] * v[1] +
+			matrix[9] * v[2] + matrix[13]) * tw;
+	}
+}
+
+// Merges the vertices that are the same once their positions, normals,
+// texture coordinates, colors, and edge flags have been quantized, and drops
+// the vertices that aren't used.  On entry, remap has one entry per vertex,
+// with -1 marking the unused ones.  On return, each entry holds the vertex's
+// new index (or -1 if it was dropped).  The vertices that are kept stay in
+// the same order.  Returns the new number of vertices.
+int TREVertexStore::weldVertices(IntVector &remap)
+{
+	int count = m_vertices ? m_vertices->getCount() : 0;
+	int newCount = 0;
+	TREVertexKeyMap<int, TREWeldKey> weldMap;
+	TREVertex *vertices;
+	TREVertex *normals = NULL;
+	TREVertex *textureCoords = NULL;
+	TCULong *colors = NULL;
+
+	if (count == 0)
+	{
+		return 0;
+	}
+	// See setCapacity NOTE at top of file.
+	if (m_normals->getCount() < count)
+	{
+		m_normals->addEmptyValues(count - m_normals->getCount());
+	}
+	if (m_textureCoords && m_textureCoords->getCount() < count)
+	{
+		m_textureCoords->addEmptyValues(count - m_textureCoords->getCount());
+	}
+	if (m_colors && m_colors->getCount() < count)
+	{
+		m_colors->setCapacity(count, true, true);
+	}
+	if (m_edgeFlags.size() > 0 && m_edgeFlags.size() < (size_t)count)
+	{
+		m_edgeFlags.resize(count, GL_TRUE);
+	}
+	vertices = m_vertices->getVertices();
+	normals = m_normals->getVertices();
+	if (m_textureCoords)
+	{
+		textureCoords = m_textureCoords->getVertices();
+	}
+	if (m_colors)
+	{
+		colors = m_colors->getValues();
+	}
+	for (int i = 0; i < count; i++)
+	{
+		if (remap[i] >= 0)
+		{
+			TREWeldKey key;
+			int oldMapCount = weldMap.getCount();
+
+			memset(&key, 0, sizeof(key));
+			for (int j = 0; j < 3; j++)
+			{
+				key.m_values[j] = quantizeWeldValue(vertices[i].v[j]);
+				key.m_values[j + 3] = quantizeWeldValue(normals[i].v[j]);
+				if (textureCoords)
+				{
+					key.m_values[j + 6] =
+						quantizeWeldValue(textureCoords[i].v[j]);
+				}
+			}
+			if (colors)
+			{
+				key.m_values[9] = colors[i];
+			}
+			if (m_edgeFlags.size() > 0)
+			{
+				key.m_values[10] = m_edgeFlags[i];
+			}
+			remap[i] = weldMap.add(key, newCount);
+			if (weldMap.getCount() > oldMapCount)
+			{
+				// New indices never pass old ones, so the vertices can be
+				// moved down in place.
+				vertices[newCount] = vertices[i];
+				normals[newCount] = normals[i];
+				if (textureCoords)
+				{
+					textureCoords[newCount] = textureCoords[i];
+				}
+				if (colors)
+				{
+					colors[newCount] = colors[i];
+				}
+				if (m_edgeFlags.size() > 0)
+				{
+					m_edgeFlags[newCount] = m_edgeFlags[i];
+				}
+				newCount++;
+			}
+		}
+	}
+	m_vertices->setCount(newCount);
+	m_normals->setCount(newCount);
+	if (m_textureCoords)
+	{
+		m_textureCoords->setCount(newCount);
+	}
+	if (m_colors)
+	{
+		m_colors->setCount(newCount);
+	}
+	if (m_edgeFlags.size() > 0)
+	{
+		m_edgeFlags.resize(newCount);
+	}
+	m_projectedVertices.clear();
+	return newCount;
+}
+
 void TREVertexStore::openGlWillEnd(void)
 {
 	deactivate();
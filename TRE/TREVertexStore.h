@@ -70,6 +70,12 @@ public:
 	void setConditionalsFlag(bool value) { m_flags.conditionals = value; }
 	bool getConditionalsFlag(void) { return m_flags.conditionals != false; }
 	virtual void openGlWillEnd(void);
+	void projectVertices(const TCFloat *matrix, int first, int count);
+	int weldVertices(IntVector &remap);
+	const TCFloat *getProjectedVertices(void) const
+	{
+		return m_projectedVertices.empty() ? NULL : &m_projectedVertices[0];
+	}
 
 	static void initVertex(TREVertex &vertex, const TCVector &point);
 	static TCVector calcNormal(const TCVector *points, bool normalize = true);
@@ -95,6 +101,9 @@ protected:
 	TCULong m_colorsOffset;
 	TCULong m_edgeFlagsOffset;
 	GLuint m_vbo;
+	// Screen-space x and y of each vertex, as of the last call to
+	// projectVertices that included it.
+	std::vector<TCFloat> m_projectedVertices;
 	struct
 	{
 		bool varTried:1;